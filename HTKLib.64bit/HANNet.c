@@ -203,8 +203,8 @@ void SetUpdateFlags(ANNSet *annSet) {
     }
 }
 
-static inline void FillBatchFromFeaMix(FeaMix *feaMix, int batLen, int *CMDVecPL) {
-    int i, j, k, srcOff = 0, curOff = 0, dstOff, hisOff, hisDim;
+static inline void FillBatchFromFeaMix(FeaMix *feaMix, int batLen, int *CMDVecPL, int curBatIdx) {
+    int i, j, k, srcOff, curOff = 0, dstOff, hisOff, hisDim, hisSlot;
     FELink feaElem;
 
     /* if it is the shared */
@@ -212,66 +212,63 @@ static inline void FillBatchFromFeaMix(FeaMix *feaMix, int batLen, int *CMDVecPL
         return;
     }
     /* cz277 - 1007 */
-    if (feaMix->batIdx > batIdx + 1 || feaMix->batIdx < batIdx) {
+    if (feaMix->batIdx > curBatIdx + 1 || feaMix->batIdx < curBatIdx) {
         HError(9999, "FillBatchFromFeaMix: batIdx of this feature mix does not match the global index");
     }
-    else if (feaMix->batIdx == batIdx + 1) {
+    else if (feaMix->batIdx == curBatIdx + 1) {
         return;
     }
     else {
         ++feaMix->batIdx;
     }
 
-    /* otherwise, fill the batch with a mixture of the FeaElem */
+    /* otherwise, fill the batch with a mixture of the FeaElem, one column block at a time */
     for (i = 0; i < feaMix->elemNum; ++i) {
         feaElem = feaMix->feaList[i];
 
         if (feaElem->inputKind == INPFEAIK || feaElem->inputKind == AUGFEAIK) {
-            for (j = 0, srcOff = 0, dstOff = curOff; j < batLen; ++j, srcOff += feaElem->extDim, dstOff += feaMix->mixDim) {
-                CopyNSegment(feaElem->feaMat, srcOff, feaElem->extDim, feaMix->mixMat, dstOff);
-            }
+            CopyNSegmentStrided(feaElem->feaMat, 0, feaElem->extDim, feaElem->extDim, batLen, feaMix->mixMat, curOff, feaMix->mixDim);
         }
         else if (feaElem->inputKind == ANNFEAIK) {  /* ANNFEAIK, left context is consecutive */
-            for (j = 0; j < batLen; ++j) {
-
-                /* cz277 - gap */
-                hisDim = feaElem->hisLen * feaElem->feaDim;
+            /* cz277 - gap */
+            hisDim = feaElem->hisLen * feaElem->feaDim;
+            /* the history of each row is a ring buffer starting from its oldest frame, hisHead[j + 1] */
+            for (j = 0; j < batLen && feaElem->hisMat != NULL; ++j) {
                 hisOff = j * hisDim;
-                if (CMDVecPL != NULL && feaElem->hisMat != NULL) {
+                if (CMDVecPL != NULL) {
                     if (CMDVecPL[j] == 0) {	/* reset the history */
-			            ClearNMatrixSegment(feaElem->hisMat, hisOff, hisDim);
+                        ClearNMatrixSegment(feaElem->hisMat, hisOff, hisDim);
+                        feaElem->hisHead[j + 1] = 0;
                     }
                     else if (CMDVecPL[j] > 0) {	/* shift the history */
                         CopyNSegment(feaElem->hisMat, CMDVecPL[j] * hisDim, hisDim, feaElem->hisMat, hisOff);
+                        feaElem->hisHead[j + 1] = feaElem->hisHead[CMDVecPL[j] + 1];
                     }
                 }
-                /* standard operations */
+                /* previous segments from hisMat to feaMix->mixMat */
                 dstOff = j * feaMix->mixDim + curOff;
-                for (k = 1; k <= feaElem->ctxMap[0]; ++k, dstOff += feaElem->feaDim) { 
+                for (k = 1; k <= feaElem->ctxMap[0]; ++k, dstOff += feaElem->feaDim) {
                     if (feaElem->ctxMap[k] < 0) {
-                        /* first, previous segments from hisMat to feaMix->mixMat */
-                        srcOff = ((j + 1) * feaElem->hisLen + feaElem->ctxMap[k]) * feaElem->feaDim;
-                        CopyNSegment(feaElem->hisMat, srcOff, feaElem->feaDim, feaMix->mixMat, dstOff);
-                    }
-                    else if (feaElem->ctxMap[k] == 0) {
-                        /* second, copy current segment from feaMat to feaMix->mixMat */
-                        srcOff = j * feaElem->srcDim + feaElem->dimOff;
-                        CopyNSegment(feaElem->feaMat, srcOff, feaElem->feaDim, feaMix->mixMat, dstOff);
-                    }
-                    else {
-                        HError(9999, "FillBatchFromFeaMix: The future of ANN features are not applicable");
+                        hisSlot = (feaElem->hisHead[j + 1] + feaElem->hisLen + feaElem->ctxMap[k]) % feaElem->hisLen;
+                        CopyNSegment(feaElem->hisMat, hisOff + hisSlot * feaElem->feaDim, feaElem->feaDim, feaMix->mixMat, dstOff);
                     }
                 }
-                /* shift history info in hisMat and copy current segment from feaMat to hisMat */
-                if (feaElem->hisMat != NULL) {
-                    dstOff = hisOff;
-                    srcOff = dstOff + feaElem->feaDim;
-                    for (k = 0; k < feaElem->hisLen - 1; ++k, srcOff += feaElem->feaDim, dstOff += feaElem->feaDim) {
-                        CopyNSegment(feaElem->hisMat, srcOff, feaElem->feaDim, feaElem->hisMat, dstOff);    
-                    }
-                    srcOff = j * feaElem->srcDim + feaElem->dimOff;
-                    CopyNSegment(feaElem->feaMat, srcOff, feaElem->feaDim, feaElem->hisMat, dstOff);
+            }
+            /* current segments from feaMat to feaMix->mixMat, for the whole batch */
+            for (k = 1, dstOff = curOff; k <= feaElem->ctxMap[0]; ++k, dstOff += feaElem->feaDim) {
+                if (feaElem->ctxMap[k] == 0) {
+                    CopyNSegmentStrided(feaElem->feaMat, feaElem->dimOff, feaElem->srcDim, feaElem->feaDim, batLen, feaMix->mixMat, dstOff, feaMix->mixDim);
                 }
+                else if (feaElem->ctxMap[k] > 0) {
+                    HError(9999, "FillBatchFromFeaMix: The future of ANN features are not applicable");
+                }
+            }
+            /* the current segment from feaMat replaces the oldest one in hisMat */
+            for (j = 0; j < batLen && feaElem->hisMat != NULL; ++j) {
+                srcOff = j * feaElem->srcDim + feaElem->dimOff;
+                dstOff = j * hisDim + feaElem->hisHead[j + 1] * feaElem->feaDim;
+                CopyNSegment(feaElem->feaMat, srcOff, feaElem->feaDim, feaElem->hisMat, dstOff);
+                feaElem->hisHead[j + 1] = (feaElem->hisHead[j + 1] + 1) % feaElem->hisLen;
             }
         }
         curOff += feaElem->extDim;
@@ -281,7 +278,7 @@ static inline void FillBatchFromFeaMix(FeaMix *feaMix, int batLen, int *CMDVecPL
 
 /* fill a batch with error signal */
 static inline void FillBatchFromErrMix(FeaMix *errMix, int batLen, NMatrix *mixMat) {
-    int i, j, srcOff, dstOff, segLen;
+    int i, dstOff, mixDim;
     FELink errElem;
 
     /* if it is the shared */
@@ -290,19 +287,17 @@ static inline void FillBatchFromErrMix(FeaMix *errMix, int batLen, NMatrix *mixM
     }
 
     /* otherwise, fill the batch with a mixture of the FeaElem */
-    dstOff = 0;
+    for (i = 0, mixDim = 0; i < errMix->elemNum; ++i) {
+        mixDim += errMix->feaList[i]->extDim;
+    }
     /* reset mixMat to 0 */
     /*SetNMatrix(0.0, mixMat, batLen);*/
     ClearNMatrix(mixMat, batLen);
-    /* accumulate the error signals from each source */
-    for (i = 0; i < batLen; ++i) {
-        for (j = 0; j < errMix->elemNum; ++j) {
-            errElem = errMix->feaList[j];
-            srcOff = i * errElem->srcDim + errElem->dimOff;
-            segLen = errElem->extDim;
-            AddNSegment(errElem->feaMat, srcOff, segLen, mixMat, dstOff);
-            dstOff += segLen;
-        }
+    /* accumulate the error signals from each source, one column block at a time */
+    for (i = 0, dstOff = 0; i < errMix->elemNum; ++i) {
+        errElem = errMix->feaList[i];
+        AddNSegmentStrided(errElem->feaMat, errElem->dimOff, errElem->srcDim, errElem->extDim, batLen, mixMat, dstOff, mixDim);
+        dstOff += errElem->extDim;
     }
 }
 
@@ -338,13 +333,48 @@ void UpdateLabMatMapSum(ANNSet *annSet, int batLen, int streamIdx) {
     HNBlasTNgemm(annSet->mapStruct->mappedTargetNum, batLen, annSet->outLayers[streamIdx]->nodeNum, 1.0, annSet->mapStruct->maskMatMapSum[streamIdx], annSet->outLayers[streamIdx]->trainInfo->labMat, 0.0, annSet->mapStruct->labMatMapSum[streamIdx]);
 }
 
+/* map an activation function to the kind done by the fused layer kernel; FALSE if it has none */
+static Boolean GetFusedActKind(ActFunKind actfunKind, NActKind *actKind) {
+
+    switch (actfunKind) {
+        case LINEARAF:
+            *actKind = NLINEARACT;
+            break;
+        case RELAF:
+            *actKind = NRELACT;
+            break;
+        case SIGMOIDAF:
+            *actKind = NSIGMOIDACT;
+            break;
+        case SOFTMAXAF:
+            *actKind = NSOFTMAXACT;
+            break;
+        case SOFTRELAF:
+            *actKind = NSOFTRELACT;
+            break;
+        case SOFTSIGNAF:
+            *actKind = NSOFTSIGNACT;
+            break;
+        case TANHAF:
+            *actKind = NTANHACT;
+            break;
+        default:
+            return FALSE;
+    }
+    return TRUE;
+}
+
 /* the batch with input features are assumed to be filled */
 void ForwardPropBatch(ANNSet *annSet, int batLen, int *CMDVecPL) {
-    int i;
+    int i, curBatIdx;
     AILink curAI;
     ADLink annDef;
     LELink layerElem;
+    NActKind actKind;
+    Boolean actDone;
 
+    /* a replica counts its own batches, so that replicas can run on different threads */
+    curBatIdx = (annSet->srcSet != NULL)? annSet->batIdx: batIdx;
     /* init the ANNInfo pointer */
     curAI = annSet->defsHead;
     /* proceed in the forward fashion */
@@ -356,13 +386,20 @@ void ForwardPropBatch(ANNSet *annSet, int batLen, int *CMDVecPL) {
             /* get current LayerElem */
             layerElem = annDef->layerList[i];
             /* at least the batch (feaMat) for each FeaElem is already */
-            FillBatchFromFeaMix(layerElem->feaMix, batLen, CMDVecPL);
+            FillBatchFromFeaMix(layerElem->feaMix, batLen, CMDVecPL, curBatIdx);
             /* do the operation of current layer */
+            actDone = FALSE;
             switch (layerElem->operKind) {
                 case MAXOK:
 
                     break;
                 case SUMOK: 
+                    /* y = f(w * x + b) in one pass over each block of Y^T when the activation allows */
+                    if (i < annDef->layerNum - 1 && GetFusedActKind(layerElem->actfunKind, &actKind)) {
+                        HNBlasTNgemmBiasAct(layerElem->nodeNum, batLen, layerElem->inputDim, layerElem->wghtMat, layerElem->xFeaMat, layerElem->biasVec, actKind, layerElem->yFeaMat);
+                        actDone = TRUE;
+                        break;
+                    }
                     /* y = b, B^T should be row major matrix, duplicate the bias vectors */ 
                     DupNVector(layerElem->biasVec, layerElem->yFeaMat, batLen);
                     /* y += w * b, X^T is row major, W^T is column major, Y^T = X^T * W^T + B^T */
@@ -371,7 +408,7 @@ void ForwardPropBatch(ANNSet *annSet, int batLen, int *CMDVecPL) {
                     //cw564 - mb -- begin
                     if (i == annDef->layerNum - 1)
                     {
-                        SetNSegmentCUDA(0, layerElem->mb_bases_yFeaMat, batLen * MBP()->num_basis * layerElem->nodeNum);
+                        SetNMatrix(0, layerElem->mb_bases_yFeaMat, batLen * MBP()->num_basis);
 
                         HNBlasTNgemm(layerElem->nodeNum, 
                                 batLen * MBP()->num_basis, 
@@ -396,6 +433,9 @@ void ForwardPropBatch(ANNSet *annSet, int batLen, int *CMDVecPL) {
                     HError(9999, "ForwardPropBatch: Unknown layer operation kind");
             }
             /* apply activation transformation */
+            if (actDone) {
+                continue;
+            }
             switch (layerElem->actfunKind) {
                 case HERMITEAF:
                     ApplyHermiteAct(layerElem->yFeaMat, batLen, layerElem->nodeNum, layerElem->actParmVec, layerElem->yFeaMat);
@@ -429,7 +469,12 @@ void ForwardPropBatch(ANNSet *annSet, int batLen, int *CMDVecPL) {
         curAI = curAI->next;
     }
 
-    SetBatchIndex(GetBatchIndex() + 1);
+    if (annSet->srcSet != NULL) {
+        ++annSet->batIdx;
+    }
+    else {
+        SetBatchIndex(GetBatchIndex() + 1);
+    }
 }
 
 /* function to compute the error signal for frame level criteria (for sequence level, do nothing) */
@@ -593,41 +638,30 @@ void BackwardPropBatch(ANNSet *annSet, int batLen, Boolean accFlag) {
                 dyFeaMat = layerElem->trainInfo->dyFeaMat;
                 /* at least the batch (feaMat) for each FeaElem is already */
                 FillBatchFromErrMix(layerElem->errMix, batLen, dyFeaMat);
-                /* apply activation transformation */
+                /* apply activation transformation, times sigma_k (dyFeaMat, from the next layer) */
                 switch (layerElem->actfunKind) {
-                    case HERMITEAF:
-                    
-                        break;
                     case LINEARAF:
-                        ApplyDLinearAct(layerElem->yFeaMat, batLen, layerElem->nodeNum, layerElem->yFeaMat);
-                        /*MulNMatrix(layerElem->yFeaMat, dyFeaMat, batLen, layerElem->nodeNum, dyFeaMat);*/
                         break;
                     case RELAF:
-			ApplyDReLAct(layerElem->yFeaMat, batLen, layerElem->nodeNum, layerElem->yFeaMat);
-                        /*MulNMatrix(layerElem->yFeaMat, dyFeaMat, batLen, layerElem->nodeNum, dyFeaMat);*/
+                        ApplyDReLActMul(layerElem->yFeaMat, batLen, layerElem->nodeNum, dyFeaMat);
                         break;
                     case SIGMOIDAF:
-                        ApplyDSigmoidAct(layerElem->yFeaMat, batLen, layerElem->nodeNum, layerElem->yFeaMat);
-                        /*MulNMatrix(layerElem->yFeaMat, dyFeaMat, batLen, layerElem->nodeNum, dyFeaMat);*/
-                        break;
-                    case SOFTMAXAF:
-
+                        ApplyDSigmoidActMul(layerElem->yFeaMat, batLen, layerElem->nodeNum, dyFeaMat);
                         break;
                     case SOFTRELAF:
-                        ApplyDSoftReLAct(layerElem->yFeaMat, batLen, layerElem->nodeNum, layerElem->yFeaMat);
-                        /*MulNMatrix(layerElem->yFeaMat, dyFeaMat, batLen, layerElem->nodeNum, dyFeaMat);*/
-                        break;
-                    case SOFTSIGNAF:
-
+                        ApplyDSoftReLActMul(layerElem->yFeaMat, batLen, layerElem->nodeNum, dyFeaMat);
                         break;
                     case TANHAF:
-                        ApplyDTanHAct(layerElem->yFeaMat, batLen, layerElem->nodeNum, layerElem->yFeaMat);
+                        ApplyDTanHActMul(layerElem->yFeaMat, batLen, layerElem->nodeNum, dyFeaMat);
+                        break;
+                    case HERMITEAF:
+                    case SOFTMAXAF:
+                    case SOFTSIGNAF:
+                        MulNMatrix(layerElem->yFeaMat, dyFeaMat, batLen, layerElem->nodeNum, dyFeaMat);
                         break;
                     default:
                         HError(9999, "BackwardPropBatch: Unknown hidden activation function kind");
                 }
-                /* times sigma_k (dyFeaMat, from the next layer) */
-                MulNMatrix(layerElem->yFeaMat, dyFeaMat, batLen, layerElem->nodeNum, dyFeaMat);
             }
             /* do current layer operation */
             switch (layerElem->operKind) {
@@ -742,6 +776,59 @@ void SetFeaMixBatchIdxes(ANNSet *annSet, int newIdx) {
     }
 }
 
+/* copy batLen samples from sample batOff of the input batches of the ANNSet a replica was made from into the replica */
+void CopyReplicaInputs(ANNSet *replica, int batOff, int batLen) {
+    int i, j;
+    AILink srcAI, dstAI;
+    LELink srcLayer, dstLayer;
+    FELink srcFea, dstFea;
+
+    /* a replica has the same ANNDefs, layers and feature elements, in the same order */
+    for (srcAI = replica->srcSet->defsHead, dstAI = replica->defsHead; srcAI != NULL; srcAI = srcAI->next, dstAI = dstAI->next) {
+        for (i = 0; i < srcAI->annDef->layerNum; ++i) {
+            srcLayer = srcAI->annDef->layerList[i];
+            dstLayer = dstAI->annDef->layerList[i];
+            for (j = 0; j < srcLayer->feaMix->elemNum; ++j) {
+                srcFea = srcLayer->feaMix->feaList[j];
+                dstFea = dstLayer->feaMix->feaList[j];
+                if (srcFea->inputKind == INPFEAIK || srcFea->inputKind == AUGFEAIK) {
+                    CopyNSegment(srcFea->feaMat, batOff * srcFea->extDim, batLen * srcFea->extDim, dstFea->feaMat, 0);
+                }
+            }
+        }
+    }
+}
+
+/* add (accFlag) or copy the gradients of srcSet to those of dstSet; one is a replica of the other, or both of the same ANNSet */
+void AccReplicaGradInfo(ANNSet *srcSet, ANNSet *dstSet, Boolean accFlag) {
+    int i;
+    AILink srcAI, dstAI;
+    LELink srcLayer, dstLayer;
+
+    for (srcAI = srcSet->defsHead, dstAI = dstSet->defsHead; srcAI != NULL; srcAI = srcAI->next, dstAI = dstAI->next) {
+        for (i = 0; i < srcAI->annDef->layerNum; ++i) {
+            srcLayer = srcAI->annDef->layerList[i];
+            dstLayer = dstAI->annDef->layerList[i];
+            if (srcLayer->trainInfo->updtFlag & WEIGHTUK) {
+                if (accFlag) {
+                    AddNMatrix(srcLayer->trainInfo->gradInfo->wghtMat, srcLayer->nodeNum, srcLayer->inputDim, dstLayer->trainInfo->gradInfo->wghtMat);
+                }
+                else {
+                    CopyNSegment(srcLayer->trainInfo->gradInfo->wghtMat, 0, srcLayer->nodeNum * srcLayer->inputDim, dstLayer->trainInfo->gradInfo->wghtMat, 0);
+                }
+            }
+            if (srcLayer->trainInfo->updtFlag & BIASUK) {
+                if (accFlag) {
+                    AddNVector(srcLayer->trainInfo->gradInfo->biasVec, srcLayer->nodeNum, dstLayer->trainInfo->gradInfo->biasVec);
+                }
+                else {
+                    CopyNVectorSegment(srcLayer->trainInfo->gradInfo->biasVec, 0, srcLayer->nodeNum, dstLayer->trainInfo->gradInfo->biasVec, 0);
+                }
+            }
+        }
+    }
+}
+
 /* cz277 - max norm2 */
 Boolean IsLinearActFun(ActFunKind actfunKind) {
     switch (actfunKind) {
@@ -136,6 +136,7 @@ typedef struct _FeaElem {
     /* cz277 - gap */
     int hisLen;			/* the length of the history */
     NMatrix *hisMat;		/* the matrix for ANN feature history */
+    IntVec hisHead;		/* the oldest frame in each row of hisMat, used as a ring buffer */
     int nUse;                   /* the usage counter */
 
     char* * frm2scp; //cw564 - mb -- to be removed
@@ -259,6 +260,8 @@ typedef struct _ANNSet {
     TargetMapStruct *mapStruct;	/* the structure for target mapping */
     NMatrix *llhMat[SMAX];	/* the llr matrix of the yFeaMat of the output layers */
     NVector *penVec[SMAX];
+    struct _ANNSet *srcSet;     /* for a replica, the ANNSet it shares the parameters with; NULL otherwise */
+    int batIdx;                 /* for a replica, the number of batches it has forwarded */
     
     MBParam mbp;
 
@@ -286,6 +289,8 @@ void RandANNLayer(LELink layerElem, int seed, float scale);
 /*LELink GenRandLayer(MemHeap *heap, int nodeNum, int inputDim, int seed);*/
 LELink GenNewLayer(MemHeap *heap, int nodeNum, int inputDim);
 void SetFeaMixBatchIdxes(ANNSet *annSet, int newIdx);
+void CopyReplicaInputs(ANNSet *replica, int batOff, int batLen);
+void AccReplicaGradInfo(ANNSet *srcSet, ANNSet *dstSet, Boolean accFlag);
 /* cz277 - max norm2 */
 Boolean IsLinearActFun(ActFunKind actfunKind);
 Boolean IsNonLinearActFun(ActFunKind actfunKind);
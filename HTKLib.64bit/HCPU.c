@@ -0,0 +1,1289 @@
+/* ----------------------------------------------------------- */
+/*                                                             */
+/*                          ___                                */
+/*                       |_| | |_/   SPEECH                    */
+/*                       | | | | \   RECOGNITION               */
+/*                       =========   SOFTWARE                  */
+/*                                                             */
+/*                                                             */
+/* ----------------------------------------------------------- */
+/* developed at:                                               */
+/*                                                             */
+/*      Machine Intelligence Laboratory                        */
+/*      Cambridge University Engineering Department            */
+/*      http://mil.eng.cam.ac.uk/                              */
+/*                                                             */
+/*                                                             */
+/* ----------------------------------------------------------- */
+/*         Copyright: Microsoft Corporation                    */
+/*          1995-2000 Redmond, Washington USA                  */
+/*                    http://www.microsoft.com                 */
+/*                                                             */
+/*              2002  Cambridge University                     */
+/*                    Engineering Department                   */
+/*                                                             */
+/*   Use of this software is governed by a License Agreement   */
+/*    ** See the file License for the Conditions of Use  **    */
+/*    **     This banner notice must not be removed      **    */
+/*                                                             */
+/* ----------------------------------------------------------- */
+/*              File: HCPU.c   CPU Kernels                     */
+/* ----------------------------------------------------------- */
+
+char *hcpu_version = "!HVER!HCPU:   3.4.1 [CUED 17/10/16]";
+char *hcpu_vc_id = "$Id: HCPU.c,v 1.1.1.1 2016/10/17 09:54:58 cz277 Exp $";
+
+/*
+   The GEMM follows the usual Goto/BLIS layout.  For each KC deep
+   panel of the operands, B is packed into NR wide column slivers
+   and blocks of A are packed into MR tall row slivers, so that the
+   micro-kernel streams both operands contiguously and keeps an
+   MR x NR tile of C in registers.  Alpha is applied once when a
+   tile is written back, and beta only on the first panel, so that
+   C is not touched inside the inner loops.  Transposition is
+   handled entirely by the packing routines.
+*/
+
+#include "HShell.h"
+#include "HMem.h"
+#include "HMath.h"
+#include "HCPU.h"
+#include "cfgs.h"
+#include <pthread.h>
+#include <unistd.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define CPUX86
+#include <immintrin.h>
+#endif
+
+/* --------------------------- Trace Flags ------------------------ */
+
+static int trace = 0;                           /* trace level */
+#define T_TOP 0001                              /* Top level tracing */
+
+static ConfParam *cParm[MAXGLOBS];              /* config parameters */
+static int nParm = 0;
+
+#define MIN(a, b) ((a)<(b)? (a): (b))
+#define CEIL(x, y) (((x) + (y) - 1) / (y))
+
+/* ------------------------ Global Settings ----------------------- */
+
+static int nCPUThreads = 1;                     /* the number of threads used by the kernels */
+static Boolean CPUInit = FALSE;                 /* whether StartCPU has been called */
+static CPUSIMDKind simdKind = CPUSIMDNONE;      /* the instruction set in use */
+
+/* the micro-kernel computes C[mr * nr] = alpha * Ap * Bp + beta * C */
+typedef void (*GemmKernFunc)(int kc, NFloat *Ap, NFloat *Bp, NFloat *C, int ldc, NFloat alpha, NFloat beta, int mr, int nr);
+
+typedef struct _GemmKernInfo {
+    CPUSIMDKind kind;                           /* the instruction set of the kernel */
+    int mr;                                     /* rows of the register tile */
+    int nr;                                     /* columns of the register tile */
+    GemmKernFunc kern;                          /* the micro-kernel */
+} GemmKernInfo;
+
+/* the packing buffers are owned by each thread */
+static __thread NFloat *packABuf = NULL;
+static __thread size_t packASize = 0;
+static __thread NFloat *packBBuf = NULL;
+static __thread size_t packBSize = 0;
+
+/* ------------------------- Worker Pool -------------------------- */
+
+static pthread_t *poolThreads = NULL;           /* the worker threads, excluding the caller */
+static pthread_mutex_t poolMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t poolStartCond = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t poolDoneCond = PTHREAD_COND_INITIALIZER;
+static int poolSize = 0;                        /* the number of worker threads */
+static Boolean poolBusy = FALSE;                /* a job is being run on the pool */
+static Boolean poolStop = FALSE;                /* request the workers to quit */
+static unsigned long poolGen = 0;               /* generation count of the current job */
+static int poolPending = 0;                     /* workers still to finish the current job */
+static CPUTaskFunc poolFunc = NULL;             /* the task function of the current job */
+static void *poolArg = NULL;                    /* the argument of the current job */
+static int poolNTask = 0;                       /* the number of tasks in the current job */
+
+/* run the tasks of the current job that belong to the given worker */
+static void RunPoolShare(int workerIdx) {
+    int i;
+
+    for (i = workerIdx; i < poolNTask; i += poolSize + 1) {
+        poolFunc(poolArg, i);
+    }
+}
+
+/* the main loop of each worker thread */
+static void *PoolWorker(void *arg) {
+    int workerIdx = (int) (long) arg;
+    unsigned long gen = 0;
+
+    while (TRUE) {
+        pthread_mutex_lock(&poolMutex);
+        while (!poolStop && poolGen == gen) {
+            pthread_cond_wait(&poolStartCond, &poolMutex);
+        }
+        if (poolStop) {
+            pthread_mutex_unlock(&poolMutex);
+            break;
+        }
+        gen = poolGen;
+        pthread_mutex_unlock(&poolMutex);
+
+        RunPoolShare(workerIdx);
+
+        pthread_mutex_lock(&poolMutex);
+        if (--poolPending == 0) {
+            pthread_cond_signal(&poolDoneCond);
+        }
+        pthread_mutex_unlock(&poolMutex);
+    }
+    return NULL;
+}
+
+static void StartPool(void) {
+    int i;
+
+    poolSize = nCPUThreads - 1;
+    poolStop = FALSE;
+    if (poolSize <= 0) {
+        poolSize = 0;
+        return;
+    }
+    poolThreads = (pthread_t *) malloc(sizeof(pthread_t) * poolSize);
+    for (i = 0; i < poolSize; ++i) {
+        if (pthread_create(&poolThreads[i], NULL, PoolWorker, (void *) (long) (i + 1)) != 0) {
+            HError(9999, "StartPool: Fail to create CPU worker thread %d", i + 1);
+        }
+    }
+}
+
+static void StopPool(void) {
+    int i;
+
+    if (poolSize == 0) {
+        return;
+    }
+    pthread_mutex_lock(&poolMutex);
+    poolStop = TRUE;
+    pthread_cond_broadcast(&poolStartCond);
+    pthread_mutex_unlock(&poolMutex);
+    for (i = 0; i < poolSize; ++i) {
+        pthread_join(poolThreads[i], NULL);
+    }
+    free(poolThreads);
+    poolThreads = NULL;
+    poolSize = 0;
+}
+
+/* EXPORT->RunCPUTasks: run func(arg, i) for i in [0, nTask) on the worker pool */
+void RunCPUTasks(CPUTaskFunc func, void *arg, int nTask) {
+    int i;
+    Boolean usePool = FALSE;
+
+    if (!CPUInit) {
+        StartCPU();
+    }
+    if (nTask > 1 && poolSize > 0) {
+        pthread_mutex_lock(&poolMutex);
+        if (!poolBusy) {
+            poolBusy = TRUE;
+            usePool = TRUE;
+        }
+        pthread_mutex_unlock(&poolMutex);
+    }
+    if (!usePool) {
+        for (i = 0; i < nTask; ++i) {
+            func(arg, i);
+        }
+        return;
+    }
+
+    pthread_mutex_lock(&poolMutex);
+    poolFunc = func;
+    poolArg = arg;
+    poolNTask = nTask;
+    poolPending = poolSize;
+    ++poolGen;
+    pthread_cond_broadcast(&poolStartCond);
+    pthread_mutex_unlock(&poolMutex);
+
+    /* the caller works as worker 0 */
+    RunPoolShare(0);
+
+    pthread_mutex_lock(&poolMutex);
+    while (poolPending > 0) {
+        pthread_cond_wait(&poolDoneCond, &poolMutex);
+    }
+    poolBusy = FALSE;
+    pthread_mutex_unlock(&poolMutex);
+}
+
+/* ---------------------- Packing Buffers ------------------------- */
+
+static NFloat *GetPackBuf(NFloat **buf, size_t *bufSize, size_t size) {
+    void *ptr = NULL;
+
+    if (size > *bufSize) {
+        if (*buf != NULL) {
+            free(*buf);
+        }
+        if (posix_memalign(&ptr, CPUALIGNMENT, size * sizeof(NFloat)) != 0) {
+            HError(9999, "GetPackBuf: Fail to allocate %lu bytes for GEMM packing", (unsigned long) (size * sizeof(NFloat)));
+        }
+        *buf = (NFloat *) ptr;
+        *bufSize = size;
+    }
+    return *buf;
+}
+
+static void FreePackBufs(void) {
+    if (packABuf != NULL) {
+        free(packABuf);
+    }
+    if (packBBuf != NULL) {
+        free(packBBuf);
+    }
+    packABuf = packBBuf = NULL;
+    packASize = packBSize = 0;
+}
+
+/* ------------------------ Micro-Kernels ------------------------- */
+
+/* write back an accumulated tile held in a column major buffer */
+static inline void StoreGemmTile(NFloat *acc, int mr, int mrMax, int nr, NFloat *C, int ldc, NFloat alpha, NFloat beta) {
+    int i, j;
+
+    for (j = 0; j < nr; ++j) {
+        if (beta == 0.0) {
+            for (i = 0; i < mr; ++i) {
+                C[j * ldc + i] = alpha * acc[j * mrMax + i];
+            }
+        }
+        else {
+            for (i = 0; i < mr; ++i) {
+                C[j * ldc + i] = alpha * acc[j * mrMax + i] + beta * C[j * ldc + i];
+            }
+        }
+    }
+}
+
+/* portable kernel, used when no SIMD instruction set is available */
+#define GENMR 8
+#define GENNR 4
+static void GemmKernGeneric(int kc, NFloat *Ap, NFloat *Bp, NFloat *C, int ldc, NFloat alpha, NFloat beta, int mr, int nr) {
+    NFloat acc[GENMR * GENNR];
+    int i, j, l;
+
+    memset(acc, 0, sizeof(acc));
+    for (l = 0; l < kc; ++l) {
+        for (j = 0; j < GENNR; ++j) {
+            for (i = 0; i < GENMR; ++i) {
+                acc[j * GENMR + i] += Ap[i] * Bp[j];
+            }
+        }
+        Ap += GENMR;
+        Bp += GENNR;
+    }
+    StoreGemmTile(acc, mr, GENMR, nr, C, ldc, alpha, beta);
+}
+
+static GemmKernInfo genericKern = {CPUSIMDNONE, GENMR, GENNR, GemmKernGeneric};
+
+#ifdef CPUX86
+
+/* SSE2: a tile of two vectors by four columns */
+#ifdef DOUBLEANN
+#define SSEVL 2
+#define SSEVEC __m128d
+#define SSEZERO _mm_setzero_pd
+#define SSELOAD _mm_load_pd
+#define SSELOADU _mm_loadu_pd
+#define SSESTOREU _mm_storeu_pd
+#define SSESTORE _mm_store_pd
+#define SSESET1 _mm_set1_pd
+#define SSEADD _mm_add_pd
+#define SSESUB _mm_sub_pd
+#define SSEMUL _mm_mul_pd
+#define SSEDIV _mm_div_pd
+#define SSEMAX _mm_max_pd
+#define SSEMIN _mm_min_pd
+#define SSECASTI _mm_castpd_si128
+#define SSECASTF _mm_castsi128_pd
+#define SSESLLI _mm_slli_epi64
+#else
+#define SSEVL 4
+#define SSEVEC __m128
+#define SSEZERO _mm_setzero_ps
+#define SSELOAD _mm_load_ps
+#define SSELOADU _mm_loadu_ps
+#define SSESTOREU _mm_storeu_ps
+#define SSESTORE _mm_store_ps
+#define SSESET1 _mm_set1_ps
+#define SSEADD _mm_add_ps
+#define SSESUB _mm_sub_ps
+#define SSEMUL _mm_mul_ps
+#define SSEDIV _mm_div_ps
+#define SSEMAX _mm_max_ps
+#define SSEMIN _mm_min_ps
+#define SSECASTI _mm_castps_si128
+#define SSECASTF _mm_castsi128_ps
+#define SSESLLI _mm_slli_epi32
+#endif
+#define SSEFMA(a, b, c) SSEADD(SSEMUL(a, b), c)
+#define SSEMR (2 * SSEVL)
+#define SSENR 4
+
+#define SSECOL(j) b = SSESET1(Bp[j]); c0##j = SSEADD(c0##j, SSEMUL(a0, b)); c1##j = SSEADD(c1##j, SSEMUL(a1, b));
+#define SSEPUT(j) \
+    if (beta == 0.0) { \
+        SSESTOREU(C + j * ldc, SSEMUL(va, c0##j)); \
+        SSESTOREU(C + j * ldc + SSEVL, SSEMUL(va, c1##j)); \
+    } \
+    else { \
+        SSESTOREU(C + j * ldc, SSEADD(SSEMUL(va, c0##j), SSEMUL(vb, SSELOADU(C + j * ldc)))); \
+        SSESTOREU(C + j * ldc + SSEVL, SSEADD(SSEMUL(va, c1##j), SSEMUL(vb, SSELOADU(C + j * ldc + SSEVL)))); \
+    }
+#define SSETMP(j) SSESTORE(acc + j * SSEMR, c0##j); SSESTORE(acc + j * SSEMR + SSEVL, c1##j);
+
+static void GemmKernSSE(int kc, NFloat *Ap, NFloat *Bp, NFloat *C, int ldc, NFloat alpha, NFloat beta, int mr, int nr) {
+    SSEVEC a0, a1, b, va, vb;
+    SSEVEC c00 = SSEZERO(), c01 = SSEZERO(), c02 = SSEZERO(), c03 = SSEZERO();
+    SSEVEC c10 = SSEZERO(), c11 = SSEZERO(), c12 = SSEZERO(), c13 = SSEZERO();
+    NFloat acc[SSEMR * SSENR] __attribute__((aligned(CPUALIGNMENT)));
+    int l;
+
+    for (l = 0; l < kc; ++l) {
+        a0 = SSELOAD(Ap);
+        a1 = SSELOAD(Ap + SSEVL);
+        SSECOL(0) SSECOL(1) SSECOL(2) SSECOL(3)
+        Ap += SSEMR;
+        Bp += SSENR;
+    }
+    if (mr == SSEMR && nr == SSENR) {
+        va = SSESET1(alpha);
+        vb = SSESET1(beta);
+        SSEPUT(0) SSEPUT(1) SSEPUT(2) SSEPUT(3)
+    }
+    else {
+        SSETMP(0) SSETMP(1) SSETMP(2) SSETMP(3)
+        StoreGemmTile(acc, mr, SSEMR, nr, C, ldc, alpha, beta);
+    }
+}
+
+static GemmKernInfo sseKern = {CPUSIMDSSE, SSEMR, SSENR, GemmKernSSE};
+
+/* AVX2 + FMA: a tile of two vectors by six columns */
+#ifdef DOUBLEANN
+#define AVXVL 4
+#define AVXVEC __m256d
+#define AVXZERO _mm256_setzero_pd
+#define AVXLOAD _mm256_load_pd
+#define AVXLOADU _mm256_loadu_pd
+#define AVXSTOREU _mm256_storeu_pd
+#define AVXSTORE _mm256_store_pd
+#define AVXSET1 _mm256_set1_pd
+#define AVXBCAST _mm256_broadcast_sd
+#define AVXADD _mm256_add_pd
+#define AVXSUB _mm256_sub_pd
+#define AVXMUL _mm256_mul_pd
+#define AVXDIV _mm256_div_pd
+#define AVXMAX _mm256_max_pd
+#define AVXMIN _mm256_min_pd
+#define AVXFMA _mm256_fmadd_pd
+#define AVXCASTI _mm256_castpd_si256
+#define AVXCASTF _mm256_castsi256_pd
+#define AVXSLLI _mm256_slli_epi64
+#else
+#define AVXVL 8
+#define AVXVEC __m256
+#define AVXZERO _mm256_setzero_ps
+#define AVXLOAD _mm256_load_ps
+#define AVXLOADU _mm256_loadu_ps
+#define AVXSTOREU _mm256_storeu_ps
+#define AVXSTORE _mm256_store_ps
+#define AVXSET1 _mm256_set1_ps
+#define AVXBCAST _mm256_broadcast_ss
+#define AVXADD _mm256_add_ps
+#define AVXSUB _mm256_sub_ps
+#define AVXMUL _mm256_mul_ps
+#define AVXDIV _mm256_div_ps
+#define AVXMAX _mm256_max_ps
+#define AVXMIN _mm256_min_ps
+#define AVXFMA _mm256_fmadd_ps
+#define AVXCASTI _mm256_castps_si256
+#define AVXCASTF _mm256_castsi256_ps
+#define AVXSLLI _mm256_slli_epi32
+#endif
+#define AVXMR (2 * AVXVL)
+#define AVXNR 6
+
+#define AVXCOL(j) b = AVXBCAST(Bp + j); c0##j = AVXFMA(a0, b, c0##j); c1##j = AVXFMA(a1, b, c1##j);
+#define AVXPUT(j) \
+    if (beta == 0.0) { \
+        AVXSTOREU(C + j * ldc, AVXMUL(va, c0##j)); \
+        AVXSTOREU(C + j * ldc + AVXVL, AVXMUL(va, c1##j)); \
+    } \
+    else { \
+        AVXSTOREU(C + j * ldc, AVXFMA(vb, AVXLOADU(C + j * ldc), AVXMUL(va, c0##j))); \
+        AVXSTOREU(C + j * ldc + AVXVL, AVXFMA(vb, AVXLOADU(C + j * ldc + AVXVL), AVXMUL(va, c1##j))); \
+    }
+#define AVXTMP(j) AVXSTORE(acc + j * AVXMR, c0##j); AVXSTORE(acc + j * AVXMR + AVXVL, c1##j);
+
+__attribute__((target("avx2,fma")))
+static void GemmKernAVX2(int kc, NFloat *Ap, NFloat *Bp, NFloat *C, int ldc, NFloat alpha, NFloat beta, int mr, int nr) {
+    AVXVEC a0, a1, b, va, vb;
+    AVXVEC c00 = AVXZERO(), c01 = AVXZERO(), c02 = AVXZERO(), c03 = AVXZERO(), c04 = AVXZERO(), c05 = AVXZERO();
+    AVXVEC c10 = AVXZERO(), c11 = AVXZERO(), c12 = AVXZERO(), c13 = AVXZERO(), c14 = AVXZERO(), c15 = AVXZERO();
+    NFloat acc[AVXMR * AVXNR] __attribute__((aligned(CPUALIGNMENT)));
+    int l;
+
+    for (l = 0; l < kc; ++l) {
+        a0 = AVXLOAD(Ap);
+        a1 = AVXLOAD(Ap + AVXVL);
+        AVXCOL(0) AVXCOL(1) AVXCOL(2) AVXCOL(3) AVXCOL(4) AVXCOL(5)
+        Ap += AVXMR;
+        Bp += AVXNR;
+    }
+    if (mr == AVXMR && nr == AVXNR) {
+        va = AVXSET1(alpha);
+        vb = AVXSET1(beta);
+        AVXPUT(0) AVXPUT(1) AVXPUT(2) AVXPUT(3) AVXPUT(4) AVXPUT(5)
+    }
+    else {
+        AVXTMP(0) AVXTMP(1) AVXTMP(2) AVXTMP(3) AVXTMP(4) AVXTMP(5)
+        StoreGemmTile(acc, mr, AVXMR, nr, C, ldc, alpha, beta);
+    }
+}
+
+static GemmKernInfo avx2Kern = {CPUSIMDAVX2, AVXMR, AVXNR, GemmKernAVX2};
+
+/* AVX-512F: a tile of two vectors by eight columns */
+#ifdef DOUBLEANN
+#define A512VL 8
+#define A512VEC __m512d
+#define A512ZERO _mm512_setzero_pd
+#define A512LOAD _mm512_load_pd
+#define A512LOADU _mm512_loadu_pd
+#define A512STOREU _mm512_storeu_pd
+#define A512STORE _mm512_store_pd
+#define A512SET1 _mm512_set1_pd
+#define A512ADD _mm512_add_pd
+#define A512SUB _mm512_sub_pd
+#define A512MUL _mm512_mul_pd
+#define A512DIV _mm512_div_pd
+#define A512MAX _mm512_max_pd
+#define A512MIN _mm512_min_pd
+#define A512FMA _mm512_fmadd_pd
+#define A512CASTI _mm512_castpd_si512
+#define A512CASTF _mm512_castsi512_pd
+#define A512SLLI _mm512_slli_epi64
+#else
+#define A512VL 16
+#define A512VEC __m512
+#define A512ZERO _mm512_setzero_ps
+#define A512LOAD _mm512_load_ps
+#define A512LOADU _mm512_loadu_ps
+#define A512STOREU _mm512_storeu_ps
+#define A512STORE _mm512_store_ps
+#define A512SET1 _mm512_set1_ps
+#define A512ADD _mm512_add_ps
+#define A512SUB _mm512_sub_ps
+#define A512MUL _mm512_mul_ps
+#define A512DIV _mm512_div_ps
+#define A512MAX _mm512_max_ps
+#define A512MIN _mm512_min_ps
+#define A512FMA _mm512_fmadd_ps
+#define A512CASTI _mm512_castps_si512
+#define A512CASTF _mm512_castsi512_ps
+#define A512SLLI _mm512_slli_epi32
+#endif
+#define A512MR (2 * A512VL)
+#define A512NR 8
+
+#define A512COL(j) b = A512SET1(Bp[j]); c0##j = A512FMA(a0, b, c0##j); c1##j = A512FMA(a1, b, c1##j);
+#define A512PUT(j) \
+    if (beta == 0.0) { \
+        A512STOREU(C + j * ldc, A512MUL(va, c0##j)); \
+        A512STOREU(C + j * ldc + A512VL, A512MUL(va, c1##j)); \
+    } \
+    else { \
+        A512STOREU(C + j * ldc, A512FMA(vb, A512LOADU(C + j * ldc), A512MUL(va, c0##j))); \
+        A512STOREU(C + j * ldc + A512VL, A512FMA(vb, A512LOADU(C + j * ldc + A512VL), A512MUL(va, c1##j))); \
+    }
+#define A512TMP(j) A512STORE(acc + j * A512MR, c0##j); A512STORE(acc + j * A512MR + A512VL, c1##j);
+
+__attribute__((target("avx512f")))
+static void GemmKernAVX512(int kc, NFloat *Ap, NFloat *Bp, NFloat *C, int ldc, NFloat alpha, NFloat beta, int mr, int nr) {
+    A512VEC a0, a1, b, va, vb;
+    A512VEC c00 = A512ZERO(), c01 = A512ZERO(), c02 = A512ZERO(), c03 = A512ZERO();
+    A512VEC c04 = A512ZERO(), c05 = A512ZERO(), c06 = A512ZERO(), c07 = A512ZERO();
+    A512VEC c10 = A512ZERO(), c11 = A512ZERO(), c12 = A512ZERO(), c13 = A512ZERO();
+    A512VEC c14 = A512ZERO(), c15 = A512ZERO(), c16 = A512ZERO(), c17 = A512ZERO();
+    NFloat acc[A512MR * A512NR] __attribute__((aligned(CPUALIGNMENT)));
+    int l;
+
+    for (l = 0; l < kc; ++l) {
+        a0 = A512LOAD(Ap);
+        a1 = A512LOAD(Ap + A512VL);
+        A512COL(0) A512COL(1) A512COL(2) A512COL(3) A512COL(4) A512COL(5) A512COL(6) A512COL(7)
+        Ap += A512MR;
+        Bp += A512NR;
+    }
+    if (mr == A512MR && nr == A512NR) {
+        va = A512SET1(alpha);
+        vb = A512SET1(beta);
+        A512PUT(0) A512PUT(1) A512PUT(2) A512PUT(3) A512PUT(4) A512PUT(5) A512PUT(6) A512PUT(7)
+    }
+    else {
+        A512TMP(0) A512TMP(1) A512TMP(2) A512TMP(3) A512TMP(4) A512TMP(5) A512TMP(6) A512TMP(7)
+        StoreGemmTile(acc, mr, A512MR, nr, C, ldc, alpha, beta);
+    }
+}
+
+static GemmKernInfo avx512Kern = {CPUSIMDAVX512, A512MR, A512NR, GemmKernAVX512};
+
+#endif  /* CPUX86 */
+
+/* ---------------------------- Packing --------------------------- */
+
+/* pack A(ic:ic+mc, pc:pc+kc) into mr tall slivers, zero padded;
+   A(i, l) is A[i + l * lda], or A[l + i * lda] when transposed */
+static void PackGemmA(Boolean trans, NFloat *A, int lda, int ic, int pc, int mc, int kc, int mr, NFloat *Ap) {
+    int ir, i, l, rows;
+    NFloat *src;
+
+    for (ir = 0; ir < mc; ir += mr) {
+        rows = MIN(mr, mc - ir);
+        if (!trans) {
+            for (l = 0; l < kc; ++l) {
+                src = A + (size_t) (pc + l) * lda + ic + ir;
+                for (i = 0; i < rows; ++i) {
+                    Ap[l * mr + i] = src[i];
+                }
+                for (; i < mr; ++i) {
+                    Ap[l * mr + i] = 0.0;
+                }
+            }
+        }
+        else {
+            for (i = 0; i < rows; ++i) {
+                src = A + (size_t) (ic + ir + i) * lda + pc;
+                for (l = 0; l < kc; ++l) {
+                    Ap[l * mr + i] = src[l];
+                }
+            }
+            for (; i < mr; ++i) {
+                for (l = 0; l < kc; ++l) {
+                    Ap[l * mr + i] = 0.0;
+                }
+            }
+        }
+        Ap += (size_t) mr * kc;
+    }
+}
+
+/* pack B(pc:pc+kc, jc:jc+nc) into nr wide slivers, zero padded;
+   B(l, j) is B[l + j * ldb], or B[j + l * ldb] when transposed */
+static void PackGemmB(Boolean trans, NFloat *B, int ldb, int pc, int jc, int kc, int nc, int nr, NFloat *Bp) {
+    int jr, j, l, cols;
+    NFloat *src;
+
+    for (jr = 0; jr < nc; jr += nr) {
+        cols = MIN(nr, nc - jr);
+        if (!trans) {
+            for (j = 0; j < cols; ++j) {
+                src = B + (size_t) (jc + jr + j) * ldb + pc;
+                for (l = 0; l < kc; ++l) {
+                    Bp[l * nr + j] = src[l];
+                }
+            }
+            for (; j < nr; ++j) {
+                for (l = 0; l < kc; ++l) {
+                    Bp[l * nr + j] = 0.0;
+                }
+            }
+        }
+        else {
+            for (l = 0; l < kc; ++l) {
+                src = B + (size_t) (pc + l) * ldb + jc + jr;
+                for (j = 0; j < cols; ++j) {
+                    Bp[l * nr + j] = src[j];
+                }
+                for (; j < nr; ++j) {
+                    Bp[l * nr + j] = 0.0;
+                }
+            }
+        }
+        Bp += (size_t) nr * kc;
+    }
+}
+
+/* ------------------------- GEMM Driver -------------------------- */
+
+/* the extra work done on the blocks of C: the bias is copied into
+   each mc x nr block just before its first panel is accumulated onto
+   it (so beta is ignored), act is applied to the block right after
+   its last panel while it is still in the cache, but rowAct needs
+   whole columns and runs on each nc wide panel, for which C must have
+   exactly m rows */
+typedef struct _GemmEpilogue {
+    NFloat *bias;                               /* added to each column of C, or NULL */
+    NSegFunc act;                               /* element-wise activation, or NULL */
+    NRowFunc rowAct;                            /* activation over each column, or NULL */
+} GemmEpilogue;
+
+typedef struct _GemmArgs {
+    GemmKernInfo *ki;                           /* the micro-kernel to use */
+    GemmEpilogue *epi;                          /* the epilogue, or NULL */
+    Boolean transA;                             /* A is stored transposed */
+    Boolean transB;                             /* B is stored transposed */
+    int m, n, k;                                /* C[m * n] = A[m * k] * B[k * n] */
+    NFloat alpha, beta;
+    NFloat *A, *B, *C;
+    int lda, ldb, ldc;
+    Boolean splitN;                             /* split the tasks by the columns of C */
+    int taskSize;                               /* the rows (or columns) of C per task */
+} GemmArgs;
+
+/* scale C[m * n] by beta, as BLAS does when k is 0 */
+static void ScaleGemmC(int m, int n, NFloat beta, NFloat *C, int ldc) {
+    int i, j;
+
+    for (j = 0; j < n; ++j) {
+        for (i = 0; i < m; ++i) {
+            C[(size_t) j * ldc + i] = (beta == 0.0)? 0.0: beta * C[(size_t) j * ldc + i];
+        }
+    }
+}
+
+/* set each column of C[m * n] to the bias, starting from its element rowOff */
+static void SetGemmBias(GemmEpilogue *epi, int m, int n, NFloat *C, int ldc, int rowOff) {
+    int j;
+
+    for (j = 0; j < n; ++j) {
+        memcpy(C + (size_t) j * ldc, epi->bias + rowOff, sizeof(NFloat) * m);
+    }
+}
+
+/* apply the element-wise activation of the epilogue to C[m * n] */
+static void ApplyGemmAct(GemmEpilogue *epi, int m, int n, NFloat *C, int ldc) {
+    int j;
+
+    if (ldc == m) {
+        epi->act(C, m * n, C);
+        return;
+    }
+    for (j = 0; j < n; ++j) {
+        epi->act(C + (size_t) j * ldc, m, C + (size_t) j * ldc);
+    }
+}
+
+/* the serial blocked GEMM over a sub-block of C, whose first row is
+   row rowOff of the whole output, as seen by the epilogue */
+static void GemmBlocked(GemmKernInfo *ki, Boolean transA, Boolean transB, int m, int n, int k, NFloat alpha, NFloat *A, int lda, NFloat *B, int ldb, NFloat beta, NFloat *C, int ldc, GemmEpilogue *epi, int rowOff) {
+    int mr = ki->mr, nr = ki->nr;
+    int mcMax = mr * CPUGEMMMCBLKS, ncMax = nr * CPUGEMMNCBLKS;
+    int ic, jc, pc, ir, jr, mc, nc, kc;
+    NFloat curBeta;
+    NFloat *Ap, *Bp;
+    NFloat *Cblk;
+
+    if (k <= 0 || alpha == 0.0) {
+        if (epi != NULL && epi->bias != NULL) {
+            SetGemmBias(epi, m, n, C, ldc, rowOff);
+        }
+        else {
+            ScaleGemmC(m, n, beta, C, ldc);
+        }
+        if (epi != NULL) {
+            if (epi->act != NULL) {
+                ApplyGemmAct(epi, m, n, C, ldc);
+            }
+            if (epi->rowAct != NULL) {
+                epi->rowAct(C, n, m, C);
+            }
+        }
+        return;
+    }
+    Ap = GetPackBuf(&packABuf, &packASize, (size_t) mcMax * CPUGEMMKC);
+    Bp = GetPackBuf(&packBBuf, &packBSize, (size_t) ncMax * CPUGEMMKC);
+    for (jc = 0; jc < n; jc += ncMax) {
+        nc = MIN(ncMax, n - jc);
+        for (pc = 0; pc < k; pc += CPUGEMMKC) {
+            kc = MIN(CPUGEMMKC, k - pc);
+            curBeta = (pc == 0 && (epi == NULL || epi->bias == NULL))? beta: 1.0;
+            PackGemmB(transB, B, ldb, pc, jc, kc, nc, nr, Bp);
+            for (ic = 0; ic < m; ic += mcMax) {
+                mc = MIN(mcMax, m - ic);
+                PackGemmA(transA, A, lda, ic, pc, mc, kc, mr, Ap);
+                for (jr = 0; jr < nc; jr += nr) {
+                    Cblk = C + (size_t) (jc + jr) * ldc + ic;
+                    if (epi != NULL && epi->bias != NULL && pc == 0) {
+                        SetGemmBias(epi, mc, MIN(nr, nc - jr), Cblk, ldc, rowOff + ic);
+                    }
+                    for (ir = 0; ir < mc; ir += mr) {
+                        ki->kern(kc, Ap + (size_t) ir * kc, Bp + (size_t) jr * kc, Cblk + ir, ldc, alpha, curBeta, MIN(mr, mc - ir), MIN(nr, nc - jr));
+                    }
+                    /* the last panel completes this mc x nr block */
+                    if (epi != NULL && epi->act != NULL && pc + kc >= k) {
+                        ApplyGemmAct(epi, mc, MIN(nr, nc - jr), Cblk, ldc);
+                    }
+                }
+            }
+        }
+        if (epi != NULL && epi->rowAct != NULL) {
+            epi->rowAct(C + (size_t) jc * ldc, nc, m, C + (size_t) jc * ldc);
+        }
+    }
+}
+
+/* run one thread's share of the output tiles */
+static void GemmTask(void *arg, int taskIdx) {
+    GemmArgs *ga = (GemmArgs *) arg;
+    int st, len;
+    NFloat *A = ga->A, *B = ga->B, *C = ga->C;
+
+    if (ga->splitN) {
+        st = taskIdx * ga->taskSize;
+        len = MIN(ga->taskSize, ga->n - st);
+        if (len <= 0) {
+            return;
+        }
+        B += ga->transB? (size_t) st: (size_t) st * ga->ldb;
+        C += (size_t) st * ga->ldc;
+        GemmBlocked(ga->ki, ga->transA, ga->transB, ga->m, len, ga->k, ga->alpha, A, ga->lda, B, ga->ldb, ga->beta, C, ga->ldc, ga->epi, 0);
+    }
+    else {
+        st = taskIdx * ga->taskSize;
+        len = MIN(ga->taskSize, ga->m - st);
+        if (len <= 0) {
+            return;
+        }
+        A += ga->transA? (size_t) st * ga->lda: (size_t) st;
+        C += st;
+        GemmBlocked(ga->ki, ga->transA, ga->transB, len, ga->n, ga->k, ga->alpha, A, ga->lda, B, ga->ldb, ga->beta, C, ga->ldc, ga->epi, st);
+    }
+}
+
+/* C[m * n] = alpha * op(A) * op(B) + beta * C, all column major, followed by the epilogue if any */
+static void GemmCPU(GemmKernInfo *ki, Boolean transA, Boolean transB, int m, int n, int k, NFloat alpha, NFloat *A, int lda, NFloat *B, int ldb, NFloat beta, NFloat *C, int ldc, GemmEpilogue *epi) {
+    GemmArgs ga;
+    int nTask, unit;
+
+    if (m <= 0 || n <= 0) {
+        return;
+    }
+    if (!CPUInit) {
+        StartCPU();
+    }
+    nTask = 1;
+    if (nCPUThreads > 1 && (double) m * n * k >= CPUGEMMMINFLOPS) {
+        nTask = nCPUThreads;
+    }
+    if (nTask == 1) {
+        GemmBlocked(ki, transA, transB, m, n, k, alpha, A, lda, B, ldb, beta, C, ldc, epi, 0);
+        return;
+    }
+
+    ga.ki = ki;
+    ga.epi = epi;
+    ga.transA = transA;
+    ga.transB = transB;
+    ga.m = m;
+    ga.n = n;
+    ga.k = k;
+    ga.alpha = alpha;
+    ga.beta = beta;
+    ga.A = A;
+    ga.B = B;
+    ga.C = C;
+    ga.lda = lda;
+    ga.ldb = ldb;
+    ga.ldc = ldc;
+    /* split along the longer side of C, in whole micro-tiles; a row
+       activation needs whole columns so it always splits along N */
+    ga.splitN = (n >= m) || (epi != NULL && epi->rowAct != NULL);
+    unit = ga.splitN? ki->nr: ki->mr;
+    ga.taskSize = CEIL(CEIL(ga.splitN? n: m, unit), nTask) * unit;
+    nTask = CEIL(ga.splitN? n: m, ga.taskSize);
+    RunCPUTasks(GemmTask, &ga, nTask);
+}
+
+/* the BLAS style entries of each micro-kernel, as used in the NKernSet tables */
+#define GEMMENTRIES(KIND, KINFO) \
+    static void HNBlasNNgemm##KIND(int m, int n, int k, NFloat alpha, NFloat *A, NFloat *B, NFloat beta, NFloat *C) { \
+        GemmCPU(&KINFO, FALSE, FALSE, m, n, k, alpha, A, m, B, k, beta, C, m, NULL); \
+    } \
+    static void HNBlasNTgemm##KIND(int m, int n, int k, NFloat alpha, NFloat *A, NFloat *B, NFloat beta, NFloat *C) { \
+        GemmCPU(&KINFO, FALSE, TRUE, m, n, k, alpha, A, m, B, n, beta, C, m, NULL); \
+    } \
+    static void HNBlasTNgemm##KIND(int m, int n, int k, NFloat alpha, NFloat *A, NFloat *B, NFloat beta, NFloat *C) { \
+        GemmCPU(&KINFO, TRUE, FALSE, m, n, k, alpha, A, k, B, k, beta, C, m, NULL); \
+    } \
+    static void HNBlasTNgemmBiasAct##KIND(int m, int n, int k, NFloat *A, NFloat *B, NFloat *bias, NSegFunc act, NRowFunc rowAct, NFloat *C) { \
+        GemmEpilogue epi; \
+        epi.bias = bias; \
+        epi.act = act; \
+        epi.rowAct = rowAct; \
+        GemmCPU(&KINFO, TRUE, FALSE, m, n, k, 1.0, A, k, B, k, 0.0, C, m, &epi); \
+    }
+
+GEMMENTRIES(Generic, genericKern)
+#ifdef CPUX86
+GEMMENTRIES(SSE, sseKern)
+GEMMENTRIES(AVX2, avx2Kern)
+GEMMENTRIES(AVX512, avx512Kern)
+#endif
+
+/* EXPORT->HNBlasNNgemmRef: C[m * n] = alpha * A[m * k] * B[k * n] + beta * C[m * n], unblocked */
+void HNBlasNNgemmRef(int m, int n, int k, NFloat alpha, NFloat *A, NFloat *B, NFloat beta, NFloat *C) {
+    int i, j, l;
+
+    for (i = 0; i < n; ++i) {
+        for (j = 0; j < m; ++j) {
+            C[i * m + j] *= beta;
+            for (l = 0; l < k; ++l) {
+                C[i * m + j] += alpha * A[l * m + j] * B[i * k + l];
+            }
+        }
+    }
+}
+
+/* EXPORT->HNBlasNTgemmRef: C[m * n] = alpha * A[m * k] * B[n * k]^T + beta * C[m * n], unblocked */
+void HNBlasNTgemmRef(int m, int n, int k, NFloat alpha, NFloat *A, NFloat *B, NFloat beta, NFloat *C) {
+    int i, j, l;
+
+    for (i = 0; i < n; ++i) {
+        for (j = 0; j < m; ++j) {
+            C[i * m + j] *= beta;
+            for (l = 0; l < k; ++l) {
+                C[i * m + j] += alpha * A[l * m + j] * B[l * n + i];
+            }
+        }
+    }
+}
+
+/* EXPORT->HNBlasTNgemmRef: C[m * n] = alpha * A[k * m]^T * B[k * n] + beta * C[m * n], unblocked */
+void HNBlasTNgemmRef(int m, int n, int k, NFloat alpha, NFloat *A, NFloat *B, NFloat beta, NFloat *C) {
+    int i, j, l;
+
+    for (i = 0; i < n; ++i) {
+        for (j = 0; j < m; ++j) {
+            C[i * m + j] *= beta;
+            for (l = 0; l < k; ++l) {
+                C[i * m + j] += alpha * A[j * k + l] * B[i * k + l];
+            }
+        }
+    }
+}
+
+/* ---------------------- Activation Kernels ---------------------- */
+
+/*
+   exp(x) is evaluated as 2^n * p(r), with n = round(x / ln2) and
+   r = x - n * ln2 in [-ln2/2, ln2/2] (ln2 is split in two parts so
+   that n * ln2hi is exact); p is the Cephes expf minimax polynomial
+   for float and the Taylor series up to r^12 for double, and 2^n
+   is built directly in the exponent bits.  The argument is first
+   clamped to [MINFLTEXPE, MAXFLTEXPE] (the DBL ones for DOUBLEANN)
+   as CHKNFLTEXPE does in the plain kernels, which keeps n within
+   the normal exponent range.  log(1 + u) for u in (0, 1] is
+   2 * atanh(u / (2 + u)) by its odd series, truncated below half
+   an ulp.
+
+   Checked by HNBench against libm evaluated in double, sigmoid and
+   softrelu are within 2.5e-7 relative error in float (5e-16 in
+   double), and tanh and 1 - exp(-y) within 2e-7 absolute error
+   (4e-16); near zero the relative error of the latter two is that
+   of the cancellation, as in the plain kernels.  Softmax adds no
+   error beyond that of rounding x - max.
+*/
+
+#define ACTLOG2E 1.44269504088896341            /* 1 / ln2 */
+
+#ifdef DOUBLEANN
+#define ACTMINEXPE MINDBLEXPE
+#define ACTMAXEXPE MAXDBLEXPE
+#define ACTEXPMAGIC 6755399441055744.0          /* 1.5 * 2^52, rounds to an integer when added */
+#define ACTEXPBIAS 4503599627371519.0           /* 2^52 + 1023, leaves n + 1023 in the low bits */
+#define ACTEXPSHIFT 52                          /* mantissa bits */
+#define ACTLN2HI 6.93145751953125E-1
+#define ACTLN2LO 1.42860682030941723212E-6
+#define ACTNEXPCOEF 11
+#define ACTNLOGCOEF 17
+/* 1 / k! for k = 12 .. 2 */
+static const NFloat actExpCoef[ACTNEXPCOEF] = {
+    2.0876756987868099E-9, 2.5052108385441720E-8, 2.7557319223985888E-7,
+    2.7557319223985893E-6, 2.4801587301587302E-5, 1.9841269841269841E-4,
+    1.3888888888888889E-3, 8.3333333333333332E-3, 4.1666666666666664E-2,
+    1.6666666666666666E-1, 5.0E-1
+};
+/* 2 / (2k + 1) for k = 16 .. 0 */
+static const NFloat actLogCoef[ACTNLOGCOEF] = {
+    2.0 / 33, 2.0 / 31, 2.0 / 29, 2.0 / 27, 2.0 / 25, 2.0 / 23, 2.0 / 21, 2.0 / 19, 2.0 / 17,
+    2.0 / 15, 2.0 / 13, 2.0 / 11, 2.0 / 9, 2.0 / 7, 2.0 / 5, 2.0 / 3, 2.0
+};
+#else
+#define ACTMINEXPE MINFLTEXPE
+#define ACTMAXEXPE MAXFLTEXPE
+#define ACTEXPMAGIC 12582912.0                  /* 1.5 * 2^23, rounds to an integer when added */
+#define ACTEXPBIAS 8388735.0                    /* 2^23 + 127, leaves n + 127 in the low bits */
+#define ACTEXPSHIFT 23                          /* mantissa bits */
+#define ACTLN2HI 0.693359375
+#define ACTLN2LO -2.12194440E-4
+#define ACTNEXPCOEF 6
+#define ACTNLOGCOEF 8
+static const NFloat actExpCoef[ACTNEXPCOEF] = {
+    1.9875691500E-4, 1.3981999507E-3, 8.3334519073E-3,
+    4.1665795894E-2, 1.6666665459E-1, 5.0000001201E-1
+};
+/* 2 / (2k + 1) for k = 7 .. 0 */
+static const NFloat actLogCoef[ACTNLOGCOEF] = {
+    2.0 / 15, 2.0 / 13, 2.0 / 11, 2.0 / 9, 2.0 / 7, 2.0 / 5, 2.0 / 3, 2.0
+};
+#endif
+
+#ifdef CPUX86
+
+/* dstPtr[i] = EXPR for i in [0, len), where EXPR is an expression of the
+   vector x loaded from srcPtr; the tail is padded to a whole vector so
+   that it goes through exactly the same arithmetic */
+#define ACTMAP(P, srcPtr, len, dstPtr, EXPR) { \
+    P##VEC x; \
+    NFloat tail[P##VL]; \
+    int i, j; \
+    for (i = 0; i + P##VL <= len; i += P##VL) { \
+        x = P##LOADU(srcPtr + i); \
+        P##STOREU(dstPtr + i, EXPR); \
+    } \
+    if (i < len) { \
+        for (j = 0; j < P##VL; ++j) { \
+            tail[j] = (i + j < len)? srcPtr[i + j]: 0.0; \
+        } \
+        x = P##LOADU(tail); \
+        P##STOREU(tail, EXPR); \
+        for (j = 0; i + j < len; ++j) { \
+            dstPtr[i + j] = tail[j]; \
+        } \
+    } \
+}
+
+/* as ACTMAP, but dstPtr is read as well, as the vector d */
+#define ACTMAPMUL(P, srcPtr, len, dstPtr, EXPR) { \
+    P##VEC x, d; \
+    NFloat tail[P##VL], dtail[P##VL]; \
+    int i, j; \
+    for (i = 0; i + P##VL <= len; i += P##VL) { \
+        x = P##LOADU(srcPtr + i); \
+        d = P##LOADU(dstPtr + i); \
+        P##STOREU(dstPtr + i, EXPR); \
+    } \
+    if (i < len) { \
+        for (j = 0; j < P##VL; ++j) { \
+            tail[j] = (i + j < len)? srcPtr[i + j]: 0.0; \
+            dtail[j] = (i + j < len)? dstPtr[i + j]: 0.0; \
+        } \
+        x = P##LOADU(tail); \
+        d = P##LOADU(dtail); \
+        P##STOREU(dtail, EXPR); \
+        for (j = 0; i + j < len; ++j) { \
+            dstPtr[i + j] = dtail[j]; \
+        } \
+    } \
+}
+
+/* the activation kernels of one instruction set P, named with suffix S */
+#define ACTKERNELS(P, S, TGT) \
+    __attribute__((target(TGT))) \
+    static inline P##VEC ExpVec##S(P##VEC x) { \
+        P##VEC n, r, p; \
+        int c; \
+        x = P##MIN(P##MAX(x, P##SET1(ACTMINEXPE)), P##SET1(ACTMAXEXPE)); \
+        n = P##SUB(P##FMA(x, P##SET1(ACTLOG2E), P##SET1(ACTEXPMAGIC)), P##SET1(ACTEXPMAGIC)); \
+        r = P##SUB(x, P##MUL(n, P##SET1(ACTLN2HI))); \
+        r = P##SUB(r, P##MUL(n, P##SET1(ACTLN2LO))); \
+        p = P##SET1(actExpCoef[0]); \
+        for (c = 1; c < ACTNEXPCOEF; ++c) { \
+            p = P##FMA(p, r, P##SET1(actExpCoef[c])); \
+        } \
+        p = P##FMA(P##MUL(p, r), r, P##ADD(r, P##SET1(1.0))); \
+        n = P##CASTF(P##SLLI(P##CASTI(P##ADD(n, P##SET1(ACTEXPBIAS))), ACTEXPSHIFT)); \
+        return P##MUL(p, n); \
+    } \
+    /* log(1 + u) for u in [0, 1] */ \
+    __attribute__((target(TGT))) \
+    static inline P##VEC Log1pVec##S(P##VEC u) { \
+        P##VEC z, w, p; \
+        int c; \
+        z = P##DIV(u, P##ADD(u, P##SET1(2.0))); \
+        w = P##MUL(z, z); \
+        p = P##SET1(actLogCoef[0]); \
+        for (c = 1; c < ACTNLOGCOEF; ++c) { \
+            p = P##FMA(p, w, P##SET1(actLogCoef[c])); \
+        } \
+        return P##MUL(p, z); \
+    } \
+    __attribute__((target(TGT))) \
+    static void SigmoidAct##S(NFloat *srcPtr, int len, NFloat *dstPtr) { \
+        ACTMAP(P, srcPtr, len, dstPtr, P##DIV(P##SET1(1.0), P##ADD(P##SET1(1.0), ExpVec##S(P##SUB(P##SET1(0.0), x))))) \
+    } \
+    __attribute__((target(TGT))) \
+    static void DSigmoidAct##S(NFloat *srcPtr, int len, NFloat *dstPtr) { \
+        ACTMAP(P, srcPtr, len, dstPtr, P##MUL(x, P##SUB(P##SET1(1.0), x))) \
+    } \
+    __attribute__((target(TGT))) \
+    static void DSigmoidActMul##S(NFloat *srcPtr, int len, NFloat *dstPtr) { \
+        ACTMAPMUL(P, srcPtr, len, dstPtr, P##MUL(d, P##MUL(x, P##SUB(P##SET1(1.0), x)))) \
+    } \
+    /* tanh(x) = 2 / (1 + exp(-2x)) - 1 */ \
+    __attribute__((target(TGT))) \
+    static void TanHAct##S(NFloat *srcPtr, int len, NFloat *dstPtr) { \
+        ACTMAP(P, srcPtr, len, dstPtr, P##SUB(P##DIV(P##SET1(2.0), P##ADD(P##SET1(1.0), ExpVec##S(P##MUL(P##SET1(-2.0), x)))), P##SET1(1.0))) \
+    } \
+    __attribute__((target(TGT))) \
+    static void DTanHAct##S(NFloat *srcPtr, int len, NFloat *dstPtr) { \
+        ACTMAP(P, srcPtr, len, dstPtr, P##SUB(P##SET1(1.0), P##MUL(x, x))) \
+    } \
+    __attribute__((target(TGT))) \
+    static void DTanHActMul##S(NFloat *srcPtr, int len, NFloat *dstPtr) { \
+        ACTMAPMUL(P, srcPtr, len, dstPtr, P##MUL(d, P##SUB(P##SET1(1.0), P##MUL(x, x)))) \
+    } \
+    /* log(1 + exp(x)) = max(x, 0) + log(1 + exp(-|x|)), x clamped as in the plain kernel */ \
+    __attribute__((target(TGT))) \
+    static inline P##VEC SoftReLVec##S(P##VEC x) { \
+        x = P##MIN(P##MAX(x, P##SET1(ACTMINEXPE)), P##SET1(ACTMAXEXPE)); \
+        return P##ADD(P##MAX(x, P##SET1(0.0)), Log1pVec##S(ExpVec##S(P##MIN(x, P##SUB(P##SET1(0.0), x))))); \
+    } \
+    __attribute__((target(TGT))) \
+    static void SoftReLAct##S(NFloat *srcPtr, int len, NFloat *dstPtr) { \
+        ACTMAP(P, srcPtr, len, dstPtr, SoftReLVec##S(x)) \
+    } \
+    /* given y = softrelu(x), the derivative is 1 - exp(-y) */ \
+    __attribute__((target(TGT))) \
+    static void DSoftReLAct##S(NFloat *srcPtr, int len, NFloat *dstPtr) { \
+        ACTMAP(P, srcPtr, len, dstPtr, P##SUB(P##SET1(1.0), ExpVec##S(P##SUB(P##SET1(0.0), x)))) \
+    } \
+    __attribute__((target(TGT))) \
+    static void DSoftReLActMul##S(NFloat *srcPtr, int len, NFloat *dstPtr) { \
+        ACTMAPMUL(P, srcPtr, len, dstPtr, P##MUL(d, P##SUB(P##SET1(1.0), ExpVec##S(P##SUB(P##SET1(0.0), x))))) \
+    } \
+    /* each row is shifted by its (clamped) maximum before exp */ \
+    __attribute__((target(TGT))) \
+    static void SoftmaxAct##S(NFloat *srcPtr, int row, int col, NFloat *dstPtr) { \
+        P##VEC v, vmax, vsum; \
+        NFloat buf[P##VL], maxVal, sumVal; \
+        NFloat *src, *dst; \
+        int i, j, l; \
+        for (i = 0; i < row; ++i) { \
+            src = srcPtr + (size_t) i * col; \
+            dst = dstPtr + (size_t) i * col; \
+            vmax = P##SET1(ACTMINEXPE); \
+            for (j = 0; j + P##VL <= col; j += P##VL) { \
+                vmax = P##MAX(vmax, P##LOADU(src + j)); \
+            } \
+            P##STOREU(buf, vmax); \
+            maxVal = buf[0]; \
+            for (l = 1; l < P##VL; ++l) { \
+                maxVal = (buf[l] > maxVal)? buf[l]: maxVal; \
+            } \
+            for (; j < col; ++j) { \
+                maxVal = (src[j] > maxVal)? src[j]: maxVal; \
+            } \
+            maxVal = (maxVal > ACTMAXEXPE)? ACTMAXEXPE: maxVal; \
+            vmax = P##SET1(maxVal); \
+            vsum = P##SET1(0.0); \
+            for (j = 0; j + P##VL <= col; j += P##VL) { \
+                v = P##MIN(P##MAX(P##LOADU(src + j), P##SET1(ACTMINEXPE)), P##SET1(ACTMAXEXPE)); \
+                v = ExpVec##S(P##SUB(v, vmax)); \
+                P##STOREU(dst + j, v); \
+                vsum = P##ADD(vsum, v); \
+            } \
+            P##STOREU(buf, vsum); \
+            sumVal = 0.0; \
+            for (l = 0; l < P##VL; ++l) { \
+                sumVal += buf[l]; \
+            } \
+            if (j < col) { \
+                for (l = 0; l < P##VL; ++l) { \
+                    buf[l] = (j + l < col)? src[j + l]: maxVal; \
+                } \
+                v = P##MIN(P##MAX(P##LOADU(buf), P##SET1(ACTMINEXPE)), P##SET1(ACTMAXEXPE)); \
+                P##STOREU(buf, ExpVec##S(P##SUB(v, vmax))); \
+                for (l = 0; j + l < col; ++l) { \
+                    dst[j + l] = buf[l]; \
+                    sumVal += buf[l]; \
+                } \
+            } \
+            v = P##SET1(1.0 / sumVal); \
+            ACTMAP(P, dst, col, dst, P##MUL(x, v)) \
+        } \
+    }
+
+ACTKERNELS(SSE, SSE, "sse2")
+ACTKERNELS(AVX, AVX2, "avx2,fma")
+ACTKERNELS(A512, AVX512, "avx512f")
+
+/* the activation entries of an NKernSet */
+#define LOADACTKERNELS(S, kset) \
+    kset->sigmoidAct = SigmoidAct##S; \
+    kset->dSigmoidAct = DSigmoidAct##S; \
+    kset->dSigmoidActMul = DSigmoidActMul##S; \
+    kset->tanHAct = TanHAct##S; \
+    kset->dTanHAct = DTanHAct##S; \
+    kset->dTanHActMul = DTanHActMul##S; \
+    kset->softReLAct = SoftReLAct##S; \
+    kset->dSoftReLAct = DSoftReLAct##S; \
+    kset->dSoftReLActMul = DSoftReLActMul##S; \
+    kset->softmaxAct = SoftmaxAct##S;
+
+#endif  /* CPUX86 */
+
+/* ----------------------- Device Management ---------------------- */
+
+/* EXPORT->DetectCPUSIMDKind: the widest instruction set supported by the CPU and the OS */
+CPUSIMDKind DetectCPUSIMDKind(void) {
+#ifdef CPUX86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f")) {
+        return CPUSIMDAVX512;
+    }
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+        return CPUSIMDAVX2;
+    }
+    return CPUSIMDSSE;
+#else
+    return CPUSIMDNONE;
+#endif
+}
+
+/* EXPORT->CPUSIMDKind2Str: the name of a SIMD kind */
+char *CPUSIMDKind2Str(CPUSIMDKind kind) {
+    switch (kind) {
+        case CPUSIMDSSE:
+            return "SSE";
+        case CPUSIMDAVX2:
+            return "AVX2";
+        case CPUSIMDAVX512:
+            return "AVX512";
+        default:
+            return "NONE";
+    }
+}
+
+/* EXPORT->GetCPUSIMDKind: the SIMD kind detected by StartCPU */
+CPUSIMDKind GetCPUSIMDKind(void) {
+    if (!CPUInit) {
+        StartCPU();
+    }
+    return simdKind;
+}
+
+/* the GEMM micro-kernel of a SIMD kind */
+static GemmKernInfo *GetGemmKernInfo(CPUSIMDKind kind) {
+    switch (kind) {
+#ifdef CPUX86
+        case CPUSIMDAVX512:
+            return &avx512Kern;
+        case CPUSIMDAVX2:
+            return &avx2Kern;
+        case CPUSIMDSSE:
+            return &sseKern;
+#endif
+        default:
+            return &genericKern;
+    }
+}
+
+/* EXPORT->LoadCPUNKernSet: replace the kernels in kset that have a version for kind */
+Boolean LoadCPUNKernSet(CPUSIMDKind kind, NKernSet *kset) {
+    if (kind > DetectCPUSIMDKind()) {
+        return FALSE;
+    }
+    switch (kind) {
+#ifdef CPUX86
+        case CPUSIMDAVX512:
+            kset->nnGemm = HNBlasNNgemmAVX512;
+            kset->ntGemm = HNBlasNTgemmAVX512;
+            kset->tnGemm = HNBlasTNgemmAVX512;
+            kset->tnGemmBiasAct = HNBlasTNgemmBiasActAVX512;
+            LOADACTKERNELS(AVX512, kset)
+            break;
+        case CPUSIMDAVX2:
+            kset->nnGemm = HNBlasNNgemmAVX2;
+            kset->ntGemm = HNBlasNTgemmAVX2;
+            kset->tnGemm = HNBlasTNgemmAVX2;
+            kset->tnGemmBiasAct = HNBlasTNgemmBiasActAVX2;
+            LOADACTKERNELS(AVX2, kset)
+            break;
+        case CPUSIMDSSE:
+            kset->nnGemm = HNBlasNNgemmSSE;
+            kset->ntGemm = HNBlasNTgemmSSE;
+            kset->tnGemm = HNBlasTNgemmSSE;
+            kset->tnGemmBiasAct = HNBlasTNgemmBiasActSSE;
+            LOADACTKERNELS(SSE, kset)
+            break;
+#endif
+        default:
+            kset->nnGemm = HNBlasNNgemmGeneric;
+            kset->ntGemm = HNBlasNTgemmGeneric;
+            kset->tnGemm = HNBlasTNgemmGeneric;
+            kset->tnGemmBiasAct = HNBlasTNgemmBiasActGeneric;
+            break;
+    }
+    return TRUE;
+}
+
+/* EXPORT->GetCPUThreadNum: the number of threads used by the kernels */
+int GetCPUThreadNum(void) {
+    return nCPUThreads;
+}
+
+/* EXPORT->InitCPU: initialise the module and load the configurations */
+void InitCPU(void) {
+    int intVal;
+
+    Register(hcpu_version, hcpu_vc_id);
+
+    nParm = GetConfig("HCPU", TRUE, cParm, MAXGLOBS);
+    if (nParm > 0) {
+        if (GetConfInt(cParm, nParm, "TRACE", &intVal)) {
+            trace = intVal;
+        }
+        if (GetConfInt(cParm, nParm, "NTHREADS", &intVal)) {
+            if (intVal <= 0) {
+                /* use all online cores */
+                intVal = (int) sysconf(_SC_NPROCESSORS_ONLN);
+            }
+            nCPUThreads = (intVal > 0)? intVal: 1;
+        }
+    }
+}
+
+/* EXPORT->StartCPU: detect the SIMD kind and start the worker threads */
+void StartCPU(void) {
+    static pthread_mutex_t startMutex = PTHREAD_MUTEX_INITIALIZER;
+
+    pthread_mutex_lock(&startMutex);
+    if (!CPUInit) {
+        simdKind = DetectCPUSIMDKind();
+        StartPool();
+        CPUInit = TRUE;
+        if (trace & T_TOP) {
+            printf("CPU kernels: SIMD = %s, GEMM tile = %dx%d, threads = %d\n", CPUSIMDKind2Str(simdKind), GetGemmKernInfo(simdKind)->mr, GetGemmKernInfo(simdKind)->nr, nCPUThreads);
+        }
+    }
+    pthread_mutex_unlock(&startMutex);
+}
+
+/* EXPORT->StopCPU: stop the worker threads */
+void StopCPU(void) {
+    if (CPUInit) {
+        StopPool();
+        FreePackBufs();
+        CPUInit = FALSE;
+    }
+}
+
+/* ------------------------- End of HCPU.c --------------------------- */
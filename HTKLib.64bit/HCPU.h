@@ -0,0 +1,117 @@
+/* ----------------------------------------------------------- */
+/*                                                             */
+/*                          ___                                */
+/*                       |_| | |_/   SPEECH                    */
+/*                       | | | | \   RECOGNITION               */
+/*                       =========   SOFTWARE                  */
+/*                                                             */
+/*                                                             */
+/* ----------------------------------------------------------- */
+/* developed at:                                               */
+/*                                                             */
+/*      Machine Intelligence Laboratory                        */
+/*      Cambridge University Engineering Department            */
+/*      http://mil.eng.cam.ac.uk/                              */
+/*                                                             */
+/*                                                             */
+/* ----------------------------------------------------------- */
+/*         Copyright: Microsoft Corporation                    */
+/*          1995-2000 Redmond, Washington USA                  */
+/*                    http://www.microsoft.com                 */
+/*                                                             */
+/*              2002  Cambridge University                     */
+/*                    Engineering Department                   */
+/*                                                             */
+/*   Use of this software is governed by a License Agreement   */
+/*    ** See the file License for the Conditions of Use  **    */
+/*    **     This banner notice must not be removed      **    */
+/*                                                             */
+/* ----------------------------------------------------------- */
+/*              File: HCPU.h   CPU Kernels                     */
+/* ----------------------------------------------------------- */
+
+/* !HVER!HCPU.h:   3.4.1 [CUED 17/10/16] */
+
+/*
+   This module provides the packed, cache blocked and SIMD
+   vectorised kernels behind the "CPU", "SSE", "AVX2" and "AVX512"
+   kernel sets of the NMatrix routines in HMath: the GEMM and the
+   polynomial based, single pass activations.  Each set is only
+   loaded when the processor supports it, and a small pool of
+   worker threads is used to split the larger kernels over the
+   output tiles.
+*/
+
+#ifndef _HCPU_H_
+#define _HCPU_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "HMem.h"
+
+#define CPUGEMMKC 256                   /* depth of a packed GEMM panel */
+#define CPUGEMMMCBLKS 12                /* micro-tiles per packed A block */
+#define CPUGEMMNCBLKS 512               /* micro-tiles per packed B panel */
+#define CPUGEMMMINFLOPS 262144.0        /* below this a GEMM is not split over threads */
+#define CPUALIGNMENT 64                 /* alignment of the packing buffers */
+
+typedef enum _CPUSIMDKind {
+    CPUSIMDNONE = 0,                    /* portable C only */
+    CPUSIMDSSE,                         /* SSE2, always present on x86_64 */
+    CPUSIMDAVX2,                        /* AVX2 with FMA3 */
+    CPUSIMDAVX512                       /* AVX-512F */
+} CPUSIMDKind;
+
+/* the task function run by the worker pool; taskIdx is in [0, nTask) */
+typedef void (*CPUTaskFunc)(void *arg, int taskIdx);
+
+void InitCPU(void);
+/*
+   Initialise the module and load its configuration parameters
+*/
+
+void StartCPU(void);
+/*
+   Detect the SIMD capabilities and start the worker threads;
+   it is called on demand by the kernels if not called explicitly
+*/
+
+void StopCPU(void);
+/*
+   Stop the worker threads and release the packing buffers
+*/
+
+CPUSIMDKind DetectCPUSIMDKind(void);
+CPUSIMDKind GetCPUSIMDKind(void);
+char *CPUSIMDKind2Str(CPUSIMDKind kind);
+int GetCPUThreadNum(void);
+
+void RunCPUTasks(CPUTaskFunc func, void *arg, int nTask);
+/*
+   Run func(arg, 0 .. nTask - 1) on the worker pool and return when
+   all tasks are finished.  When the pool is already busy (i.e. the
+   call is nested or made concurrently) the tasks are run serially
+   on the calling thread.
+*/
+
+Boolean LoadCPUNKernSet(CPUSIMDKind kind, NKernSet *kset);
+/*
+   Replace the entries of kset that have a version for the given
+   SIMD kind (CPUSIMDNONE gives the portable blocked versions);
+   returns FALSE if the processor does not support the kind
+*/
+
+/* the plain triple loops, all matrices are column major as in BLAS */
+void HNBlasNNgemmRef(int m, int n, int k, NFloat alpha, NFloat *A, NFloat *B, NFloat beta, NFloat *C);
+void HNBlasNTgemmRef(int m, int n, int k, NFloat alpha, NFloat *A, NFloat *B, NFloat beta, NFloat *C);
+void HNBlasTNgemmRef(int m, int n, int k, NFloat alpha, NFloat *A, NFloat *B, NFloat beta, NFloat *C);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  /* _HCPU_H_ */
+
+/* ------------------------- End of HCPU.h --------------------------- */
@@ -251,6 +251,28 @@ __global__ void HKern_DupNSegment(NFloat *srcPtr, int segLen, NFloat *dstPtr, in
     }
 }
 
+__global__ void HKern_CopyNSegmentStrided(NFloat *srcPtr, int srcStride, int segLen, int segNum, NFloat *dstPtr, int dstStride) {
+    int pos, seg, off;
+
+    pos = (blockIdx.x * blockDim.x) + threadIdx.x;
+    if (pos < segLen * segNum) {
+        seg = pos / segLen;
+        off = pos % segLen;
+        dstPtr[seg * dstStride + off] = srcPtr[seg * srcStride + off];
+    }
+}
+
+__global__ void HKern_AddNSegmentStrided(NFloat *srcPtr, int srcStride, int segLen, int segNum, NFloat *dstPtr, int dstStride) {
+    int pos, seg, off;
+
+    pos = (blockIdx.x * blockDim.x) + threadIdx.x;
+    if (pos < segLen * segNum) {
+        seg = pos / segLen;
+        off = pos % segLen;
+        dstPtr[seg * dstStride + off] += srcPtr[seg * srcStride + off];
+    }
+}
+
 __global__ void HKern_SubNSegment(NFloat *lhPtr, NFloat *rhPtr, int segLen, NFloat *resPtr) {
     int pos;
 
@@ -1190,6 +1212,26 @@ void DupNSegmentCUDA(NFloat *srcPtr, int segLen, NFloat *dstPtr, int times) {
     HKern_DupNSegment<<<nBlocks, THREADPERBLOCK>>>(srcPtr, segLen, dstPtr, times);
 }
 
+/*  */
+void CopyNSegmentStridedCUDA(NFloat *srcPtr, int srcStride, int segLen, int segNum, NFloat *dstPtr, int dstStride) {
+    int nBlocks;
+
+    nBlocks = CEIL(segLen * segNum, THREADPERBLOCK);
+    if (nBlocks > MAXBLOCKNUM)
+        HError(9999, "CopyNSegmentStridedCUDA: Block number exceeds the maximum");
+    HKern_CopyNSegmentStrided<<<nBlocks, THREADPERBLOCK>>>(srcPtr, srcStride, segLen, segNum, dstPtr, dstStride);
+}
+
+/*  */
+void AddNSegmentStridedCUDA(NFloat *srcPtr, int srcStride, int segLen, int segNum, NFloat *dstPtr, int dstStride) {
+    int nBlocks;
+
+    nBlocks = CEIL(segLen * segNum, THREADPERBLOCK);
+    if (nBlocks > MAXBLOCKNUM)
+        HError(9999, "AddNSegmentStridedCUDA: Block number exceeds the maximum");
+    HKern_AddNSegmentStrided<<<nBlocks, THREADPERBLOCK>>>(srcPtr, srcStride, segLen, segNum, dstPtr, dstStride);
+}
+
 /*  */
 void SubNSegmentCUDA(NFloat *lhPtr, NFloat *rhPtr, int segLen, NFloat *resPtr) {
     int nBlocks;
@@ -92,6 +92,8 @@ void AddNSegmentCUDA(NFloat *srcPtr, int segLen, NFloat *dstPtr);
 void ScaleNSegmentCUDA(int segLen, NFloat scale, NFloat *valPtr);
 void ScaledSelfAddNSegmentCUDA(NFloat *rhPtr, int segLen, NFloat scale, NFloat *lhPtr);
 void DupNSegmentCUDA(NFloat *srcPtr, int segLen, NFloat *dstPtr, int times);
+void CopyNSegmentStridedCUDA(NFloat *srcPtr, int srcStride, int segLen, int segNum, NFloat *dstPtr, int dstStride);
+void AddNSegmentStridedCUDA(NFloat *srcPtr, int srcStride, int segLen, int segNum, NFloat *dstPtr, int dstStride);
 void SubNSegmentCUDA(NFloat *lhPtr, NFloat *rhPtr, int segLen, NFloat *resPtr);
 void MulNSegmentCUDA(NFloat *lhPtr, NFloat *rhPtr, int segLen, NFloat *resPtr);
 void ApplyReLActCUDA(NFloat *srcPtr, int len, NFloat *dstPtr);
@@ -28,6 +28,7 @@ char *hdict_vc_id = "$Id: HDict.c,v 1.1.1.1 2006/10/11 09:54:57 jal58 Exp $";
 #include "HWave.h"
 #include "HLabel.h"
 #include "HDict.h"
+#include <pthread.h>
 
 /* --------------------------- Trace Flags ------------------------- */
 
@@ -55,6 +56,9 @@ void InitDict(void)
 
 /* ----------- Vocab Hash Table Routines  ---------------------- */
 
+/* Lattices may be read into a vocab by several threads at once */
+static pthread_mutex_t vocLock = PTHREAD_MUTEX_INITIALIZER;
+
 /* VocabHash: return a hash value for given Word LabId */
 static int VocabHash(LabId name)
 {
@@ -104,24 +108,27 @@ Word GetWord(Vocab *voc, LabId wordName, Boolean insert)
    int h;
    Word p;
 
+   pthread_mutex_lock(&vocLock);
    h = VocabHash(wordName); p = voc->wtab[h];
    if (p==NULL) {  /* special case - this slot empty */
       if (insert) {
          p=voc->wtab[h]=NewWord(voc,wordName);
          p->next=NULL;
       }
+      pthread_mutex_unlock(&vocLock);
       return p;
    }
    do{             /* general case - look for name */
       if (wordName == p->wordName)
-         return p; /* found it */
+         break;    /* found it */
       p = p->next;
    } while (p != NULL);
-   if (insert){    /* name not stored */
+   if (p==NULL && insert){    /* name not stored */
       p = NewWord(voc,wordName);
       p->next = voc->wtab[h];
       voc->wtab[h] = p; 
    }
+   pthread_mutex_unlock(&vocLock);
    return p;
 }
 
@@ -130,7 +130,8 @@ Word GetWord(Vocab *voc, LabId wordName, Boolean insert);
 /* 
    Return the Word with name wordName from Vocab voc.  If
    insert and wordName not in voc, then a new entry is
-   created with a null pronunciation.
+   created with a null pronunciation.  Calls are serialised by
+   a lock, so lattices may be read into voc by several threads.
 */
 
 void DelWord(Vocab *voc, Word word);
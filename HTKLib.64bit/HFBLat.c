@@ -125,10 +125,11 @@ static float phnInsPen = 0.0;                 /* Insertion penalty for each phon
 
 static int StartTime=0;     /* This is a value that we use to help calculating the PreComp's of
 			       the MOutP's, to make sure not to use previously cached values. 
-			       Doesn't matter if shared between different FBLatInfo's.  */
+			       Shared between different FBLatInfo's, each of which reserves
+			       fbInfo->T values from it for its own fbInfo->startTime.  */
 float hfwdbkwd_totalProbScale = 1.0;          /* (not a config.) Product of all scales affecting lm likelihoods.   Also read in HFBExactMPE.c and possibly
                                                  HMMIRest.c */
-static FBLatInfo *fbInfo; /* current fbInfo, so don't have to pass it around. */
+static __thread FBLatInfo *fbInfo; /* current fbInfo of this thread, so don't have to pass it around. */
 
 static ConfParam *cParm[MAXGLOBS];  /* config parameters */
 static int nParm = 0;
@@ -951,10 +952,10 @@ static void Setotprob(int t)
                                 sharing is needed in any case for lattices. */
                         case SHAREDHS:
 		            if (fbInfo->S == 1) {
-		                outprob[j][0] = ShStrP(fbInfo->al_ot.fv[s], t + StartTime, ste, fbInfo->inXForm, fbInfo->aInfo->mem);
+		                outprob[j][0] = ShStrP(fbInfo->al_ot.fv[s], t + fbInfo->startTime, ste, fbInfo->inXForm, fbInfo->aInfo->mem);
                             }
 		            else {
-		                outprob[j][s] = ShStrP(fbInfo->al_ot.fv[s], t + StartTime, ste, fbInfo->inXForm, fbInfo->aInfo->mem);
+		                outprob[j][s] = ShStrP(fbInfo->al_ot.fv[s], t + fbInfo->startTime, ste, fbInfo->inXForm, fbInfo->aInfo->mem);
                             }
 		            break;
                         case HYBRIDHS:	/* cz277 - ANN */
@@ -1135,54 +1136,41 @@ static void UpTranParms(int t, int q){
 
 
 
-typedef struct{
-   MixPDF *mp;
-   float occ;
-   float scaledOcc; /*for MEE.*/
-} MixOcc;
-
-Boolean CachingInitialised = FALSE;
-MemHeap cacheMixoccHeap;
-
-/* Following variables relate to caching of mixture occupation probabilities. */
-
-
-static int nPDFs[SMAX];  /*rely on it being initialised to zeros.*/
-static int SavedMixesSize[SMAX]; 
-static MixOcc *SavedMixes[SMAX]; /* [1..S][1..nPDFs[s]] */
+/* The caching of mixture occupation probabilities uses nPDFs,
+   savedMixesSize and savedMixes of fbInfo. */
 
 
 void DoMixUpdate(MixPDF *mp, int s, float Lr, float meescale, int t){  
    /* Stores the mp for update later...  The updates are performed once every time frame.  Avoids
       accumulating stats more than once for the same Gaussian.  */
   
-   int RealT = -(10+t+StartTime); /*now t is a unique identifier; the minus is to distinguish from the use of PreComp for caching of OutPs.
+   int RealT = -(10+t+fbInfo->startTime); /*now t is a unique identifier; the minus is to distinguish from the use of PreComp for caching of OutPs.
                                     10 is to avoid zero. */
    PreComp *pMix;
    pMix = (PreComp *)mp->hook;
 
    if(pMix->time != RealT){
-      int indx = nPDFs[s]++;
+      int indx = fbInfo->nPDFs[s]++;
       pMix->indx = indx;
       pMix->time = RealT;
-      if(SavedMixesSize[s] <= indx){
+      if(fbInfo->savedMixesSize[s] <= indx){
          MixOcc *NewArray;
-         int NewSize = MAX(100, SavedMixesSize[s]*2), n;
-         SavedMixesSize[s] = NewSize;
-         NewArray = New(&cacheMixoccHeap, sizeof(MixOcc) * NewSize);
+         int NewSize = MAX(100, fbInfo->savedMixesSize[s]*2), n;
+         fbInfo->savedMixesSize[s] = NewSize;
+         NewArray = New(&gcheap, sizeof(MixOcc) * NewSize);
          for(n=0;n<indx;n++){
-            NewArray[n] = SavedMixes[s][n];
+            NewArray[n] = fbInfo->savedMixes[s][n];
          }
-         if(SavedMixes[s]!=NULL)
-            Dispose(&gcheap, SavedMixes[s]);
-         SavedMixes[s] = NewArray;
+         if(fbInfo->savedMixes[s]!=NULL)
+            Dispose(&gcheap, fbInfo->savedMixes[s]);
+         fbInfo->savedMixes[s] = NewArray;
       }
-      SavedMixes[s][indx].mp = mp;
-      SavedMixes[s][indx].occ = 0;
-      SavedMixes[s][indx].scaledOcc = 0;
+      fbInfo->savedMixes[s][indx].mp = mp;
+      fbInfo->savedMixes[s][indx].occ = 0;
+      fbInfo->savedMixes[s][indx].scaledOcc = 0;
    }
-   SavedMixes[s][pMix->indx].occ += Lr;
-   SavedMixes[s][pMix->indx].scaledOcc += Lr*meescale;
+   fbInfo->savedMixes[s][pMix->indx].occ += Lr;
+   fbInfo->savedMixes[s][pMix->indx].scaledOcc += Lr*meescale;
 
 }
 
@@ -1203,14 +1191,14 @@ void DoAllMixUpdates(int t){
       vSize = fbInfo->hset->swidth[s];
       al_otvs = fbInfo->al_ot.fv[s];
     
-      for(m=0;m<nPDFs[s];m++){
-         unscaledLr = SavedMixes[s][m].occ;  /*differs in MPE case from Lr*/
-         LrWithSign = SavedMixes[s][m].scaledOcc; 
+      for(m=0;m<fbInfo->nPDFs[s];m++){
+         unscaledLr = fbInfo->savedMixes[s][m].occ;  /*differs in MPE case from Lr*/
+         LrWithSign = fbInfo->savedMixes[s][m].scaledOcc; 
 
          if(LrWithSign>0.0) local_accindx = fbInfo->num_index; else local_accindx = fbInfo->den_index;
          Lr = fabs(LrWithSign);
 
-         mp = SavedMixes[s][m].mp;
+         mp = fbInfo->savedMixes[s][m].mp;
          steSumLr += unscaledLr; /*just a check.*/
          mean = mp->mean; 
          variance = mp->cov.var;
@@ -1307,7 +1295,7 @@ void DoAllMixUpdates(int t){
       if(steSumLr > 1.01 || steSumLr < 0.99) HError(-1, "Wrong steSumLr: %f, t=%d, s=%d",steSumLr, t, s);
    }
    for(s=1;s<=fbInfo->S;s++) /*Reset.*/
-      nPDFs[s] = 0;
+      fbInfo->nPDFs[s] = 0;
 }
 
 
@@ -1407,8 +1395,8 @@ static double UpMixParms(int q, HLink hmm, int t, DVector aqt, DVector aqt1, DVe
                     if (!mmix || (fbInfo->hsKind == DISCRETEHS)) {       /*    Don't need the MOutP for 1-mix systems. */
                         x = aqt[j] + gqt[j] - outprob[j][0][0]/*-pr*/;   
                         pMix = (PreComp *) mp->hook;
-                        if (pMix->time != t + StartTime) { /* set the indx to -1, this relates to caching of the mixture occupation probability on each time frame. */
-                            pMix->time = t + StartTime; 
+                        if (pMix->time != t + fbInfo->startTime) { /* set the indx to -1, this relates to caching of the mixture occupation probability on each time frame. */
+                            pMix->time = t + fbInfo->startTime; 
 #ifdef MIX_UPDATE_SHARING
                             pMix->indx = -1;
 #endif
@@ -1431,9 +1419,9 @@ static double UpMixParms(int q, HLink hmm, int t, DVector aqt, DVector aqt1, DVe
 		                    prob = outprob[j][s][mx];
                                 }
 		                pMix = (PreComp *) mp->hook;
-		                if (pMix->time != t + StartTime) { /* set the indx to -1, this relates to caching of the mixture occupation
+		                if (pMix->time != t + fbInfo->startTime) { /* set the indx to -1, this relates to caching of the mixture occupation
 						       probability on each time frame. */
-		                    pMix->time = t + StartTime; 
+		                    pMix->time = t + fbInfo->startTime; 
 #ifdef MIX_UPDATE_SHARING
 			            pMix->indx = -1;
 #endif
@@ -1705,8 +1693,6 @@ static void StepForward()
 
 
 
-static  char buf1[255];
-static  Boolean eSep;
 
  
 void GetTimes(LArc *larc, int i, int *start, int *end){ /* get start & end times for a lattice arc.  Frame
@@ -1778,6 +1764,8 @@ void FBLatClearUp(FBLatInfo *fbInfo);
 Boolean FBLatFirstPass(FBLatInfo *_fbInfo, FileFormat dff, char * datafn, char *datafn2, Lattice *MPECorrLat){
     int q, T2 = 0; 
     Boolean MPE;
+    Boolean eSep;
+    char buf1[255];
   
     fbInfo = _fbInfo;
     if (fbInfo->InUse) {
@@ -1847,6 +1835,9 @@ Boolean FBLatFirstPass(FBLatInfo *_fbInfo, FileFormat dff, char * datafn, char *
         }
     }
 
+    /* reserve the frame ids of this utterance (see StartTime) */
+    fbInfo->startTime = __atomic_fetch_add(&StartTime, fbInfo->T, __ATOMIC_RELAXED);
+
     /* cz277 - cuda fblat */
     /* Step back through file. */
 #ifdef CUDA
@@ -2113,7 +2104,6 @@ void FBLatSecondPass(FBLatInfo *_fbInfo, int num_index, int den_index){
    if(fbInfo->pr == 0) HError(1, "FBLatSecondPass: 1st pass not done!!");
    StepForward();
    FBLatClearUp(fbInfo);
-   StartTime += fbInfo->T; /*relates to caching of likelihoods */
 
    /* cz277 - ANN */
    fbInfo->latPr[num_index] = fbInfo->pr;
@@ -2212,13 +2202,10 @@ void InitialiseFBInfo(FBLatInfo *fbInfo,
    fbInfo->aInfo->mem = &(fbInfo->arcStack);
    fbInfo->InUse = FALSE;
    fbInfo->aInfo->nLats = 0;
-   if(!CachingInitialised){ /* Initialise the mix occupation-caching  stack. */
-      CachingInitialised = TRUE;
-      CreateHeap(&cacheMixoccHeap,    "cacheMixocc C heap",       CHEAP, 1, 0.5, 1000,  10000);
-      for(s=0;s<SMAX;s++){
-         nPDFs[s] = 0; SavedMixesSize[s]=0; SavedMixes[s]=0;
-      }
+   for(s=0;s<SMAX;s++){ /* Initialise the mix occupation-caching. */
+      fbInfo->nPDFs[s] = 0; fbInfo->savedMixesSize[s]=0; fbInfo->savedMixes[s]=NULL;
    }
+   fbInfo->startTime = 0;
  
     /* cz277 - ANN */
     for (s = 1; s <= SMAX; ++s) {
@@ -41,6 +41,16 @@
    each mixture component.
 */   
 
+typedef struct{
+   MixPDF *mp;
+   float occ;
+   float scaledOcc; /*for MEE.*/
+} MixOcc;
+
+/* All the state of a forward-backward pass is kept in its FBLatInfo,
+   so passes with different FBLatInfo's may run on different threads
+   (each needs its own HMMSet, since the caches and accumulators are
+   attached to the HMMSet). */
 typedef struct {
   /* protected [readonly] : */
   int T;
@@ -101,6 +111,12 @@ typedef struct {
   DVector occVec[SMAX];	/* num occ when proc num lattice, den occ when proc den lattice */
   Boolean findRef;	/* compute the state with the maximum num likelihood or not */
   Boolean rejFrame;	/* do frame rejection or not */
+
+  /* caching of the mixture occupation probabilities of a frame */
+  int nPDFs[SMAX];
+  int savedMixesSize[SMAX];
+  MixOcc *savedMixes[SMAX]; /* [1..S][0..nPDFs[s]-1] */
+  int startTime;	/* base of the frame ids of the PreComp's (see HFBLat.c) */
 } FBLatInfo;
 
 void InitFBLat(void);
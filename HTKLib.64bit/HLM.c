@@ -42,6 +42,12 @@ char *hlm_vc_id = "$Id: HLM.c,v 1.1.1.1 2006/10/11 09:54:57 jal58 Exp $";
 #include "HLabel.h"
 #include "HLM.h"
 
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
 /* --------------------------- Trace Flags ------------------------- */
 
 #define T_TIO 1  /* Progress tracing whilst performing IO */
@@ -53,6 +59,7 @@ static int trace=0;
 #define LN10 2.30258509299404568 /* Defined to save recalculating it */
 
 static Boolean rawMITFormat = FALSE;    /* Don't use HTK quoting and escapes */
+static int lmCacheSize = 65536;         /* Entries in each LMTrans cache */
 
 
 static ConfParam *cParm[MAXGLOBS];      /* config parameters */
@@ -69,7 +76,10 @@ void InitLM(void)
    if (nParm>0){
       if (GetConfInt(cParm,nParm,"TRACE",&i)) trace = i;
       if (GetConfBool(cParm,nParm,"RAWMITFORMAT",&b)) rawMITFormat = b;
+      if (GetConfInt(cParm,nParm,"LMCACHESIZE",&i)) lmCacheSize = i;
    }
+   if (lmCacheSize<0)
+      HError(8190,"InitLM: LMCACHESIZE must not be negative");
 }
 
 /*------------------------- Input Scanner ---------------------------*/
@@ -330,6 +340,7 @@ NGramLM *CreateBoNGram(LModel *lm,int vocSize, int counts[NSIZE])
    nglm = (NGramLM *) New(lm->heap, sizeof(NGramLM));
    lm->data.ngram = nglm;
    nglm->heap = lm->heap;
+   nglm->cache = NULL;
 
    for (i=0;i<=NSIZE;i++) nglm->counts[i]=0;
    for (i=1;i<=NSIZE;i++)
@@ -567,6 +578,109 @@ static void WriteBoNGram(LModel *lm,char *fn,int flags)
    FClose(file,isPipe);
 }
 
+/* ----------------------- LMTrans Cache -------------------------- */
+
+/*
+   The cache is direct mapped on the source state and word, so it is
+   bounded and an entry is simply overwritten by the next transition
+   that maps to it.  A transition depends only on the model, so the
+   entries stay valid for as long as the model is loaded.  Threads that
+   share the model share its cache; each entry is guarded by one of
+   LMCACHELOCKS locks chosen by its slot.
+*/
+
+#define LMCACHELOCKS 64         /* Number of locks, a power of 2 */
+
+typedef struct lmcentry {
+   Ptr src;                     /* Source state, NULL==start of sentence */
+   lmId word;                   /* Word, 0==entry unused */
+   LogFloat prob;               /* Log prob of word following src */
+   Ptr dest;                    /* State that follows */
+} LMCEntry;
+
+typedef struct lmcache {
+   unsigned int size;           /* Number of entries, a power of 2 */
+   LMCEntry *tab;               /* Array[0..size-1] of entries */
+   long hits;                   /* Number of transitions found */
+   long misses;                 /* Number of transitions computed */
+   pthread_mutex_t lock[LMCACHELOCKS];  /* Locks for the entries */
+} LMCache;
+
+static pthread_mutex_t lmCacheLock = PTHREAD_MUTEX_INITIALIZER;
+
+/* CreateLMCache: create cache of at least lmCacheSize entries */
+static LMCache *CreateLMCache(void)
+{
+   LMCache *c;
+   unsigned int i;
+
+   c=(LMCache *) New(&gcheap,sizeof(LMCache));
+   for (c->size=1; c->size<lmCacheSize; c->size<<=1);
+   c->tab=(LMCEntry *) New(&gcheap,c->size*sizeof(LMCEntry));
+   for (i=0; i<c->size; i++) c->tab[i].word=0;
+   c->hits=c->misses=0;
+   for (i=0; i<LMCACHELOCKS; i++)
+      pthread_mutex_init(&c->lock[i],NULL);
+   return c;
+}
+
+/* FreeLMCache: free the cache of nglm if it has one */
+static void FreeLMCache(NGramLM *nglm)
+{
+   int i;
+
+   if (nglm->cache!=NULL) {
+      for (i=0; i<LMCACHELOCKS; i++)
+         pthread_mutex_destroy(&nglm->cache->lock[i]);
+      Dispose(&gcheap,nglm->cache->tab);
+      Dispose(&gcheap,nglm->cache);
+      nglm->cache=NULL;
+   }
+}
+
+/* LMCacheSlot: return the slot of cache c for word following src */
+static unsigned int LMCacheSlot(LMCache *c,Ptr src,lmId word)
+{
+   unsigned long h;
+
+   h=((unsigned long) src>>4)*2654435761UL+word*40503UL;
+   return (h^(h>>16))&(c->size-1);
+}
+
+/* GetLMCache: return the cache of nglm, creating it on first use */
+static LMCache *GetLMCache(NGramLM *nglm)
+{
+   LMCache *c;
+
+   c=__atomic_load_n(&nglm->cache,__ATOMIC_ACQUIRE);
+   if (c==NULL) {
+      pthread_mutex_lock(&lmCacheLock);
+      if ((c=nglm->cache)==NULL) {
+         c=CreateLMCache();
+         __atomic_store_n(&nglm->cache,c,__ATOMIC_RELEASE);
+      }
+      pthread_mutex_unlock(&lmCacheLock);
+   }
+   return c;
+}
+
+/* EXPORT->PrintLMCacheStats: print hit rate of LMTrans cache */
+void PrintLMCacheStats(LModel *lm)
+{
+   LMCache *c;
+   long n;
+
+   if (lm->type!=boNGram || (c=lm->data.ngram->cache)==NULL) {
+      printf("LM cache not used\n");
+      return;
+   }
+   n=c->hits+c->misses;
+   printf("LM cache: %u entries, %ld lookups, %ld hits (%.1f%%)\n",
+          c->size,n,c->hits,(n>0)?100.0*c->hits/n:0.0);
+   fflush(stdout);
+}
+
+
 void ClearBoNGram(LModel *lm)
 {
    NGramLM *nglm = lm->data.ngram;
@@ -574,6 +688,374 @@ void ClearBoNGram(LModel *lm)
    
    for(i=1;i<=nglm->vocSize;i++)
       if (nglm->wdlist[i]!=NULL) nglm->wdlist[i]->aux=0;
+   FreeLMCache(nglm);
+}
+
+/*------------------------ Binary NGrams --------------------------*/
+
+/*
+   A binary LM holds the NGramLM exactly as it is laid out in memory so
+   that it can be mapped instead of parsed.  The NEntries are sorted by
+   history and written as NEntry records with indexes in place of their
+   pointers, followed by the hash table (as indexes) and the SEntry
+   arrays of all the NEntries one after the other.  Loading relocates
+   the NEntries and hash table in place (the mapping is private) while
+   the SEntries, which are most of the model, are used straight from
+   the mapped file.
+
+   If the probabilities are quantised each SEntry is stored as a word
+   id and a code for an entry of a table of the quantised values, and
+   the SEntries are rebuilt on the heap when the model is read.  The
+   back-off weights stay in the NEntries and are not quantised.
+
+   The format is not a trie.  It keeps the hash table of histories, so
+   LMTrans finds an NEntry and its SEntries exactly as it does in a
+   model parsed from text.  Every section is checked against the size
+   of the file before it is used, so a truncated or corrupted file is
+   an error rather than a read outside the mapping.
+*/
+
+#define BINLMMAGIC "HTKBLM1"
+#define BINLMVERSION 1
+#define BINLMBYTEORDER 0x01020304
+
+typedef struct {
+   char magic[8];          /* BINLMMAGIC */
+   int byteOrder;          /* BINLMBYTEORDER as written */
+   int version;            /* BINLMVERSION */
+   int neSize;             /* sizeof(NEntry) of the writer */
+   int nsize;              /* Order of the model */
+   int vocSize;            /* Number of words */
+   int counts[NSIZE+1];    /* NEntries and ngrams of each order */
+   unsigned int hashsize;  /* Size of the hash table */
+   int qBits;              /* Bits per quantised probability, 0==none */
+   int pad;
+   long long nse;          /* Total number of SEntries */
+   long long wordOff;      /* Word names, in id order */
+   long long uniOff;       /* Unigram vector (size in element 0) */
+   long long neOff;        /* Array[0..counts[0]-1] of NEntry */
+   long long hashOff;      /* Array[0..hashsize-1] of NEntry index+1 */
+   long long seOff;        /* Array[0..nse-1] of SEntry, or of lmId */
+   long long codeOff;      /* Array[0..nse-1] of codes if quantised */
+   long long qtabOff;      /* Array[0..2^qBits-1] of quantised values */
+   long long size;         /* Total size of the file */
+} BinLMHeader;
+
+/* Round offset up to a multiple of 8 so that all records are aligned */
+#define BinLMAlign(off) (((off)+7)&~((long long)7))
+
+static void WriteBinLMData(FILE *f,void *data,size_t size,char *fn)
+{
+   if (size>0 && fwrite(data,size,1,f)!=1)
+      HError(8111,"WriteBinLModel: Cannot write LM file %s",fn);
+}
+
+static void PadBinLM(FILE *f,long long *off,char *fn)
+{
+   char zero[8]={0};
+   long long n;
+
+   n=BinLMAlign(*off)-*off;
+   WriteBinLMData(f,zero,n,fn);
+   *off+=n;
+}
+
+static int flt_cmp(const void *v1,const void *v2)
+{
+   float f1=*(float*)v1,f2=*(float*)v2;
+
+   return((f1<f2)?-1:(f1>f2)?1:0);
+}
+
+/* Return the code of the entry of qtab[0..nq-1] nearest to x */
+static int QuantCode(float *qtab,int nq,float x)
+{
+   int l,h,c;
+
+   l=0; h=nq-1;
+   while (h-l>1) {
+      c=(l+h)/2;
+      if (qtab[c]<=x) l=c; else h=c;
+   }
+   return((x-qtab[l]<=qtab[h]-x)?l:h);
+}
+
+/* EXPORT->WriteBinLModel: write back-off ngram in binary form */
+void WriteBinLModel(LModel *lm,char *fn,int qBits)
+{
+   NGramLM *nglm;
+   BinLMHeader hdr;
+   NEntry *ne,**neTab,rec;
+   Ptr *user;
+   float *vals,*qtab=NULL;
+   long long off,n,nse,*hash;
+   int i,j,k,nq=0,len;
+   FILE *f;
+
+   if (lm->type!=boNGram)
+      HError(8190,"WriteBinLModel: Only back-off ngrams have a binary form");
+   if (qBits!=0 && qBits!=8 && qBits!=16)
+      HError(8190,"WriteBinLModel: Cannot quantise to %d bits",qBits);
+   nglm=lm->data.ngram;
+
+   /* Sort the NEntries by history and number them through user */
+   neTab=(NEntry**) New(&gcheap,nglm->counts[0]*sizeof(NEntry*));
+   user=(Ptr*) New(&gcheap,nglm->counts[0]*sizeof(Ptr));
+   for (i=0,k=0;i<nglm->hashsize;i++)
+      for (ne=nglm->hashtab[i];ne!=NULL;ne=ne->link)
+         neTab[k++]=ne;
+   if (k!=nglm->counts[0])
+      HError(8190,"WriteBinLModel: %d NEntries found not %d",k,nglm->counts[0]);
+   qsort(neTab,k,sizeof(NEntry*),nep_cmp);
+   for (i=0,nse=0;i<k;i++) {
+      user[i]=neTab[i]->user;
+      neTab[i]->user=(Ptr)(long)(i+1);
+      nse+=neTab[i]->nse;
+   }
+
+   /* Quantisation table holds the means of equal sized ranges */
+   if (qBits>0) {
+      nq=1<<qBits;
+      vals=(float*) New(&gcheap,(nse+1)*sizeof(float));
+      for (i=0,n=0;i<k;i++)
+         for (j=0;j<neTab[i]->nse;j++)
+            vals[n++]=neTab[i]->se[j].prob;
+      qsort(vals,nse,sizeof(float),flt_cmp);
+      qtab=(float*) New(&gcheap,nq*sizeof(float));
+      for (i=0;i<nq;i++) {
+         long long lo=nse*i/nq,hi=nse*(i+1)/nq;
+         double sum=0.0;
+         for (n=lo;n<hi;n++) sum+=vals[n];
+         qtab[i]=(hi>lo)?sum/(hi-lo):((i>0)?qtab[i-1]:LZERO);
+      }
+      Dispose(&gcheap,vals);
+   }
+
+   memset(&hdr,0,sizeof(BinLMHeader));
+   memcpy(hdr.magic,BINLMMAGIC,sizeof(hdr.magic));
+   hdr.byteOrder=BINLMBYTEORDER;
+   hdr.version=BINLMVERSION;
+   hdr.neSize=sizeof(NEntry);
+   hdr.nsize=nglm->nsize;
+   hdr.vocSize=nglm->vocSize;
+   for (i=0;i<=NSIZE;i++) hdr.counts[i]=nglm->counts[i];
+   hdr.hashsize=nglm->hashsize;
+   hdr.qBits=qBits;
+   hdr.nse=nse;
+
+   if ((f=fopen(fn,"wb"))==NULL)
+      HError(8111,"WriteBinLModel: Cannot create LM file %s",fn);
+   WriteBinLMData(f,&hdr,sizeof(BinLMHeader),fn);
+   off=sizeof(BinLMHeader);
+
+   hdr.wordOff=off;
+   for (i=1;i<=nglm->vocSize;i++) {
+      len=strlen(nglm->wdlist[i]->name)+1;
+      WriteBinLMData(f,nglm->wdlist[i]->name,len,fn);
+      off+=len;
+   }
+   PadBinLM(f,&off,fn);
+   hdr.uniOff=off;
+   WriteBinLMData(f,nglm->unigrams,VectorElemSize(nglm->vocSize),fn);
+   off+=VectorElemSize(nglm->vocSize);
+   PadBinLM(f,&off,fn);
+
+   hdr.neOff=off;
+   for (i=0,n=0;i<k;i++) {
+      ne=neTab[i];
+      memset(&rec,0,sizeof(NEntry));
+      for (j=0;j<NSIZE-1;j++) rec.word[j]=ne->word[j];
+      rec.nse=ne->nse;
+      rec.bowt=ne->bowt;
+      rec.se=(SEntry*)(long)n;
+      rec.link=(NEntry*)((ne->link==NULL)?0:(long)ne->link->user);
+      WriteBinLMData(f,&rec,sizeof(NEntry),fn);
+      n+=ne->nse;
+   }
+   off+=(long long)k*sizeof(NEntry);
+
+   hdr.hashOff=off;
+   hash=(long long*) New(&gcheap,nglm->hashsize*sizeof(long long));
+   for (i=0;i<nglm->hashsize;i++)
+      hash[i]=(nglm->hashtab[i]==NULL)?0:(long)nglm->hashtab[i]->user;
+   WriteBinLMData(f,hash,nglm->hashsize*sizeof(long long),fn);
+   off+=nglm->hashsize*sizeof(long long);
+   Dispose(&gcheap,hash);
+
+   hdr.seOff=off;
+   if (qBits==0) {
+      for (i=0;i<k;i++)
+         WriteBinLMData(f,neTab[i]->se,neTab[i]->nse*sizeof(SEntry),fn);
+      off+=nse*sizeof(SEntry);
+   }
+   else {
+      for (i=0;i<k;i++)
+         for (j=0;j<neTab[i]->nse;j++)
+            WriteBinLMData(f,&neTab[i]->se[j].word,sizeof(lmId),fn);
+      off+=nse*sizeof(lmId);
+      PadBinLM(f,&off,fn);
+      hdr.codeOff=off;
+      for (i=0;i<k;i++)
+         for (j=0;j<neTab[i]->nse;j++) {
+            unsigned short code=QuantCode(qtab,nq,neTab[i]->se[j].prob);
+            unsigned char ccode=code;
+            if (qBits==8) WriteBinLMData(f,&ccode,1,fn);
+            else WriteBinLMData(f,&code,2,fn);
+         }
+      off+=nse*(qBits/8);
+      PadBinLM(f,&off,fn);
+      hdr.qtabOff=off;
+      WriteBinLMData(f,qtab,nq*sizeof(float),fn);
+      off+=nq*sizeof(float);
+      Dispose(&gcheap,qtab);
+   }
+   hdr.size=off;
+   if (fseek(f,0,SEEK_SET)!=0)
+      HError(8111,"WriteBinLModel: Cannot rewind LM file %s",fn);
+   WriteBinLMData(f,&hdr,sizeof(BinLMHeader),fn);
+   if (fclose(f)!=0)
+      HError(8111,"WriteBinLModel: Cannot close LM file %s",fn);
+
+   for (i=0;i<k;i++) neTab[i]->user=user[i];
+   Dispose(&gcheap,user);
+   Dispose(&gcheap,neTab);
+}
+
+/* CheckBinLMSection: check that the n records of size sz at offset
+   off of the binary LM fn are aligned and lie inside the file */
+static void CheckBinLMSection(BinLMHeader *hdr,long long off,long long n,
+                              long long sz,char *what,char *fn)
+{
+   if (off<(long long)sizeof(BinLMHeader) || (off&7)!=0 || off>hdr->size ||
+       n<0 || n>(hdr->size-off)/sz)
+      HError(8113,"ReadBinLModel: The %s of %s lie outside the file",what,fn);
+}
+
+/* ReadBinLModel: map binary ngram fn into lm, FALSE if not binary */
+static Boolean ReadBinLModel(LModel *lm,char *fn)
+{
+   NGramLM *nglm;
+   BinLMHeader *hdr;
+   NEntry *ne;
+   SEntry *se;
+   long long *hash,i,idx;
+   float *qtab;
+   lmId *words;
+   struct stat sb;
+   char *base,*name;
+   int fd,j;
+   size_t size;
+
+   if ((fd=open(fn,O_RDONLY))<0)
+      return(FALSE);
+   if (fstat(fd,&sb)!=0 || sb.st_size<sizeof(BinLMHeader)) {
+      close(fd);
+      return(FALSE);
+   }
+   size=sb.st_size;
+   base=(char*) mmap(NULL,size,PROT_READ|PROT_WRITE,MAP_PRIVATE,fd,0);
+   close(fd);
+   if (base==MAP_FAILED)
+      HError(8110,"ReadBinLModel: Cannot map LM file %s",fn);
+   hdr=(BinLMHeader*) base;
+   if (memcmp(hdr->magic,BINLMMAGIC,sizeof(hdr->magic))!=0) {
+      munmap(base,size);
+      return(FALSE);
+   }
+   if (hdr->byteOrder!=BINLMBYTEORDER || hdr->neSize!=sizeof(NEntry))
+      HError(8113,"ReadBinLModel: %s was written on an incompatible machine",fn);
+   if (hdr->version!=BINLMVERSION)
+      HError(8113,"ReadBinLModel: %s has unsupported version %d",fn,hdr->version);
+   if (hdr->size!=size || hdr->nsize<1 || hdr->nsize>NSIZE || 
+       hdr->vocSize<1 || hdr->counts[0]<1 || hdr->hashsize==0 ||
+       (hdr->hashsize&(hdr->hashsize-1))!=0)
+      HError(8113,"ReadBinLModel: The header of %s is corrupted",fn);
+   if ((hdr->qBits!=0 && hdr->qBits!=8 && hdr->qBits!=16) || hdr->nse<0 ||
+       hdr->wordOff!=sizeof(BinLMHeader) || hdr->uniOff<hdr->wordOff)
+      HError(8113,"ReadBinLModel: The header of %s is corrupted",fn);
+   CheckBinLMSection(hdr,hdr->uniOff,hdr->vocSize+1,sizeof(float),"unigrams",fn);
+   CheckBinLMSection(hdr,hdr->neOff,hdr->counts[0],sizeof(NEntry),"NEntries",fn);
+   CheckBinLMSection(hdr,hdr->hashOff,hdr->hashsize,sizeof(long long),"hash table",fn);
+   if (hdr->qBits==0)
+      CheckBinLMSection(hdr,hdr->seOff,hdr->nse,sizeof(SEntry),"SEntries",fn);
+   else {
+      CheckBinLMSection(hdr,hdr->seOff,hdr->nse,sizeof(lmId),"SEntries",fn);
+      CheckBinLMSection(hdr,hdr->codeOff,hdr->nse,hdr->qBits/8,"codes",fn);
+      CheckBinLMSection(hdr,hdr->qtabOff,1<<hdr->qBits,sizeof(float),"quantisation table",fn);
+   }
+   if (trace&T_TIO)
+      printf("\nBinLM "),fflush(stdout);
+
+   nglm=(NGramLM *) New(lm->heap,sizeof(NGramLM));
+   lm->data.ngram=nglm;
+   nglm->heap=lm->heap;
+   nglm->cache=NULL;
+   nglm->nsize=hdr->nsize;
+   nglm->vocSize=hdr->vocSize;
+   for (j=0;j<=NSIZE;j++) nglm->counts[j]=hdr->counts[j];
+   nglm->hashsize=hdr->hashsize;
+
+   /* Words */
+   nglm->wdlist=(LabId *) New(lm->heap,nglm->vocSize*sizeof(LabId)); 
+   nglm->wdlist--;
+   for (j=1,name=base+hdr->wordOff;j<=nglm->vocSize;j++) {
+      if (memchr(name,'\0',base+hdr->uniOff-name)==NULL)
+         HError(8113,"ReadBinLModel: The words of %s are corrupted",fn);
+      nglm->wdlist[j]=GetLabId(name,TRUE);
+      if (nglm->wdlist[j]->aux!=NULL)
+         HError(8150,"ReadBinLModel: Duplicate word (%s) in %s",name,fn);
+      nglm->wdlist[j]->aux=(Ptr)(long)j;
+      name+=strlen(name)+1;
+   }
+   nglm->unigrams=(Vector) (base+hdr->uniOff);
+   if (VectorSize(nglm->unigrams)!=nglm->vocSize)
+      HError(8113,"ReadBinLModel: The unigrams of %s are corrupted",fn);
+
+   /* SEntries are mapped unless quantised */
+   if (hdr->qBits==0)
+      se=(SEntry*) (base+hdr->seOff);
+   else {
+      se=(SEntry*) New(lm->heap,(hdr->nse+1)*sizeof(SEntry));
+      words=(lmId*) (base+hdr->seOff);
+      qtab=(float*) (base+hdr->qtabOff);
+      for (i=0;i<hdr->nse;i++) {
+         se[i].word=words[i];
+         se[i].prob=qtab[(hdr->qBits==8)?
+                         ((unsigned char*)(base+hdr->codeOff))[i]:
+                         ((unsigned short*)(base+hdr->codeOff))[i]];
+      }
+   }
+
+   /* Relocate the NEntries and the hash table */
+   ne=(NEntry*) (base+hdr->neOff);
+   for (i=0;i<hdr->counts[0];i++) {
+      idx=(long)ne[i].se;
+      if (idx<0 || idx+ne[i].nse>hdr->nse)
+         HError(8113,"ReadBinLModel: NEntry %lld of %s is corrupted",i,fn);
+      ne[i].se=(ne[i].nse>0)?se+idx:NULL;
+      idx=(long)ne[i].link;
+      if (idx<0 || idx>hdr->counts[0])
+         HError(8113,"ReadBinLModel: NEntry %lld of %s is corrupted",i,fn);
+      ne[i].link=(idx==0)?NULL:ne+idx-1;
+      ne[i].user=NULL;
+   }
+   hash=(long long*) (base+hdr->hashOff);
+   nglm->hashtab=(NEntry**) hash;
+   for (i=0;i<nglm->hashsize;i++) {
+      idx=hash[i];
+      if (idx<0 || idx>hdr->counts[0])
+         HError(8113,"ReadBinLModel: The hash table of %s is corrupted",fn);
+      nglm->hashtab[i]=(idx==0)?NULL:ne+idx-1;
+   }
+
+   if (trace&T_TIO) {
+      printf("\n NEntry==%d ",nglm->counts[0]);
+      for(j=1;j<=nglm->nsize;j++)
+         printf(" %d-Grams==%d",j,nglm->counts[j]);
+      printf("\n\n");
+      fflush(stdout);
+   }
+   return(TRUE);
 }
 
 /* -------------- Matrix Bigram Handling Routines ----------- */
@@ -821,6 +1303,9 @@ LModel *ReadLModel(MemHeap *heap,char *fn)
    lm->heap=heap;
    lm->name=CopyString(heap,fn);
 
+   lm->type=boNGram;
+   if (ReadBinLModel(lm,fn))
+      return(lm);
    if(InitSource(fn,&source,LangModFilter)<SUCCESS)
       HError(8110,"ReadLModel: Can't open file %s", fn);
    type=boNGram;i=0;
@@ -910,6 +1395,10 @@ LogFloat LMTrans (LModel *lm, LMState src, LabId wdid, LMState *dest)
    NEntry *ne;
    SEntry *se;
    lmId word;
+   LMCache *cache = NULL;
+   LMCEntry *ce;
+   pthread_mutex_t *lock = NULL;
+   unsigned int slot = 0;
 
    assert (lm->type == boNGram);
    nglm = lm->data.ngram;
@@ -922,6 +1411,23 @@ LogFloat LMTrans (LModel *lm, LMState src, LabId wdid, LMState *dest)
       return (LZERO);
    }
 
+   if (lmCacheSize>0) {
+      cache = GetLMCache (nglm);
+      slot = LMCacheSlot (cache, src, word);
+      lock = &cache->lock[slot&(LMCACHELOCKS-1)];
+      pthread_mutex_lock (lock);
+      ce = cache->tab + slot;
+      if (ce->word == word && ce->src == src) {
+         *dest = ce->dest;
+         lmprob = ce->prob;
+         pthread_mutex_unlock (lock);
+         __atomic_add_fetch (&cache->hits, 1, __ATOMIC_RELAXED);
+         return (lmprob);
+      }
+      pthread_mutex_unlock (lock);
+      __atomic_add_fetch (&cache->misses, 1, __ATOMIC_RELAXED);
+   }
+
    ne = src;
    
    if (!src) {          /* unigram case */
@@ -1000,6 +1506,16 @@ LogFloat LMTrans (LModel *lm, LMState src, LabId wdid, LMState *dest)
 
    *dest = ne;
 
+   if (lmCacheSize>0) {
+      pthread_mutex_lock (lock);
+      ce = cache->tab + slot;
+      ce->src = src;
+      ce->word = word;
+      ce->prob = lmprob;
+      ce->dest = ne;
+      pthread_mutex_unlock (lock);
+   }
+
 #if 0
    printf ("lmprob = %f  dest %p\n", lmprob, *dest);
 #endif
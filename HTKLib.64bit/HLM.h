@@ -77,6 +77,7 @@ typedef struct ngramlm {
    Vector unigrams;             /* Unigram probabilities */
    LabId *wdlist;               /* Lookup table for words from lmId */
    MemHeap *heap;               /* Pointer to heap */
+   struct lmcache *cache;       /* LMTrans results, NULL until first used */
 } NGramLM;
 
 typedef struct matbilm {
@@ -138,7 +139,16 @@ LModel *ReadLModel(MemHeap *heap,char *fn);
 void WriteLModel(LModel *lm,char *fn,int flags);
 /*
    Read/write language model from/to specified file.
-   Flags control format for writing.
+   Flags control format for writing.  ReadLModel also reads the
+   binary form written by WriteBinLModel.
+*/
+
+void WriteBinLModel(LModel *lm,char *fn,int qBits);
+/*
+   Write back-off ngram lm to fn in a binary form that ReadLModel maps
+   into memory instead of parsing.  If qBits is 8 or 16 the ngram
+   probabilities are quantised to that many bits.  The file can only
+   be read on machines with the same byte order and word size.
 */
 
 void ClearLModel(LModel *lm);
@@ -150,6 +160,17 @@ void ClearLModel(LModel *lm);
 typedef Ptr LMState;
 
 LogFloat LMTrans (LModel *lm, LMState src, LabId wdid, LMState *dest);
+/*
+   Return the log prob of wdid following state src and set dest to
+   the state that follows.  Results are kept in a cache of LMCACHESIZE
+   entries (0 disables it) so that transitions which are needed again,
+   in the same or later lattices, skip the back-off search.
+*/
+
+void PrintLMCacheStats(LModel *lm);
+/*
+   Print the number of LMTrans calls found in the cache
+*/
 #endif
 
 #ifdef __cplusplus
@@ -27,6 +27,7 @@ char *hlabel_vc_id = "$Id: HLabel.c,v 1.1.1.1 2006/10/11 09:54:57 jal58 Exp $";
 #include "HMath.h"
 #include "HWave.h"
 #include "HLabel.h"
+#include <pthread.h>
 
 /* ----------------------------- Trace Flags ------------------------- */
 
@@ -116,6 +117,7 @@ static double htkLabelTimeScale = 1; /* multiply all times in HTK format labels
 
 static int      numMLFs = 0;     /* number of MLF files opened */
 static FILE   * mlfile[MAXMLFS]; /* array [0..numMLFs-1] of MLF file */
+static char   * mlfName[MAXMLFS];/* array [0..numMLFs-1] of MLF file name */
 static int      mlfUsed = 0;     /* number of entries in mlfTab */
 static MLFEntry *mlfHead = NULL; /* head of linked list of MLFEntry */
 static MLFEntry *mlfTail = NULL; /* tail of linked list of MLFEntry */
@@ -126,6 +128,14 @@ typedef struct {
    LabId name;
 } OutMLFEntry;
 
+/* Labels may be loaded by several threads at once.  The thread that
+   initialised HLabel reads immediate definitions through mlfile, but
+   other threads have their own handles to the MLFs, opened when first
+   needed and closed when the thread exits, so that one thread's seek
+   does not move another's read position */
+static pthread_t mlfOwner;       /* the thread that owns mlfile */
+static pthread_key_t mlfKey;     /* per thread array of MLF handles */
+
 static FILE *outMLF = NULL;                 /* output MLF file, if any */ 
 static int numOutMLF = 0;                   /* number of output MLFs */ 
 static OutMLFEntry outMLFSet[MAXMLFS];      /* array of output MLFs */
@@ -137,6 +147,7 @@ static NameCell *hashtab[HASHSIZE];  /* the actual table */
 static MemHeap namecellHeap;         /* heap for name cells */
 static long numAccesses = 0;
 static long numTests = 0;
+static pthread_mutex_t nameLock = PTHREAD_MUTEX_INITIALIZER; /* guards the table */
 
 /* Hash: return a hash value for given label name */
 static unsigned Hash(char *name)
@@ -163,6 +174,17 @@ static NameCell *NewCell(char *name)
    return p;
 }
 
+/* CloseThreadMLFs: close the MLF handles of an exiting thread */
+static void CloseThreadMLFs(void *arg)
+{
+   FILE **files = (FILE **) arg;
+   int i;
+
+   for (i=0; i<MAXMLFS; i++)
+      if (files[i] != NULL) fclose(files[i]);
+   free(files);
+}
+
 /* EXPORT->InitLabel: initialise module */
 void InitLabel(void)
 {
@@ -176,6 +198,9 @@ void InitLabel(void)
    for (i=0;i<HASHSIZE;i++)
       hashtab[i] = NULL;
    CreateHeap(&mlfHeap,"mlfHeap",MSTAK,1,0.5,10000,50000);
+   mlfOwner = pthread_self();
+   if (pthread_key_create(&mlfKey,CloseThreadMLFs) != 0)
+      HError(6505,"InitLabel: Cannot create MLF handle key");
    numParm = GetConfig("HLABEL", TRUE, cParm, MAXGLOBS);
    if (numParm>0){
       if (GetConfInt(cParm,numParm,"TRACE",&i)) trace = i;
@@ -197,6 +222,7 @@ LabId GetLabId(char *name, Boolean insert)
    int h;
    NameCell *p;
 
+   pthread_mutex_lock(&nameLock);
    ++numAccesses; ++numTests;
    if ((trace&T_HASH) && numAccesses%100 == 0) 
       PrintNameTabStats();
@@ -205,19 +231,21 @@ LabId GetLabId(char *name, Boolean insert)
    if (p==NULL) {  /* special case - this slot empty */
       if (insert)
          p=hashtab[h]=NewCell(name);
+      pthread_mutex_unlock(&nameLock);
       return p;
    }
    do{             /* general case - look for name */
       if (strcmp(name,p->name) == 0)
-         return p; /* found it */
+         break;    /* found it */
       ++numTests;
       p = p->next;
    } while (p != NULL);
-   if (insert){    /* name not stored */
+   if (p==NULL && insert){    /* name not stored */
       p = NewCell(name);
       p->next = hashtab[h];
       hashtab[h] = p; 
    }
+   pthread_mutex_unlock(&nameLock);
    return p;
 }
 
@@ -587,10 +615,11 @@ static void FilterLevel(Transcription *t, int lev)
 enum _TrSymbol{TRNULL,TRNUM,TRSTR,TREOL,TRLEV,TRCOMMA,TREOF};
 typedef enum _TrSymbol TrSymbol;
 
-static int curch = ' ';
-static TrSymbol trSym = TRNULL;
-static double trNum;
-static char trStr[256];
+/* the scanner state is per thread, so labels can be read concurrently */
+static __thread int curch = ' ';
+static __thread TrSymbol trSym = TRNULL;
+static __thread double trNum;
+static __thread char trStr[256];
 
 /* IsNumeric: returns true if given string is a number */
 Boolean IsNumeric(char *s)
@@ -1248,6 +1277,7 @@ void LoadMasterFile(char *fname)
    if (compatMode && incSpaces)
       HError(-6551,"LoadMasterFile: . or %s on line with spaces in %s",
              LEVELSEP,fname);
+   mlfName[numMLFs] = CopyString(&mlfHeap,fname);
    mlfile[numMLFs++] = f;
 }
 
@@ -1271,6 +1301,23 @@ FILE *GetMLFFile(int fidx)
    return mlfile[fidx];
 }
 
+/* ThreadMLFFile: return the calling thread's handle to the fidx'th MLF */
+static FILE *ThreadMLFFile(int fidx)
+{
+   FILE **files;
+
+   if (pthread_equal(pthread_self(),mlfOwner))
+      return mlfile[fidx];
+   if ((files = (FILE **) pthread_getspecific(mlfKey)) == NULL) {
+      if ((files = (FILE **) calloc(MAXMLFS,sizeof(FILE *))) == NULL)
+         HError(6505,"ThreadMLFFile: Cannot allocate MLF handles");
+      pthread_setspecific(mlfKey,files);
+   }
+   if (files[fidx] == NULL && (files[fidx] = fopen(mlfName[fidx],"rb")) == NULL)
+      HError(6510,"ThreadMLFFile: cannot open MLF %s",mlfName[fidx]);
+   return files[fidx];
+}
+
 /*EXPORT->IsMLFFile: return true if fn is an MLF */
 Boolean IsMLFFile(char *fn)
 {
@@ -1327,7 +1374,7 @@ static FILE * OpenLabFile(char *fname, Boolean *isMLF)
    unsigned fixedHash;     /* hash value for PAT_FIXED */
    unsigned anypathHash;   /* hash value for PAT_ANYPATH */ 
    char *fnStart;          /* start of actual file name */
-   static MLFEntry *q=NULL;/* entry after last one accessed - checked first */
+   static __thread MLFEntry *q=NULL;/* entry after last one accessed - checked first */
    
    *isMLF = FALSE; 
    fixedHash = anypathHash = MLFHash(fname);
@@ -1367,7 +1414,7 @@ static FILE * OpenLabFile(char *fname, Boolean *isMLF)
       }
       if ( isMatch ) {
          if (e->type == MLF_IMMEDIATE) {
-            f = mlfile[e->def.immed.fidx];
+            f = ThreadMLFFile(e->def.immed.fidx);
             if (fseek(f,e->def.immed.offset,SEEK_SET) != 0)
                HError(6521,"OpenLabFile: cant seek to label def in MLF");
             *isMLF=TRUE;
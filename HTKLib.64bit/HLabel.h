@@ -132,7 +132,8 @@ LabId GetLabId(char *name, Boolean insert);
 /*
    Lookup given name in hash table and return its id.  If it
    is not there and insert is true then insert the new name
-   otherwise return NULL.
+   otherwise return NULL.  The table is locked, so several
+   threads may look up and insert names at once.
 */
 
 void PrintNameTabStats(void);
@@ -262,7 +263,10 @@ Transcription *LOpen(MemHeap *x, char *fname, FileFormat fmt);
    will be SOURCEFORMAT if set else source format will be HTK.
    If TRANSALT is set to N then all but the N'th alternative is
    discarded on read in.  If TRANSLEV is set to L then all but the 
-   L'th level is discarded on read in.
+   L'th level is discarded on read in.  Several threads may
+   call LOpen at once, each with its own heap x; threads other
+   than the one that initialised HLabel open their own handles
+   to the loaded MLFs.
 */
 
 ReturnStatus SaveToMasterfile(char *fname);
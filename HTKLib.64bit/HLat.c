@@ -52,6 +52,7 @@ char *hlat_vc_id = "$Id: HLat.c,v 1.2 2006/12/07 11:09:08 mjfg Exp $";
 #include "HNet.h"
 #include "HLM.h"
 #include "HLat.h"
+#include <pthread.h>
 
 /* ----------------------------- Trace Flags ------------------------- */
 
@@ -80,8 +81,6 @@ static Boolean compressMerge = TRUE; /* compressing lattice scores when merging
 
 static char *llfExt = "LLF";    /* extension for LLF lattice files */
 
-static MemHeap slaHeap, slnHeap;/* MHEAPs for use in LatExpand() */
-
 /* --------------------------- Prototypes ---------------------------- */
 
 
@@ -117,10 +116,14 @@ struct _LLFInfo {
 };
 
 
-static int numLLFs = 0; 
+/* Each thread scans LLFs of its own, so that threads loading the
+   lattices of different utterances do not move one another's read
+   position; the LLFs of a thread are closed when it exits */
+static __thread int numLLFs = 0; 
 static int maxLLFs = 5; 
-static int numLatsLoaded = 0;
-static LLFInfo *llfInfo = NULL;
+static __thread int numLatsLoaded = 0;
+static __thread LLFInfo *llfInfo = NULL;
+static pthread_key_t llfKey;
 
 static MemHeap llfHeap;
 
@@ -135,6 +138,20 @@ void CloseLLF (LLFInfo *llf)
 }
 
 
+/* CloseThreadLLFs: close and free the LLFs of an exiting thread */
+static void CloseThreadLLFs (void *p)
+{
+   LLFInfo *llf, *next;
+
+   for (llf = (LLFInfo *) p; llf; llf = next) {
+      next = llf->next;
+      if (llf->name[0])
+         CloseLLF (llf);
+      Dispose (&llfHeap, llf);
+   }
+}
+
+
 LLFInfo *OpenLLF (char *fn)
 {
    LLFInfo *llf;
@@ -159,6 +176,7 @@ LLFInfo *OpenLLF (char *fn)
       llf = New (&llfHeap, sizeof (LLFInfo));
       llf->next = llfInfo;
       llfInfo = llf;
+      pthread_setspecific (llfKey, llfInfo);
    }
    else {
       LLFInfo *l;
@@ -208,6 +226,11 @@ Lattice *GetLattice (char *fn, char *path, char *ext,
    char llfName[MAXFNAMELEN];
    char buf[MAXFNAMELEN];
 
+   /* lattices packed in the archive need no file at all */
+   MakeFN (fn, path, ext, buf);
+   if (InLatArchive (buf))
+      return ReadArchiveLattice (buf, heap, voc, shortArc, add2Dict);
+
    MakeFN (path, NULL, llfExt, llfName);
 
    /* check whether LLF is open already */
@@ -282,11 +305,9 @@ void InitLat(void)
       if (GetConfInt(cParm,nParm,"MAXLLFS",&i)) maxLLFs = i;
    }
 
-   CreateHeap (&llfHeap, "LLF stack", MSTAK, 1, 1.0, 1000, 10000);
-#ifndef NO_LAT_LM
-   CreateHeap (&slaHeap, "LatExpand arc heap", MHEAP, sizeof (SubLArc), 1.0, 1000, 128000);
-   CreateHeap (&slnHeap, "LatExpand node heap", MHEAP,sizeof (SubLNode), 1.0, 1000, 32000);
-#endif
+   CreateHeap (&llfHeap, "LLF heap", CHEAP, 1, 0.0, 1000, 10000);
+   if (pthread_key_create (&llfKey, CloseThreadLLFs) != 0)
+      HError (8690, "InitLat: Cannot create the LLF key");
 }
 
 
@@ -1130,7 +1151,9 @@ static SubLNode *FindAddSubLNode (MemHeap *heap, LNode *ln, LMState lmstate, int
 
 /* EXPORT->LatExpand
 
-     expand lattice using new (typically higher-order) language Model
+     expand lattice using new (typically higher-order) language Model.
+     The sub-nodes and sub-arcs live on heaps local to the call, so
+     several threads can expand lattices with the same LM at once.
 */
 Lattice *LatExpand (MemHeap *heap, Lattice *lat, LModel *lm)
 {
@@ -1143,8 +1166,11 @@ Lattice *LatExpand (MemHeap *heap, Lattice *lat, LModel *lm)
    LogFloat lmprob;
    LMState dest;
    Lattice *newlat;
+   MemHeap slaHeap, slnHeap;   /* MHEAPs for sub-arcs and sub-nodes */
 
    nsln = nsla = 0;
+   CreateHeap (&slaHeap, "LatExpand arc heap", MHEAP, sizeof (SubLArc), 1.0, 1000, 128000);
+   CreateHeap (&slnHeap, "LatExpand node heap", MHEAP,sizeof (SubLNode), 1.0, 1000, 32000);
 
    /* The idea of this algorithm is that we will split each node and arc
       in the lattice into multiple sub-nodes and sub-arcs as required
@@ -1248,8 +1274,8 @@ Lattice *LatExpand (MemHeap *heap, Lattice *lat, LModel *lm)
    }
 
    Dispose (&gcheap, topOrder);
-   ResetHeap (&slaHeap);
-   ResetHeap (&slnHeap);
+   DeleteHeap (&slaHeap);
+   DeleteHeap (&slnHeap);
 
    return newlat;
 }
@@ -1825,14 +1851,10 @@ void ApplyNGram2LabLat(Lattice *lat, LModel *lm)
 
    /* all the words in the label lattice are store in a reverse order in 
       as [W_n, W_n-1, ..., W_2, W_1] in the array excluding NULL word. 
-      LM vocab word Id is also assigned to each word to access LM */ 
+      Label names are unique, so a word of the LM already carries its 
+      LM vocab word Id in aux and needs no search of the LM wordlist */ 
    for (i = 0, ln = &lat->lnodes[1]; i < lat->nn - 2; i++, ln++) {
       revlab[lat->nn - 3 - i] = ln->word->wordName;
-      for (j = 1; j <= lm->data.ngram->vocSize; j++) {
-         if (strcmp(lm->data.ngram->wdlist[j]->name, revlab[lat->nn - 3 - i]->name) == 0) {
-            revlab[lat->nn - 3 - i]->aux = (Ptr) lm->data.ngram->wdlist[j]->aux;
-         }
-      }
    }
    
    if (trace & T_EXP) {
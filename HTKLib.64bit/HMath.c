@@ -40,6 +40,7 @@ char *hmath_vc_id = "$Id: HMath.c,v 1.1.1.1 2006/10/11 09:54:58 jal58 Exp $";
 #include "HMem.h"
 #include "HMath.h"
 #include "cfgs.h"
+#include "HCPU.h"
 
 #ifdef CUDA
 #include "HCUDA.h"
@@ -54,6 +55,7 @@ char *hmath_vc_id = "$Id: HMath.c,v 1.1.1.1 2006/10/11 09:54:58 jal58 Exp $";
 static int trace = 0;
 
 #define T_DIM   0002        /* Matrix/Vector dimension checking */
+#define T_KERN  0004        /* NMatrix kernel set selection */
 /* cz277 - 1004 */
 #define MAXSVDITER 30
 #define SIGN(a, b) (b > 0.0 ? fabs(a): -fabs(a))
@@ -74,6 +76,9 @@ static int nMKLThreads = 1;             /* the number of threads used by CPU LAP
 static NMatrix *tmpNMat = NULL;         /* the pointer to the temp matrix */
 static int tmpRowNum = 1;               /* the row number of the temp matrix*/
 static int tmpColNum = 1;               /* the column number of the temp matrix */
+static NKernSet nKern;                  /* the host kernels used by the NMatrix routines */
+
+static void SetNKernOverrides(char *spec);
 
 /* ------------------ Vector Oriented Routines ----------------------- */
 
@@ -1662,6 +1667,7 @@ double   L2F(LogDouble x)
 #ifdef UNIX
 /* Prototype for C Library functions drand48 and srand48 */
 double drand48(void);
+double erand48(unsigned short xsubi[3]);
 void srand48(long);
 #define RANDF() drand48()
 #define SRAND(x) srand48(x)
@@ -1685,6 +1691,29 @@ float RandomValue(void)
    return RANDF();
 }
 
+/* EXPORT->RandInitState: Initialise random number state rs */
+void RandInitState(RandState *rs, int seed)
+{
+   if (seed<0) seed = (int)time(NULL)%257;
+   /* as srand48 sets the 48 bit state of drand48 */
+   rs->x[0] = 0x330E;
+   rs->x[1] = (unsigned short) (seed & 0xFFFF);
+   rs->x[2] = (unsigned short) ((seed >> 16) & 0xFFFF);
+#ifndef UNIX
+   SRAND(seed);
+#endif
+}
+
+/* EXPORT->RandomStateValue: random value from state rs */
+float RandomStateValue(RandState *rs)
+{
+#ifdef UNIX
+   return erand48(rs->x);
+#else
+   return RANDF();
+#endif
+}
+
 /* EXPORT->GaussDeviate: random number with a N(mu,sigma) distribution */
 float GaussDeviate(float mu, float sigma)
 {
@@ -1790,6 +1819,7 @@ float CumGauss(float x, float mean, float var)
 void InitMath(void)
 {
    int i;
+   char buf[MAXSTRLEN];
 
    Register(hmath_version,hmath_vc_id);
    RandInit(-1);
@@ -1814,6 +1844,12 @@ void InitMath(void)
       }
 #endif
    }
+   /* cz277 - ANN */
+   if (numParm == 0 || !GetConfStr(cParm, numParm, "NKERNSET", buf))
+      strcpy(buf, "AUTO");
+   SelectNKernSet(buf);
+   if (numParm > 0 && GetConfStr(cParm, numParm, "NKERNOVERRIDE", buf))
+      SetNKernOverrides(buf);
 }
 
 /* cz277 - ANN */
@@ -1869,11 +1905,7 @@ void CopyNSegment(NMatrix *srcMat, int srcOff, int segLen, NMatrix *dstMat, int
 #ifdef CUDA
     CopyNSegmentCUDA(srcMat->devElems + srcOff, segLen, dstMat->devElems + dstOff);
 #else
-    #ifdef MKL
-    CopyNSegmentMKL(srcMat->matElems + srcOff, segLen, dstMat->matElems + dstOff);
-    #else
-    CopyNSegmentCPU(srcMat->matElems + srcOff, segLen, dstMat->matElems + dstOff);
-    #endif
+    nKern.copySeg(srcMat->matElems + srcOff, segLen, dstMat->matElems + dstOff);
 #endif
 }
 
@@ -1887,11 +1919,7 @@ void CopyNVectorSegment(NVector *srcVec, int srcOff, int segLen, NVector *dstVec
 #ifdef CUDA
     CopyNSegmentCUDA(srcVec->devElems + srcOff, segLen, dstVec->devElems + dstOff);
 #else
-    #ifdef MKL
-    CopyNSegmentMKL(srcVec->vecElems + srcOff, segLen, dstVec->vecElems + dstOff);
-    #else
-    CopyNSegmentCPU(srcVec->vecElems + srcOff, segLen, dstVec->vecElems + dstOff);
-    #endif
+    nKern.copySeg(srcVec->vecElems + srcOff, segLen, dstVec->vecElems + dstOff);
 #endif
 }
 
@@ -2251,11 +2279,59 @@ void AddNSegment(NMatrix *srcMat, int srcOff, int segLen, NMatrix *dstMat, int d
 #ifdef CUDA
     AddNSegmentCUDA(srcMat->devElems + srcOff, segLen, dstMat->devElems + dstOff);
 #else
-    #ifdef MKL
-    AddNSegmentMKL(srcMat->matElems + srcOff, segLen, dstMat->matElems + dstOff);
-    #else
-    AddNSegmentCPU(srcMat->matElems + srcOff, segLen, dstMat->matElems + dstOff);
-    #endif
+    nKern.addSeg(srcMat->matElems + srcOff, segLen, dstMat->matElems + dstOff);
+#endif
+}
+
+/* EXPORT->CopyNSegmentStrided: copy segNum segments of segLen, srcStride and dstStride apart */
+void CopyNSegmentStrided(NMatrix *srcMat, int srcOff, int srcStride, int segLen, int segNum, NMatrix *dstMat, int dstOff, int dstStride) {
+#ifndef CUDA
+    int i;
+#endif
+
+    if (trace & T_DIM) {
+        if (!(srcOff >= 0 && segLen >= 0 && segNum >= 0 && segLen <= srcStride && (srcOff + (segNum - 1) * srcStride + segLen) <= srcMat->rowNum * srcMat->colNum))
+            HError(9999, "CopyNSegmentStrided: Illegal source matrix offset, stride or segment length");
+        if (!(dstOff >= 0 && segLen <= dstStride && (dstOff + (segNum - 1) * dstStride + segLen) <= dstMat->rowNum * dstMat->colNum))
+            HError(9999, "CopyNSegmentStrided: Illegal destinate matrix offset or stride");
+    }
+    if (segLen <= 0 || segNum <= 0)
+        return;
+#ifdef CUDA
+    CopyNSegmentStridedCUDA(srcMat->devElems + srcOff, srcStride, segLen, segNum, dstMat->devElems + dstOff, dstStride);
+#else
+    if (srcStride == segLen && dstStride == segLen) {
+        nKern.copySeg(srcMat->matElems + srcOff, segLen * segNum, dstMat->matElems + dstOff);
+        return;
+    }
+    for (i = 0; i < segNum; ++i, srcOff += srcStride, dstOff += dstStride)
+        nKern.copySeg(srcMat->matElems + srcOff, segLen, dstMat->matElems + dstOff);
+#endif
+}
+
+/* EXPORT->AddNSegmentStrided: add segNum segments of segLen, srcStride and dstStride apart */
+void AddNSegmentStrided(NMatrix *srcMat, int srcOff, int srcStride, int segLen, int segNum, NMatrix *dstMat, int dstOff, int dstStride) {
+#ifndef CUDA
+    int i;
+#endif
+
+    if (trace & T_DIM) {
+        if (!(srcOff >= 0 && segLen >= 0 && segNum >= 0 && segLen <= srcStride && (srcOff + (segNum - 1) * srcStride + segLen) <= srcMat->rowNum * srcMat->colNum))
+            HError(9999, "AddNSegmentStrided: Illegal source matrix offset, stride or segment length");
+        if (!(dstOff >= 0 && segLen <= dstStride && (dstOff + (segNum - 1) * dstStride + segLen) <= dstMat->rowNum * dstMat->colNum))
+            HError(9999, "AddNSegmentStrided: Illegal destinate matrix offset or stride");
+    }
+    if (segLen <= 0 || segNum <= 0)
+        return;
+#ifdef CUDA
+    AddNSegmentStridedCUDA(srcMat->devElems + srcOff, srcStride, segLen, segNum, dstMat->devElems + dstOff, dstStride);
+#else
+    if (srcStride == segLen && dstStride == segLen) {
+        nKern.addSeg(srcMat->matElems + srcOff, segLen * segNum, dstMat->matElems + dstOff);
+        return;
+    }
+    for (i = 0; i < segNum; ++i, srcOff += srcStride, dstOff += dstStride)
+        nKern.addSeg(srcMat->matElems + srcOff, segLen, dstMat->matElems + dstOff);
 #endif
 }
 
@@ -2270,11 +2346,7 @@ void AddNMatrix(NMatrix *srcMat, int row, int col, NMatrix *dstMat) {
 #ifdef CUDA
     AddNSegmentCUDA(srcMat->devElems, row * col, dstMat->devElems);
 #else
-    #ifdef MKL
-    AddNSegmentMKL(srcMat->matElems, row * col, dstMat->matElems);
-    #else
-    AddNSegmentCPU(srcMat->matElems, row * col, dstMat->matElems);
-    #endif
+    nKern.addSeg(srcMat->matElems, row * col, dstMat->matElems);
 #endif
 }
 
@@ -2287,11 +2359,7 @@ void AddNVector(NVector *srcVec, int len, NVector *dstVec) {
 #ifdef CUDA
     AddNSegmentCUDA(srcVec->devElems, len, dstVec->devElems);
 #else
-    #ifdef MKL
-    AddNSegmentMKL(srcVec->vecElems, len, dstVec->vecElems);
-    #else
-    AddNSegmentCPU(srcVec->vecElems, len, dstVec->vecElems);
-    #endif
+    nKern.addSeg(srcVec->vecElems, len, dstVec->vecElems);
 #endif
 }
 
@@ -2306,8 +2374,7 @@ static void AddScaledNSegmentCPU(NFloat *srcPtr, int segLen, NFloat scale, NFloa
 
 /* cz277 - l2 fix */
 #ifdef MKL
-static void AddScaledNSegmentMKL(NFloat *srcPtr, int segnLen, NFloat scale, NFloat *dstPtr) {
-    int i;
+static void AddScaledNSegmentMKL(NFloat *srcPtr, int segLen, NFloat scale, NFloat *dstPtr) {
     const NFloat alpha = scale;
 
 #ifdef DOUBLEANN
@@ -2330,11 +2397,7 @@ void AddScaledNMatrix(NMatrix *srcMat, int row, int col, NFloat scale, NMatrix *
 #ifdef CUDA
     AddScaledNSegmentCUDA(srcMat->devElems, row * col, scale, dstMat->devElems);
 #else
-    #ifdef MKL
-    AddScaledNSegmentMKL(srcMat->matElems, row * col, scale, dstMat->matElems);
-    #else
-    AddScaledNSegmentCPU(srcMat->matElems, row * col, scale, dstMat->matElems);
-    #endif
+    nKern.addScaledSeg(srcMat->matElems, row * col, scale, dstMat->matElems);
 #endif
 }
 
@@ -2348,11 +2411,7 @@ void AddScaledNVector(NVector *srcVec, int len, NFloat scale, NVector *dstVec) {
 #ifdef CUDA
     AddScaledNSegmentCUDA(srcVec->devElems, len, scale, dstVec->devElems);
 #else
-    #ifdef MKL
-    AddScaledNSegmentMKL(srcVec->vecElems, len, scale, dstVec->vecElems);
-    #else
-    AddScaledNSegmentCPU(srcVec->vecElems, len, scale, dstVec->vecElems);
-    #endif
+    nKern.addScaledSeg(srcVec->vecElems, len, scale, dstVec->vecElems);
 #endif
 }
 
@@ -2382,11 +2441,7 @@ void ScaleNMatrix(NFloat scale, int row, int col, NMatrix *valMat) {
 #ifdef CUDA
     ScaleNSegmentCUDA(row * col, scale, valMat->devElems);
 #else
-    #ifdef MKL
-    ScaleNSegmentMKL(row * col, scale, valMat->matElems);
-    #else
-    ScaleNSegmentCPU(row * col, scale, valMat->matElems);
-    #endif
+    nKern.scaleSeg(row * col, scale, valMat->matElems);
 #endif
 
 }
@@ -2400,11 +2455,7 @@ void ScaleNVector(NFloat scale, int len, NVector *valVec) {
 #ifdef CUDA
     ScaleNSegmentCUDA(len, scale, valVec->devElems);
 #else
-    #ifdef MKL
-    ScaleNSegmentMKL(len, scale, valVec->vecElems);
-    #else
-    ScaleNSegmentCPU(len, scale, valVec->vecElems);
-    #endif
+    nKern.scaleSeg(len, scale, valVec->vecElems);
 #endif
 }
 
@@ -2437,11 +2488,7 @@ void ScaledSelfAddNVector(NVector *rhVec, int len, NFloat scale, NVector *lhVec)
 #ifdef CUDA
     ScaledSelfAddNSegmentCUDA(rhVec->devElems, len, scale, lhVec->devElems);
 #else
-    #ifdef MKL
-    ScaledSelfAddNSegmentMKL(rhVec->vecElems, len, scale, lhVec->vecElems);
-    #else
-    ScaledSelfAddNSegmentCPU(rhVec->vecElems, len, scale, lhVec->vecElems);
-    #endif
+    nKern.scaledSelfAddSeg(rhVec->vecElems, len, scale, lhVec->vecElems);
 #endif
 }
 
@@ -2456,11 +2503,7 @@ void ScaledSelfAddNMatrix(NMatrix *rhMat, int row, int col, NFloat scale, NMatri
 #ifdef CUDA
     ScaledSelfAddNSegmentCUDA(rhMat->devElems, row * col, scale, lhMat->devElems);
 #else
-    #ifdef MKL
-    ScaledSelfAddNSegmentMKL(rhMat->matElems, row * col, scale, lhMat->matElems);
-    #else
-    ScaledSelfAddNSegmentCPU(rhMat->matElems, row * col, scale, lhMat->matElems);
-    #endif
+    nKern.scaledSelfAddSeg(rhMat->matElems, row * col, scale, lhMat->matElems);
 #endif
 }
 
@@ -2498,11 +2541,7 @@ void DupNVector(NVector *srcVec, NMatrix *dstMat, int times) {
 #ifdef CUDA
     DupNSegmentCUDA(srcVec->devElems, srcVec->vecLen, dstMat->devElems, times);
 #else
-    #ifdef MKL
-    DupNSegmentMKL(srcVec->vecElems, srcVec->vecLen, dstMat->matElems, times);
-    #else
-    DupNSegmentCPU(srcVec->vecElems, srcVec->vecLen, dstMat->matElems, times);
-    #endif
+    nKern.dupSeg(srcVec->vecElems, srcVec->vecLen, dstMat->matElems, times);
 #endif
 }
 
@@ -2537,11 +2576,7 @@ void SubNMatrix(NMatrix *lhMat, NMatrix *rhMat, int row, int col, NMatrix *resMa
 #ifdef CUDA
     SubNSegmentCUDA(lhMat->devElems, rhMat->devElems, row * col, resMat->devElems);
 #else
-    #ifdef MKL
-    SubNSegmentMKL(lhMat->matElems, rhMat->matElems, row * col, resMat->matElems);
-    #else
-    SubNSegmentCPU(lhMat->matElems, rhMat->matElems, row * col, resMat->matElems);
-    #endif
+    nKern.subSeg(lhMat->matElems, rhMat->matElems, row * col, resMat->matElems);
 #endif
 }
 
@@ -2576,11 +2611,7 @@ void MulNMatrix(NMatrix *lhMat, NMatrix *rhMat, int row, int col, NMatrix *resMa
 #ifdef CUDA
     MulNSegmentCUDA(lhMat->devElems, rhMat->devElems, row * col, resMat->devElems);
 #else
-    #ifdef MKL
-    MulNSegmentMKL(lhMat->matElems, rhMat->matElems, row * col, resMat->matElems);
-    #else
-    MulNSegmentCPU(lhMat->matElems, rhMat->matElems, row * col, resMat->matElems);
-    #endif
+    nKern.mulSeg(lhMat->matElems, rhMat->matElems, row * col, resMat->matElems);
 #endif
 }
 
@@ -2593,11 +2624,7 @@ void MulNVector(NVector *lhVec, NVector *rhVec, int len, NVector *resVec) {
 #ifdef CUDA
     MulNSegmentCUDA(lhVec->devElems, rhVec->devElems, len, resVec->devElems);
 #else
-    #ifdef MKL
-    MulNSegmentMKL(lhVec->vecElems, rhVec->vecElems, len, resVec->vecElems);
-    #else
-    MulNSegmentCPU(lhVec->vecElems, rhVec->vecElems, len, resVec->vecElems);
-    #endif
+    nKern.mulSeg(lhVec->vecElems, rhVec->vecElems, len, resVec->vecElems);
 #endif
 }
 
@@ -2628,7 +2655,7 @@ void ApplyReLAct(NMatrix *srcMat, int row, int col, NMatrix *dstMat) {
 #ifdef CUDA
     ApplyReLActCUDA(srcMat->devElems, row * col, dstMat->devElems);
 #else
-    ApplyReLActCPU(srcMat->matElems, row * col, dstMat->matElems);
+    nKern.reLAct(srcMat->matElems, row * col, dstMat->matElems);
 #endif
 }
 
@@ -2654,7 +2681,30 @@ void ApplyDReLAct(NMatrix *srcMat, int row, int col, NMatrix *dstMat) {
 #ifdef CUDA
     ApplyDReLActCUDA(srcMat->devElems, row * col, dstMat->devElems);
 #else
-    ApplyDReLActCPU(srcMat->matElems, row * col, dstMat->matElems);
+    nKern.dReLAct(srcMat->matElems, row * col, dstMat->matElems);
+#endif
+}
+
+static inline void ApplyDReLActMulCPU(NFloat *srcPtr, int len, NFloat *dstPtr) {
+    int i;
+
+    for (i = 0; i < len; ++i)
+        dstPtr[i] *= (srcPtr[i] > 0)? 1.0: RELUNEGSCALE;
+}
+
+void ApplyDReLActMul(NMatrix *srcMat, int row, int col, NMatrix *dstMat) {
+    /* safety check */
+    if (trace & T_DIM) {
+        if (!(srcMat->colNum == col && dstMat->colNum == col))
+            HError(9999, "ApplyDReLActMul: Input column number incompatible");
+        if (!(row > 0 && row <= srcMat->rowNum && row <= dstMat->rowNum))
+            HError(9999, "ApplyDReLActMul: Input row number out of range");
+    }
+#ifdef CUDA
+    ApplyDReLActCUDA(srcMat->devElems, row * col, srcMat->devElems);
+    MulNSegmentCUDA(srcMat->devElems, dstMat->devElems, row * col, dstMat->devElems);
+#else
+    nKern.dReLActMul(srcMat->matElems, row * col, dstMat->matElems);
 #endif
 }
 
@@ -2677,7 +2727,7 @@ void ApplyDLinearAct(NMatrix *srcMat, int row, int col, NMatrix *dstMat) {
 #ifdef CUDA
     ApplyDLinearActCUDA(srcMat->devElems, row * col, dstMat->devElems);
 #else
-    ApplyDLinearActCPU(srcMat->matElems, row * col, dstMat->matElems);
+    nKern.dLinearAct(srcMat->matElems, row * col, dstMat->matElems);
 #endif
 }
 
@@ -2724,11 +2774,34 @@ void ApplyDSoftReLAct(NMatrix *srcMat, int row, int col, NMatrix *dstMat) {
 #ifdef CUDA
     ApplyDSoftReLActCUDA(srcMat->devElems, row * col, dstMat->devElems);
 #else
-    #ifdef MKL
-    ApplyDSoftReLActMKL(srcMat->matElems, row * col, dstMat->matElems);
-    #else
-    ApplyDSoftReLActCPU(srcMat->matElems, row * col, dstMat->matElems);
-    #endif
+    nKern.dSoftReLAct(srcMat->matElems, row * col, dstMat->matElems);
+#endif
+}
+
+static inline void ApplyDSoftReLActMulCPU(NFloat *srcPtr, int len, NFloat *dstPtr) {
+    int i;
+    NFloat expVal;
+
+    for (i = 0; i < len; ++i) {
+        expVal = srcPtr[i];
+        CHKNFLTEXPE(expVal)
+        dstPtr[i] *= 1.0 - 1.0 / exp(expVal);
+    }
+}
+
+void ApplyDSoftReLActMul(NMatrix *srcMat, int row, int col, NMatrix *dstMat) {
+    /* safety check */
+    if (trace & T_DIM) {
+        if (!(srcMat->colNum == col && dstMat->colNum == col))
+            HError(9999, "ApplyDSoftReLActMul: Input column number incompatible");
+        if (!(row > 0 && row <= srcMat->rowNum && row <= dstMat->rowNum))
+            HError(9999, "ApplyDSoftReLActMul: Input row number out of range");
+    }
+#ifdef CUDA
+    ApplyDSoftReLActCUDA(srcMat->devElems, row * col, srcMat->devElems);
+    MulNSegmentCUDA(srcMat->devElems, dstMat->devElems, row * col, dstMat->devElems);
+#else
+    nKern.dSoftReLActMul(srcMat->matElems, row * col, dstMat->matElems);
 #endif
 }
 
@@ -2776,11 +2849,7 @@ void ApplySoftReLAct(NMatrix *srcMat, int row, int col, NMatrix *dstMat) {
 #ifdef CUDA
     ApplySoftReLActCUDA(srcMat->devElems, row * col, dstMat->devElems);
 #else
-    #ifdef MKL
-    ApplySoftReLActMKL(srcMat->matElems, row * col, dstMat->matElems);
-    #else
-    ApplySoftReLActCPU(srcMat->matElems, row * col, dstMat->matElems);
-    #endif
+    nKern.softReLAct(srcMat->matElems, row * col, dstMat->matElems);
 #endif
 }
 
@@ -2839,11 +2908,7 @@ void ApplySigmoidAct(NMatrix *srcMat, int row, int col, NMatrix *dstMat) {
 #ifdef CUDA
     ApplySigmoidActCUDA(srcMat->devElems, row * col, dstMat->devElems);
 #else
-    #ifdef MKL
-    ApplySigmoidActMKL(srcMat->matElems, row * col, dstMat->matElems);
-    #else
-    ApplySigmoidActCPU(srcMat->matElems, row * col, dstMat->matElems);
-    #endif
+    nKern.sigmoidAct(srcMat->matElems, row * col, dstMat->matElems);
 #endif
 }
 
@@ -2881,11 +2946,30 @@ void ApplyDSigmoidAct(NMatrix *srcMat, int row, int col, NMatrix *dstMat) {
 #ifdef CUDA
     ApplyDSigmoidActCUDA(srcMat->devElems, row * col, dstMat->devElems);
 #else
-    #ifdef MKL
-    ApplyDSigmoidActMKL(srcMat->matElems, row * col, dstMat->matElems);
-    #else
-    ApplyDSigmoidActCPU(srcMat->matElems, row * col, dstMat->matElems);
-    #endif
+    nKern.dSigmoidAct(srcMat->matElems, row * col, dstMat->matElems);
+#endif
+}
+
+static inline void ApplyDSigmoidActMulCPU(NFloat *srcPtr, int len, NFloat *dstPtr) {
+    int i;
+
+    for (i = 0; i < len; ++i)
+        dstPtr[i] *= (1 - srcPtr[i]) * srcPtr[i];
+}
+
+void ApplyDSigmoidActMul(NMatrix *srcMat, int row, int col, NMatrix *dstMat) {
+    /* safety check */
+    if (trace & T_DIM) {
+        if (!(srcMat->colNum == col && dstMat->colNum == col))
+            HError(9999, "ApplyDSigmoidActMul: Input column number incompatible");
+        if (!(row > 0 && row <= srcMat->rowNum && row <= dstMat->rowNum))
+            HError(9999, "ApplyDSigmoidActMul: Input row number out of range");
+    }
+#ifdef CUDA
+    ApplyDSigmoidActCUDA(srcMat->devElems, row * col, srcMat->devElems);
+    MulNSegmentCUDA(srcMat->devElems, dstMat->devElems, row * col, dstMat->devElems);
+#else
+    nKern.dSigmoidActMul(srcMat->matElems, row * col, dstMat->matElems);
 #endif
 }
 
@@ -2932,11 +3016,7 @@ void ApplyTanHAct(NMatrix *srcMat, int row, int col, NMatrix *dstMat) {
 #ifdef CUDA
     ApplyTanHActCUDA(srcMat->devElems, row * col, dstMat->devElems);
 #else
-    #ifdef MKL
-    ApplyTanHActMKL(srcMat->matElems, row * col, dstMat->matElems);
-    #else
-    ApplyTanHActCPU(srcMat->matElems, row * col, dstMat->matElems);
-    #endif
+    nKern.tanHAct(srcMat->matElems, row * col, dstMat->matElems);
 #endif
 }
 
@@ -2974,11 +3054,30 @@ void ApplyDTanHAct(NMatrix *srcMat, int row, int col, NMatrix *dstMat) {
 #ifdef CUDA
     ApplyDTanHActCUDA(srcMat->devElems, row * col, dstMat->devElems);
 #else
-    #ifdef MKL
-    ApplyDTanHActMKL(srcMat->matElems, row * col, dstMat->matElems);
-    #else
-    ApplyDTanHActCPU(srcMat->matElems, row * col, dstMat->matElems);
-    #endif
+    nKern.dTanHAct(srcMat->matElems, row * col, dstMat->matElems);
+#endif
+}
+
+static inline void ApplyDTanHActMulCPU(NFloat *srcPtr, int len, NFloat *dstPtr) {
+    int i;
+
+    for (i = 0; i < len; ++i)
+        dstPtr[i] *= 1 - srcPtr[i] * srcPtr[i];
+}
+
+void ApplyDTanHActMul(NMatrix *srcMat, int row, int col, NMatrix *dstMat) {
+    /* safety check */
+    if (trace & T_DIM) {
+        if (!(srcMat->colNum == col && dstMat->colNum == col))
+            HError(9999, "ApplyDTanHActMul: Input column number incompatible");
+        if (!(row > 0 && row <= srcMat->rowNum && row <= dstMat->rowNum))
+            HError(9999, "ApplyDTanHActMul: Input row number out of range");
+    }
+#ifdef CUDA
+    ApplyDTanHActCUDA(srcMat->devElems, row * col, srcMat->devElems);
+    MulNSegmentCUDA(srcMat->devElems, dstMat->devElems, row * col, dstMat->devElems);
+#else
+    nKern.dTanHActMul(srcMat->matElems, row * col, dstMat->matElems);
 #endif
 }
 
@@ -3043,11 +3142,7 @@ void ApplySoftmaxAct(NMatrix *srcMat, int row, int col, NMatrix *dstMat) {
 #ifdef CUDA
     ApplyRedSoftmaxActCUDA(srcMat->devElems, row, col, dstMat->devElems);
 #else
-    #ifdef MKL
-    ApplySoftmaxActMKL(srcMat->matElems, row, col, dstMat->matElems);
-    #else
-    ApplySoftmaxActCPU(srcMat->matElems, row, col, dstMat->matElems);
-    #endif
+    nKern.softmaxAct(srcMat->matElems, row, col, dstMat->matElems);
 #endif
 }
 
@@ -3070,7 +3165,7 @@ void ApplySoftSignAct(NMatrix *srcMat, int row, int col, NMatrix *dstMat) {
 #ifdef CUDA
     ApplySoftSignActCUDA(srcMat->devElems, row * col, dstMat->devElems);
 #else
-    ApplySoftSignActCPU(srcMat->matElems, row * col, dstMat->matElems);
+    nKern.softSignAct(srcMat->matElems, row * col, dstMat->matElems);
 #endif
 }
 
@@ -3170,7 +3265,7 @@ void ApplyLogTrans(NMatrix *srcMat, int row, int col, NMatrix *dstMat) {
 #ifdef CUDA
     ApplyLogTransCUDA(srcMat->devElems, row * col, dstMat->devElems);
 #else
-    ApplyLogTransCPU(srcMat->matElems, row * col, dstMat->matElems);
+    nKern.logTrans(srcMat->matElems, row * col, dstMat->matElems);
 #endif
 }
 
@@ -3182,7 +3277,7 @@ static inline void SumNMatrixByColCPU(NFloat *srcPtr, int row, int col, Boolean
     int i;
 
     if (accFlag == FALSE) {
-        memset(res_p, 0, row * col * sizeof(NFloat));
+        memset(res_p, 0, col * sizeof(NFloat));
     }
     while (res_p != res_end_b8p) {
         res_p[0] += in_p[0];
@@ -3230,7 +3325,7 @@ void SumNMatrixByCol(NMatrix *srcMat, int row, int col, Boolean accFlag, NVector
 #ifdef CUDA
     RedSumNMatrixByColCUDA(srcMat->devElems, row, col, accFlag, dstVec->devElems);
 #else
-    SumNMatrixByColCPU(srcMat->matElems, row, col, accFlag, dstVec->vecElems);
+    nKern.sumByCol(srcMat->matElems, row, col, accFlag, dstVec->vecElems);
 #endif
 
 }
@@ -3265,11 +3360,7 @@ void SquaredNMatrix(NMatrix *srcMat, int row, int col, NMatrix *dstMat) {
 #ifdef CUDA
     SquaredNSegmentCUDA(srcMat->devElems, row * col, dstMat->devElems);
 #else
-    #ifdef MKL
-    SquaredNSegmentMKL(srcMat->matElems, row * col, dstMat->matElems);
-    #else
-    SquaredNSegmentCPU(srcMat->matElems, row * col, dstMat->matElems);
-    #endif
+    nKern.squaredSeg(srcMat->matElems, row * col, dstMat->matElems);
 #endif 
 }
 
@@ -3283,11 +3374,7 @@ void SquaredNVector(NVector *srcVec, int len, NVector *dstVec) {
 #ifdef CUDA
     SquaredNSegmentCUDA(srcVec->devElems, len, dstVec->devElems);
 #else
-    #ifdef MKL
-    SquaredNSegmentMKL(srcVec->vecElems, len, dstVec->vecElems);
-    #else
-    SquaredNSegmentCPU(srcVec->vecElems, len, dstVec->vecElems);
-    #endif
+    nKern.squaredSeg(srcVec->vecElems, len, dstVec->vecElems);
 #endif 
 }
 
@@ -3308,7 +3395,7 @@ void CompAdaGradBias(NFloat eta, int K, NVector *ssgVec, NVector *nlrVec) {
 #ifdef CUDA
     CompAdaGradNSegmentCUDA(eta, K, nlrVec->vecLen, ssgVec->devElems, nlrVec->devElems);
 #else
-    CompAdaGradNSegmentCPU(eta, K, nlrVec->vecLen, ssgVec->vecElems, nlrVec->vecElems);
+    nKern.compAdaGradSeg(eta, K, nlrVec->vecLen, ssgVec->vecElems, nlrVec->vecElems);
 #endif
 }
 
@@ -3323,7 +3410,7 @@ void CompAdaGradWeight(NFloat eta, int K, NMatrix *ssgMat, NMatrix *nlrMat) {
 #ifdef CUDA
     CompAdaGradNSegmentCUDA(eta, K, nlrMat->rowNum * nlrMat->colNum, ssgMat->devElems, nlrMat->devElems);
 #else
-    CompAdaGradNSegmentCPU(eta, K, nlrMat->rowNum * nlrMat->colNum, ssgMat->matElems, nlrMat->matElems);
+    nKern.compAdaGradSeg(eta, K, nlrMat->rowNum * nlrMat->colNum, ssgMat->matElems, nlrMat->matElems);
 #endif
 }
 
@@ -3379,32 +3466,11 @@ void FindMaxElement(NMatrix *srcMat, int row, int col, IntVec resVec) {
         resVec[i + 1] = (int) tmpNMat->matElems[i];
     } 
 #else
-    FindMaxElementCPU(srcMat->matElems, row, col, resVec);
+    nKern.findMax(srcMat->matElems, row, col, resVec);
 #endif
     
 }
 
-static inline void HNBlasNNgemmCPU(int m, int n, int k, NFloat alpha, NFloat *A, NFloat *B, NFloat beta, NFloat *C) {
-    int i, j, l;
-
-    /*for (i = 0; i < m; ++i) {
-        for (l = 0; l < k; ++l) {
-            C[i * k + l] *= beta;
-            for (j = 0; j < n; ++j) {
-                C[i * k + l] += alpha * A[i * n + j] * B[j * k + l];
-            }
-        }
-    }*/
-    for (i = 0; i < n; ++i) {
-        for (j = 0; j < m; ++j) {
-            C[i * m + j] *= beta;
-            for (l = 0; l < k; ++l) {
-                C[i * m + j] += alpha * A[l * m + j] * B[i * k + l];
-            }
-        }
-    }
-}
-
 #ifdef MKL
 static inline void HNBlasNNgemmMKL(int m, int n, int k, NFloat alpha, NFloat *A, NFloat *B, NFloat beta, NFloat *C) {
     #ifdef DOUBLEANN
@@ -3429,34 +3495,10 @@ void HNBlasNNgemm(int m, int n, int k, NFloat alpha, NMatrix *A, NMatrix *B, NFl
 #ifdef CUDA
     HNBlasNNgemmCUDA(m, n, k, alpha, A->devElems, B->devElems, beta, C->devElems);
 #else
-    #ifdef MKL
-    HNBlasNNgemmMKL(m, n, k, alpha, A->matElems, B->matElems, beta, C->matElems);
-    #else
-    HNBlasNNgemmCPU(m, n, k, alpha, A->matElems, B->matElems, beta, C->matElems);
-    #endif
+    nKern.nnGemm(m, n, k, alpha, A->matElems, B->matElems, beta, C->matElems);
 #endif
 }
 
-static inline void HNBlasNTgemmCPU(int m, int n, int k, NFloat alpha, NFloat *A, NFloat *B, NFloat beta, NFloat *C) {
-    int i, j, l;
-    /*for (i = 0; i < m; ++i) {
-        for (l = 0; l < k; ++l) {
-            C[i * k + l] *= beta;
-            for (j = 0; j < n; ++j) {
-                C[i * k + l] += alpha * A[i * n + j] * B[l * n + j];
-            }
-        }
-    }*/
-    for (i = 0; i < n; ++i) {
-        for (j = 0; j < m; ++j) {
-            C[i * m + j] *= beta;
-            for (l = 0; l < k; ++l) {
-                C[i * m + j] += alpha * A[l * m + j] * B[l * n + i];
-            }
-        }
-    }
-}
-
 #ifdef MKL
 static inline void HNBlasNTgemmMKL(int m, int n, int k, NFloat alpha, NFloat *A, NFloat *B, NFloat beta, NFloat *C) {
     #ifdef DOUBLEANN
@@ -3481,28 +3523,11 @@ void HNBlasNTgemm(int m, int n, int k, NFloat alpha, NMatrix *A, NMatrix *B, NFl
 #ifdef CUDA
     HNBlasNTgemmCUDA(m, n, k, alpha, A->devElems, B->devElems, beta, C->devElems);
 #else
-    #ifdef MKL
-    HNBlasNTgemmMKL(m, n, k, alpha, A->matElems, B->matElems, beta, C->matElems);
-    #else
-    HNBlasNTgemmCPU(m, n, k, alpha, A->matElems, B->matElems, beta, C->matElems);
-    #endif
+    nKern.ntGemm(m, n, k, alpha, A->matElems, B->matElems, beta, C->matElems);
 #endif
 
 }
 
-static inline void HNBlasTNgemmCPU(int m, int n, int k, NFloat alpha, NFloat *A, NFloat *B, NFloat beta, NFloat *C) {
-    int i, j, l;
-
-    for (i = 0; i < n; ++i) {
-        for (j = 0; j < m; ++j) {
-            C[i * m + j] *= beta;
-            for (l = 0; l < k; ++l) {
-                C[i * m + j] += alpha * A[j * k + l] * B[i * k + l];
-            }
-        }
-    }
-}
-
 #ifdef MKL
 static inline void HNBlasTNgemmMKL(int m, int n, int k, NFloat alpha, NFloat *A, NFloat *B, NFloat beta, NFloat *C) {
     #ifdef DOUBLEANN
@@ -3527,13 +3552,98 @@ void HNBlasTNgemm(int m, int n, int k, NFloat alpha, NMatrix *A, NMatrix *B, NFl
 #ifdef CUDA
     HNBlasTNgemmCUDA(m, n, k, alpha, A->devElems, B->devElems, beta, C->devElems);
 #else
-    #ifdef MKL
-    HNBlasTNgemmMKL(m, n, k, alpha, A->matElems, B->matElems, beta, C->matElems);
-    #else
-    HNBlasTNgemmCPU(m, n, k, alpha, A->matElems, B->matElems, beta, C->matElems);
-    #endif
+    nKern.tnGemm(m, n, k, alpha, A->matElems, B->matElems, beta, C->matElems);
+#endif
+
+}
+
+/* the unfused reference: C = bias, C += A^T * B, then the activation pass */
+static void HNBlasTNgemmBiasActCPU(int m, int n, int k, NFloat *A, NFloat *B, NFloat *bias, NSegFunc act, NRowFunc rowAct, NFloat *C) {
+    DupNSegmentCPU(bias, m, C, n);
+    HNBlasTNgemmRef(m, n, k, 1.0, A, B, 1.0, C);
+    if (act != NULL)
+        act(C, m * n, C);
+    if (rowAct != NULL)
+        rowAct(C, n, m, C);
+}
+
+#ifdef MKL
+static void HNBlasTNgemmBiasActMKL(int m, int n, int k, NFloat *A, NFloat *B, NFloat *bias, NSegFunc act, NRowFunc rowAct, NFloat *C) {
+    DupNSegmentMKL(bias, m, C, n);
+    HNBlasTNgemmMKL(m, n, k, 1.0, A, B, 1.0, C);
+    if (act != NULL)
+        act(C, m * n, C);
+    if (rowAct != NULL)
+        rowAct(C, n, m, C);
+}
+#endif
+
+/* C[m * n] = act(A[k * m]^T * B[k * n] + bias) */
+void HNBlasTNgemmBiasAct(int m, int n, int k, NMatrix *A, NMatrix *B, NVector *bias, NActKind actKind, NMatrix *C) {
+#ifndef CUDA
+    NSegFunc act = NULL;
+    NRowFunc rowAct = NULL;
 #endif
 
+    /* safety check */
+    if (trace & T_DIM) {
+        if (!(m > 0 && m <= A->rowNum && m == C->colNum && m <= bias->vecLen))
+            HError(9999, "HNBlasTNgemmBiasAct: First input dimension out of range");
+        if (!(n > 0 && n <= B->rowNum && n <= C->rowNum))
+            HError(9999, "HNBlasTNgemmBiasAct: Second input dimension out of range");
+        if (!(k > 0 && k <= A->colNum && k <= B->colNum))
+            HError(9999, "HNBlasTNgemmBiasAct: Third input dimension out of range");
+    }
+#ifdef CUDA
+    DupNSegmentCUDA(bias->devElems, m, C->devElems, n);
+    HNBlasTNgemmCUDA(m, n, k, 1.0, A->devElems, B->devElems, 1.0, C->devElems);
+    switch (actKind) {
+        case NLINEARACT:
+            break;
+        case NRELACT:
+            ApplyReLActCUDA(C->devElems, m * n, C->devElems);
+            break;
+        case NSIGMOIDACT:
+            ApplySigmoidActCUDA(C->devElems, m * n, C->devElems);
+            break;
+        case NSOFTMAXACT:
+            ApplyRedSoftmaxActCUDA(C->devElems, n, m, C->devElems);
+            break;
+        case NSOFTRELACT:
+            ApplySoftReLActCUDA(C->devElems, m * n, C->devElems);
+            break;
+        case NSOFTSIGNACT:
+            ApplySoftSignActCUDA(C->devElems, m * n, C->devElems);
+            break;
+        case NTANHACT:
+            ApplyTanHActCUDA(C->devElems, m * n, C->devElems);
+            break;
+    }
+#else
+    switch (actKind) {
+        case NLINEARACT:
+            break;
+        case NRELACT:
+            act = nKern.reLAct;
+            break;
+        case NSIGMOIDACT:
+            act = nKern.sigmoidAct;
+            break;
+        case NSOFTMAXACT:
+            rowAct = nKern.softmaxAct;
+            break;
+        case NSOFTRELACT:
+            act = nKern.softReLAct;
+            break;
+        case NSOFTSIGNACT:
+            act = nKern.softSignAct;
+            break;
+        case NTANHACT:
+            act = nKern.tanHAct;
+            break;
+    }
+    nKern.tnGemmBiasAct(m, n, k, A->matElems, B->matElems, bias->vecElems, act, rowAct, C->matElems);
+#endif
 }
 
 void SetNSegmentCPU(NFloat val, NFloat *segPtr, int segLen) {
@@ -3547,7 +3657,7 @@ void SetNVector(NFloat val, NVector *vec) {
 #ifdef CUDA
     SetNSegmentCUDA(val, vec->devElems, vec->vecLen);
 #else
-    SetNSegmentCPU(val, vec->vecElems, vec->vecLen);
+    nKern.setSeg(val, vec->vecElems, vec->vecLen);
 #endif
 }
 
@@ -3558,7 +3668,7 @@ void SetNMatrix(NFloat val, NMatrix *mat, int nrows) {
 #ifdef CUDA
     SetNSegmentCUDA(val, mat->devElems, len);
 #else
-    SetNSegmentCPU(val, mat->matElems, len);
+    nKern.setSeg(val, mat->matElems, len);
 #endif
 }
 
@@ -3567,7 +3677,7 @@ void SetNMatrixSegment(NFloat val, NMatrix *mat, int off, int len) {
 #ifdef CUDA
     SetNSegmentCUDA(val, mat->devElems + off, len);
 #else
-    SetNSegmentCPU(val, mat->matElems + off, len);
+    nKern.setSeg(val, mat->matElems + off, len);
 #endif
 }
 
@@ -3575,7 +3685,7 @@ void SetNVectorSegment(NFloat val, NVector *vec, int off, int len) {
 #ifdef CUDA
     SetNSegmentCUDA(val, vec->devElems + off, len);
 #else
-    SetNSegmentCPU(val, vec->vecElems + off, len);
+    nKern.setSeg(val, vec->vecElems + off, len);
 #endif
 }
 
@@ -3588,7 +3698,7 @@ void ClearNVector(NVector *vec) {
 #ifdef CUDA
     ClearNSegmentCUDA(vec->devElems, vec->vecLen);
 #else
-    ClearNSegmentCPU(vec->vecElems, vec->vecLen);
+    nKern.clearSeg(vec->vecElems, vec->vecLen);
 #endif
 }
 
@@ -3599,7 +3709,7 @@ void ClearNMatrix(NMatrix *mat, int nrows) {
 #ifdef CUDA
     ClearNSegmentCUDA(mat->devElems, len);
 #else
-    ClearNSegmentCPU(mat->matElems, len);
+    nKern.clearSeg(mat->matElems, len);
 #endif
 }
 
@@ -3608,7 +3718,7 @@ void ClearNMatrixSegment(NMatrix *mat, int off, int len) {
 #ifdef CUDA
     ClearNSegmentCUDA(mat->devElems + off, len);
 #else
-    ClearNSegmentCPU(mat->matElems + off, len);
+    nKern.clearSeg(mat->matElems + off, len);
 #endif
 }
 
@@ -3617,7 +3727,7 @@ void ClearNVectorSegment(NVector *vec, int off, int len) {
 #ifdef CUDA
     ClearNSegmentCUDA(vec->devElems + off, len);
 #else
-    ClearNSegmentCPU(vec->vecElems + off, len);
+    nKern.clearSeg(vec->vecElems + off, len);
 #endif
 }
 
@@ -3827,11 +3937,7 @@ void AddNVectorTargetPen(NMatrix *srcMat, NVector *penVec, int nrows, NMatrix *d
 #ifdef CUDA
     AddNSegmentTargetPenCUDA(srcMat->devElems, penVec->devElems, nrows, penVec->vecLen, dstMat->devElems);
 #else
-    #ifdef MKL
-    AddNSegmentTargetPenMKL(srcMat->matElems, penVec->vecElems, nrows, penVec->vecLen, dstMat->matElems);
-    #else
-    AddNSegmentTargetPenCPU(srcMat->matElems, penVec->vecElems, nrows, penVec->vecLen, dstMat->matElems);
-    #endif
+    nKern.addTargetPen(srcMat->matElems, penVec->vecElems, nrows, penVec->vecLen, dstMat->matElems);
 #endif
 }
 
@@ -3856,7 +3962,7 @@ void ShiftNMatrixVals(NMatrix *srcMat, int row, int col, NFloat shiftVal, NMatri
 #ifdef CUDA
     ShiftNSegmentValsCUDA(srcMat->devElems, row * col, shiftVal, dstMat->devElems);
 #else
-    ShiftNSegmentValsCPU(srcMat->matElems, row * col, shiftVal, dstMat->matElems);
+    nKern.shiftSeg(srcMat->matElems, row * col, shiftVal, dstMat->matElems);
 #endif
 }
 
@@ -3871,7 +3977,7 @@ void ShiftNVectorVals(NVector *srcVec, int len, NFloat shiftVal, NVector *dstVec
 #ifdef CUDA
     ShiftNSegmentValsCUDA(srcVec->devElems, len, shiftVal, dstVec->devElems);
 #else
-    ShiftNSegmentValsCPU(srcVec->vecElems, len, shiftVal, dstVec->vecElems);
+    nKern.shiftSeg(srcVec->vecElems, len, shiftVal, dstVec->vecElems);
 #endif
 }
 
@@ -3893,7 +3999,7 @@ void CopyPartialNSegment(int minRow, int minCol, NFloat *srcPtr, int srcCol, NFl
 #ifdef CUDA
     CopyPartialNSegmentCUDA(minRow, minCol, srcPtr, srcCol, dstPtr, dstCol);
 #else
-    CopyPartialNSegmentCPU(minRow, minCol, srcPtr, srcCol, dstPtr, dstCol);
+    nKern.copyPartialSeg(minRow, minCol, srcPtr, srcCol, dstPtr, dstCol);
 #endif
 }
 
@@ -3924,8 +4030,8 @@ void ClipNMatrixVals(NMatrix* srcMat, int row, int col, NFloat upperLim, NFloat
     }
 #ifdef CUDA
     ClipNSegmentValsCUDA(srcMat->devElems, row * col, upperLim, lowerLim, dstMat->devElems);
-#else 
-    ClipNSegmentValsCPU(srcMat->matElems, row * col, upperLim, lowerLim, dstMat->matElems);
+#else
+    nKern.clipSeg(srcMat->matElems, row * col, upperLim, lowerLim, dstMat->matElems);
 #endif
 
 }
@@ -3942,7 +4048,7 @@ void ClipNVectorVals(NVector* srcVec, int len, NFloat upperLim, NFloat lowerLim,
 #ifdef CUDA
     ClipNSegmentValsCUDA(srcVec->devElems, len, upperLim, lowerLim, dstVec->devElems);
 #else
-    ClipNSegmentValsCPU(srcVec->vecElems, len, upperLim, lowerLim, dstVec->vecElems);
+    nKern.clipSeg(srcVec->vecElems, len, upperLim, lowerLim, dstVec->vecElems);
 #endif
 
 }
@@ -3978,10 +4084,216 @@ void CalExtNMatrixL2Norm(NMatrix *srcMat, NVector *srcVec, NFloat *alpha) {
     SyncNMatrixDev2Host(tmpNMat); 
     *alpha = tmpNMat->matElems[0];
 #else
-    CalExtNMatrixL2NormCPU(srcMat->matElems, srcVec->vecElems, srcMat->rowNum, srcMat->colNum, alpha);
+    nKern.l2Norm(srcMat->matElems, srcVec->vecElems, srcMat->rowNum, srcMat->colNum, alpha);
 #endif
 }
 
 
 
+/* ------------------------- NMatrix Kernel Sets ------------------------- */
+
+/* the backends, in the order of NKERNSET=AUTO preference after MKL */
+static char *nKernBackends[] = {"REF", "CPU", "SSE", "AVX2", "AVX512", "MKL", NULL};
+
+/* the kernel names used by NKERNOVERRIDE and their places in NKernSet */
+typedef struct _NKernEntry {
+    char *name;
+    size_t off;
+} NKernEntry;
+
+#define NKERNENTRY(name, field) {name, offsetof(NKernSet, field)}
+static NKernEntry nKernEntries[] = {
+    NKERNENTRY("COPYSEG", copySeg),
+    NKERNENTRY("ADDSEG", addSeg),
+    NKERNENTRY("ADDSCALEDSEG", addScaledSeg),
+    NKERNENTRY("SCALESEG", scaleSeg),
+    NKERNENTRY("SCALEDSELFADDSEG", scaledSelfAddSeg),
+    NKERNENTRY("DUPSEG", dupSeg),
+    NKERNENTRY("SUBSEG", subSeg),
+    NKERNENTRY("MULSEG", mulSeg),
+    NKERNENTRY("RELACT", reLAct),
+    NKERNENTRY("DRELACT", dReLAct),
+    NKERNENTRY("DRELACTMUL", dReLActMul),
+    NKERNENTRY("DLINEARACT", dLinearAct),
+    NKERNENTRY("SOFTRELACT", softReLAct),
+    NKERNENTRY("DSOFTRELACT", dSoftReLAct),
+    NKERNENTRY("DSOFTRELACTMUL", dSoftReLActMul),
+    NKERNENTRY("SIGMOIDACT", sigmoidAct),
+    NKERNENTRY("DSIGMOIDACT", dSigmoidAct),
+    NKERNENTRY("DSIGMOIDACTMUL", dSigmoidActMul),
+    NKERNENTRY("TANHACT", tanHAct),
+    NKERNENTRY("DTANHACT", dTanHAct),
+    NKERNENTRY("DTANHACTMUL", dTanHActMul),
+    NKERNENTRY("SOFTMAXACT", softmaxAct),
+    NKERNENTRY("SOFTSIGNACT", softSignAct),
+    NKERNENTRY("LOGTRANS", logTrans),
+    NKERNENTRY("SUMBYCOL", sumByCol),
+    NKERNENTRY("SQUAREDSEG", squaredSeg),
+    NKERNENTRY("COMPADAGRADSEG", compAdaGradSeg),
+    NKERNENTRY("FINDMAX", findMax),
+    NKERNENTRY("NNGEMM", nnGemm),
+    NKERNENTRY("NTGEMM", ntGemm),
+    NKERNENTRY("TNGEMM", tnGemm),
+    NKERNENTRY("TNGEMMBIASACT", tnGemmBiasAct),
+    NKERNENTRY("SETSEG", setSeg),
+    NKERNENTRY("CLEARSEG", clearSeg),
+    NKERNENTRY("ADDTARGETPEN", addTargetPen),
+    NKERNENTRY("SHIFTSEG", shiftSeg),
+    NKERNENTRY("COPYPARTIALSEG", copyPartialSeg),
+    NKERNENTRY("CLIPSEG", clipSeg),
+    NKERNENTRY("L2NORM", l2Norm),
+    {NULL, 0}
+};
+
+/* the plain C kernels, which the other backends start from */
+static void LoadRefNKernSet(NKernSet *kset) {
+    kset->copySeg = CopyNSegmentCPU;
+    kset->addSeg = AddNSegmentCPU;
+    kset->addScaledSeg = AddScaledNSegmentCPU;
+    kset->scaleSeg = ScaleNSegmentCPU;
+    kset->scaledSelfAddSeg = ScaledSelfAddNSegmentCPU;
+    kset->dupSeg = DupNSegmentCPU;
+    kset->subSeg = SubNSegmentCPU;
+    kset->mulSeg = MulNSegmentCPU;
+    kset->reLAct = ApplyReLActCPU;
+    kset->dReLAct = ApplyDReLActCPU;
+    kset->dReLActMul = ApplyDReLActMulCPU;
+    kset->dLinearAct = ApplyDLinearActCPU;
+    kset->softReLAct = ApplySoftReLActCPU;
+    kset->dSoftReLAct = ApplyDSoftReLActCPU;
+    kset->dSoftReLActMul = ApplyDSoftReLActMulCPU;
+    kset->sigmoidAct = ApplySigmoidActCPU;
+    kset->dSigmoidAct = ApplyDSigmoidActCPU;
+    kset->dSigmoidActMul = ApplyDSigmoidActMulCPU;
+    kset->tanHAct = ApplyTanHActCPU;
+    kset->dTanHAct = ApplyDTanHActCPU;
+    kset->dTanHActMul = ApplyDTanHActMulCPU;
+    kset->softmaxAct = ApplySoftmaxActCPU;
+    kset->softSignAct = ApplySoftSignActCPU;
+    kset->logTrans = ApplyLogTransCPU;
+    kset->sumByCol = SumNMatrixByColCPU;
+    kset->squaredSeg = SquaredNSegmentCPU;
+    kset->compAdaGradSeg = CompAdaGradNSegmentCPU;
+    kset->findMax = FindMaxElementCPU;
+    kset->nnGemm = HNBlasNNgemmRef;
+    kset->ntGemm = HNBlasNTgemmRef;
+    kset->tnGemm = HNBlasTNgemmRef;
+    kset->tnGemmBiasAct = HNBlasTNgemmBiasActCPU;
+    kset->setSeg = SetNSegmentCPU;
+    kset->clearSeg = ClearNSegmentCPU;
+    kset->addTargetPen = AddNSegmentTargetPenCPU;
+    kset->shiftSeg = ShiftNSegmentValsCPU;
+    kset->copyPartialSeg = CopyPartialNSegmentCPU;
+    kset->clipSeg = ClipNSegmentValsCPU;
+    kset->l2Norm = CalExtNMatrixL2NormCPU;
+}
+
+#ifdef MKL
+static void LoadMKLNKernSet(NKernSet *kset) {
+    kset->copySeg = CopyNSegmentMKL;
+    kset->addSeg = AddNSegmentMKL;
+    kset->addScaledSeg = AddScaledNSegmentMKL;
+    kset->scaleSeg = ScaleNSegmentMKL;
+    kset->scaledSelfAddSeg = ScaledSelfAddNSegmentMKL;
+    kset->dupSeg = DupNSegmentMKL;
+    kset->subSeg = SubNSegmentMKL;
+    kset->mulSeg = MulNSegmentMKL;
+    kset->squaredSeg = SquaredNSegmentMKL;
+    kset->nnGemm = HNBlasNNgemmMKL;
+    kset->ntGemm = HNBlasNTgemmMKL;
+    kset->tnGemm = HNBlasTNgemmMKL;
+    kset->tnGemmBiasAct = HNBlasTNgemmBiasActMKL;
+    kset->addTargetPen = AddNSegmentTargetPenMKL;
+}
+#endif
+
+/* EXPORT->LoadNKernSet: fill kset with the kernels of the named backend */
+Boolean LoadNKernSet(char *backend, NKernSet *kset) {
+    int i;
+    Boolean ok = TRUE;
+    NKernSet newSet;
+
+    if (strcmp(backend, "AUTO") == 0) {
+#ifdef MKL
+        backend = "MKL";
+#else
+        backend = (DetectCPUSIMDKind() == CPUSIMDNONE)? "CPU": CPUSIMDKind2Str(DetectCPUSIMDKind());
+#endif
+    }
+    for (i = 0; nKernBackends[i] != NULL; ++i) {
+        if (strcmp(backend, nKernBackends[i]) == 0)
+            break;
+    }
+    if (nKernBackends[i] == NULL)
+        return FALSE;
+    LoadRefNKernSet(&newSet);
+    newSet.name = nKernBackends[i];
+    if (strcmp(newSet.name, "CPU") == 0)
+        ok = LoadCPUNKernSet(CPUSIMDNONE, &newSet);
+    else if (strcmp(newSet.name, "SSE") == 0)
+        ok = LoadCPUNKernSet(CPUSIMDSSE, &newSet);
+    else if (strcmp(newSet.name, "AVX2") == 0)
+        ok = LoadCPUNKernSet(CPUSIMDAVX2, &newSet);
+    else if (strcmp(newSet.name, "AVX512") == 0)
+        ok = LoadCPUNKernSet(CPUSIMDAVX512, &newSet);
+    else if (strcmp(newSet.name, "MKL") == 0) {
+#ifdef MKL
+        /* the single pass SIMD activations are faster than the VML ones */
+        LoadCPUNKernSet(DetectCPUSIMDKind(), &newSet);
+        LoadMKLNKernSet(&newSet);
+#else
+        ok = FALSE;
+#endif
+    }
+    if (ok)
+        *kset = newSet;
+    return ok;
+}
+
+/* EXPORT->SelectNKernSet: use the named backend for the NMatrix routines */
+void SelectNKernSet(char *backend) {
+    if (!LoadNKernSet(backend, &nKern))
+        HError(9999, "SelectNKernSet: Kernel set %s is unknown or not supported", backend);
+    if (trace & T_KERN)
+        printf("NMatrix kernel set: %s\n", nKern.name);
+}
+
+/* EXPORT->GetNKernSet: the table used by the NMatrix routines */
+NKernSet *GetNKernSet(void) {
+    return &nKern;
+}
+
+/* EXPORT->OverrideNKern: take a single kernel from another backend */
+Boolean OverrideNKern(char *kern, char *backend) {
+    int i;
+    NKernSet srcSet;
+
+    for (i = 0; nKernEntries[i].name != NULL; ++i) {
+        if (strcmp(kern, nKernEntries[i].name) == 0)
+            break;
+    }
+    if (nKernEntries[i].name == NULL || !LoadNKernSet(backend, &srcSet))
+        return FALSE;
+    /* all the entries are function pointers */
+    memcpy((char *) &nKern + nKernEntries[i].off, (char *) &srcSet + nKernEntries[i].off, sizeof(NGemmFunc));
+    if (trace & T_KERN)
+        printf("NMatrix kernel %s: %s\n", kern, srcSet.name);
+    return TRUE;
+}
+
+/* apply a comma separated list of KERN=BACKEND overrides */
+static void SetNKernOverrides(char *spec) {
+    char buf[MAXSTRLEN], *tok, *eq;
+
+    strcpy(buf, spec);
+    for (tok = strtok(buf, ","); tok != NULL; tok = strtok(NULL, ",")) {
+        eq = strchr(tok, '=');
+        if (eq == NULL)
+            HError(9999, "SetNKernOverrides: KERN=BACKEND expected in NKERNOVERRIDE, got %s", tok);
+        *eq = '\0';
+        if (!OverrideNKern(tok, eq + 1))
+            HError(9999, "SetNKernOverrides: Cannot take kernel %s from kernel set %s", tok, eq + 1);
+    }
+}
+
 /* ------------------------- End of HMath.c ------------------------- */
@@ -263,6 +263,19 @@ float RandomValue(void);
    Return a random number in range 0.0->1.0 with uniform distribution
 */
 
+typedef struct {
+   unsigned short x[3];
+} RandState;
+
+void RandInitState(RandState *rs, int seed);
+float RandomStateValue(RandState *rs);
+/*
+   As RandInit and RandomValue, but with the generator state held in
+   rs so that several threads can draw their own sequences.  After
+   RandInitState(rs,seed) the values are those RandomValue returns
+   after RandInit(seed).
+*/
+
 float GaussDeviate(float mu, float sigma);
 /*
    Return a random number with a N(mu,sigma) distribution
@@ -275,6 +288,89 @@ float CumGauss(float x, float mean, float var);
 /* cz277 - ANN */
 /* --------------------- ANN related math kernels --------------------- */
 
+/* the host memory kernels behind the NMatrix routines below; the
+   backends ("CPU", "SSE", "AVX2", "AVX512" and, when built with it,
+   "MKL") each fill in such a table, and the one in use is chosen
+   at run time by the HMATH configuration variable NKERNSET, which
+   defaults to "AUTO", i.e. MKL if available, otherwise the widest
+   SIMD set supported by the processor.  NKERNOVERRIDE takes a comma
+   separated list of KERN=BACKEND pairs, e.g. "SIGMOIDACT=CPU", to
+   replace single kernels, mainly for benchmarking.  When CUDA is
+   in use the routines work on the device memory and the table is
+   not used. */
+typedef void (*NSegFunc)(NFloat *srcPtr, int segLen, NFloat *dstPtr);
+typedef void (*NGemmFunc)(int m, int n, int k, NFloat alpha, NFloat *A, NFloat *B, NFloat beta, NFloat *C);
+typedef void (*NRowFunc)(NFloat *srcPtr, int row, int col, NFloat *dstPtr);
+/* C[m * n] = act(A[k * m]^T * B[k * n] + bias), act being either the
+   element-wise act or the row-wise rowAct (or neither) */
+typedef void (*NGemmBiasActFunc)(int m, int n, int k, NFloat *A, NFloat *B, NFloat *bias, NSegFunc act, NRowFunc rowAct, NFloat *C);
+
+typedef struct _NKernSet {
+    char *name;                         /* the backend the table was loaded from */
+    NSegFunc copySeg;
+    NSegFunc addSeg;
+    void (*addScaledSeg)(NFloat *srcPtr, int segLen, NFloat scale, NFloat *dstPtr);
+    void (*scaleSeg)(int segLen, NFloat scale, NFloat *valPtr);
+    void (*scaledSelfAddSeg)(NFloat *rhPtr, int segLen, NFloat scale, NFloat *lhPtr);
+    void (*dupSeg)(NFloat *srcPtr, int segLen, NFloat *dstPtr, int times);
+    void (*subSeg)(NFloat *lhPtr, NFloat *rhPtr, int segLen, NFloat *resPtr);
+    void (*mulSeg)(NFloat *lhPtr, NFloat *rhPtr, int segLen, NFloat *resPtr);
+    NSegFunc reLAct;
+    NSegFunc dReLAct;
+    NSegFunc dReLActMul;
+    NSegFunc dLinearAct;
+    NSegFunc softReLAct;
+    NSegFunc dSoftReLAct;
+    NSegFunc dSoftReLActMul;
+    NSegFunc sigmoidAct;
+    NSegFunc dSigmoidAct;
+    NSegFunc dSigmoidActMul;
+    NSegFunc tanHAct;
+    NSegFunc dTanHAct;
+    NSegFunc dTanHActMul;
+    NRowFunc softmaxAct;
+    NSegFunc softSignAct;
+    NSegFunc logTrans;
+    void (*sumByCol)(NFloat *srcPtr, int row, int col, Boolean accFlag, NFloat *dstPtr);
+    NSegFunc squaredSeg;
+    void (*compAdaGradSeg)(NFloat eta, int K, int segLen, NFloat *ssgSeg, NFloat *nlrSeg);
+    void (*findMax)(NFloat *srcPtr, int row, int col, IntVec resVec);
+    NGemmFunc nnGemm;
+    NGemmFunc ntGemm;
+    NGemmFunc tnGemm;
+    NGemmBiasActFunc tnGemmBiasAct;
+    void (*setSeg)(NFloat val, NFloat *segPtr, int segLen);
+    void (*clearSeg)(NFloat *segPtr, int segLen);
+    void (*addTargetPen)(NFloat *srcSeg, NFloat *penSeg, int row, int col, NFloat *dstSeg);
+    void (*shiftSeg)(NFloat *srcSeg, int segLen, NFloat shiftVal, NFloat *dstSeg);
+    void (*copyPartialSeg)(int minRow, int minCol, NFloat *srcPtr, int srcCol, NFloat *dstPtr, int dstCol);
+    void (*clipSeg)(NFloat *srcSeg, int len, NFloat upperLim, NFloat lowerLim, NFloat *dstSeg);
+    void (*l2Norm)(NFloat *matPtr, NFloat *biasPtr, int row, int col, NFloat *alpha);
+} NKernSet;
+
+Boolean LoadNKernSet(char *backend, NKernSet *kset);
+/*
+   Fill kset with the kernels of the named backend; returns FALSE
+   if the backend is unknown, or not supported by the processor or
+   by this build
+*/
+
+void SelectNKernSet(char *backend);
+/*
+   Make the named backend the one used by the NMatrix routines
+*/
+
+NKernSet *GetNKernSet(void);
+/*
+   Return the table in use; its entries may be replaced directly
+*/
+
+Boolean OverrideNKern(char *kern, char *backend);
+/*
+   Replace a single kernel of the table in use, named as in
+   NKERNOVERRIDE, by the one of another backend
+*/
+
 void RegisterTmpNMat(int nrows, int ncols);
 void CreateTmpNMat(MemHeap *heap);
 NMatrix *GetTmpNMat(void);
@@ -283,6 +379,13 @@ void FreeTmpNMat(MemHeap *heap);
 void CopyNSegment(NMatrix *srcMat, int srcOff, int segLen, NMatrix *dstMat, int dstOff);
 void CopyNVectorSegment(NVector *srcVec, int srcOff, int segLen, NVector *dstVec, int dstOff);
 void AddNSegment(NMatrix *srcMat, int srcOff, int segLen, NMatrix *dstMat, int dstOff);
+void CopyNSegmentStrided(NMatrix *srcMat, int srcOff, int srcStride, int segLen, int segNum, NMatrix *dstMat, int dstOff, int dstStride);
+void AddNSegmentStrided(NMatrix *srcMat, int srcOff, int srcStride, int segLen, int segNum, NMatrix *dstMat, int dstOff, int dstStride);
+/*
+   Copy (or add) segNum segments of segLen elements, the i-th starting
+   at srcOff + i * srcStride, to dstOff + i * dstStride, e.g. a block
+   of columns for every sample of a batch in a single call
+*/
 void AddNMatrix(NMatrix *srcMat, int row, int col, NMatrix *dstMat);
 void AddNVector(NVector *srcVec, int len, NVector *dstVec);
 void DupNVector(NVector *srcVec, NMatrix *dstMat, int times);
@@ -312,11 +415,31 @@ void ApplyDSoftmaxAct(NMatrix *srcMat, int row, int col, NMatrix *dstMat);
 void ApplySoftReLAct(NMatrix *srcMat, int row, int col, NMatrix *dstMat);
 void ApplyDSoftReLAct(NMatrix *srcMat, int row, int col, NMatrix *dstMat);
 void ApplySoftSignAct(NMatrix *srcMat, int row, int col, NMatrix *dstMat);
+/* the back-propagation of an activation in one pass: dstMat *= f'(srcMat),
+   where srcMat holds the activation outputs; with CUDA, srcMat is
+   overwritten by the derivatives */
+void ApplyDReLActMul(NMatrix *srcMat, int row, int col, NMatrix *dstMat);
+void ApplyDSigmoidActMul(NMatrix *srcMat, int row, int col, NMatrix *dstMat);
+void ApplyDTanHActMul(NMatrix *srcMat, int row, int col, NMatrix *dstMat);
+void ApplyDSoftReLActMul(NMatrix *srcMat, int row, int col, NMatrix *dstMat);
 void ApplyLogTrans(NMatrix *srcMat, int row, int col, NMatrix *dstMat);
 void FindMaxElement(NMatrix *srcMat, int row, int col, IntVec resVec);
 void HNBlasNNgemm(int m, int n, int k, NFloat alpha, NMatrix *A, NMatrix *B, NFloat beta, NMatrix *C);
 void HNBlasNTgemm(int m, int n, int k, NFloat alpha, NMatrix *A, NMatrix *B, NFloat beta, NMatrix *C);
 void HNBlasTNgemm(int m, int n, int k, NFloat alpha, NMatrix *A, NMatrix *B, NFloat beta, NMatrix *C);
+
+/* the activations HNBlasTNgemmBiasAct can apply */
+typedef enum _NActKind {
+    NLINEARACT, NRELACT, NSIGMOIDACT, NSOFTMAXACT, NSOFTRELACT, NSOFTSIGNACT, NTANHACT
+} NActKind;
+
+void HNBlasTNgemmBiasAct(int m, int n, int k, NMatrix *A, NMatrix *B, NVector *bias, NActKind actKind, NMatrix *C);
+/*
+   C[m * n] = act(A[k * m]^T * B[k * n] + bias), i.e. the forward pass of
+   an affine layer of m nodes on a batch of n samples; the host kernel
+   sets add the bias and apply the activation to each output tile as
+   soon as it is complete, rather than in separate passes over C
+*/
 /*void SetNSegment(NFloat val, NFloat *segPtr, int segLen);*/
 void RandNSegment(NFloat lower, NFloat upper, int segLen, NFloat *segPtr);
 /* cz277 - 0 mask */
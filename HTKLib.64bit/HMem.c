@@ -28,6 +28,8 @@ char *hmem_vc_id = "$Id: HMem.c,v 1.1.1.1 2006/10/11 09:54:58 jal58 Exp $";
 #include "cfgs.h"
 #include "HMath.h"
 
+#include <pthread.h>
+
 int debug_level = 0;               /* For esps linking */
 
 /* cz277 - ANN */
@@ -78,6 +80,8 @@ typedef struct _MemHeapRec {
 } MemHeapRec;
 
 static MemHeapRec *heapList = NULL;
+/* Heaps may be created and deleted by several threads */
+static pthread_mutex_t heapListLock = PTHREAD_MUTEX_INITIALIZER;
 
 /* RecordHeap: add given heap to list */
 static void RecordHeap(MemHeap *x)
@@ -86,8 +90,10 @@ static void RecordHeap(MemHeap *x)
    
    if ((p=(MemHeapRec *)malloc(sizeof(MemHeapRec))) == NULL)
       HError(5105,"RecordHeap: Cannot allocate memory for MemHeapRec");
+   pthread_mutex_lock(&heapListLock);
    p->heap = x; p->next = heapList;
    heapList = p;
+   pthread_mutex_unlock(&heapListLock);
 }
 
 /* UnRecordHeap: remove given heap from list */
@@ -95,6 +101,7 @@ static void UnRecordHeap(MemHeap *x)
 {
    MemHeapRec *p, *q;
    
+   pthread_mutex_lock(&heapListLock);
    p = heapList; q = NULL;
    while (p != NULL && p->heap != x){
       q = p;
@@ -106,6 +113,7 @@ static void UnRecordHeap(MemHeap *x)
       heapList = p->next;
    else
       q->next = p->next;
+   pthread_mutex_unlock(&heapListLock);
    free(p);
 }
 
@@ -357,8 +365,9 @@ void *New(MemHeap *x,size_t size)
       q = malloc(size+chdr);
       if (q==NULL)
          HError(5105,"New: memory exhausted");
-      x->totUsed += size; 
-      x->totAlloc += size+chdr;
+      /* C heaps such as gcheap are shared by all threads */
+      __atomic_add_fetch(&x->totUsed,size,__ATOMIC_RELAXED); 
+      __atomic_add_fetch(&x->totAlloc,size+chdr,__ATOMIC_RELAXED);
       ip = (size_t *)q; *ip = size;
       if (trace&T_CHP)
          printf("HMem: %s[C] %u+%u bytes at %p allocated\n",x->name,chdr,size,q);
@@ -419,7 +428,7 @@ void Dispose(MemHeap *x, void *p)
    size_t num,index, *ip;
    Ptr *pp;
    
-   if (x->totUsed == 0)
+   if (__atomic_load_n(&x->totUsed,__ATOMIC_RELAXED) == 0)
       HError(5105,"Dispose: heap %s is empty",x->name);
    switch(x->type){
    case MHEAP:
@@ -497,7 +506,8 @@ void Dispose(MemHeap *x, void *p)
       chdr = MRound(sizeof(size_t));
       bp = (ByteP)p-chdr;
       ip = (size_t *)bp;
-      x->totAlloc -= (*ip + chdr); x->totUsed -= *ip;
+      __atomic_sub_fetch(&x->totAlloc,*ip+chdr,__ATOMIC_RELAXED);
+      __atomic_sub_fetch(&x->totUsed,*ip,__ATOMIC_RELAXED);
       if (trace&T_CHP)
          printf("HMem: %s[C] %u+%u bytes at %p de-allocated\n",
                 x->name,chdr,*ip,bp);
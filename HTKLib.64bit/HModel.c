@@ -201,6 +201,8 @@ void InitANNSet(HMMSet *hset) {
     for (i = 1; i < SMAX; ++i) {
         hset->annSet->penVec[i] = NULL;
     }
+    hset->annSet->srcSet = NULL;
+    hset->annSet->batIdx = 0;
 }
 
 /* cz277 - ANN */
@@ -327,6 +329,9 @@ void FreeANNSet(HMMSet *hset)
                 /* cz277 - gap */
                 if (feaElem->hisMat != NULL) {
                     FreeNMatrix(hset->hmem, feaElem->hisMat);
+                    if (hset->hmem->type == CHEAP) {
+                        FreeIntVec(hset->hmem, feaElem->hisHead);
+                    }
                 }
             }
             /* cz277 - 1007 */
@@ -3363,6 +3368,7 @@ static FeaMix *GetDefaultInpFeaMix(HMMSet *hset, int streamIdx)
         feaElem->feaSrc = NULL;
         feaElem->hisLen = 0;
         feaElem->hisMat = NULL;
+        feaElem->hisHead = NULL;
         feaElem->nUse = 0;
         /* insert to hset->inpElem[streamIdx] */
         hset->inpElem[streamIdx][hset->nInp[streamIdx]++] = feaElem;
@@ -3488,6 +3494,7 @@ static FeaMix *GetFeaMix(HMMSet *hset, Source *src, Token *tok)
             /* cz277 - gap */
             feaElem->hisLen = 0;
             feaElem->hisMat = NULL;
+            feaElem->hisHead = NULL;
             feaElem->dimOff = 0;
             /* cz277 - 1007 */
             feaElem->feaMat = NULL;
@@ -6201,6 +6208,7 @@ FeaMix *GetDefaultANNFeaMix(HMMSet *hset, LELink srcLayer) {
     feaMix->mixMat = feaElem->feaMat;
     feaElem->hisLen = 0;
     feaElem->hisMat = NULL;
+    feaElem->hisHead = NULL;
     feaElem->doBackProp = TRUE;
     feaElem->augFeaIdx = 0;
     feaElem->streamIdx = 0;
@@ -6351,6 +6359,8 @@ void InitXYBatch(HMMSet *hset) {
                     if (feaElem->hisLen > 0) {
                         feaElem->hisMat = CreateNMatrix(hset->hmem, GetNBatchSamples(), feaElem->hisLen * feaElem->feaDim);
                         ++feaElem->hisMat->nUse;
+                        feaElem->hisHead = CreateIntVec(hset->hmem, GetNBatchSamples());
+                        ZeroIntVec(feaElem->hisHead);
                     }
                 }
             }
@@ -6388,6 +6398,264 @@ void InitXYBatch(HMMSet *hset) {
 
 }
 
+/* the copy of src made for a replica, NULL if it has not been copied */
+static Ptr FindReplicaItem(Ptr *srcList, Ptr *dstList, int num, Ptr src) {
+    int i;
+
+    for (i = 0; i < num; ++i) {
+        if (srcList[i] == src) {
+            return dstList[i];
+        }
+    }
+    return NULL;
+}
+
+/* the layer of replica that is the copy of the layer srcLayer of its source */
+static LELink FindReplicaLayer(ANNSet *replica, LELink srcLayer) {
+    int i;
+    AILink srcAI, dstAI;
+
+    for (srcAI = replica->srcSet->defsHead, dstAI = replica->defsHead; srcAI != NULL; srcAI = srcAI->next, dstAI = dstAI->next) {
+        for (i = 0; i < srcAI->annDef->layerNum; ++i) {
+            if (srcAI->annDef->layerList[i] == srcLayer) {
+                return dstAI->annDef->layerList[i];
+            }
+        }
+    }
+    HError(9999, "FindReplicaLayer: Layer not in the source of the replica");
+    return NULL;
+}
+
+/* EXPORT->CreateANNSetReplica: a copy of annSet for forwarding batches on
+   another thread; the weights, biases, activation parameters and target
+   penalties are shared with annSet, the batch matrices are its own.
+   NULL if the outputs of a batch depend on the previous batches (ANN
+   feature history or cycled links), as then batches cannot be forwarded
+   independently.  Target mapping and training structures are not copied */
+ANNSet *CreateANNSetReplica(MemHeap *heap, ANNSet *annSet) {
+    int i, j, s, nLayer = 0, nFea = 0, layerCnt = 0, mixCnt = 0, feaCnt = 0;
+    Boolean indep = TRUE;
+    AILink curAI, newAI;
+    ADLink curAD, newAD;
+    LELink layerElem, newLayer;
+    FeaMix *feaMix, *newMix;
+    FELink feaElem, newFea;
+    Ptr *srcLayers, *dstLayers, *srcMixes, *dstMixes, *srcFeas, *dstFeas;
+    ANNSet *replica;
+
+    /* check the batches are independent; a source layer must be forwarded before its users */
+    for (curAI = annSet->defsHead; curAI != NULL; curAI = curAI->next) {
+        for (i = 0; i < curAI->annDef->layerNum; ++i) {
+            nLayer += 1;
+            nFea += curAI->annDef->layerList[i]->feaMix->elemNum;
+        }
+    }
+    srcLayers = (Ptr *) New(&gstack, nLayer * sizeof(Ptr));
+    for (curAI = annSet->defsHead; curAI != NULL && indep; curAI = curAI->next) {
+        curAD = curAI->annDef;
+        for (i = 0; i < curAD->layerNum && indep; ++i) {
+            layerElem = curAD->layerList[i];
+            for (j = 0; j < layerElem->feaMix->elemNum; ++j) {
+                feaElem = layerElem->feaMix->feaList[j];
+                if (feaElem->inputKind == ANNFEAIK &&
+                    (feaElem->hisLen > 0 || FindReplicaItem(srcLayers, srcLayers, layerCnt, (Ptr) feaElem->feaSrc) == NULL)) {
+                    indep = FALSE;
+                }
+            }
+            srcLayers[layerCnt++] = (Ptr) layerElem;
+        }
+    }
+    Dispose(&gstack, srcLayers);
+    if (!indep) {
+        return NULL;
+    }
+
+    /* copy the layers, feature mixtures and feature elements, each once */
+    srcLayers = (Ptr *) New(&gstack, nLayer * sizeof(Ptr));
+    dstLayers = (Ptr *) New(&gstack, nLayer * sizeof(Ptr));
+    srcMixes = (Ptr *) New(&gstack, nLayer * sizeof(Ptr));
+    dstMixes = (Ptr *) New(&gstack, nLayer * sizeof(Ptr));
+    srcFeas = (Ptr *) New(&gstack, nFea * sizeof(Ptr));
+    dstFeas = (Ptr *) New(&gstack, nFea * sizeof(Ptr));
+    layerCnt = 0;
+    replica = (ANNSet *) New(heap, sizeof(ANNSet));
+    replica->annNum = annSet->annNum;
+    replica->defsHead = NULL;
+    replica->defsTail = NULL;
+    for (curAI = annSet->defsHead; curAI != NULL; curAI = curAI->next) {
+        curAD = curAI->annDef;
+        newAD = (ADLink) New(heap, sizeof(ANNDef));
+        *newAD = *curAD;
+        newAD->layerList = (LELink *) New(heap, curAD->layerNum * sizeof(LELink));
+        for (i = 0; i < curAD->layerNum; ++i) {
+            layerElem = curAD->layerList[i];
+            newLayer = (LELink) FindReplicaItem(srcLayers, dstLayers, layerCnt, (Ptr) layerElem);
+            if (newLayer == NULL) {
+                /* the feature mixture, as set up by InitXYBatch */
+                feaMix = layerElem->feaMix;
+                newMix = (FeaMix *) FindReplicaItem(srcMixes, dstMixes, mixCnt, (Ptr) feaMix);
+                if (newMix == NULL) {
+                    newMix = (FeaMix *) New(heap, sizeof(FeaMix));
+                    *newMix = *feaMix;
+                    newMix->batIdx = 0;
+                    newMix->feaList = (FELink *) New(heap, feaMix->elemNum * sizeof(FELink));
+                    for (j = 0; j < feaMix->elemNum; ++j) {
+                        feaElem = feaMix->feaList[j];
+                        newFea = (FELink) FindReplicaItem(srcFeas, dstFeas, feaCnt, (Ptr) feaElem);
+                        if (newFea == NULL) {
+                            newFea = (FELink) New(heap, sizeof(FeaElem));
+                            *newFea = *feaElem;
+                            if (feaElem->inputKind == ANNFEAIK) {
+                                newFea->feaSrc = (LELink) FindReplicaItem(srcLayers, dstLayers, layerCnt, (Ptr) feaElem->feaSrc);
+                                newFea->feaMat = newFea->feaSrc->yFeaMat;
+                            }
+                            else {
+                                newFea->feaMat = CreateNMatrix(heap, feaElem->feaMat->rowNum, feaElem->feaMat->colNum);
+                            }
+                            newFea->hisMat = NULL;
+                            newFea->hisHead = NULL;
+                            srcFeas[feaCnt] = (Ptr) feaElem;
+                            dstFeas[feaCnt++] = (Ptr) newFea;
+                        }
+                        newMix->feaList[j] = newFea;
+                    }
+                    if (feaMix->mixMat == feaMix->feaList[0]->feaMat) {
+                        newMix->mixMat = newMix->feaList[0]->feaMat;
+                    }
+                    else {
+                        newMix->mixMat = CreateNMatrix(heap, feaMix->mixMat->rowNum, feaMix->mixMat->colNum);
+                    }
+                    srcMixes[mixCnt] = (Ptr) feaMix;
+                    dstMixes[mixCnt++] = (Ptr) newMix;
+                }
+                /* the layer, with its own batches */
+                newLayer = (LELink) New(heap, sizeof(LayerElem));
+                *newLayer = *layerElem;
+                newLayer->feaMix = newMix;
+                newLayer->errMix = NULL;
+                newLayer->trainInfo = NULL;
+                newLayer->xFeaMat = newMix->mixMat;
+                newLayer->yFeaMat = CreateNMatrix(heap, layerElem->yFeaMat->rowNum, layerElem->yFeaMat->colNum);
+                if (layerElem->mb_bases_yFeaMat != NULL) {
+                    newLayer->mb_bases_yFeaMat = CreateNMatrix(heap, layerElem->mb_bases_yFeaMat->rowNum, layerElem->mb_bases_yFeaMat->colNum);
+                }
+                srcLayers[layerCnt] = (Ptr) layerElem;
+                dstLayers[layerCnt++] = (Ptr) newLayer;
+            }
+            newAD->layerList[i] = newLayer;
+        }
+        /* chain the ANNDef, in the same order */
+        newAI = (AILink) New(heap, sizeof(ANNInfo));
+        *newAI = *curAI;
+        newAI->annDef = newAD;
+        newAI->next = NULL;
+        newAI->prev = replica->defsTail;
+        if (replica->defsTail == NULL) {
+            replica->defsHead = newAI;
+        }
+        else {
+            replica->defsTail->next = newAI;
+        }
+        replica->defsTail = newAI;
+    }
+    /* the owners of the feature mixtures */
+    for (i = 0; i < mixCnt; ++i) {
+        newMix = (FeaMix *) dstMixes[i];
+        for (j = 0; j < newMix->ownerNum; ++j) {
+            newMix->ownerList[j] = (LELink) FindReplicaItem(srcLayers, dstLayers, layerCnt, (Ptr) newMix->ownerList[j]);
+        }
+    }
+    /* the output layers and their log likelihoods */
+    replica->mapStruct = NULL;
+    for (s = 0; s < SMAX; ++s) {
+        replica->outLayers[s] = NULL;
+        replica->llhMat[s] = NULL;
+        replica->penVec[s] = NULL;
+        if (annSet->outLayers[s] != NULL) {
+            replica->outLayers[s] = (LELink) FindReplicaItem(srcLayers, dstLayers, layerCnt, (Ptr) annSet->outLayers[s]);
+            replica->llhMat[s] = CreateNMatrix(heap, GetNBatchSamples(), annSet->outLayers[s]->nodeNum);
+            replica->penVec[s] = annSet->penVec[s];
+        }
+    }
+    replica->srcSet = annSet;
+    replica->batIdx = 0;
+    Dispose(&gstack, srcLayers);
+
+    return replica;
+}
+
+/* EXPORT->InitReplicaTrainInfo: give a replica of an ANNSet the training
+   structures of its source (after InitTrainInfo and InitErrMix), so it can
+   back-propagate a batch on another thread; the gradients, updates, error
+   signals and target matrices are its own, the learning rates are shared.
+   The sums of the squared gradients are not copied */
+void InitReplicaTrainInfo(MemHeap *heap, ANNSet *replica) {
+    int i, j;
+    AILink srcAI, dstAI;
+    LELink srcLayer, dstLayer;
+    TrainInfo *srcInfo, *dstInfo;
+    FeaMix *errMix;
+    FELink errElem;
+
+    /* 1. the per layer structures; a replica has the same layers in the same order */
+    for (srcAI = replica->srcSet->defsHead, dstAI = replica->defsHead; srcAI != NULL; srcAI = srcAI->next, dstAI = dstAI->next) {
+        for (i = 0; i < srcAI->annDef->layerNum; ++i) {
+            srcLayer = srcAI->annDef->layerList[i];
+            dstLayer = dstAI->annDef->layerList[i];
+            srcInfo = srcLayer->trainInfo;
+            if (dstLayer->trainInfo != NULL || srcInfo == NULL) {
+                continue;
+            }
+            dstInfo = (TrainInfo *) New(heap, sizeof(TrainInfo));
+            dstInfo->updtFlag = srcInfo->updtFlag;
+            dstInfo->nlrInfo = srcInfo->nlrInfo;
+            dstInfo->ssgInfo = NULL;
+            dstInfo->gradInfo = (LILink) New(heap, sizeof(LayerInfo));
+            dstInfo->gradInfo->wghtMat = CreateNMatrix(heap, dstLayer->nodeNum, dstLayer->inputDim);
+            dstInfo->gradInfo->biasVec = CreateNVector(heap, dstLayer->nodeNum);
+            dstInfo->updtInfo = (LILink) New(heap, sizeof(LayerInfo));
+            dstInfo->updtInfo->wghtMat = CreateNMatrix(heap, dstLayer->nodeNum, dstLayer->inputDim);
+            ClearNMatrix(dstInfo->updtInfo->wghtMat, dstInfo->updtInfo->wghtMat->rowNum);
+            dstInfo->updtInfo->biasVec = CreateNVector(heap, dstLayer->nodeNum);
+            ClearNVector(dstInfo->updtInfo->biasVec);
+            dstInfo->dxFeaMat = CreateNMatrix(heap, srcInfo->dxFeaMat->rowNum, srcInfo->dxFeaMat->colNum);
+            dstInfo->dyFeaMat = NULL;
+            dstInfo->labMat = NULL;
+            if (srcInfo->labMat != NULL) {
+                dstInfo->labMat = CreateNMatrix(heap, srcInfo->labMat->rowNum, srcInfo->labMat->colNum);
+            }
+            dstLayer->trainInfo = dstInfo;
+        }
+    }
+    /* 2. the error mixtures, as set up by InitErrMix, on the replica layers */
+    for (srcAI = replica->srcSet->defsHead, dstAI = replica->defsHead; srcAI != NULL; srcAI = srcAI->next, dstAI = dstAI->next) {
+        for (i = 0; i < srcAI->annDef->layerNum; ++i) {
+            srcLayer = srcAI->annDef->layerList[i];
+            dstLayer = dstAI->annDef->layerList[i];
+            if (srcLayer->errMix == NULL || dstLayer->errMix != NULL) {
+                continue;
+            }
+            errMix = (FeaMix *) New(heap, sizeof(FeaMix));
+            *errMix = *srcLayer->errMix;
+            errMix->feaList = (FELink *) New(heap, errMix->elemNum * sizeof(FELink));
+            for (j = 0; j < errMix->elemNum; ++j) {
+                errElem = (FELink) New(heap, sizeof(FeaElem));
+                *errElem = *srcLayer->errMix->feaList[j];
+                errElem->feaSrc = FindReplicaLayer(replica, errElem->feaSrc);
+                errElem->feaMat = errElem->feaSrc->trainInfo->dxFeaMat;
+                errMix->feaList[j] = errElem;
+            }
+            dstLayer->errMix = errMix;
+            if (srcLayer->trainInfo->dyFeaMat == srcLayer->errMix->feaList[0]->feaMat) {
+                dstLayer->trainInfo->dyFeaMat = errMix->feaList[0]->feaMat;
+            }
+            else {
+                dstLayer->trainInfo->dyFeaMat = CreateNMatrix(heap, srcLayer->trainInfo->dyFeaMat->rowNum, srcLayer->trainInfo->dyFeaMat->colNum);
+            }
+        }
+    }
+}
+
 /* TODO: for sequence TANDEM system */
 /* initialise errMix in each layer */
 void InitErrMix(HMMSet *hset) {
@@ -6456,6 +6724,7 @@ void InitErrMix(HMMSet *hset) {
                     errElem->doBackProp = feaElem->doBackProp;	/* will be 1 all the time */
                     errElem->hisLen = 0;
                     errElem->hisMat = NULL;
+                    errElem->hisHead = NULL;
 
                     /* update srcElem->nDrv */
                     ++srcElem->nDrv;
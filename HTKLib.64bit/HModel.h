@@ -713,6 +713,8 @@ void InitTrainInfo(HMMSet *hset, Boolean initLabMats, Boolean initLRInfo, Boolea
 void InitErrMix(HMMSet *hset);
 void CheckANNConsistency(HMMSet *hset);
 void InitXYBatch(HMMSet *hset);
+ANNSet *CreateANNSetReplica(MemHeap *heap, ANNSet *annSet);
+void InitReplicaTrainInfo(MemHeap *heap, ANNSet *replica);
 ReturnStatus SaveANNUpdate(HMMSet *hset, char *fname, Boolean binary);
 ReturnStatus SaveANNNegLR(HMMSet *hset, char *fname, Boolean binary);
 ReturnStatus SaveANNSquareGrad(HMMSet *hset, char *fname, Boolean binary);
@@ -56,6 +56,10 @@ char *hncache_vc_id = "$Id: HNCache.c,v 1.1.1.1 2013/11/13 09:54:58 cz277 Exp $"
 #include "HLat.h"
 #include "HNCache.h"
 #include <math.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 /* ------------------------------ Trace Flags ------------------------------ */
 
@@ -63,6 +67,7 @@ static int trace = 0;
 
 #define T_TOP 0001
 #define T_CCH 0002
+#define T_LIV 0004      /* chunk by chunk latency of simulated live input */
 #define MAX(a,b) ((a)>(b) ? (a):(b))
 
 
@@ -95,8 +100,17 @@ static const size_t QN_XORTable[32] = {0x1, 0x1, 0x3, 0x6, 0xc, 0x14, 0x30, 0x60
 
 /* cz277 - mtload */
 static Boolean extThreadLoad = FALSE;
+static int loadThreads = 0;                     /* the number of load threads, 0 for none */
+static int loadAhead = 64;                      /* the number of utterances to parse ahead */
+
+typedef struct _FeaArchive FeaArchive;
+static FeaArchive *feaArchive = NULL;           /* the feature archive to load from, NULL for the parameter files */
+
+static Boolean simLive = FALSE;                 /* replay the waveforms through an online front end */
+static HTime liveChunk = 200000;                /* the duration of each replayed chunk */
 
 static void UnloadOneUtt(DataCache *cache, int dstPos);
+static FeaArchive *OpenFeaArchive(char *fn);
 
 
 /* get the batch size */
@@ -255,6 +269,7 @@ static inline void ShuffleSegment(void *list, size_t stPos, size_t edPos, int un
 void InitNCache(void)
 {
     int intVal;
+    double fltVal;
     char buf[MAXSTRLEN];
     Boolean boolVal;
 
@@ -322,6 +337,30 @@ void InitNCache(void)
             extThreadLoad = boolVal;
             /*memset(extThread, 0, sizeof(pthread_t) * SMAX);*/
         }
+        if (GetConfInt(cParm, nParm, "LOADTHREADS", &intVal)) {
+            if (intVal < 0) {
+                HError(9999, "InitNCache: LOADTHREADS should not be negative");
+            }
+            loadThreads = intVal;
+        }
+        if (GetConfInt(cParm, nParm, "LOADAHEAD", &intVal)) {
+            if (intVal <= 0) {
+                HError(9999, "InitNCache: LOADAHEAD should be positive");
+            }
+            loadAhead = intVal;
+        }
+        if (GetConfStr(cParm, nParm, "FEAARCHIVE", buf)) {
+            feaArchive = OpenFeaArchive(buf);
+        }
+        if (GetConfBool(cParm, nParm, "SIMLIVE", &boolVal)) {
+            simLive = boolVal;
+        }
+        if (GetConfFlt(cParm, nParm, "LIVECHUNK", &fltVal)) {
+            if (fltVal <= 0.0) {
+                HError(9999, "InitNCache: LIVECHUNK should be positive");
+            }
+            liveChunk = fltVal;
+        }
     }
 
     /* initialise the stacks */
@@ -338,6 +377,824 @@ void InitNCache(void)
     }
 }
 
+/* ---------------------------- Feature Archives --------------------------- */
+
+/* the layout is the header, the frames of each utterance in the order
+   they were added, the index sorted by name and then the names; all
+   values are in the byte order of the machine that wrote the archive */
+#define FEAARCMAGIC "HNFEAARC"
+#define FEAARCVERSION 1
+#define FEAARCBYTEORDER 0x01020304
+#define FEAARCALIGN 64                          /* the alignment of the frames of each utterance, in bytes */
+#define FEAARCMAXSTREAMS 16
+
+typedef struct _FeaArcHeader {
+    char magic[8];              /* FEAARCMAGIC, not NULL terminated */
+    int version;                /* FEAARCVERSION */
+    int byteOrder;              /* FEAARCBYTEORDER as written */
+    int uttNum;                 /* the number of utterances */
+    int frmDim;                 /* the number of floats in a frame, all streams */
+    int nStreams;               /* the number of streams */
+    int swidth[FEAARCMAXSTREAMS + 1];   /* the width of each stream, 1..nStreams */
+    int parmKind;               /* the parameter kind of the observations */
+    HTime sampRate;             /* the frame period */
+    long long idxOff;           /* the file offset of the index */
+    long long nameOff;          /* the file offset of the names */
+} FeaArcHeader;
+
+typedef struct _FeaArcEntry {
+    long long nameOff;          /* the offset of the name, from hdr.nameOff */
+    long long frmOff;           /* the file offset of the first frame */
+    long long uttLen;           /* the number of frames */
+} FeaArcEntry;
+
+struct _FeaArchive {
+    char *fn;                   /* the archive file name */
+    char *base;                 /* the start of the mapping */
+    size_t size;                /* the length of the mapping */
+    FeaArcHeader *hdr;          /* the header, at base */
+    FeaArcEntry *entries;       /* the index, sorted by name */
+    char *names;                /* the names */
+};
+
+struct _FeaArchiveWriter {
+    char *fn;                   /* the archive file name */
+    FILE *file;                 /* the file being written */
+    FeaArcHeader hdr;           /* the header, written again by CloseFeaArchive */
+    long long curOff;           /* the file offset of the next utterance */
+    int nAlloc;                 /* the size of entries and uttNames */
+    FeaArcEntry *entries;       /* the entries, in the order added */
+    char **uttNames;            /* the names of the entries */
+    MemHeap heap;               /* holds the name and the index */
+};
+
+/* the file offset rounded up to the next FEAARCALIGN boundary */
+static long long FeaArcAlign(long long off) {
+    return (off + FEAARCALIGN - 1) / FEAARCALIGN * FEAARCALIGN;
+}
+
+/* write len bytes at the current position of the archive */
+static void WriteFeaArcData(FeaArchiveWriter *arcw, void *data, size_t len) {
+    if (len > 0 && fwrite(data, 1, len, arcw->file) != len) {
+        HError(9999, "WriteFeaArcData: Failed to write feature archive %s", arcw->fn);
+    }
+}
+
+/* pad the archive with zeros up to the file offset off */
+static void PadFeaArc(FeaArchiveWriter *arcw, long long curOff, long long off) {
+    char zeros[FEAARCALIGN];
+
+    memset(zeros, 0, FEAARCALIGN);
+    WriteFeaArcData(arcw, zeros, (size_t) (off - curOff));
+}
+
+/* EXPORT->CreateFeaArchive: start a feature archive for observations of kind pk with stream widths swidth */
+FeaArchiveWriter *CreateFeaArchive(char *fn, short *swidth, ParmKind pk, HTime sampRate) {
+    int s;
+    FeaArchiveWriter *arcw;
+
+    if (swidth[0] < 1 || swidth[0] > FEAARCMAXSTREAMS) {
+        HError(9999, "CreateFeaArchive: %d streams is not supported in feature archives", swidth[0]);
+    }
+    arcw = (FeaArchiveWriter *) New(&gcheap, sizeof(FeaArchiveWriter));
+    memset(arcw, 0, sizeof(FeaArchiveWriter));
+    CreateHeap(&arcw->heap, "FeaArchiveWriter", MSTAK, 1, 1.0, 10000, 10000000);
+    arcw->fn = CopyString(&arcw->heap, fn);
+    if ((arcw->file = fopen(fn, "wb")) == NULL) {
+        HError(9999, "CreateFeaArchive: Cannot create feature archive %s", fn);
+    }
+    memcpy(arcw->hdr.magic, FEAARCMAGIC, sizeof(arcw->hdr.magic));
+    arcw->hdr.version = FEAARCVERSION;
+    arcw->hdr.byteOrder = FEAARCBYTEORDER;
+    arcw->hdr.nStreams = swidth[0];
+    for (s = 1; s <= swidth[0]; ++s) {
+        arcw->hdr.swidth[s] = swidth[s];
+        arcw->hdr.frmDim += swidth[s];
+    }
+    arcw->hdr.parmKind = pk;
+    arcw->hdr.sampRate = sampRate;
+    /* the header is written again with the offsets by CloseFeaArchive */
+    WriteFeaArcData(arcw, &arcw->hdr, sizeof(FeaArcHeader));
+    arcw->curOff = FeaArcAlign(sizeof(FeaArcHeader));
+    PadFeaArc(arcw, sizeof(FeaArcHeader), arcw->curOff);
+
+    return arcw;
+}
+
+/* EXPORT->AddFeaArchiveUtt: append uttLen frames of frmDim floats, stored as uttName */
+void AddFeaArchiveUtt(FeaArchiveWriter *arcw, char *uttName, int uttLen, float *frmMat) {
+    int nAlloc;
+    long long len;
+    FeaArcEntry *entries;
+    char **uttNames;
+
+    /* grow the index; the old arrays stay on the stack until CloseFeaArchive */
+    if (arcw->hdr.uttNum == arcw->nAlloc) {
+        nAlloc = MAX(1024, 2 * arcw->nAlloc);
+        entries = (FeaArcEntry *) New(&arcw->heap, nAlloc * sizeof(FeaArcEntry));
+        uttNames = (char **) New(&arcw->heap, nAlloc * sizeof(char *));
+        if (arcw->nAlloc > 0) {
+            memcpy(entries, arcw->entries, arcw->nAlloc * sizeof(FeaArcEntry));
+            memcpy(uttNames, arcw->uttNames, arcw->nAlloc * sizeof(char *));
+        }
+        arcw->entries = entries;
+        arcw->uttNames = uttNames;
+        arcw->nAlloc = nAlloc;
+    }
+    arcw->entries[arcw->hdr.uttNum].frmOff = arcw->curOff;
+    arcw->entries[arcw->hdr.uttNum].uttLen = uttLen;
+    arcw->uttNames[arcw->hdr.uttNum] = CopyString(&arcw->heap, uttName);
+    ++arcw->hdr.uttNum;
+    /* the frames, padded to the start of the next utterance */
+    len = (long long) uttLen * arcw->hdr.frmDim * sizeof(float);
+    WriteFeaArcData(arcw, frmMat, (size_t) len);
+    PadFeaArc(arcw, arcw->curOff + len, FeaArcAlign(arcw->curOff + len));
+    arcw->curOff = FeaArcAlign(arcw->curOff + len);
+}
+
+/* the entries of the writer, to be sorted by name */
+static char **sortNames;
+
+static int CmpFeaArcEntry(const void *a, const void *b) {
+    return strcmp(sortNames[*(const int *) a], sortNames[*(const int *) b]);
+}
+
+/* EXPORT->CloseFeaArchive: write the sorted index and the names, and close the archive */
+void CloseFeaArchive(FeaArchiveWriter *arcw) {
+    int i, uttNum, *order;
+    long long nameOff = 0;
+    FeaArcEntry entry;
+
+    uttNum = arcw->hdr.uttNum;
+    order = (int *) New(&arcw->heap, MAX(uttNum, 1) * sizeof(int));
+    for (i = 0; i < uttNum; ++i) {
+        order[i] = i;
+    }
+    sortNames = arcw->uttNames;
+    qsort(order, uttNum, sizeof(int), CmpFeaArcEntry);
+    for (i = 1; i < uttNum; ++i) {
+        if (strcmp(arcw->uttNames[order[i - 1]], arcw->uttNames[order[i]]) == 0) {
+            HError(9999, "CloseFeaArchive: Utterance %s is added to %s twice", arcw->uttNames[order[i]], arcw->fn);
+        }
+    }
+    /* the index */
+    arcw->hdr.idxOff = arcw->curOff;
+    for (i = 0; i < uttNum; ++i) {
+        entry = arcw->entries[order[i]];
+        entry.nameOff = nameOff;
+        WriteFeaArcData(arcw, &entry, sizeof(FeaArcEntry));
+        nameOff += strlen(arcw->uttNames[order[i]]) + 1;
+    }
+    /* the names, in the same order */
+    arcw->hdr.nameOff = arcw->hdr.idxOff + (long long) uttNum * sizeof(FeaArcEntry);
+    for (i = 0; i < uttNum; ++i) {
+        WriteFeaArcData(arcw, arcw->uttNames[order[i]], strlen(arcw->uttNames[order[i]]) + 1);
+    }
+    /* the header, now complete */
+    if (fseek(arcw->file, 0, SEEK_SET) != 0) {
+        HError(9999, "CloseFeaArchive: Failed to rewind feature archive %s", arcw->fn);
+    }
+    WriteFeaArcData(arcw, &arcw->hdr, sizeof(FeaArcHeader));
+    if (fclose(arcw->file) != 0) {
+        HError(9999, "CloseFeaArchive: Failed to close feature archive %s", arcw->fn);
+    }
+    DeleteHeap(&arcw->heap);
+    Dispose(&gcheap, arcw);
+}
+
+/* map a feature archive and check its header and index */
+static FeaArchive *OpenFeaArchive(char *fn) {
+    int fd;
+    struct stat st;
+    FeaArchive *arc;
+    FeaArcHeader *hdr;
+
+    if ((fd = open(fn, O_RDONLY)) < 0) {
+        HError(9999, "OpenFeaArchive: Cannot open feature archive %s", fn);
+    }
+    if (fstat(fd, &st) != 0 || st.st_size < sizeof(FeaArcHeader)) {
+        HError(9999, "OpenFeaArchive: %s is not a feature archive", fn);
+    }
+    arc = (FeaArchive *) New(&gcheap, sizeof(FeaArchive));
+    arc->fn = CopyString(&gcheap, fn);
+    arc->size = st.st_size;
+    arc->base = (char *) mmap(NULL, arc->size, PROT_READ, MAP_SHARED, fd, 0);
+    if (arc->base == MAP_FAILED) {
+        HError(9999, "OpenFeaArchive: Cannot map feature archive %s", fn);
+    }
+    /* the mapping stays valid after the file is closed */
+    close(fd);
+    hdr = arc->hdr = (FeaArcHeader *) arc->base;
+    if (memcmp(hdr->magic, FEAARCMAGIC, sizeof(hdr->magic)) != 0) {
+        HError(9999, "OpenFeaArchive: %s is not a feature archive", fn);
+    }
+    if (hdr->byteOrder != FEAARCBYTEORDER) {
+        HError(9999, "OpenFeaArchive: %s was written with a different byte order", fn);
+    }
+    if (hdr->version != FEAARCVERSION) {
+        HError(9999, "OpenFeaArchive: %s has unsupported version %d", fn, hdr->version);
+    }
+    if (hdr->nStreams < 1 || hdr->nStreams > FEAARCMAXSTREAMS || hdr->uttNum < 0 ||
+        hdr->idxOff < 0 || hdr->nameOff != hdr->idxOff + (long long) hdr->uttNum * sizeof(FeaArcEntry) || hdr->nameOff > arc->size) {
+        HError(9999, "OpenFeaArchive: The header of %s is corrupted", fn);
+    }
+    arc->entries = (FeaArcEntry *) (arc->base + hdr->idxOff);
+    arc->names = arc->base + hdr->nameOff;
+    if (trace & T_TOP) {
+        printf("OpenFeaArchive: %d utterances of dimension %d in %s\n", hdr->uttNum, hdr->frmDim, fn);
+    }
+
+    return arc;
+}
+
+/* find an utterance in a feature archive by binary search, NULL if absent */
+static FeaArcEntry *FindFeaArchiveUtt(FeaArchive *arc, char *uttName) {
+    int lo, hi, mid, cmp;
+    FeaArcEntry *entry;
+
+    lo = 0;
+    hi = arc->hdr->uttNum - 1;
+    while (lo <= hi) {
+        mid = (lo + hi) / 2;
+        entry = &arc->entries[mid];
+        if (entry->nameOff < 0 || arc->hdr->nameOff + entry->nameOff >= arc->size) {
+            HError(9999, "FindFeaArchiveUtt: The index of %s is corrupted", arc->fn);
+        }
+        cmp = strcmp(uttName, arc->names + entry->nameOff);
+        if (cmp == 0) {
+            if (entry->frmOff < 0 || entry->uttLen < 0 ||
+                entry->frmOff + entry->uttLen * arc->hdr->frmDim * (long long) sizeof(float) > arc->hdr->idxOff) {
+                HError(9999, "FindFeaArchiveUtt: The entry of %s in %s is corrupted", uttName, arc->fn);
+            }
+            return entry;
+        }
+        else if (cmp < 0) {
+            hi = mid - 1;
+        }
+        else {
+            lo = mid + 1;
+        }
+    }
+    return NULL;
+}
+
+/* the frames of the stream of the cache for the utterance uttName, from
+   the feature archive; returns the frame period */
+static HTime LoadUttFromArchive(DataCache *cache, UttElem *uttElem, char *uttName) {
+    int i, s, dim, stOff;
+    float *srcPtr, *dstPtr;
+    FeaArcHeader *hdr;
+    FeaArcEntry *entry;
+
+    hdr = feaArchive->hdr;
+    if ((entry = FindFeaArchiveUtt(feaArchive, uttName)) == NULL) {
+        HError(9999, "LoadUttFromArchive: Utterance %s is not in feature archive %s", uttName, feaArchive->fn);
+    }
+    dim = cache->frmDim;
+    if (cache->streamIdx > hdr->nStreams || hdr->swidth[cache->streamIdx] != dim) {
+        HError(9999, "LoadUttFromArchive: Stream %d in feature archive %s does not have dimension %d", cache->streamIdx, feaArchive->fn, dim);
+    }
+    uttElem->uttLen = (int) entry->uttLen;
+    srcPtr = (float *) (feaArchive->base + entry->frmOff);
+    if (hdr->nStreams == 1) {
+        /* the frames are stored the way the cache holds them, use the mapping in place */
+        uttElem->frmMat = srcPtr;
+        uttElem->frmMapped = TRUE;
+    }
+    else {
+        /* copy the slice of this stream */
+        for (s = 1, stOff = 0; s < cache->streamIdx; ++s) {
+            stOff += hdr->swidth[s];
+        }
+        uttElem->frmMat = (float *) New(cache->cmem, uttElem->uttLen * dim * sizeof(float));
+        uttElem->frmMapped = FALSE;
+        for (i = 0, srcPtr += stOff, dstPtr = uttElem->frmMat; i < uttElem->uttLen; ++i, srcPtr += hdr->frmDim, dstPtr += dim) {
+            memcpy(dstPtr, srcPtr, dim * sizeof(float));
+        }
+    }
+    /* the augmented features are not archived */
+    for (i = 1; i <= MAXAUGFEAS; ++i) {
+        uttElem->augFeaVec[i] = NULL;
+    }
+
+    return hdr->sampRate;
+}
+
+/* the frames of the stream of the cache for the waveform file fn, replayed
+   to an online front end in chunks of liveChunk as if the samples arrived
+   from a live source; returns the frame period */
+static HTime LoadUttLive(DataCache *cache, UttElem *uttElem, char *fn) {
+    int i, j, dim, nChunks = 0, chunkFrames, delay, maxDelay = 0;
+    long nSamples, stIdx, n, chunkSize;
+    short *data;
+    float *dstPtr;
+    Vector x;
+    Wave wave;
+    OnlineFE fe;
+    BufferInfo info;
+    HTime sampPeriod = 0.0;
+    clock_t stClock, chunkClock, totClock = 0, maxClock = 0;
+
+    ResetHeap(&pbufStack);
+    if ((wave = OpenWaveInput(&pbufStack, fn, UNDEFF, 0.0, 0.0, &sampPeriod)) == NULL) {
+        HError(9999, "LoadUttLive: Open input waveform %s failed", fn);
+    }
+    data = GetWaveDirect(wave, &nSamples);
+    fe = CreateOnlineFE(&pbufStack, sampPeriod);
+    GetOnlineFEInfo(fe, &info);
+    /* the frames are stored as they are popped, so size the matrix for all of them */
+    dim = cache->frmDim;
+    uttElem->uttLen = (nSamples < info.frSize)? 0: (nSamples - info.frSize) / info.frRate + 1;
+    uttElem->frmMat = (float *) New(cache->cmem, MAX(uttElem->uttLen, 1) * dim * sizeof(float));
+    uttElem->frmMapped = FALSE;
+    dstPtr = uttElem->frmMat;
+    chunkSize = MAX((long) (liveChunk / sampPeriod + 0.5), 1);
+    for (stIdx = 0, i = 0; stIdx < nSamples || nChunks == 0; stIdx += n) {
+        n = (nSamples - stIdx < chunkSize)? nSamples - stIdx: chunkSize;
+        stClock = clock();
+        PushOnlineFE(fe, data + stIdx, n);
+        if (stIdx + n >= nSamples) {
+            EndOnlineFE(fe);
+        }
+        for (chunkFrames = 0; PopOnlineFE(fe, cache->obs); ++chunkFrames, ++i) {
+            if (i >= uttElem->uttLen) {
+                HError(9999, "LoadUttLive: %s has more frames than expected", fn);
+            }
+            x = cache->obs->fv[cache->streamIdx];
+            for (j = 1; j <= dim; ++j, ++dstPtr) {
+                if (isnan(x[j]) || isinf(x[j])) {
+                    HError(9999, "LoadUttLive: %s, frame no. %d, dim %d has nan or inf value", fn, i, j);
+                }
+                *dstPtr = x[j];
+            }
+        }
+        chunkClock = clock() - stClock;
+        delay = OnlineFEDelay(fe);
+        totClock += chunkClock;
+        ++nChunks;
+        maxClock = MAX(maxClock, chunkClock);
+        maxDelay = MAX(maxDelay, delay);
+        if (trace & T_LIV) {
+            printf("LoadUttLive: chunk %d, %ld samples, %d frames in %.2fms, %d frames waiting\n", nChunks, n, chunkFrames, 1000.0 * chunkClock / CLOCKS_PER_SEC, delay);
+        }
+    }
+    if (i != uttElem->uttLen) {
+        HError(9999, "LoadUttLive: %s has %d frames rather than %d", fn, i, uttElem->uttLen);
+    }
+    if (trace & T_LIV) {
+        printf("LoadUttLive: %s, %d chunks of %.1fms, %.2fms mean, %.2fms max per chunk, max delay %d frames (%.1fms)\n", fn, nChunks, liveChunk / 10000.0, 1000.0 * totClock / CLOCKS_PER_SEC / nChunks, 1000.0 * maxClock / CLOCKS_PER_SEC, maxDelay, maxDelay * info.tgtSampRate / 10000.0);
+        fflush(stdout);
+    }
+    CloseOnlineFE(fe);
+    CloseWaveInput(wave);
+    /* the augmented features come from the parameter buffer only */
+    for (i = 1; i <= MAXAUGFEAS; ++i) {
+        uttElem->augFeaVec[i] = NULL;
+    }
+
+    return info.tgtSampRate;
+}
+
+/* ask the kernel to read in the frames of the utterance uttName */
+static void ReadAheadArchiveUtt(char *uttName) {
+    long pageSize;
+    long long stOff, edOff;
+    FeaArcEntry *entry;
+
+    if ((entry = FindFeaArchiveUtt(feaArchive, uttName)) == NULL) {
+        return;
+    }
+    pageSize = sysconf(_SC_PAGESIZE);
+    stOff = entry->frmOff / pageSize * pageSize;
+    edOff = entry->frmOff + entry->uttLen * feaArchive->hdr->frmDim * (long long) sizeof(float);
+    madvise(feaArchive->base + stOff, (size_t) (edOff - stOff), MADV_WILLNEED);
+}
+
+/* ------------------------------ Load Pool -------------------------------- */
+
+/* The workers of this pool parse the next loadAhead utterances of the
+   script, features, labels and lattices, each into a slot of its own,
+   while LoadOneUtt takes them in script order.  The slot of utterance
+   p is slots[p % nSlots], and a worker only takes an utterance whose
+   slot has been released by LoadOneUtt, so the parsed utterances are
+   committed in the same order, with the same frame counts, speaker
+   changes and statistics, whatever the number of workers.  Each
+   worker has a parameter buffer heap and an observation of its own;
+   the label and lattice readers keep their state per thread, and the
+   label name and word tables are locked.  What depends on the order
+   of the script, the speaker statistics, the transition and target
+   counts and the replay of simLive, is left to LoadOneUtt */
+typedef enum {EMPTYSS, BUSYSS, READYSS} SlotState;
+
+typedef struct _UttSlot {
+    int uttPos;                 /* the utterance in the slot */
+    SlotState state;            /* free, being parsed, or parsed */
+    char uttName[MAXSTRLEN];    /* the logical name of the utterance */
+    HTime sampRate;             /* the frame period of the utterance */
+    UttElem utt;                /* the frames, augmented features and lattices */
+    Transcription *trans;       /* the labels, in labHeap, NULL if none */
+    MemHeap labHeap;            /* the heap for the labels */
+} UttSlot;
+
+struct _UttPrefetch {
+    DataCache *cache;           /* the cache being loaded */
+    char **scpWords;            /* the whole script, as raw words */
+    int nThreads;               /* the number of workers */
+    pthread_t *threads;         /* the workers */
+    int nSlots;                 /* the number of slots */
+    UttSlot *slots;             /* the utterances parsed ahead */
+    pthread_mutex_t lock;       /* protects the fields below and the slot states */
+    pthread_cond_t cond;        /* signalled when the window moves, a slot is parsed, or on stop */
+    int nxtPos;                 /* the next utterance to parse */
+    int endPos;                 /* the end of the window */
+    Boolean stop;               /* the workers should exit */
+};
+
+/* load the lattices of one kind into lats, following the path rules of the lattice directories */
+static void LoadUttLats(DataCache *cache, char *latBuf, int nLats, char **latDir, char *subDirPat, char *latMask, Lattice **lats) {
+    int i;
+    char spkBuf[256], pathBuf[256], fnBuf[256];
+    FILE *filePtr;
+    Boolean isPipe;
+    LabelInfo *labelInfo = cache->labelInfo;
+
+    for (i = 0; i < nLats; ++i) {
+        if (subDirPat[0]) {
+            if (!MaskMatch(subDirPat, spkBuf, latBuf)) {
+                HError(9999, "LoadUttLats: Mask %s has no match with segment %s", subDirPat, latBuf);
+            }
+            MakeFN(spkBuf, latDir[i], NULL, pathBuf);
+        }
+        else {
+            strcpy(pathBuf, latDir[i]);
+        }
+        if (latMask != NULL) {
+            if (!MaskMatch(latMask, spkBuf, latBuf)) {
+                HError(9999, "LoadUttLats: Mask %s has no match with segment %s", latMask, latBuf);
+            }
+            MakeFN(spkBuf, pathBuf, NULL, fnBuf);
+            strcpy(pathBuf, fnBuf);
+        }
+        if (labelInfo->useLLF) {
+            lats[i] = GetLattice(latBuf, pathBuf, labelInfo->latExt, cache->cmem, labelInfo->vocab, FALSE, TRUE);
+        }
+        else {
+            MakeFN(latBuf, pathBuf, labelInfo->latExt, fnBuf);
+            if (InLatArchive(fnBuf)) {
+                lats[i] = ReadArchiveLattice(fnBuf, cache->cmem, labelInfo->vocab, FALSE, TRUE);
+            }
+            else {
+                filePtr = FOpen(fnBuf, NetFilter, &isPipe);
+                if (!filePtr) {
+                    HError(9999, "LoadUttLats: Could not open file %s", fnBuf);
+                }
+                lats[i] = ReadLattice(filePtr, cache->cmem, labelInfo->vocab, FALSE, TRUE);
+                FClose(filePtr, isPipe);
+            }
+        }
+    }
+}
+
+/* parse the utterance uttName into uttElem and *trans, using pbufHeap
+   and obs for the features and labHeap for the labels; the frames are
+   left to LoadOneUtt under simLive; returns the frame period */
+static HTime ParseOneUtt(DataCache *cache, char *uttName, UttElem *uttElem, Transcription **trans, MemHeap *pbufHeap, MemHeap *labHeap, Observation *obs) {
+    int i, j, len, dim;
+    char spkBuf[256], labBuf[256], latBuf[256];
+    float *dstPtr;
+    Vector x, tmpVec;
+    ParmBuf parmBuf;
+    BufferInfo pbInfo;
+    HTime sampRate = 0.0;
+    LabelInfo *labelInfo = cache->labelInfo;
+
+    dim = cache->frmDim;
+    if (feaArchive != NULL) {
+        /* take the frames from the feature archive */
+        ReadAheadArchiveUtt(uttName);
+        sampRate = LoadUttFromArchive(cache, uttElem, uttName);
+    }
+    else if (simLive) {
+        /* the waveform is replayed in script order by LoadOneUtt */
+    }
+    else {
+        /* reset the heap for the next utterance */
+        ResetHeap(pbufHeap);
+        /* open the next utterance */
+        parmBuf = OpenBuffer(pbufHeap, uttName, 0, UNDEFF, TRI_UNDEF, TRI_UNDEF);
+        if (!parmBuf) {
+            HError(9999, "ParseOneUtt: Open input data failed");
+        }
+        GetBufferInfo(parmBuf, &pbInfo);
+        sampRate = pbInfo.tgtSampRate;
+        uttElem->uttLen = ObsInBuffer(parmBuf);
+        /* load all frames into cache */
+        len = uttElem->uttLen;
+        uttElem->frmMat = (float *) New(cache->cmem, len * dim * sizeof(float));
+        uttElem->frmMapped = FALSE;
+        dstPtr = uttElem->frmMat;
+        for (i = 0; i < len; ++i) {
+            ReadAsTable(parmBuf, i, obs);
+            x = obs->fv[cache->streamIdx];
+            /* TODO: apply compFX form */
+            /* ApplyCompXForm ??? */
+            for (j = 1; j <= dim; ++j, ++dstPtr) {   /* just copy the data */
+                if (isnan(x[j]))
+                    HError(9999, "ParseOneUtt: %s, frame no. %d, dim %d has nan value", uttName, i, j);
+                if (isinf(x[j]))
+                    HError(9999, "ParseOneUtt: %s, frame no. %d, dim %d has inf value", uttName, i, j);
+                *dstPtr = x[j];
+            }
+        }
+        /* cz277 - aug */
+        /* load the augmented feature vectors */
+        for (i = 1; i <= MAXAUGFEAS; ++i) {
+            uttElem->augFeaVec[i] = NULL;
+            if (cache->streamIdx == 1) {
+                tmpVec = GetAugFeaVector(parmBuf, i);
+                if (tmpVec != NULL) {
+                    uttElem->augFeaVec[i] = CreateVector(cache->cmem, VectorSize(tmpVec));
+                    CopyVector(tmpVec, uttElem->augFeaVec[i]);
+                }
+            }
+        }
+        /* close current buffer */
+        CloseBuffer(parmBuf);
+    }
+    *trans = NULL;
+    if (labelInfo == NULL) {
+        return sampRate;
+    }
+    /* read the lab file, to be converted by LoadOneUtt */
+    if ((labelInfo->labelKind & LABLK) != 0) {
+        if (labelInfo->labFileMask != NULL) {
+            if (!MaskMatch(labelInfo->labFileMask, spkBuf, uttName)) {
+                HError(9999, "ParseOneUtt: Mask %s has no match with segment %s", labelInfo->labFileMask, uttName);
+            }
+            MakeFN(spkBuf, labelInfo->labDir, labelInfo->labExt, labBuf);
+        }
+        else {
+            MakeFN(uttName, labelInfo->labDir, labelInfo->labExt, labBuf);
+        }
+        ResetHeap(labHeap);
+        *trans = LOpen(labHeap, labBuf, UNDEFF);
+    }
+    /* process lattice files */
+    if (((labelInfo->labelKind & LATLK) != 0) && (cache->streamIdx == 1)) {
+        uttElem->numInDen = NULL;
+        for (i = 0; i < MAXLATSUTT; ++i) {
+            uttElem->denLats[i] = NULL;
+            uttElem->numLats[i] = NULL;
+        }
+        /* set basic lattice file mask */
+        if (labelInfo->latFileMask != NULL) {
+            if (!MaskMatch(labelInfo->latFileMask, latBuf, uttName)) {
+                HError(9999, "ParseOneUtt: Mask %s has no match with segment %s", labelInfo->latFileMask, uttName);
+            }
+        }
+        else {
+            strcpy(latBuf, uttName);
+        }
+        /* load denorminator lattices */
+        LoadUttLats(cache, latBuf, labelInfo->nDenLats, labelInfo->denLatDir, labelInfo->denLatSubDirPat, labelInfo->latMaskDen, uttElem->denLats);
+        /* load numerator lattices */
+        if (labelInfo->nNumLats > 0) {
+            LoadUttLats(cache, latBuf, labelInfo->nNumLats, labelInfo->numLatDir, labelInfo->numLatSubDirPat, labelInfo->latMaskNum, uttElem->numLats);
+            uttElem->numInDen = (Boolean *) New(cache->cmem, labelInfo->nNumLats * sizeof(Boolean));
+            for (i = 0; i < labelInfo->nNumLats; ++i) {
+                /* to include this num lattice as a den lattice or not */
+                uttElem->numInDen[i] = TRUE;
+                if (labelInfo->incNumInDen == TRUE) {
+                    for (j = 0; j < labelInfo->nDenLats; ++j) {
+                        if (LatInLat(uttElem->numLats[i], uttElem->denLats[j])) {
+                            uttElem->numInDen[i] = FALSE;
+                            break;
+                        }
+                    }
+                }
+                else {
+                    uttElem->numInDen[i] = FALSE;
+                }
+            }
+        }
+    }
+
+    return sampRate;
+}
+
+/* parse the utterance at uttPos into its slot, with the heap and observation of the caller */
+static void ParseUttSlot(UttPrefetch *pf, int uttPos, MemHeap *pbufHeap, Observation *obs) {
+    char buf[MAXSTRLEN];
+    char *uttName;
+    UttSlot *slot = &pf->slots[uttPos % pf->nSlots];
+
+    /* the extended name is registered in the parsing thread, and passed
+       on as registered, so that it is found by pointer */
+    strcpy(buf, pf->scpWords[uttPos]);
+    uttName = RegisterExtFileName(buf);
+    strcpy(slot->uttName, uttName);
+    memset(&slot->utt, 0, sizeof(UttElem));
+    slot->sampRate = ParseOneUtt(pf->cache, uttName, &slot->utt, &slot->trans, pbufHeap, &slot->labHeap, obs);
+}
+
+/* release what a parsed slot holds, if it is not to be committed */
+static void FreeUttSlot(DataCache *cache, UttSlot *slot) {
+    int i;
+    UttElem *uttElem = &slot->utt;
+
+    if (uttElem->frmMat != NULL && !uttElem->frmMapped) {
+        Dispose(cache->cmem, uttElem->frmMat);
+    }
+    for (i = 1; i <= MAXAUGFEAS; ++i) {
+        if (uttElem->augFeaVec[i] != NULL) {
+            Dispose(cache->cmem, uttElem->augFeaVec[i]);
+        }
+    }
+    for (i = 0; i < MAXLATSUTT; ++i) {
+        if (uttElem->numLats[i] != NULL) {
+            FreeLattice(uttElem->numLats[i]);
+        }
+        if (uttElem->denLats[i] != NULL) {
+            FreeLattice(uttElem->denLats[i]);
+        }
+    }
+    if (uttElem->numInDen != NULL) {
+        Dispose(cache->cmem, uttElem->numInDen);
+    }
+    memset(uttElem, 0, sizeof(UttElem));
+    slot->trans = NULL;
+    slot->state = EMPTYSS;
+}
+
+/* the worker: parse the next utterance in the window until stopped */
+static void *UttPrefetchWorker(void *arg) {
+    int uttPos;
+    MemHeap pbufHeap, obsHeap;
+    Observation obs;
+    UttPrefetch *pf = (UttPrefetch *) arg;
+    UttSlot *slot;
+
+    CreateHeap(&pbufHeap, "pbufStore", MSTAK, 1, 0.5, 1000, 10000);
+    CreateHeap(&obsHeap, "obsStore", MSTAK, 1, 0.5, 1000, 10000);
+    obs = MakeObservation(&obsHeap, pf->cache->obs->swidth, pf->cache->obs->pk, FALSE, pf->cache->obs->eSep);
+    while (TRUE) {
+        pthread_mutex_lock(&pf->lock);
+        while (!pf->stop && pf->nxtPos >= pf->endPos) {
+            pthread_cond_wait(&pf->cond, &pf->lock);
+        }
+        if (pf->stop) {
+            pthread_mutex_unlock(&pf->lock);
+            break;
+        }
+        uttPos = pf->nxtPos++;
+        slot = &pf->slots[uttPos % pf->nSlots];
+        slot->uttPos = uttPos;
+        slot->state = BUSYSS;
+        pthread_mutex_unlock(&pf->lock);
+        ParseUttSlot(pf, uttPos, &pbufHeap, &obs);
+        pthread_mutex_lock(&pf->lock);
+        slot->state = READYSS;
+        pthread_cond_broadcast(&pf->cond);
+        pthread_mutex_unlock(&pf->lock);
+    }
+    DeleteHeap(&obsHeap);
+    DeleteHeap(&pbufHeap);
+    return NULL;
+}
+
+/* read the script and start the load workers */
+static UttPrefetch *StartUttPrefetch(DataCache *cache, int nThreads) {
+    int i;
+    char buf[MAXSTRLEN];
+    UttPrefetch *pf;
+
+    pf = (UttPrefetch *) New(cache->cmem, sizeof(UttPrefetch));
+    pf->cache = cache;
+    pf->scpWords = (char **) New(cache->cmem, cache->tUttNum * sizeof(char *));
+    for (i = 0; i < cache->tUttNum; ++i) {
+        if (GetNextRawScpWord(cache->scpFile, buf) == NULL) {
+            HError(9999, "StartUttPrefetch: Fail to read the next word in the script");
+        }
+        pf->scpWords[i] = CopyString(cache->cmem, buf);
+    }
+    rewind(cache->scpFile);
+    pf->nSlots = loadAhead;
+    pf->slots = (UttSlot *) New(cache->cmem, pf->nSlots * sizeof(UttSlot));
+    memset(pf->slots, 0, pf->nSlots * sizeof(UttSlot));
+    for (i = 0; i < pf->nSlots; ++i) {
+        pf->slots[i].state = EMPTYSS;
+        CreateHeap(&pf->slots[i].labHeap, "labStore", MSTAK, 1, 0.5, 1000, 10000);
+    }
+    pthread_mutex_init(&pf->lock, NULL);
+    pthread_cond_init(&pf->cond, NULL);
+    pf->nxtPos = 0;
+    pf->endPos = 0;
+    pf->stop = FALSE;
+    pf->nThreads = nThreads;
+    pf->threads = (pthread_t *) New(cache->cmem, nThreads * sizeof(pthread_t));
+    for (i = 0; i < nThreads; ++i) {
+        if (pthread_create(&pf->threads[i], NULL, UttPrefetchWorker, (void *) pf) != 0) {
+            HError(9999, "StartUttPrefetch: Fail to create the load threads");
+        }
+    }
+    return pf;
+}
+
+/* open the window at uttPos and return its slot once parsed; if no
+   worker has taken uttPos yet, it is parsed here */
+static UttSlot *TakeUttSlot(UttPrefetch *pf, int uttPos) {
+    Boolean parseHere = FALSE;
+    UttSlot *slot = &pf->slots[uttPos % pf->nSlots];
+
+    pthread_mutex_lock(&pf->lock);
+    pf->endPos = uttPos + pf->nSlots;
+    if (pf->endPos > pf->cache->tUttNum) {
+        pf->endPos = pf->cache->tUttNum;
+    }
+    if (pf->nxtPos <= uttPos) {
+        pf->nxtPos = uttPos + 1;
+        slot->uttPos = uttPos;
+        slot->state = BUSYSS;
+        parseHere = TRUE;
+    }
+    pthread_cond_broadcast(&pf->cond);
+    pthread_mutex_unlock(&pf->lock);
+    if (parseHere) {
+        ParseUttSlot(pf, uttPos, &pbufStack, pf->cache->obs);
+        pthread_mutex_lock(&pf->lock);
+        slot->state = READYSS;
+    }
+    else {
+        pthread_mutex_lock(&pf->lock);
+        while (slot->state != READYSS) {
+            pthread_cond_wait(&pf->cond, &pf->lock);
+        }
+    }
+    pthread_mutex_unlock(&pf->lock);
+    if (slot->uttPos != uttPos) {
+        HError(9999, "TakeUttSlot: Utterance %d found in the slot of %d", slot->uttPos, uttPos);
+    }
+    return slot;
+}
+
+/* release the slot of uttPos, once committed, and move the window past it */
+static void ReleaseUttSlot(UttPrefetch *pf, int uttPos) {
+
+    pthread_mutex_lock(&pf->lock);
+    pf->slots[uttPos % pf->nSlots].trans = NULL;
+    pf->slots[uttPos % pf->nSlots].state = EMPTYSS;
+    pf->endPos = uttPos + 1 + pf->nSlots;
+    if (pf->endPos > pf->cache->tUttNum) {
+        pf->endPos = pf->cache->tUttNum;
+    }
+    pthread_cond_broadcast(&pf->cond);
+    pthread_mutex_unlock(&pf->lock);
+}
+
+/* restart the window from the first utterance, once the utterances
+   being parsed are done; the uncommitted ones are freed */
+static void ResetUttPrefetch(UttPrefetch *pf) {
+    int i;
+    Boolean busy;
+
+    pthread_mutex_lock(&pf->lock);
+    pf->endPos = 0;
+    do {
+        for (i = 0, busy = FALSE; i < pf->nSlots && !busy; ++i) {
+            busy = (pf->slots[i].state == BUSYSS);
+        }
+        if (busy) {
+            pthread_cond_wait(&pf->cond, &pf->lock);
+        }
+    } while (busy);
+    for (i = 0; i < pf->nSlots; ++i) {
+        if (pf->slots[i].state == READYSS) {
+            FreeUttSlot(pf->cache, &pf->slots[i]);
+        }
+    }
+    pf->nxtPos = 0;
+    pthread_mutex_unlock(&pf->lock);
+}
+
+/* stop and release the load workers and the slots */
+static void StopUttPrefetch(UttPrefetch *pf) {
+    int i;
+
+    ResetUttPrefetch(pf);
+    pthread_mutex_lock(&pf->lock);
+    pf->stop = TRUE;
+    pthread_cond_broadcast(&pf->cond);
+    pthread_mutex_unlock(&pf->lock);
+    for (i = 0; i < pf->nThreads; ++i) {
+        pthread_join(pf->threads[i], NULL);
+    }
+    for (i = 0; i < pf->nSlots; ++i) {
+        DeleteHeap(&pf->slots[i].labHeap);
+    }
+    pthread_cond_destroy(&pf->cond);
+    pthread_mutex_destroy(&pf->lock);
+}
+
 /* use to create a cache */
 /* if labelInfo == NULL, then no label is available */
 DataCache *CreateCache(MemHeap *heap, FILE *scpFile, int scpCnt, HMMSet *hset, Observation *obs, int streamIdx, size_t cacheSamples, VisitKind visitKind, XFInfo *xfInfo, LabelInfo *labelInfo, Boolean saveUttName) {
@@ -464,6 +1321,11 @@ DataCache *CreateCache(MemHeap *heap, FILE *scpFile, int scpCnt, HMMSet *hset, O
     cache->saveUttName = saveUttName;
     /* 7. set xfInfo */
     cache->xfInfo = xfInfo;
+    /* 8. start the load pool */
+    cache->prefetch = NULL;
+    if (loadThreads > 0) {
+        cache->prefetch = StartUttPrefetch(cache, loadThreads);
+    }
 
     
     cache->uttrIdx2Name = (char* *) malloc(sizeof(char *) * scpCnt); //cw564 - mb
@@ -524,6 +1386,9 @@ void ResetCache(DataCache *cache) {
     /* reset file handler */
     if (need2Unload) {
         rewind(cache->scpFile);
+        if (cache->prefetch != NULL) {
+            ResetUttPrefetch(cache->prefetch);
+        }
     }
     /* initialise the cache */
     /*InitCache(cache);*/
@@ -531,6 +1396,11 @@ void ResetCache(DataCache *cache) {
 
 /* A function to release the whole cache */
 void FreeCache(DataCache *cache) {
+    /* stop the load pool */
+    if (cache->prefetch != NULL) {
+        StopUttPrefetch(cache->prefetch);
+        cache->prefetch = NULL;
+    }
     /* release the rest loaded utterances */
     CleanCache(cache);
     /* release uttElems */
@@ -553,25 +1423,19 @@ void FreeCache(DataCache *cache) {
 
 /* load one utterance into cache, at dstPos (usually nxtUttPos) */
 static ReturnStatus LoadOneUtt(DataCache *cache, int dstPos) {
-    int i, j, len, dim, sIdx, lsIdx = 0, transcnt;	/* cz277 - trans */
+    int i, j, len, sIdx, lsIdx = 0, transcnt;	/* cz277 - trans */
     long stIdx, edIdx, curIdx;
-    char feaBuf[256], spkBuf[256], labBuf[256], hmmBuf[256];
-    char fnBuf[256], pathBuf[256], latBuf[256];
-    FILE *filePtr;
-    Boolean isPipe, isPhoneLab;	/* cz277 - trans */
-    Observation *obs;
+    char feaBuf[256], hmmBuf[256], liveBuf[MAXSTRLEN];
+    Boolean isPhoneLab;	/* cz277 - trans */
     UttElem *uttElem;
-    float *dstPtr;
-    Vector x;
+    UttSlot *slot = NULL;
     Transcription *trans;
     LLink llink;
     MLink macDef;
     StreamElem *streamElem;
     HLink hlink;
-    ParmBuf parmBuf;
-    BufferInfo pbInfo;
     LabId hmmId = NULL, lhmmId;	/* cz277 - trans */
-    Vector tmpVec;
+    HTime sampRate;
     /* cz277 - trans */
     TrAcc *ta;
 
@@ -579,8 +1443,13 @@ static ReturnStatus LoadOneUtt(DataCache *cache, int dstPos) {
     if (dstPos >= cache->tUttNum) {
         return FAIL;
     }
+    if (cache->prefetch != NULL) {
+        /* the script has been read, and the utterance parsed, by the load pool */
+        slot = TakeUttSlot(cache->prefetch, dstPos);
+        strcpy(feaBuf, slot->uttName);
+    }
     /* if no word to read in the script */
-    if (GetNextScpWord(cache->scpFile, feaBuf) == NULL) {
+    else if (GetNextScpWord(cache->scpFile, feaBuf) == NULL) {
         HError(9999, "LoadOneUtt: Fail to read the next word in the script");
     }
 
@@ -608,66 +1477,42 @@ static ReturnStatus LoadOneUtt(DataCache *cache, int dstPos) {
     if (cache->xfInfo != NULL) {
         UpdateSpkrStats(cache->hmmSet, cache->xfInfo, feaBuf);
     }
-    /* reset the heap for the next utterance */
-    ResetHeap(&pbufStack);
-    /* open the next utterance */
-    parmBuf = OpenBuffer(&pbufStack, feaBuf, 0, UNDEFF, TRI_UNDEF, TRI_UNDEF);
-    if (!parmBuf) {
-        HError(9999, "LoadOneUtt: Open input data failed");
-    }
-    /* prepare to load the data */
+    /* parse the utterance, or take it from the load pool */
     uttElem = &cache->uttElems[dstPos];
+    if (slot != NULL) {
+        *uttElem = slot->utt;
+        trans = slot->trans;
+        sampRate = slot->sampRate;
+    }
+    else {
+        sampRate = ParseOneUtt(cache, feaBuf, uttElem, &trans, &pbufStack, &transStack, cache->obs);
+    }
+    if (simLive && feaArchive == NULL) {
+        /* replay the waveform as a live stream */
+        if (slot != NULL) {
+            /* the extended name was registered by the parsing thread */
+            strcpy(liveBuf, cache->prefetch->scpWords[dstPos]);
+            sampRate = LoadUttLive(cache, uttElem, RegisterExtFileName(liveBuf));
+        }
+        else {
+            sampRate = LoadUttLive(cache, uttElem, feaBuf);
+        }
+    }
     if (cache->saveUttName) {
         /* cz277 - newstr */
         /*uttElem->uttName = (char *) New(cache->cmem, 256);
         strcpy(uttElem->uttName, feaBuf);*/
         uttElem->uttName = CopyString(cache->cmem, feaBuf);
     }
-    uttElem->uttLen = ObsInBuffer(parmBuf);
     uttElem->frmUsed = 0; /* the usage counter of the frames */
-    /* load all frames into cache */
     len = uttElem->uttLen;
-    dim = cache->frmDim;
-    obs = cache->obs;
-    uttElem->frmMat = (float *) New(cache->cmem, len * dim * sizeof(float));
-    dstPtr = uttElem->frmMat;
-    for (i = 0; i < len; ++i) {
-        ReadAsTable(parmBuf, i, obs);
-        x = obs->fv[cache->streamIdx];
-        /* TODO: apply compFX form */
-        /* ApplyCompXForm ??? */
-        for (j = 1; j <= dim; ++j, ++dstPtr) {   /* just copy the data */
-            if (isnan(x[j]))
-                HError(9999, "LoadOneUtt: %s, frame no. %d, dim %d has nan value", uttElem->uttName, i, j);
-            if (isinf(x[j]))
-                HError(9999, "LoadOneUtt: %s, frame no. %d, dim %d has inf value", uttElem->uttName, i, j);
-            *dstPtr = x[j];
-        }
-    }
-    /* cz277 - aug */
-    /* load the augmented feature vectors */
-    for (i = 1; i <= MAXAUGFEAS; ++i) {
-        uttElem->augFeaVec[i] = NULL;
-        if (cache->streamIdx == 1) {
-            tmpVec = GetAugFeaVector(parmBuf, i);
-            if (tmpVec != NULL) {
-                uttElem->augFeaVec[i] = CreateVector(cache->cmem, VectorSize(tmpVec));
-                CopyVector(tmpVec, uttElem->augFeaVec[i]);
-            }
-        }
-    }
-    
-    /* close current buffer */
-    CloseBuffer(parmBuf);
-    /* set frmOrder */
+    /* set frmOrder, to be shuffled by UpdateUttOrder */
     if (cache->visitKind == PLUTTFRMVK || cache->visitKind == UTTFRMVK) {
         /* initialise */
         uttElem->frmOrder = (int *) New(cache->cmem, len * sizeof(int));
         for (i = 0; i < len; ++i) {
             uttElem->frmOrder[i] = i;
         }
-        /* shuffle the order array */
-        ShuffleSegment(uttElem->frmOrder, 0, len, sizeof(int));
     }
     else {
         uttElem->frmOrder = NULL;
@@ -694,18 +1539,7 @@ static ReturnStatus LoadOneUtt(DataCache *cache, int dstPos) {
     if (cache->labelInfo != NULL) {
         /* process lab files */
         uttElem->labIdxes = NULL;
-        if ((cache->labelInfo->labelKind & LABLK) != 0) { /* load lab files */
-            if (cache->labelInfo->labFileMask != NULL) {
-                if (!MaskMatch(cache->labelInfo->labFileMask, spkBuf, feaBuf)) {
-                    HError(9999, "LoadOneUtt: Mask %s has no match with segment %s", cache->labelInfo->labFileMask, feaBuf);
-                }
-                MakeFN(spkBuf, cache->labelInfo->labDir, cache->labelInfo->labExt, labBuf);
-            }
-            else {
-                MakeFN(feaBuf, cache->labelInfo->labDir, cache->labelInfo->labExt, labBuf);
-            }
-            ResetHeap(&transStack);
-            trans = LOpen(&transStack, labBuf, UNDEFF);
+        if ((cache->labelInfo->labelKind & LABLK) != 0) { /* the lab file read by ParseOneUtt */
             /* convert trans to labIdxes */
             uttElem->labIdxes = (int *) New(cache->cmem, len * sizeof(int));
             i = 0;
@@ -752,9 +1586,8 @@ static ReturnStatus LoadOneUtt(DataCache *cache, int dstPos) {
                     HError(9999, "LoadOneUtt: Only one output layer is allowed in one stream");
                 }
                 /* get the frame indexes */
-                GetBufferInfo(parmBuf, &pbInfo);
-                stIdx = (long) (llink->start / pbInfo.tgtSampRate + 0.5);
-                edIdx = (long) (llink->end / pbInfo.tgtSampRate + 0.5);
+                stIdx = (long) (llink->start / sampRate + 0.5);
+                edIdx = (long) (llink->end / sampRate + 0.5);
                 if (stIdx > edIdx) {
                     HError(9999, "LoadOneUtt: Empty segment");
                 }
@@ -803,110 +1636,10 @@ static ReturnStatus LoadOneUtt(DataCache *cache, int dstPos) {
                 HError(9999, "LoadOneUtt: Feature and Utterance file length do not match");
             }
         }
-        /* process lattice files */
-        if (((cache->labelInfo->labelKind & LATLK) != 0) && (cache->streamIdx == 1)) { /* load lattice files */
-            /*CreateHeap(&uttElem->latStack, "latStore", MSTAK, 1, 1.0, 5000, 500000);*/
-            uttElem->numInDen = NULL;
-            for (i = 0; i < MAXLATSUTT; ++i) {
-                uttElem->denLats[i] = NULL;
-                uttElem->numLats[i] = NULL;
-            }
-            /* set basic lattice file mask */
-            if (cache->labelInfo->latFileMask != NULL) {
-                if (!MaskMatch(cache->labelInfo->latFileMask, latBuf, feaBuf)) {
-                    HError(9999, "LoadOneUtt: Mask %s has no match with segment %s", cache->labelInfo->latFileMask, feaBuf);
-                }
-            }
-            else {
-                strcpy(latBuf, feaBuf);
-            }
-            /* load denorminator lattices */
-            if (cache->labelInfo->nDenLats > 0) {
-                for (i = 0; i < cache->labelInfo->nDenLats; ++i) {
-                    if (cache->labelInfo->denLatSubDirPat[0]) {
-                        if (!MaskMatch(cache->labelInfo->denLatSubDirPat, spkBuf, latBuf)) {
-                            HError(9999, "LoadOneUtt: Mask %s has not match with segment %s", cache->labelInfo->denLatSubDirPat, latBuf);
-                        }
-                        MakeFN(spkBuf, cache->labelInfo->denLatDir[i], NULL, pathBuf);
-                    }
-                    else {
-                        strcpy(pathBuf, cache->labelInfo->denLatDir[i]);
-                    }
-                    if (cache->labelInfo->latMaskDen != NULL) {
-                        if (!MaskMatch(cache->labelInfo->latMaskDen, spkBuf, latBuf)) {
-                            HError(9999, "LoadOneUtt: Mask %s has not match with segment %s", cache->labelInfo->latMaskDen, latBuf);
-                        }
-                        MakeFN(spkBuf, pathBuf, NULL, fnBuf);
-                        strcpy(pathBuf, fnBuf); 
-                    }
-                    if (cache->labelInfo->useLLF) {
-                        uttElem->denLats[i] = GetLattice(latBuf, pathBuf, cache->labelInfo->latExt, cache->cmem, cache->labelInfo->vocab, FALSE, TRUE);    
-                        /*GetLatticeNoRet(latBuf, pathBuf, cache->labelInfo->latExt, cache->cmem, cache->labelInfo->vocab, FALSE, TRUE, &uttElem->denLats[i]);*/
-                    }
-                    else {
-                        MakeFN(latBuf, pathBuf, cache->labelInfo->latExt, fnBuf);
-                        filePtr = FOpen(fnBuf, NetFilter, &isPipe);
-                        if (!filePtr) {
-                            HError(9999, "LoadOneUtt: Could not open file %s", fnBuf);
-                        }
-                        /* printf("Reading lattice from file: %s\n", fnBuf); fflush(stdout); */
-                        uttElem->denLats[i] = ReadLattice(filePtr, cache->cmem, cache->labelInfo->vocab, FALSE, TRUE);
-                        /*uttElem->denLats[i] = ReadLattice(filePtr, &uttElem->latStack, cache->labelInfo->vocab, FALSE, TRUE);*/
-                        FClose(filePtr, isPipe);
-                    }
-                }
-            }
-            /* load numerator lattices */
-            if (cache->labelInfo->nNumLats > 0) {
-                uttElem->numInDen = (Boolean *) New(cache->cmem, cache->labelInfo->nNumLats * sizeof(Boolean));
-                /*uttElem->numInDen = (Boolean *) New(&uttElem->latStack, cache->labelInfo->nNumLats * sizeof(Boolean));*/
-                /*memset(uttElem->numInDen, 1, cache->labelInfo->nNumLats * sizeof(Boolean));*/
-                for (i = 0; i < cache->labelInfo->nNumLats; ++i) {
-                    if (cache->labelInfo->numLatSubDirPat[0]) {
-                        if (!MaskMatch(cache->labelInfo->numLatSubDirPat, spkBuf, latBuf)) {
-                            HError(9999, "LoadOneUtt: Mask %s has no match with segment %s", cache->labelInfo->numLatSubDirPat, latBuf);
-                        }
-                        MakeFN(spkBuf, cache->labelInfo->numLatDir[i], NULL, pathBuf);
-                    }
-                    else {
-                        strcpy(pathBuf, cache->labelInfo->numLatDir[i]);
-                    }
-                    if (cache->labelInfo->latMaskNum != NULL) {
-                        if (!MaskMatch(cache->labelInfo->latMaskNum, spkBuf, latBuf)) {
-                            HError(9999, "LoadOneUtt: Mask %s has not match with segment %s", cache->labelInfo->latMaskNum, latBuf);
-                        }
-                        MakeFN(spkBuf, pathBuf, NULL, fnBuf);
-                        strcpy(pathBuf, fnBuf);
-                    }
-                    if (cache->labelInfo->useLLF) {
-                        uttElem->numLats[i] = GetLattice(latBuf, pathBuf, cache->labelInfo->latExt, cache->cmem, cache->labelInfo->vocab, FALSE, TRUE);
-                        /*GetLatticeNoRet(latBuf, pathBuf, cache->labelInfo->latExt, cache->cmem, cache->labelInfo->vocab, FALSE, TRUE, &uttElem->numLats[i]);*/
-                    }
-                    else {
-                        MakeFN(latBuf, pathBuf, cache->labelInfo->latExt, fnBuf);
-                        filePtr = FOpen(fnBuf, NetFilter, &isPipe);
-                        if (!filePtr) {
-                            HError(9999, "LoadOneUtt: Could not open file %s", fnBuf);
-                        }
-                        uttElem->numLats[i] = ReadLattice(filePtr, cache->cmem, cache->labelInfo->vocab, FALSE, TRUE);
-                        FClose(filePtr, isPipe);
-                    }
-                    /* to include this num lattice as a den lattice or not */
-                    uttElem->numInDen[i] = TRUE;
-                    if (cache->labelInfo->incNumInDen == TRUE) {
-                        for (j = 0; j < cache->labelInfo->nDenLats; ++j) {
-                            if (LatInLat(uttElem->numLats[i], uttElem->denLats[j])) {
-                                uttElem->numInDen[i] = FALSE;
-                                break;
-                            }
-                        }
-                    }
-                    else {
-                        uttElem->numInDen[i] = FALSE;
-                    }
-                }
-            }
-        }
+    }
+    /* the slot can take the next utterance */
+    if (slot != NULL) {
+        ReleaseUttSlot(cache->prefetch, dstPos);
     }
 
     return SUCCESS;
@@ -992,8 +1725,10 @@ static void UnloadOneUtt(DataCache *cache, int dstPos) {
     }
     /* update the total number of frame cached */
     cache->frmNum -= uttElem->uttLen;
-    /* release the space for frame matrix */
-    Dispose(cache->cmem, uttElem->frmMat);
+    /* release the space for frame matrix, unless it is in the feature archive */
+    if (!uttElem->frmMapped) {
+        Dispose(cache->cmem, uttElem->frmMat);
+    }
     /*free(uttElem->frmMat);*/
     uttElem->frmMat = NULL;
     /* cz277 - aug */
@@ -1044,6 +1779,8 @@ static void UnloadOneUtt(DataCache *cache, int dstPos) {
 }
 
 static ReturnStatus UpdateUttOrder(DataCache *cache) {
+    int i;
+
     /* if no newly loaded utterances to be indexed */
     if (cache->edUttPos == cache->nxtUttPos) {  /* nxtUttPos stops at tUttNum */
         return FAIL;
@@ -1053,6 +1790,15 @@ static ReturnStatus UpdateUttOrder(DataCache *cache) {
     /* update cache->edUttPos */
     cache->edUttPos = cache->nxtUttPos;
 
+    /* shuffle the frames of the newly loaded utterances here rather than in
+       LoadOneUtt, which may run in the loading thread, so that the use of
+       rand() does not depend on the thread timing */
+    if ((cache->visitKind == UTTFRMVK || cache->visitKind == PLUTTFRMVK) && (cache->revisit == FALSE || need2Unload)) {
+        for (i = cache->stUttPos; i < cache->edUttPos; ++i) {
+            ShuffleSegment(cache->uttElems[i].frmOrder, 0, cache->uttElems[i].uttLen, sizeof(int));
+        }
+    }
+
     /* shuffle the indexes if needed */
     if (cache->visitKind == UTTFRMVK || cache->visitKind == UTTVK || cache->visitKind == PLUTTVK || cache->visitKind == PLUTTFRMVK) {
         ShuffleSegment(cache->uttOrder, cache->stUttPos, cache->edUttPos, sizeof(int));   
@@ -79,6 +79,7 @@ typedef struct _UttElem {
     int uttLen;                 /* the length (frame number) of this utterance */
     int frmUsed;                /* the number of frames processed */
     float *frmMat;              /* the frame matrix; could be NULL if utterance not loaded */
+    Boolean frmMapped;          /* frmMat points into the feature archive, not into the cache heap */
     Vector augFeaVec[MAXAUGFEAS + 1];	/* specify the maximum number of augmented feature vectors */
     int *frmOrder;              /* the frame visiting order within the utterance */
     int *labIdxes;              /* the vector with the indexes for all frames, could be NULL */
@@ -116,6 +117,8 @@ typedef struct _LabelInfo {
     UPDSet uFlags;
 } LabelInfo;
 
+typedef struct _UttPrefetch UttPrefetch;   /* the load pool, private to HNCache */
+
 typedef struct _DataCache {
     /* basic elements */
     MemHeap *cmem;              /* the memory heap for this data cache */
@@ -161,6 +164,7 @@ typedef struct _DataCache {
     XFInfo *xfInfo;
     pthread_t extThread;	/* cz277 - mtload */
     Boolean firstLoad;		/* cz277 - mtload */
+    UttPrefetch *prefetch;	/* the pool parsing the next utterances ahead, NULL if not used */
     
     char* * uttrIdx2Name; //cw564 - mb -- to be removed
     int * uttrIdx2spkrIdx; //cw564 - mb
@@ -197,6 +201,22 @@ void ResetCache(DataCache *cache);
 void FreeCache(DataCache *cache);
 void ResetCacheHMMSetCfg(DataCache *cache, HMMSet *hset);
 
+/* ------------------------ Feature Archives ------------------------ */
+
+/*
+   A feature archive packs the observations of a whole script into one
+   file, which HNCache memory maps when HNCACHE: FEAARCHIVE is set.
+   LoadOneUtt then finds the frames of an utterance by its logical name
+   instead of opening and parsing its parameter file.  The frames are
+   float, one row per frame with all streams, and each utterance starts
+   on a 64 byte boundary.  HNPack builds the archives.
+*/
+typedef struct _FeaArchiveWriter FeaArchiveWriter;
+
+FeaArchiveWriter *CreateFeaArchive(char *fn, short *swidth, ParmKind pk, HTime sampRate);
+void AddFeaArchiveUtt(FeaArchiveWriter *arcw, char *uttName, int uttLen, float *frmMat);
+void CloseFeaArchive(FeaArchiveWriter *arcw);
+
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,449 @@
+/* ----------------------------------------------------------- */
+/*                                                             */
+/*                          ___                                */
+/*                       |_| | |_/   SPEECH                    */
+/*                       | | | | \   RECOGNITION               */
+/*                       =========   SOFTWARE                  */
+/*                                                             */
+/*                                                             */
+/* ----------------------------------------------------------- */
+/* developed at:                                               */
+/*                                                             */
+/*      Machine Intelligence Laboratory                        */
+/*      Cambridge University Engineering Department            */
+/*      http://mil.eng.cam.ac.uk/                              */
+/*                                                             */
+/*                                                             */
+/* ----------------------------------------------------------- */
+/*         Copyright: Microsoft Corporation                    */
+/*          1995-2000 Redmond, Washington USA                  */
+/*                    http://www.microsoft.com                 */
+/*                                                             */
+/*              2002  Cambridge University                     */
+/*                    Engineering Department                   */
+/*                                                             */
+/*   Use of this software is governed by a License Agreement   */
+/*    ** See the file License for the Conditions of Use  **    */
+/*    **     This banner notice must not be removed      **    */
+/*                                                             */
+/* ----------------------------------------------------------- */
+/*         File: HNDist.c   Distributed ANN Training           */
+/* ----------------------------------------------------------- */
+
+char *hndist_version = "!HVER!HNDist:   3.4.1 [CUED 17/10/16]";
+char *hndist_vc_id = "$Id: HNDist.c,v 1.1.1.1 2016/10/17 09:54:58 cz277 Exp $";
+
+/*
+   The workers form a star around worker 0.  For an all-reduce each
+   of the other workers sends its whole buffer and then waits for
+   the result, while worker 0 first reads and adds the buffers of all
+   the others, in rank order, and only then sends the result back.
+   Since worker 0 never sends before it has read everything, the
+   workers cannot block each other however large the buffer is.
+*/
+
+#include "HShell.h"
+#include "HMem.h"
+#include "HNDist.h"
+#include "cfgs.h"
+#include <errno.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+/* --------------------------- Trace Flags ------------------------ */
+
+static int trace = 0;                           /* trace level */
+#define T_TOP 0001                              /* Top level tracing */
+
+static ConfParam *cParm[MAXGLOBS];              /* config parameters */
+static int nParm = 0;
+
+#define MIN(a, b) ((a)<(b)? (a): (b))
+
+/* ------------------------ Global Settings ----------------------- */
+
+#define DISTMAGIC 0x484e4453                    /* "HNDS", sent when a worker connects */
+#define DISTCHUNK 65536                         /* the elements read from a worker at a time */
+
+typedef enum _DistElemKind {DISTFLOAT, DISTDOUBLE} DistElemKind;
+
+static int distRank = 0;                        /* the rank of this worker */
+static int distSize = 1;                        /* the number of workers */
+static char masterHost[MAXSTRLEN] = "127.0.0.1";        /* the host of worker 0 */
+static int masterPort = 27182;                  /* the port worker 0 listens on */
+static int distTimeOut = 60;                    /* seconds to wait for the other workers */
+static int *peerFds = NULL;                     /* worker 0: the socket of each worker; others: [0] only */
+static Boolean distStarted = FALSE;             /* whether StartDist has been called */
+static void *redBuf = NULL;                     /* worker 0: the buffer for the incoming chunks */
+
+/* ------------------------- Socket I/O --------------------------- */
+
+/* write all nbytes of buf to fd */
+static void SendAll(int fd, void *buf, size_t nbytes) {
+    char *ptr = (char *) buf;
+    ssize_t n;
+
+    while (nbytes > 0) {
+        n = send(fd, ptr, nbytes, 0);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            HError(9999, "SendAll: Failed to send to another worker (%s)", strerror(errno));
+        }
+        ptr += n;
+        nbytes -= n;
+    }
+}
+
+/* read exactly nbytes from fd into buf */
+static void RecvAll(int fd, void *buf, size_t nbytes) {
+    char *ptr = (char *) buf;
+    ssize_t n;
+
+    while (nbytes > 0) {
+        n = recv(fd, ptr, nbytes, 0);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            HError(9999, "RecvAll: Failed to receive from another worker (%s)", strerror(errno));
+        }
+        if (n == 0) {
+            HError(9999, "RecvAll: Another worker closed its connection");
+        }
+        ptr += n;
+        nbytes -= n;
+    }
+}
+
+/* set the options of a connected socket */
+static void SetSocketOpts(int fd) {
+    int one = 1;
+
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(int));
+}
+
+/* resolve the address of worker 0 */
+static struct addrinfo *GetMasterAddr(Boolean passive) {
+    struct addrinfo hints, *res = NULL;
+    char port[32];
+    int ret;
+
+    memset(&hints, 0, sizeof(struct addrinfo));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    if (passive) {
+        hints.ai_flags = AI_PASSIVE;
+    }
+    sprintf(port, "%d", masterPort);
+    if ((ret = getaddrinfo(masterHost, port, &hints, &res)) != 0) {
+        HError(9999, "GetMasterAddr: Cannot resolve %s (%s)", masterHost, gai_strerror(ret));
+    }
+    return res;
+}
+
+/* worker 0: listen and accept a connection from each other worker */
+static void AcceptWorkers(void) {
+    struct addrinfo *addr;
+    int lfd, fd, i, one = 1;
+    int hello[3];
+
+    addr = GetMasterAddr(TRUE);
+    if ((lfd = socket(addr->ai_family, addr->ai_socktype, addr->ai_protocol)) < 0) {
+        HError(9999, "AcceptWorkers: Cannot create socket (%s)", strerror(errno));
+    }
+    setsockopt(lfd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(int));
+    if (bind(lfd, addr->ai_addr, addr->ai_addrlen) < 0) {
+        HError(9999, "AcceptWorkers: Cannot bind to %s:%d (%s)", masterHost, masterPort, strerror(errno));
+    }
+    freeaddrinfo(addr);
+    if (listen(lfd, distSize) < 0) {
+        HError(9999, "AcceptWorkers: Cannot listen on port %d (%s)", masterPort, strerror(errno));
+    }
+    for (i = 1; i < distSize; ++i) {
+        if ((fd = accept(lfd, NULL, NULL)) < 0) {
+            if (errno == EINTR) {
+                --i;
+                continue;
+            }
+            HError(9999, "AcceptWorkers: Failed to accept a worker (%s)", strerror(errno));
+        }
+        RecvAll(fd, hello, sizeof(hello));
+        if (hello[0] != DISTMAGIC || hello[2] != distSize) {
+            HError(9999, "AcceptWorkers: A worker of another job or with a different NUMWORKERS connected");
+        }
+        if (hello[1] <= 0 || hello[1] >= distSize || peerFds[hello[1]] >= 0) {
+            HError(9999, "AcceptWorkers: Illegal or repeated worker rank %d", hello[1]);
+        }
+        SetSocketOpts(fd);
+        peerFds[hello[1]] = fd;
+        if (trace & T_TOP) {
+            printf("HNDist: Worker %d connected\n", hello[1]);
+            fflush(stdout);
+        }
+    }
+    close(lfd);
+}
+
+/* the other workers: connect to worker 0, retrying until distTimeOut */
+static void ConnectMaster(void) {
+    struct addrinfo *addr;
+    int fd = -1, waited = 0;
+    int hello[3];
+
+    addr = GetMasterAddr(FALSE);
+    while (TRUE) {
+        if ((fd = socket(addr->ai_family, addr->ai_socktype, addr->ai_protocol)) < 0) {
+            HError(9999, "ConnectMaster: Cannot create socket (%s)", strerror(errno));
+        }
+        if (connect(fd, addr->ai_addr, addr->ai_addrlen) == 0) {
+            break;
+        }
+        close(fd);
+        if (waited >= distTimeOut * 10) {
+            HError(9999, "ConnectMaster: Cannot connect to worker 0 at %s:%d", masterHost, masterPort);
+        }
+        usleep(100000);
+        ++waited;
+    }
+    freeaddrinfo(addr);
+    SetSocketOpts(fd);
+    hello[0] = DISTMAGIC;
+    hello[1] = distRank;
+    hello[2] = distSize;
+    SendAll(fd, hello, sizeof(hello));
+    peerFds[0] = fd;
+}
+
+/* ------------------------ Collectives --------------------------- */
+
+/* add the next n elements from worker fd to dst */
+static void RecvAndAdd(int fd, void *dst, size_t n, DistElemKind kind) {
+    size_t i;
+
+    if (kind == DISTFLOAT) {
+        RecvAll(fd, redBuf, n * sizeof(float));
+        for (i = 0; i < n; ++i) {
+            ((float *) dst)[i] += ((float *) redBuf)[i];
+        }
+    }
+    else {
+        RecvAll(fd, redBuf, n * sizeof(double));
+        for (i = 0; i < n; ++i) {
+            ((double *) dst)[i] += ((double *) redBuf)[i];
+        }
+    }
+}
+
+/* sum buf (len elements of kind) over the workers */
+static void DistAllReduce(void *buf, size_t len, DistElemKind kind) {
+    size_t esize, off, n;
+    int i;
+
+    if (distSize <= 1 || len == 0) {
+        return;
+    }
+    if (!distStarted) {
+        HError(9999, "DistAllReduce: StartDist has not been called");
+    }
+    esize = (kind == DISTFLOAT)? sizeof(float): sizeof(double);
+    if (distRank == 0) {
+        /* the chunks of each worker are added in rank order */
+        for (i = 1; i < distSize; ++i) {
+            for (off = 0; off < len; off += n) {
+                n = MIN(DISTCHUNK, len - off);
+                RecvAndAdd(peerFds[i], (char *) buf + off * esize, n, kind);
+            }
+        }
+        for (i = 1; i < distSize; ++i) {
+            SendAll(peerFds[i], buf, len * esize);
+        }
+    }
+    else {
+        SendAll(peerFds[0], buf, len * esize);
+        RecvAll(peerFds[0], buf, len * esize);
+    }
+}
+
+/* EXPORT->DistAllReduceFloat: sum a float buffer over the workers */
+void DistAllReduceFloat(float *buf, size_t len) {
+    DistAllReduce(buf, len, DISTFLOAT);
+}
+
+/* EXPORT->DistAllReduceDouble: sum a double buffer over the workers */
+void DistAllReduceDouble(double *buf, size_t len) {
+    DistAllReduce(buf, len, DISTDOUBLE);
+}
+
+/* EXPORT->DistAllReduceNFloat: sum a NFloat buffer over the workers */
+void DistAllReduceNFloat(NFloat *buf, size_t len) {
+    DistAllReduce(buf, len, (sizeof(NFloat) == sizeof(float))? DISTFLOAT: DISTDOUBLE);
+}
+
+/* EXPORT->DistBroadcast: copy buf of worker 0 to all the others */
+void DistBroadcast(void *buf, size_t nbytes) {
+    int i;
+
+    if (distSize <= 1 || nbytes == 0) {
+        return;
+    }
+    if (!distStarted) {
+        HError(9999, "DistBroadcast: StartDist has not been called");
+    }
+    if (distRank == 0) {
+        for (i = 1; i < distSize; ++i) {
+            SendAll(peerFds[i], buf, nbytes);
+        }
+    }
+    else {
+        RecvAll(peerFds[0], buf, nbytes);
+    }
+}
+
+/* EXPORT->DistBarrier: wait for all the workers */
+void DistBarrier(void) {
+    double one = 1.0;
+
+    DistAllReduceDouble(&one, 1);
+}
+
+/* --------------------------- Scripts ---------------------------- */
+
+/* EXPORT->ShardScript: the share of this worker of the words of script */
+FILE *ShardScript(FILE *script, int *scriptCnt) {
+    FILE *shard;
+    char buf[MAXFNAMELEN];
+    int idx = 0, cnt = 0;
+
+    if (distSize <= 1 || script == NULL) {
+        return script;
+    }
+    if ((shard = tmpfile()) == NULL) {
+        HError(9999, "ShardScript: Cannot create the script of worker %d", distRank);
+    }
+    rewind(script);
+    while (GetNextRawScpWord(script, buf) != NULL) {
+        if (idx++ % distSize == distRank) {
+            /* quote the words that GetNextRawScpWord would split */
+            if (strpbrk(buf, " \t\n") != NULL || buf[0] == '\'' || buf[0] == '"') {
+                fprintf(shard, (strchr(buf, '"') == NULL)? "\"%s\"\n": "'%s'\n", buf);
+            }
+            else {
+                fprintf(shard, "%s\n", buf);
+            }
+            ++cnt;
+        }
+    }
+    if (cnt == 0) {
+        HError(9999, "ShardScript: No script words left for worker %d of %d", distRank, distSize);
+    }
+    fclose(script);
+    rewind(shard);
+    *scriptCnt = cnt;
+    return shard;
+}
+
+/* ------------------------- Initialisation ----------------------- */
+
+/* EXPORT->InitDist: initialise the module and its configuration */
+void InitDist(void) {
+    int intVal;
+    char buf[MAXSTRLEN];
+
+    Register(hndist_version, hndist_vc_id);
+
+    nParm = GetConfig("HNDIST", TRUE, cParm, MAXGLOBS);
+    if (nParm > 0) {
+        if (GetConfInt(cParm, nParm, "TRACE", &intVal)) {
+            trace = intVal;
+        }
+        if (GetConfInt(cParm, nParm, "NUMWORKERS", &intVal)) {
+            if (intVal < 1) {
+                HError(9999, "InitDist: NUMWORKERS should be at least 1");
+            }
+            distSize = intVal;
+        }
+        if (GetConfInt(cParm, nParm, "RANK", &intVal)) {
+            distRank = intVal;
+        }
+        if (GetConfStr(cParm, nParm, "MASTERHOST", buf)) {
+            strcpy(masterHost, buf);
+        }
+        if (GetConfInt(cParm, nParm, "MASTERPORT", &intVal)) {
+            if (intVal <= 0 || intVal > 65535) {
+                HError(9999, "InitDist: MASTERPORT out of range");
+            }
+            masterPort = intVal;
+        }
+        if (GetConfInt(cParm, nParm, "TIMEOUT", &intVal)) {
+            distTimeOut = intVal;
+        }
+    }
+    if (distRank < 0 || distRank >= distSize) {
+        HError(9999, "InitDist: RANK %d out of range for %d workers", distRank, distSize);
+    }
+}
+
+/* EXPORT->StartDist: connect the workers */
+void StartDist(void) {
+    int i;
+
+    if (distSize <= 1 || distStarted) {
+        return;
+    }
+    peerFds = (int *) New(&gcheap, distSize * sizeof(int));
+    for (i = 0; i < distSize; ++i) {
+        peerFds[i] = -1;
+    }
+    if (distRank == 0) {
+        redBuf = New(&gcheap, DISTCHUNK * sizeof(double));
+        AcceptWorkers();
+    }
+    else {
+        ConnectMaster();
+    }
+    distStarted = TRUE;
+    if (trace & T_TOP) {
+        printf("HNDist: Worker %d of %d connected through %s:%d\n", distRank, distSize, masterHost, masterPort);
+        fflush(stdout);
+    }
+}
+
+/* EXPORT->StopDist: wait for all the workers and close the connections */
+void StopDist(void) {
+    int i;
+
+    if (!distStarted) {
+        return;
+    }
+    DistBarrier();
+    for (i = 0; i < distSize; ++i) {
+        if (peerFds[i] >= 0) {
+            close(peerFds[i]);
+            peerFds[i] = -1;
+        }
+    }
+    distStarted = FALSE;
+}
+
+/* EXPORT->IsDistributed: whether this process is one of several workers */
+Boolean IsDistributed(void) {
+    return distSize > 1;
+}
+
+/* EXPORT->GetDistRank: the rank of this worker */
+int GetDistRank(void) {
+    return distRank;
+}
+
+/* EXPORT->GetDistSize: the number of workers */
+int GetDistSize(void) {
+    return distSize;
+}
+
+/* ------------------------- End of HNDist.c -------------------------- */
@@ -0,0 +1,107 @@
+/* ----------------------------------------------------------- */
+/*                                                             */
+/*                          ___                                */
+/*                       |_| | |_/   SPEECH                    */
+/*                       | | | | \   RECOGNITION               */
+/*                       =========   SOFTWARE                  */
+/*                                                             */
+/*                                                             */
+/* ----------------------------------------------------------- */
+/* developed at:                                               */
+/*                                                             */
+/*      Machine Intelligence Laboratory                        */
+/*      Cambridge University Engineering Department            */
+/*      http://mil.eng.cam.ac.uk/                              */
+/*                                                             */
+/*                                                             */
+/* ----------------------------------------------------------- */
+/*         Copyright: Microsoft Corporation                    */
+/*          1995-2000 Redmond, Washington USA                  */
+/*                    http://www.microsoft.com                 */
+/*                                                             */
+/*              2002  Cambridge University                     */
+/*                    Engineering Department                   */
+/*                                                             */
+/*   Use of this software is governed by a License Agreement   */
+/*    ** See the file License for the Conditions of Use  **    */
+/*    **     This banner notice must not be removed      **    */
+/*                                                             */
+/* ----------------------------------------------------------- */
+/*         File: HNDist.h   Distributed ANN Training           */
+/* ----------------------------------------------------------- */
+
+/* !HVER!HNDist.h:   3.4.1 [CUED 17/10/16] */
+
+/*
+   This module connects the processes of a distributed training
+   job.  Each process is a worker with a rank in [0, NUMWORKERS);
+   the other workers connect to worker 0 over TCP at MASTERHOST and
+   MASTERPORT, so that the job can run on one host over the loopback
+   interface or on several hosts.  Worker 0 sums the buffers of all
+   workers in rank order and sends the result back, so every worker
+   gets bit identical results.  When NUMWORKERS is 1 (the default)
+   every routine below is a no-op.
+*/
+
+#ifndef _HNDIST_H_
+#define _HNDIST_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdio.h>
+#include "HMem.h"
+
+void InitDist(void);
+/*
+   Initialise the module and load its configuration parameters
+*/
+
+void StartDist(void);
+/*
+   Connect the workers of the job; worker 0 waits for all the others
+   and the others retry until TIMEOUT seconds have passed
+*/
+
+void StopDist(void);
+/*
+   Wait for all the workers and close the connections
+*/
+
+Boolean IsDistributed(void);
+int GetDistRank(void);
+int GetDistSize(void);
+
+void DistAllReduceFloat(float *buf, size_t len);
+void DistAllReduceDouble(double *buf, size_t len);
+void DistAllReduceNFloat(NFloat *buf, size_t len);
+/*
+   Replace buf on every worker by the sum of buf over all workers
+*/
+
+void DistBroadcast(void *buf, size_t nbytes);
+/*
+   Copy the nbytes of buf on worker 0 into buf on all the others
+*/
+
+void DistBarrier(void);
+/*
+   Return when all workers have called DistBarrier
+*/
+
+FILE *ShardScript(FILE *script, int *scriptCnt);
+/*
+   Return a script with the share of this worker of the words of
+   script: every NUMWORKERS-th word starting from the rank.  The
+   words are kept as they are, so extended file names still work.
+   scriptCnt is updated to the size of the share.
+*/
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  /* _HNDIST_H_ */
+
+/* ------------------------- End of HNDist.h -------------------------- */
@@ -48,6 +48,11 @@ char *hnet_vc_id = "$Id: HNet.c,v 1.1.1.1 2006/10/11 09:54:58 jal58 Exp $";
 #include "HDict.h"
 #include "HNet.h"
 
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
 /* ----------------------------- Trace Flags ------------------------- */
 
 #define T_CXT 0001         /* Trace context definitions */
@@ -116,6 +121,17 @@ char *subLatEnd="!)_SUBLAT",subLatEndBuf[MAXSTRLEN];
 /* if TRUE, logical hmm name will be used in phone-marked lattices*/
 static Boolean markLogHmm = FALSE;
 
+static Boolean compileNet = TRUE;
+/*
+   Lay out expanded networks in flat node and link arrays
+*/
+
+static LatArchive *latArchive = NULL;
+/*
+   Archive of binary lattices searched by ReadArchiveLattice
+*/
+static LatArchive *OpenLatArchive(char *fn);
+
 /* --------------------------- Initialisation ---------------------- */
 
 /* EXPORT->InitNet: register module & set configuration parameters */
@@ -123,6 +139,7 @@ void InitNet(void)
 {
    Boolean b;
    int i;
+   char buf[MAXFNAMELEN];
 
    Register(hnet_version,hnet_vc_id);
    nParm = GetConfig("HNET", TRUE, cParm, MAXGLOBS);
@@ -145,6 +162,9 @@ void InitNet(void)
       
       /* sxz20: config this in lib/settings/scoremark.cfg, HNET:MARKLOGHMM=T */
       if (GetConfBool(cParm,nParm,"MARKLOGHMM",&b)) markLogHmm = b;
+      if (GetConfBool(cParm,nParm,"COMPILENET",&b)) compileNet = b;
+      if (GetConfStr(cParm,nParm,"LATARCHIVE",buf)) 
+         latArchive = OpenLatArchive(buf);
    }
    /* cz277 - ANN */
    CreateHeap(&netstak, "HNet Stack", MSTAK, 1, 0.0, 100000, ULONG_MAX);
@@ -373,7 +393,7 @@ static Lattice *GetSubLat(LabId subLatId,Lattice *subLat)
 {
    int h;
    Lattice *cur,*nxt;
-   static Lattice **subLatHashTab = NULL;
+   static __thread Lattice **subLatHashTab = NULL; /* one per reading thread */
 
    if (subLatHashTab==NULL) {
       /* Need to allocate and initialise table */
@@ -687,12 +707,21 @@ ReturnStatus WriteOneLattice(Lattice *lat,FILE *file,LatFormat format)
    return(SUCCESS);
 }
 
+/* The binary form of lattices is at the end of this file */
+#define LATFILEMAGIC "\001HTKLAT"
+
+static long long WriteBinLattice(Lattice *lat,FILE *file);
+static Lattice *ReadBinLattice(FILE *file,MemHeap *heap,Vocab *voc,
+                               Boolean shortArc,Boolean add2Dict);
+
 /* EXPORT->WriteLattice: Write lattice to file */
 ReturnStatus WriteLattice(Lattice *lat,FILE *file,LatFormat format)
 {
    LabId id;
    Lattice *list;
    
+   if (format&HLAT_BLAT)
+      return((WriteBinLattice(lat,file)<0)?FAIL:SUCCESS);
    fprintf(file,"VERSION=%s\n",L_VERSION);
    if (lat->utterance!=NULL)
       fprintf(file,"UTTERANCE=%s\n",lat->utterance);
@@ -808,7 +837,7 @@ static char *GetNextFieldName(char *buf, char *del, Source *src)
 /* GetFieldValue: into buf and return type */
 static LatFieldType GetFieldValue(char *buf, Source *src, int buflen)
 {
-   static char tmp[MAXSTRLEN*10];
+   char tmp[MAXSTRLEN*10];
    int ch;
   
    ch=GetCh(src);
@@ -1296,7 +1325,13 @@ Lattice *ReadLattice(FILE *file, MemHeap *heap, Vocab *voc,
 {
    Lattice *lat,*list,*fLat;
    Source source;
+   int c;
  
+   if ((c=getc(file))!=EOF) {
+      ungetc(c,file);
+      if (c==LATFILEMAGIC[0])
+         return(ReadBinLattice(file,heap,voc,shortArc,add2Dict));
+   }
    AttachSource(file,&source);
 
    if((lat=ReadOneLattice(&source,heap,voc,shortArc,add2Dict))==NULL)
@@ -3695,17 +3730,25 @@ Network *ExpandWordNet(MemHeap *heap,Lattice *lat,Vocab *voc,HMMSet *hset)
    Word thisWord;
    PronHolder *pInst;
    LNode *thisLNode;
-   MemHeap holderHeap;
+   MemHeap holderHeap,expHeap;
    int i,j,p,q,nc,nNull;
 
    /* Initialise */
    CreateHeap(&holderHeap,"Holder Heap",MSTAK,1,0.0,80000,80000);
 
    net=(Network*) New(heap,sizeof(Network));
-   net->heap=heap;
+   /* A network to be compiled is built on a scratch heap, so that
+      only the compiled arrays are left on heap */
+   if (compileNet) {
+      CreateHeap(&expHeap,"Expand Heap",MSTAK,1,1.0,80000,8000000);
+      net->heap=&expHeap;
+   }
+   else
+      net->heap=heap;
    net->vocab=voc;
    net->numNode=net->numLink=0;
    net->chain=NULL;
+   net->nodes=NULL; net->links=NULL;
 
    if (!(allowXWrdExp || allowCxtExp) ||
        (forceCxtExp==FALSE && forceRightBiphones==FALSE &&
@@ -3863,10 +3906,12 @@ Network *ExpandWordNet(MemHeap *heap,Lattice *lat,Vocab *voc,HMMSet *hset)
    /* Count the initial/final nodes/links */
    net->numLink=net->initial.nlinks;
    net->numNode=2;
+   net->initial.aux=0; net->final.aux=1;
    /* now reorder links and identify wd0 nodes */
    for (chainNode = net->chain, ncn=0; chainNode != NULL; 
         chainNode = chainNode->chain,net->numNode++,ncn++) {
       chainNode->inst=NULL;
+      chainNode->aux=net->numNode;   /* Index for per-recogniser tables */
       chainNode->type=chainNode->type&n_nocontext;
       net->numLink+=chainNode->nlinks;
       /* Make !NULL words really NULL */
@@ -3903,10 +3948,1014 @@ Network *ExpandWordNet(MemHeap *heap,Lattice *lat,Vocab *voc,HMMSet *hset)
              net->numLink,nil,nxl,nnl);
       fflush(stdout);
    }
+   if (compileNet) {
+      net->heap=heap;
+      CompileNetwork(net);
+      DeleteHeap(&expHeap);
+   }
    if (trace&T_ALL)
       PrintChain(net,hset);
 
    return(net);
 }   
 
+/* ----------------------- Compiled Networks ------------------------ */
+
+/* 
+   A compiled network has its nodes in one array, in breadth first
+   order from the initial node, and the links of each node in one
+   array straight after those of the node before, so that the models
+   likely to be active together are close in memory.  Node n of the
+   array is node n+2 of the network (initial is 0 and final is 1), 
+   which is its aux index.
+
+   The file form holds the same arrays with indexes for pointers and
+   string table offsets for the models, words and tags.  It is mapped
+   into memory and translated in a single pass.
+*/
+
+#define NETFILEMAGIC "HTKCNET"
+#define NETFILEVERSION 1
+#define NETFILEBYTEORDER 0x01020304
+
+typedef struct {
+   char magic[8];          /* NETFILEMAGIC */
+   int byteOrder;          /* NETFILEBYTEORDER as written */
+   int version;            /* NETFILEVERSION */
+   int numNode;            /* Nodes including initial and final */
+   int numLink;            /* Links including those of initial */
+   int teeWords;           /* Network has tee words */
+   int nullWord;           /* !NULL is a real null word */
+   long long nodeOff;      /* Offset of array[0..numNode-1] of NetFileNode */
+   long long linkOff;      /* Offset of array[0..numLink-1] of NetFileLink */
+   long long strOff;       /* Offset of the string table */
+   long long strSize;      /* Size of the string table */
+} NetFileHeader;
+
+typedef struct {
+   int type;               /* Node type */
+   int name;               /* Physical HMM or word name, -1 == NULL pron */
+   int pnum;               /* Pronunciation number of word nodes */
+   int tag;                /* Semantic tag, -1 == none */
+   int labid;              /* Logical HMM name, -1 == none or not a model */
+   int nlinks;             /* Number of links */
+   int link;               /* Index of first link */
+} NetFileNode;
+
+typedef struct {
+   int node;               /* Index of node linked to */
+   float like;             /* Transition likelihood */
+} NetFileLink;
+
+/* Index of node in a network whose chain nodes have aux set */
+#define NetNodeIndex(net,node) ((node)==&(net)->initial?0:\
+                                (node)==&(net)->final?1:(node)->aux)
+
+/* EXPORT->CompileNetwork: lay net out in flat arrays */
+void CompileNetwork(Network *net)
+{
+   NetNode **order,*node,*dest;
+   NetLink *link;
+   Boolean *seen;
+   int *newIdx;
+   int i,j,n,head,nNode;
+
+   nNode=net->numNode-2;
+   if (nNode<=0 || net->nodes!=NULL) return;
+   order=(NetNode**) New(&gcheap,nNode*sizeof(NetNode*));
+   newIdx=(int*) New(&gcheap,net->numNode*sizeof(int));
+   seen=(Boolean*) New(&gcheap,net->numNode*sizeof(Boolean));
+   for (i=0;i<net->numNode;i++) seen[i]=FALSE;
+   seen[0]=seen[1]=TRUE;
+
+   /* Breadth first from initial, then anything not reached */
+   for (i=0,n=0;i<net->initial.nlinks;i++) {
+      node=net->initial.links[i].node;
+      if (!seen[node->aux]) seen[node->aux]=TRUE,order[n++]=node;
+   }
+   for (head=0;head<n;head++)
+      for (i=0,node=order[head];i<node->nlinks;i++) {
+         dest=node->links[i].node;
+         if (!seen[dest->aux]) seen[dest->aux]=TRUE,order[n++]=dest;
+      }
+   for (node=net->chain;node!=NULL;node=node->chain)
+      if (!seen[node->aux]) seen[node->aux]=TRUE,order[n++]=node;
+   if (n!=nNode)
+      HError(8290,"CompileNetwork: Chain holds %d nodes not %d",n,nNode);
+   newIdx[0]=0; newIdx[1]=1;
+   for (i=0;i<nNode;i++) newIdx[order[i]->aux]=i+2;
+
+   net->nodes=(NetNode*) New(net->heap,nNode*sizeof(NetNode));
+   net->links=(NetLink*) New(net->heap,net->numLink*sizeof(NetLink));
+   link=net->links;
+   for (i=0;i<net->initial.nlinks;i++,link++) {
+      link->node=net->nodes+newIdx[net->initial.links[i].node->aux]-2;
+      link->like=net->initial.links[i].like;
+   }
+   net->initial.links=net->links;
+   net->initial.tag=SafeCopyString(net->heap,net->initial.tag);
+   net->final.tag=SafeCopyString(net->heap,net->final.tag);
+   for (j=0;j<nNode;j++) {
+      node=net->nodes+j;
+      *node=*order[j];
+      node->tag=SafeCopyString(net->heap,order[j]->tag);
+      node->links=(node->nlinks>0)?link:NULL;
+      for (i=0;i<node->nlinks;i++,link++) {
+         dest=order[j]->links[i].node;
+         if (dest==&net->final) link->node=dest;
+         else link->node=net->nodes+newIdx[dest->aux]-2;
+         link->like=order[j]->links[i].like;
+      }
+      node->aux=j+2;
+      node->inst=NULL;
+      node->chain=(j+1<nNode)?node+1:NULL;
+   }
+   net->chain=net->nodes;
+   Dispose(&gcheap,seen);
+   Dispose(&gcheap,newIdx);
+   Dispose(&gcheap,order);
+}
+
+/* String table used while writing a network file */
+#define NETSTRHASHSIZE 4099
+
+typedef struct netstr {
+   char *str;              /* String (pointer is the key) */
+   int off;                /* Offset in the string table */
+   int idx;                /* Index in table order */
+   struct netstr *next;    /* Next in hash bucket */
+   struct netstr *chain;   /* Next in table order */
+} NetStr;
+
+typedef struct {
+   MemHeap heap;
+   NetStr *tab[NETSTRHASHSIZE];
+   NetStr *head,*tail;     /* In table order */
+   int size;
+   int num;
+} NetStrTab;
+
+static void InitNetStrTab(NetStrTab *st)
+{
+   int i;
+
+   CreateHeap(&st->heap,"NetStrTab",MSTAK,1,0.0,10000,100000);
+   for (i=0;i<NETSTRHASHSIZE;i++) st->tab[i]=NULL;
+   st->head=st->tail=NULL; st->size=0; st->num=0;
+}
+
+/* Find str in st, adding it at the end of the table if new */
+static NetStr *NetStrFind(NetStrTab *st,char *str)
+{
+   NetStr *e;
+   unsigned int h;
+
+   h=(unsigned int)(((unsigned long)str>>3)%NETSTRHASHSIZE);
+   for (e=st->tab[h];e!=NULL;e=e->next)
+      if (e->str==str) return(e);
+   e=(NetStr*) New(&st->heap,sizeof(NetStr));
+   e->str=str; e->off=st->size; st->size+=strlen(str)+1;
+   e->idx=st->num++;
+   e->next=st->tab[h]; st->tab[h]=e; e->chain=NULL;
+   if (st->tail==NULL) st->head=e; else st->tail->chain=e;
+   st->tail=e;
+   return(e);
+}
+
+static int NetStrOff(NetStrTab *st,char *str)
+{
+   return((str==NULL)?-1:NetStrFind(st,str)->off);
+}
+
+static int NetStrIdx(NetStrTab *st,char *str)
+{
+   return((str==NULL)?-1:NetStrFind(st,str)->idx);
+}
+
+static void WriteNetData(FILE *f,void *data,size_t size,char *fn)
+{
+   if (size>0 && fwrite(data,size,1,f)!=1)
+      HError(8211,"WriteNetwork: Cannot write network file %s",fn);
+}
+
+/* EXPORT->WriteNetwork: write net to file fn in compiled form */
+ReturnStatus WriteNetwork(Network *net,char *fn,HMMSet *hset)
+{
+   FILE *f;
+   NetFileHeader hdr;
+   NetFileNode fnode;
+   NetFileLink flink;
+   NetStrTab st;
+   NetStr *e;
+   NetNode *node;
+   int i,j,nlink;
+
+   CompileNetwork(net);
+   if ((f=fopen(fn,"wb"))==NULL) {
+      HRError(8211,"WriteNetwork: Cannot create network file %s",fn);
+      return(FAIL);
+   }
+   InitNetStrTab(&st);
+
+   memset(&hdr,0,sizeof(NetFileHeader));
+   memcpy(hdr.magic,NETFILEMAGIC,sizeof(hdr.magic));
+   hdr.byteOrder=NETFILEBYTEORDER;
+   hdr.version=NETFILEVERSION;
+   hdr.numNode=net->numNode;
+   hdr.numLink=net->numLink;
+   hdr.teeWords=net->teeWords;
+   hdr.nullWord=(net->nullWord!=NULL);
+   hdr.nodeOff=sizeof(NetFileHeader);
+   hdr.linkOff=hdr.nodeOff+(long long)net->numNode*sizeof(NetFileNode);
+   hdr.strOff=hdr.linkOff+(long long)net->numLink*sizeof(NetFileLink);
+   WriteNetData(f,&hdr,sizeof(NetFileHeader),fn);
+
+   /* Nodes in index order */
+   for (j=0,nlink=0;j<net->numNode;j++) {
+      node=(j==0)?&net->initial:(j==1)?&net->final:net->nodes+j-2;
+      fnode.type=node->type;
+      if (node->type&n_hmm) {
+         fnode.name=NetStrOff(&st,HMMPhysName(hset,node->info.hmm));
+         fnode.pnum=0;
+      }
+      else if (node->info.pron!=NULL) {
+         fnode.name=NetStrOff(&st,node->info.pron->word->wordName->name);
+         fnode.pnum=node->info.pron->pnum;
+      }
+      else
+         fnode.name=-1,fnode.pnum=0;
+      fnode.tag=NetStrOff(&st,node->tag);
+      /* Only model nodes have a logical name */
+      fnode.labid=(!(node->type&n_hmm) || node->labid==NULL)?-1:
+         NetStrOff(&st,node->labid->name);
+      fnode.nlinks=node->nlinks;
+      fnode.link=nlink;
+      nlink+=node->nlinks;
+      WriteNetData(f,&fnode,sizeof(NetFileNode),fn);
+   }
+   if (nlink!=net->numLink)
+      HError(8290,"WriteNetwork: Network has %d links not %d",nlink,net->numLink);
+   /* Links in the same order */
+   for (j=0;j<net->numNode;j++) {
+      node=(j==0)?&net->initial:(j==1)?&net->final:net->nodes+j-2;
+      for (i=0;i<node->nlinks;i++) {
+         flink.node=NetNodeIndex(net,node->links[i].node);
+         flink.like=node->links[i].like;
+         WriteNetData(f,&flink,sizeof(NetFileLink),fn);
+      }
+   }
+   for (e=st.head;e!=NULL;e=e->chain)
+      WriteNetData(f,e->str,strlen(e->str)+1,fn);
+
+   /* Header again now the string table size is known */
+   hdr.strSize=st.size;
+   if (fseek(f,0,SEEK_SET)!=0)
+      HError(8211,"WriteNetwork: Cannot rewind network file %s",fn);
+   WriteNetData(f,&hdr,sizeof(NetFileHeader),fn);
+   if (fclose(f)!=0)
+      HError(8211,"WriteNetwork: Cannot close network file %s",fn);
+   DeleteHeap(&st.heap);
+   return(SUCCESS);
+}
+
+/* Return the string at offset off of the string table of a network file */
+static char *NetFileStr(char *strs,long long size,int off,char *fn)
+{
+   if (off<0 || off>=size)
+      HError(8250,"ReadNetwork: String offset %d out of range in %s",off,fn);
+   return(strs+off);
+}
+
+/* EXPORT->ReadNetwork: map network file fn, NULL if not a network file */
+Network *ReadNetwork(MemHeap *heap,char *fn,Vocab *voc,HMMSet *hset)
+{
+   Network *net;
+   NetFileHeader *hdr;
+   NetFileNode *fnodes,*fnode;
+   NetFileLink *flinks,*flink;
+   NetNode *node;
+   MLink m;
+   Word word;
+   Pron pron;
+   struct stat sb;
+   char *base,*strs,*name;
+   int fd,i,j;
+   size_t size;
+
+   if ((fd=open(fn,O_RDONLY))<0)
+      return(NULL);
+   if (fstat(fd,&sb)!=0 || sb.st_size<sizeof(NetFileHeader)) {
+      close(fd);
+      return(NULL);
+   }
+   size=sb.st_size;
+   base=(char*) mmap(NULL,size,PROT_READ,MAP_SHARED,fd,0);
+   close(fd);
+   if (base==MAP_FAILED)
+      HError(8210,"ReadNetwork: Cannot map network file %s",fn);
+   hdr=(NetFileHeader*) base;
+   if (memcmp(hdr->magic,NETFILEMAGIC,sizeof(hdr->magic))!=0) {
+      munmap(base,size);
+      return(NULL);
+   }
+   if (hdr->byteOrder!=NETFILEBYTEORDER)
+      HError(8250,"ReadNetwork: %s was written with a different byte order",fn);
+   if (hdr->version!=NETFILEVERSION)
+      HError(8250,"ReadNetwork: %s has unsupported version %d",fn,hdr->version);
+   if (hdr->numNode<2 || hdr->numLink<0 || 
+       hdr->linkOff!=hdr->nodeOff+(long long)hdr->numNode*sizeof(NetFileNode) ||
+       hdr->strOff!=hdr->linkOff+(long long)hdr->numLink*sizeof(NetFileLink) ||
+       hdr->strOff+hdr->strSize>size)
+      HError(8250,"ReadNetwork: The header of %s is corrupted",fn);
+   fnodes=(NetFileNode*) (base+hdr->nodeOff);
+   flinks=(NetFileLink*) (base+hdr->linkOff);
+   strs=base+hdr->strOff;
+
+   net=(Network*) New(heap,sizeof(Network));
+   net->heap=heap;
+   net->vocab=voc;
+   net->teeWords=hdr->teeWords;
+   net->nullWord=NULL;
+   if (hdr->nullWord)
+      net->nullWord=GetWord(voc,GetLabId("!NULL",TRUE),TRUE);
+   net->numNode=hdr->numNode;
+   net->numLink=hdr->numLink;
+   net->nodes=(hdr->numNode>2)?
+      (NetNode*) New(heap,(hdr->numNode-2)*sizeof(NetNode)):NULL;
+   net->links=(hdr->numLink>0)?
+      (NetLink*) New(heap,hdr->numLink*sizeof(NetLink)):NULL;
+   net->chain=net->nodes;
+
+   for (j=0,fnode=fnodes;j<hdr->numNode;j++,fnode++) {
+      node=(j==0)?&net->initial:(j==1)?&net->final:net->nodes+j-2;
+      node->type=fnode->type;
+      if (fnode->type&n_hmm) {
+         name=NetFileStr(strs,hdr->strSize,fnode->name,fn);
+         if ((m=FindMacroName(hset,'h',GetLabId(name,FALSE)))==NULL)
+            HError(8231,"ReadNetwork: Model %s of %s not in HMM set",name,fn);
+         node->info.hmm=(HLink) m->structure;
+      }
+      else if (fnode->name<0)
+         node->info.pron=NULL;
+      else {
+         name=NetFileStr(strs,hdr->strSize,fnode->name,fn);
+         word=GetWord(voc,GetLabId(name,FALSE),FALSE);
+         for (pron=(word==NULL)?NULL:word->pron;pron!=NULL;pron=pron->next)
+            if (pron->pnum==fnode->pnum) break;
+         if (pron==NULL)
+            HError(8231,"ReadNetwork: Pronunciation %d of %s of %s not in dictionary",
+                   fnode->pnum,name,fn);
+         node->info.pron=pron;
+      }
+      node->tag=(fnode->tag<0)?NULL:
+         CopyString(heap,NetFileStr(strs,hdr->strSize,fnode->tag,fn));
+      node->labid=(fnode->labid<0)?NULL:
+         GetLabId(NetFileStr(strs,hdr->strSize,fnode->labid,fn),TRUE);
+      if (fnode->nlinks<0 || fnode->link<0 || 
+          fnode->link+fnode->nlinks>hdr->numLink)
+         HError(8250,"ReadNetwork: Links of node %d of %s out of range",j,fn);
+      node->nlinks=fnode->nlinks;
+      node->links=(fnode->nlinks>0)?net->links+fnode->link:NULL;
+      for (i=0,flink=flinks+fnode->link;i<fnode->nlinks;i++,flink++) {
+         if (flink->node<1 || flink->node>=hdr->numNode)
+            HError(8250,"ReadNetwork: Link to node %d of %s out of range",
+                   flink->node,fn);
+         node->links[i].node=(flink->node==1)?&net->final:
+            net->nodes+flink->node-2;
+         node->links[i].like=flink->like;
+      }
+      node->inst=NULL;
+      node->aux=j;
+      node->chain=(j>=2 && j+1<hdr->numNode)?node+1:NULL;
+   }
+   munmap(base,size);
+   if (trace&T_CST) {
+      printf("Read network with %d nodes / %d links from %s\n",
+             net->numNode,net->numLink,fn);
+      fflush(stdout);
+   }
+   return(net);
+}
+
+/* ------------------------ Binary Lattices ------------------------- */
+
+/*
+   A binary lattice record holds the nodes, arcs and alignment records
+   of one lattice in arrays, with indexes in place of pointers and
+   string table indexes for the words, labels and tags.  Likelihoods
+   and times are kept as they are in memory, so a record is read with
+   one fread (or found in a mapped archive) and translated in a single
+   pass with no parsing or log base conversion.  The first byte of
+   LATFILEMAGIC cannot start an SLF file, which is how ReadLattice
+   tells the two forms apart.  Sublattices are not supported.
+
+   The record is the header, array[0..nn-1] of LatFileNode, array
+   [0..na-1] of LatFileArc, array[0..nAlign-1] of LatFileAlign, the
+   offsets of the nStr strings and then the strSize bytes of strings,
+   padded to a multiple of 8 bytes.
+*/
+
+#define LATFILEVERSION 1
+#define LATFILEBYTEORDER 0x01020304
+
+typedef struct {
+   char magic[8];          /* LATFILEMAGIC */
+   int byteOrder;          /* LATFILEBYTEORDER as written */
+   int version;            /* LATFILEVERSION */
+   long long size;         /* Size of the whole record */
+   HTime framedur;         /* Frame duration */
+   int nn;                 /* Number of nodes */
+   int na;                 /* Number of arcs */
+   int nAlign;             /* Number of alignment records */
+   int nStr;               /* Number of strings */
+   int strSize;            /* Size of the strings */
+   int format;             /* Format of the lattice less HLAT_SHARC */
+   int utterance;          /* String index of utterance name, -1 == NULL */
+   int vocab;              /* String index of dictionary name, -1 == NULL */
+   int hmms;               /* String index of MMF name, -1 == NULL */
+   int net;                /* String index of network name, -1 == NULL */
+   float acscale,lmscale,wdpenalty,prscale,logbase,tscale;
+} LatFileHeader;
+
+typedef struct {
+   HTime time;             /* Time of node */
+   int word;               /* String index of word, -1 == null word */
+   int tag;                /* String index of tag, -1 == none */
+   int v;                  /* Pronunciation variant */
+   int pad;
+} LatFileNode;
+
+typedef struct {
+   int start;              /* Index of start node */
+   int end;                /* Index of end node */
+   float lmlike,aclike,prlike;
+   int nAlign;             /* Number of alignment records */
+   int align;              /* Index of the first */
+} LatFileArc;
+
+typedef struct {
+   int label;              /* String index of label */
+   int state;              /* State number */
+   float dur;              /* Duration of segment */
+   float like;             /* Total likelihood of segment */
+} LatFileAlign;
+
+/* Size of the record described by hdr before padding */
+static long long LatFileBytes(LatFileHeader *hdr)
+{
+   return(sizeof(LatFileHeader)+(long long)hdr->nn*sizeof(LatFileNode)+
+          (long long)hdr->na*sizeof(LatFileArc)+
+          (long long)hdr->nAlign*sizeof(LatFileAlign)+
+          (long long)hdr->nStr*sizeof(int)+hdr->strSize);
+}
+
+static void WriteLatData(FILE *f,void *data,size_t size)
+{
+   if (size>0 && fwrite(data,size,1,f)!=1)
+      HError(8211,"WriteBinLattice: Cannot write binary lattice");
+}
+
+/* Write lat to file as a binary lattice record, return its size */
+static long long WriteBinLattice(Lattice *lat,FILE *file)
+{
+   LatFileHeader hdr;
+   LatFileNode fnode;
+   LatFileArc farc;
+   LatFileAlign falign;
+   NetStrTab st;
+   NetStr *e;
+   LNode *ln;
+   LArc *la;
+   LAlign *lal;
+   Boolean full;
+   Word word;
+   char pad[8];
+   int i,j,nAlign;
+
+   if (lat->subList!=NULL) {
+      HRError(8253,"WriteLattice: Lattices with sublats cannot be written in binary");
+      return(-1);
+   }
+   full=!(lat->format&HLAT_SHARC);
+   InitNetStrTab(&st);
+   memset(&hdr,0,sizeof(LatFileHeader));
+   memcpy(hdr.magic,LATFILEMAGIC,sizeof(hdr.magic));
+   hdr.byteOrder=LATFILEBYTEORDER;
+   hdr.version=LATFILEVERSION;
+   hdr.framedur=lat->framedur;
+   hdr.nn=lat->nn;
+   hdr.na=lat->na;
+   hdr.format=lat->format&~(HLAT_SHARC|HLAT_BLAT);
+   hdr.utterance=NetStrIdx(&st,lat->utterance);
+   hdr.vocab=NetStrIdx(&st,lat->vocab);
+   hdr.hmms=NetStrIdx(&st,lat->hmms);
+   hdr.net=NetStrIdx(&st,lat->net);
+   hdr.acscale=lat->acscale; hdr.lmscale=lat->lmscale;
+   hdr.wdpenalty=lat->wdpenalty; hdr.prscale=lat->prscale;
+   hdr.logbase=lat->logbase; hdr.tscale=lat->tscale;
+
+   /* The strings first since the header needs their number and size */
+   for (i=0,ln=lat->lnodes;i<lat->nn;i++,ln++) {
+      if (ln->word!=NULL && ln->word!=lat->voc->nullWord)
+         NetStrIdx(&st,ln->word->wordName->name);
+      NetStrIdx(&st,ln->tag);
+   }
+   for (i=0,nAlign=0,la=lat->larcs;full && i<lat->na;i++,la++)
+      for (j=0,lal=la->lAlign;j<la->nAlign;j++,lal++,nAlign++)
+         NetStrIdx(&st,lal->label->name);
+   hdr.nAlign=nAlign;
+   hdr.nStr=st.num;
+   hdr.strSize=st.size;
+   hdr.size=(LatFileBytes(&hdr)+7)/8*8;
+   WriteLatData(file,&hdr,sizeof(LatFileHeader));
+
+   for (i=0,ln=lat->lnodes;i<lat->nn;i++,ln++) {
+      word=ln->word;
+      fnode.time=ln->time;
+      fnode.word=(word==NULL || word==lat->voc->nullWord)?-1:
+         NetStrIdx(&st,word->wordName->name);
+      fnode.tag=NetStrIdx(&st,ln->tag);
+      fnode.v=ln->v;
+      fnode.pad=0;
+      WriteLatData(file,&fnode,sizeof(LatFileNode));
+   }
+   for (i=0,nAlign=0,la=lat->larcs;i<lat->na;i++,la=NextLArc(lat,la)) {
+      farc.start=la->start-lat->lnodes;
+      farc.end=la->end-lat->lnodes;
+      farc.lmlike=la->lmlike;
+      farc.aclike=full?la->aclike:0.0;
+      farc.prlike=full?la->prlike:0.0;
+      farc.nAlign=full?la->nAlign:0;
+      farc.align=nAlign;
+      nAlign+=farc.nAlign;
+      WriteLatData(file,&farc,sizeof(LatFileArc));
+   }
+   for (i=0,la=lat->larcs;full && i<lat->na;i++,la++)
+      for (j=0,lal=la->lAlign;j<la->nAlign;j++,lal++) {
+         falign.label=NetStrIdx(&st,lal->label->name);
+         falign.state=lal->state;
+         falign.dur=lal->dur;
+         falign.like=lal->like;
+         WriteLatData(file,&falign,sizeof(LatFileAlign));
+      }
+   for (e=st.head;e!=NULL;e=e->chain)
+      WriteLatData(file,&e->off,sizeof(int));
+   for (e=st.head;e!=NULL;e=e->chain)
+      WriteLatData(file,e->str,strlen(e->str)+1);
+   memset(pad,0,sizeof(pad));
+   WriteLatData(file,pad,hdr.size-LatFileBytes(&hdr));
+   DeleteHeap(&st.heap);
+   return(hdr.size);
+}
+
+/* Check the header of a binary lattice record of at most size bytes */
+static ReturnStatus CheckLatFileHeader(LatFileHeader *hdr,long long size)
+{
+   if (memcmp(hdr->magic,LATFILEMAGIC,sizeof(hdr->magic))!=0) {
+      HRError(8250,"ReadLattice: Not a binary lattice");
+      return(FAIL);
+   }
+   if (hdr->byteOrder!=LATFILEBYTEORDER) {
+      HRError(8250,"ReadLattice: Binary lattice was written with a different byte order");
+      return(FAIL);
+   }
+   if (hdr->version!=LATFILEVERSION) {
+      HRError(8250,"ReadLattice: Binary lattice has unsupported version %d",
+              hdr->version);
+      return(FAIL);
+   }
+   if (hdr->nn<0 || hdr->na<0 || hdr->nAlign<0 || hdr->nStr<0 || 
+       hdr->strSize<0 || hdr->size>size || 
+       hdr->size!=(LatFileBytes(hdr)+7)/8*8) {
+      HRError(8250,"ReadLattice: The header of the binary lattice is corrupted");
+      return(FAIL);
+   }
+   return(SUCCESS);
+}
+
+/* Return string idx of a binary lattice record, NULL if out of range */
+static char *LatFileStr(LatFileHeader *hdr,int *offs,char *strs,int idx)
+{
+   if (idx<0 || idx>=hdr->nStr || offs[idx]<0 || offs[idx]>=hdr->strSize)
+      return(NULL);
+   return(strs+offs[idx]);
+}
+
+/* Create a lattice from the binary lattice record rec, which has
+   been checked by CheckLatFileHeader */
+static Lattice *LoadBinLattice(char *rec,MemHeap *heap,Vocab *voc,
+                               Boolean shortArc,Boolean add2Dict)
+{
+   LatFileHeader *hdr;
+   LatFileNode *fnode;
+   LatFileArc *farc;
+   LatFileAlign *falign,*faligns;
+   Lattice *lat;
+   LNode *ln;
+   LArc *la;
+   LAlign *lals,*lal;
+   Word *words;
+   LabId *labs;
+   Boolean ok;
+   char *strs,*name;
+   int i,*offs;
+
+   hdr=(LatFileHeader*) rec;
+   fnode=(LatFileNode*) (rec+sizeof(LatFileHeader));
+   farc=(LatFileArc*) (fnode+hdr->nn);
+   faligns=(LatFileAlign*) (farc+hdr->na);
+   offs=(int*) (faligns+hdr->nAlign);
+   strs=(char*) (offs+hdr->nStr);
+   if (hdr->strSize>0 && strs[hdr->strSize-1]!=0) {
+      HRError(8250,"ReadLattice: The strings of the binary lattice are corrupted");
+      return(NULL);
+   }
+
+   /* Words and labels are looked up once each */
+   words=(Word*) New(&gcheap,(hdr->nStr+1)*sizeof(Word));
+   labs=(LabId*) New(&gcheap,(hdr->nStr+1)*sizeof(LabId));
+   for (i=0;i<hdr->nStr;i++) words[i]=NULL,labs[i]=NULL;
+
+   lat=(Lattice*) New(heap,sizeof(Lattice));
+   lat->heap=heap; lat->voc=voc;
+   lat->subLatId=NULL; lat->subList=NULL; lat->refList=NULL; 
+   lat->chain=NULL; lat->hook=NULL;
+   lat->format=hdr->format&~(HLAT_SHARC|HLAT_BLAT);
+   if (shortArc) lat->format|=HLAT_SHARC;
+   lat->nn=hdr->nn; lat->na=hdr->na;
+   name=LatFileStr(hdr,offs,strs,hdr->utterance);
+   lat->utterance=SafeCopyString(heap,name);
+   name=LatFileStr(hdr,offs,strs,hdr->vocab);
+   lat->vocab=SafeCopyString(heap,name);
+   name=LatFileStr(hdr,offs,strs,hdr->hmms);
+   lat->hmms=SafeCopyString(heap,name);
+   name=LatFileStr(hdr,offs,strs,hdr->net);
+   lat->net=SafeCopyString(heap,name);
+   lat->acscale=hdr->acscale; lat->lmscale=hdr->lmscale;
+   lat->wdpenalty=hdr->wdpenalty; lat->prscale=hdr->prscale;
+   lat->logbase=hdr->logbase; lat->tscale=hdr->tscale;
+   lat->framedur=hdr->framedur;
+   lat->lnodes=(LNode*) New(heap,sizeof(LNode)*lat->nn);
+   lat->larcs=(LArc*) New(heap,(shortArc?sizeof(LArc_S):sizeof(LArc))*lat->na);
+   lals=NULL;
+   if (!shortArc && hdr->nAlign>0)
+      lals=(LAlign*) New(heap,sizeof(LAlign)*hdr->nAlign);
+
+   ok=TRUE;
+   for (i=0,ln=lat->lnodes;ok && i<lat->nn;i++,ln++,fnode++) {
+      ln->n=i;
+      ln->time=fnode->time;
+      if (fnode->word<0)
+         ln->word=voc->nullWord;
+      else {
+         if ((name=LatFileStr(hdr,offs,strs,fnode->word))==NULL) {
+            ok=FALSE; break;
+         }
+         if (words[fnode->word]==NULL &&
+             (words[fnode->word]=GetWord(voc,GetLabId(name,add2Dict),add2Dict))==NULL) {
+            Dispose(heap,lat);
+            Dispose(&gcheap,labs); Dispose(&gcheap,words);
+            HRError(8251,"ReadLattice: Word %s not in dict",name);
+            return(NULL);
+         }
+         ln->word=words[fnode->word];
+      }
+      if (fnode->tag<0)
+         ln->tag=NULL;
+      else {
+         if ((name=LatFileStr(hdr,offs,strs,fnode->tag))==NULL) {
+            ok=FALSE; break;
+         }
+         ln->tag=CopyString(heap,name);
+      }
+      ln->v=fnode->v;
+      ln->sublat=NULL;
+      ln->foll=ln->pred=NARC;
+      ln->score=0.0;
+      ln->hook=NULL;
+   }
+   for (i=0,la=lat->larcs;ok && i<lat->na;i++,la=NextLArc(lat,la),farc++) {
+      if (farc->start<0 || farc->start>=lat->nn || 
+          farc->end<0 || farc->end>=lat->nn ||
+          farc->nAlign<0 || farc->nAlign>SHRT_MAX || farc->align<0 || 
+          farc->align+farc->nAlign>hdr->nAlign) {
+         ok=FALSE; break;
+      }
+      la->start=lat->lnodes+farc->start;
+      la->end=lat->lnodes+farc->end;
+      la->lmlike=farc->lmlike;
+      la->farc=la->start->foll;
+      la->parc=la->end->pred;
+      la->start->foll=la;
+      la->end->pred=la;
+      if (!shortArc) {
+         la->aclike=farc->aclike;
+         la->prlike=farc->prlike;
+         la->score=0.0;
+         la->nAlign=farc->nAlign;
+         la->lAlign=(farc->nAlign>0)?lals+farc->align:NULL;
+      }
+   }
+   for (i=0,lal=lals,falign=faligns;ok && lals!=NULL && i<hdr->nAlign;
+        i++,lal++,falign++) {
+      if ((name=LatFileStr(hdr,offs,strs,falign->label))==NULL) {
+         ok=FALSE; break;
+      }
+      if (labs[falign->label]==NULL)
+         labs[falign->label]=GetLabId(name,TRUE);
+      lal->label=labs[falign->label];
+      lal->state=falign->state;
+      lal->dur=falign->dur;
+      lal->like=falign->like;
+   }
+   Dispose(&gcheap,labs); Dispose(&gcheap,words);
+   if (!ok) {
+      Dispose(heap,lat);
+      HRError(8250,"ReadLattice: The binary lattice is corrupted");
+      return(NULL);
+   }
+   if (CheckStEndNodes(lat)<SUCCESS) {
+      Dispose(heap,lat);
+      HRError(8250,"ReadLattice: Start/End nodes incorrect");
+      return(NULL);
+   }
+   if (shortArc)
+      lat->format&=~(HLAT_ACLIKE|HLAT_PRLIKE|HLAT_ALIGN);
+   return(lat);
+}
+
+/* Read a binary lattice record from file */
+static Lattice *ReadBinLattice(FILE *file,MemHeap *heap,Vocab *voc,
+                               Boolean shortArc,Boolean add2Dict)
+{
+   LatFileHeader hdr;
+   Lattice *lat;
+   char *rec;
+
+   if (fread(&hdr,sizeof(LatFileHeader),1,file)!=1) {
+      HRError(8250,"ReadLattice: Premature end of binary lattice");
+      return(NULL);
+   }
+   if (CheckLatFileHeader(&hdr,hdr.size)<SUCCESS)
+      return(NULL);
+   rec=(char*) New(&gcheap,hdr.size);
+   memcpy(rec,&hdr,sizeof(LatFileHeader));
+   if (fread(rec+sizeof(LatFileHeader),hdr.size-sizeof(LatFileHeader),1,file)!=1) {
+      Dispose(&gcheap,rec);
+      HRError(8250,"ReadLattice: Premature end of binary lattice");
+      return(NULL);
+   }
+   lat=LoadBinLattice(rec,heap,voc,shortArc,add2Dict);
+   Dispose(&gcheap,rec);
+   return(lat);
+}
+
+/* ------------------------ Lattice Archives ------------------------ */
+
+/*
+   A lattice archive is a header, the binary lattice records in the
+   order they were added, an index sorted by name and then the names.
+   The archive named by HNET: LATARCHIVE is mapped when the module is
+   initialised and its records are translated in place.
+*/
+
+#define LATARCMAGIC "HTKLATAR"
+#define LATARCVERSION 1
+
+typedef struct {
+   char magic[8];          /* LATARCMAGIC, not NULL terminated */
+   int byteOrder;          /* LATFILEBYTEORDER as written */
+   int version;            /* LATARCVERSION */
+   int numLat;             /* Number of lattices */
+   int pad;
+   long long idxOff;       /* Offset of array[0..numLat-1] of LatArcEntry */
+   long long nameOff;      /* Offset of the names */
+} LatArcHeader;
+
+typedef struct {
+   long long nameOff;      /* Offset of the name from the names */
+   long long recOff;       /* Offset of the record */
+} LatArcEntry;
+
+struct latarchive {
+   char *fn;               /* File name of archive */
+   FILE *file;             /* File being written, NULL when mapped */
+   char *base;             /* Start of the mapping */
+   size_t size;            /* Size of the mapping */
+   LatArcHeader hdr;       /* Header, written again when closed */
+   LatArcEntry *entries;   /* Index, in order added until closed */
+   char **names;           /* Names of the entries being written */
+   int nAlloc;             /* Size of entries and names */
+   MemHeap heap;           /* Holds the index being written */
+};
+
+static void WriteLatArcData(LatArchive *arc,void *data,size_t size)
+{
+   if (size>0 && fwrite(data,size,1,arc->file)!=1)
+      HError(8211,"WriteLatArchive: Cannot write lattice archive %s",arc->fn);
+}
+
+/* EXPORT->CreateLatArchive: start writing lattice archive fn */
+LatArchive *CreateLatArchive(char *fn)
+{
+   LatArchive *arc;
+
+   arc=(LatArchive*) New(&gcheap,sizeof(LatArchive));
+   memset(arc,0,sizeof(LatArchive));
+   CreateHeap(&arc->heap,"LatArchive",MSTAK,1,1.0,10000,10000000);
+   arc->fn=CopyString(&arc->heap,fn);
+   if ((arc->file=fopen(fn,"wb"))==NULL)
+      HError(8211,"CreateLatArchive: Cannot create lattice archive %s",fn);
+   memcpy(arc->hdr.magic,LATARCMAGIC,sizeof(arc->hdr.magic));
+   arc->hdr.byteOrder=LATFILEBYTEORDER;
+   arc->hdr.version=LATARCVERSION;
+   arc->hdr.idxOff=sizeof(LatArcHeader);
+   WriteLatArcData(arc,&arc->hdr,sizeof(LatArcHeader));
+   return(arc);
+}
+
+/* EXPORT->AddLatArchive: append lat to arc under name */
+ReturnStatus AddLatArchive(LatArchive *arc,char *name,Lattice *lat)
+{
+   LatArcEntry *entries;
+   char **names;
+   long long size;
+   int nAlloc;
+
+   if (arc->hdr.numLat==arc->nAlloc) {
+      /* The old arrays stay on the stack until the archive is closed */
+      nAlloc=(arc->nAlloc<1024)?1024:2*arc->nAlloc;
+      entries=(LatArcEntry*) New(&arc->heap,nAlloc*sizeof(LatArcEntry));
+      names=(char**) New(&arc->heap,nAlloc*sizeof(char*));
+      if (arc->nAlloc>0) {
+         memcpy(entries,arc->entries,arc->nAlloc*sizeof(LatArcEntry));
+         memcpy(names,arc->names,arc->nAlloc*sizeof(char*));
+      }
+      arc->entries=entries; arc->names=names; arc->nAlloc=nAlloc;
+   }
+   if ((size=WriteBinLattice(lat,arc->file))<0)
+      return(FAIL);
+   arc->entries[arc->hdr.numLat].recOff=arc->hdr.idxOff;
+   arc->names[arc->hdr.numLat]=CopyString(&arc->heap,name);
+   arc->hdr.numLat++;
+   arc->hdr.idxOff+=size;
+   return(SUCCESS);
+}
+
+static char **sortLatNames;
+
+static int CmpLatArcEntry(const void *a,const void *b)
+{
+   return(strcmp(sortLatNames[*(const int*)a],sortLatNames[*(const int*)b]));
+}
+
+/* EXPORT->CloseLatArchive: write the index of arc and close it */
+void CloseLatArchive(LatArchive *arc)
+{
+   LatArcEntry entry;
+   long long nameOff;
+   int i,*order;
+
+   order=(int*) New(&arc->heap,(arc->hdr.numLat+1)*sizeof(int));
+   for (i=0;i<arc->hdr.numLat;i++) order[i]=i;
+   sortLatNames=arc->names;
+   qsort(order,arc->hdr.numLat,sizeof(int),CmpLatArcEntry);
+   for (i=1;i<arc->hdr.numLat;i++)
+      if (strcmp(arc->names[order[i-1]],arc->names[order[i]])==0)
+         HError(8211,"CloseLatArchive: Lattice %s is added to %s twice",
+                arc->names[order[i]],arc->fn);
+   for (i=0,nameOff=0;i<arc->hdr.numLat;i++) {
+      entry=arc->entries[order[i]];
+      entry.nameOff=nameOff;
+      WriteLatArcData(arc,&entry,sizeof(LatArcEntry));
+      nameOff+=strlen(arc->names[order[i]])+1;
+   }
+   arc->hdr.nameOff=arc->hdr.idxOff+
+      (long long)arc->hdr.numLat*sizeof(LatArcEntry);
+   for (i=0;i<arc->hdr.numLat;i++)
+      WriteLatArcData(arc,arc->names[order[i]],strlen(arc->names[order[i]])+1);
+   if (fseek(arc->file,0,SEEK_SET)!=0)
+      HError(8211,"CloseLatArchive: Cannot rewind lattice archive %s",arc->fn);
+   WriteLatArcData(arc,&arc->hdr,sizeof(LatArcHeader));
+   if (fclose(arc->file)!=0)
+      HError(8211,"CloseLatArchive: Cannot close lattice archive %s",arc->fn);
+   DeleteHeap(&arc->heap);
+   Dispose(&gcheap,arc);
+}
+
+/* Map lattice archive fn for reading */
+static LatArchive *OpenLatArchive(char *fn)
+{
+   LatArchive *arc;
+   LatArcHeader *hdr;
+   struct stat sb;
+   int fd;
+
+   if ((fd=open(fn,O_RDONLY))<0)
+      HError(8210,"OpenLatArchive: Cannot open lattice archive %s",fn);
+   if (fstat(fd,&sb)!=0 || sb.st_size<sizeof(LatArcHeader))
+      HError(8250,"OpenLatArchive: %s is not a lattice archive",fn);
+   arc=(LatArchive*) New(&gcheap,sizeof(LatArchive));
+   memset(arc,0,sizeof(LatArchive));
+   arc->fn=CopyString(&gcheap,fn);
+   arc->size=sb.st_size;
+   arc->base=(char*) mmap(NULL,arc->size,PROT_READ,MAP_SHARED,fd,0);
+   close(fd);
+   if (arc->base==MAP_FAILED)
+      HError(8210,"OpenLatArchive: Cannot map lattice archive %s",fn);
+   hdr=(LatArcHeader*) arc->base;
+   if (memcmp(hdr->magic,LATARCMAGIC,sizeof(hdr->magic))!=0)
+      HError(8250,"OpenLatArchive: %s is not a lattice archive",fn);
+   if (hdr->byteOrder!=LATFILEBYTEORDER)
+      HError(8250,"OpenLatArchive: %s was written with a different byte order",fn);
+   if (hdr->version!=LATARCVERSION)
+      HError(8250,"OpenLatArchive: %s has unsupported version %d",fn,hdr->version);
+   if (hdr->numLat<0 || hdr->idxOff<sizeof(LatArcHeader) ||
+       hdr->nameOff!=hdr->idxOff+(long long)hdr->numLat*sizeof(LatArcEntry) ||
+       hdr->nameOff>arc->size)
+      HError(8250,"OpenLatArchive: The header of %s is corrupted",fn);
+   arc->hdr=*hdr;
+   arc->entries=(LatArcEntry*) (arc->base+hdr->idxOff);
+   if (trace&T_CST) {
+      printf("Mapped %d lattices from archive %s\n",hdr->numLat,fn);
+      fflush(stdout);
+   }
+   return(arc);
+}
+
+/* Find lattice latfn in the archive, NULL if absent */
+static LatArcEntry *FindLatArchive(char *latfn)
+{
+   LatArcEntry *entry;
+   char *names;
+   int lo,hi,mid,cmp;
+
+   if (latArchive==NULL) return(NULL);
+   names=latArchive->base+latArchive->hdr.nameOff;
+   lo=0; hi=latArchive->hdr.numLat-1;
+   while (lo<=hi) {
+      mid=(lo+hi)/2;
+      entry=latArchive->entries+mid;
+      if (entry->nameOff<0 || 
+          latArchive->hdr.nameOff+entry->nameOff>=latArchive->size)
+         HError(8250,"FindLatArchive: The index of %s is corrupted",
+                latArchive->fn);
+      cmp=strcmp(latfn,names+entry->nameOff);
+      if (cmp==0) {
+         if (entry->recOff<sizeof(LatArcHeader) || 
+             entry->recOff+(long long)sizeof(LatFileHeader)>latArchive->hdr.idxOff)
+            HError(8250,"FindLatArchive: The entry of %s in %s is corrupted",
+                   latfn,latArchive->fn);
+         return(entry);
+      }
+      else if (cmp<0) hi=mid-1;
+      else lo=mid+1;
+   }
+   return(NULL);
+}
+
+/* EXPORT->InLatArchive: return TRUE if lattice latfn is in the archive */
+Boolean InLatArchive(char *latfn)
+{
+   return(FindLatArchive(latfn)!=NULL);
+}
+
+/* EXPORT->ReadArchiveLattice: create lattice latfn from the archive */
+Lattice *ReadArchiveLattice(char *latfn,MemHeap *heap,Vocab *voc,
+                            Boolean shortArc,Boolean add2Dict)
+{
+   LatArcEntry *entry;
+   LatFileHeader *hdr;
+
+   if ((entry=FindLatArchive(latfn))==NULL)
+      HError(8250,"ReadArchiveLattice: Lattice %s is not in the lattice archive",
+             latfn);
+   hdr=(LatFileHeader*) (latArchive->base+entry->recOff);
+   if (CheckLatFileHeader(hdr,latArchive->hdr.idxOff-entry->recOff)<SUCCESS) {
+      HRError(8250,"ReadArchiveLattice: Lattice %s in %s is corrupted",
+              latfn,latArchive->fn);
+      return(NULL);
+   }
+   return(LoadBinLattice((char*) hdr,heap,voc,shortArc,add2Dict));
+}
+
+/* EXPORT->ReadAheadArchiveLattice: start reading in lattice latfn */
+Boolean ReadAheadArchiveLattice(char *latfn)
+{
+   LatArcEntry *entry;
+   LatFileHeader *hdr;
+   long pageSize;
+   long long stOff;
+
+   if ((entry=FindLatArchive(latfn))==NULL)
+      return(FALSE);
+   hdr=(LatFileHeader*) (latArchive->base+entry->recOff);
+   pageSize=sysconf(_SC_PAGESIZE);
+   stOff=entry->recOff/pageSize*pageSize;
+   if (hdr->size>0 && entry->recOff+hdr->size<=latArchive->hdr.idxOff)
+      madvise(latArchive->base+stOff,(size_t) (entry->recOff+hdr->size-stOff),
+              MADV_WILLNEED);
+   return(TRUE);
+}
+
 /* ------------------------ End of HNet.c ------------------------- */
@@ -93,6 +93,7 @@ typedef int LatFormat;      /* Format of lattice. Formed by oring flags */
 #define HLAT_NOSUBS 0x2000  /* Do not output sublats */
 /* #define HLAT_EXTEN  0x2000   Using extensible versions of everything */
 #define HLAT_SHARC  0x4000  /* Using short version of arc data structures */
+#define HLAT_BLAT   0x8000  /* Binary lattice record (see WriteLattice) */
 
 #define HLAT_DEFAULT 0x03f8 /* Default output format */
 
@@ -286,7 +287,10 @@ void FreeLattice(Lattice *lat);
 ReturnStatus WriteLattice(Lattice *lat, FILE *file, LatFormat form);
 /*
    Write lattice to given file, according to given format  
-   specifier.
+   specifier.  If form includes HLAT_BLAT the lattice is written as
+   a binary record holding all its fields in their internal form,
+   which ReadLattice recognises and loads without any parsing.
+   Binary records cannot hold sublattices.
 */
 
 Lattice *ReadLattice(FILE *file, MemHeap *heap, Vocab *voc, 
@@ -300,7 +304,8 @@ Lattice *ReadOneLattice(Source *src, MemHeap *heap, Vocab *voc,
    using the Vocab voc.  If shortArc is true, then each arc is stored in
    short form and cannot then support alignment information.
    If add2Dict is TRUE then ReadLattice will add unseen words to voc
-   rather than generating an error.
+   rather than generating an error.  Several threads may read
+   lattices at once, each into its own heap or a C heap.
 */
 
 
@@ -386,9 +391,9 @@ struct _NetNode {
    char    *tag;        /* Semantic tagging information */
    int nlinks;          /* Number of nodes connected to this one */
    NetLink *links;      /* Array[0..nlinks-1] of links to connected nodes */
-   NetInst *inst;       /* Model Instance (if one exists, else NULL) */   
+   NetInst *inst;       /* Scratch while building the network */   
    NetNode *chain;
-   int aux;
+   int aux;             /* Index of the node in [0,numNode) once built */
 
    LabId labid;         /* sxz20: Logical HMM name */
 };
@@ -410,6 +415,8 @@ typedef struct {
    MemHeap nodeHeap;  /* a heap for allocating nodes */
    MemHeap linkHeap;  /* a stack for adding the links as needed */
    NetNode *chain;
+   NetNode *nodes;    /* Array[0..numNode-3] of nodes when compiled */
+   NetLink *links;    /* Array[0..numLink-1] of links when compiled */
 } Network;
 
 typedef struct hmmsetcxtinfo {
@@ -503,6 +510,69 @@ Network *ExpandWordNet(MemHeap *heap,Lattice *lat,Vocab *voc,HMMSet *hset);
      and last phone of context dependent models ].
 */
 
+void CompileNetwork(Network *net);
+/*
+   Move the nodes of net into one array, in breadth first order from
+   the initial node, with the links of each node in one array after
+   those of the node before.  Node pointers are still used throughout
+   so the network is used as before.  The arrays and node tags are
+   allocated on net->heap and the original nodes are left where they
+   were.  ExpandWordNet therefore builds the nodes on a scratch heap,
+   which it deletes once they are compiled, unless HNET: COMPILENET
+   is false.
+*/
+
+ReturnStatus WriteNetwork(Network *net,char *fn,HMMSet *hset);
+/*
+   Compile net and write it to file fn in a binary form that
+   ReadNetwork can load without expanding the word network again.
+   The file is only valid for the same HMM set and dictionary.
+*/
+
+Network *ReadNetwork(MemHeap *heap,char *fn,Vocab *voc,HMMSet *hset);
+/*
+   Map the network file fn written by WriteNetwork and create the
+   compiled network it holds using heap, looking up its models in
+   hset and its pronunciations in voc.  Returns NULL if fn is not a
+   network file.
+*/
+
+/* ------------------------ Lattice Archives ------------------------ */
+
+/*
+   A lattice archive packs the binary records of many lattices into
+   one file with an index sorted by name.  The archive named by
+   HNET: LATARCHIVE is memory mapped by InitNet and GetLattice then
+   looks each lattice up by its file name (as made by MakeFN) before
+   trying to open the file.  HLatPack builds the archives.
+*/
+typedef struct latarchive LatArchive;
+
+LatArchive *CreateLatArchive(char *fn);
+ReturnStatus AddLatArchive(LatArchive *arc, char *name, Lattice *lat);
+void CloseLatArchive(LatArchive *arc);
+/*
+   Create lattice archive fn, add lat to it as name and write the
+   index and close it
+*/
+
+Boolean InLatArchive(char *latfn);
+/*
+   Return TRUE if lattice file latfn is in the archive
+*/
+
+Lattice *ReadArchiveLattice(char *latfn, MemHeap *heap, Vocab *voc, 
+                            Boolean shortArc, Boolean add2Dict);
+/*
+   Create lattice latfn from the archive as ReadLattice would
+*/
+
+Boolean ReadAheadArchiveLattice(char *latfn);
+/*
+   Ask the system to read in lattice latfn of the archive, return
+   FALSE if it is not in the archive
+*/
+
 /* --- Context handling stuff useful for general network building --- */
 
 HMMSetCxtInfo *GetHMMSetCxtInfo(HMMSet *hset, Boolean frcCxtInd);
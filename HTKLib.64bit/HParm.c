@@ -51,6 +51,7 @@ char *hparm_vc_id = "$Id: HParm.c,v 1.1.1.1 2006/10/11 09:54:58 jal58 Exp $";
 #ifdef UNIX
 #include <sys/ioctl.h>
 #endif
+#include <pthread.h>
 
 /* ----------------------------- Trace Flags ------------------------- */
 
@@ -78,6 +79,17 @@ static char varScaleFN[MAXFNAMELEN] = "\0";
 
 static Boolean highDiff = FALSE;   /* compute higher oder differentials, only up to fourth */
 static Boolean UseOldXFormCVN = FALSE;  /* this allows us to go back to the old version with broken CVN */
+static Boolean batchFBank = TRUE;  /* analyse FBANKBATCH frames at a time */
+static int onlineLookAhead = -1;   /* max frames of regression look-ahead online, -1 for full windows */
+static float cmnTConst = 0.995;    /* time constant of the online running mean */
+static Boolean cmnResetOnStop = TRUE; /* restart the online running mean each utterance */
+/* Buffers with their own heaps can be opened and filled by several
+   threads at once.  Each IOConfig has its own windows, dither
+   generator and workspace, but the channel level state, ie side
+   based normalisation and the silence detector, is set under chanLock */
+static pthread_mutex_t chanLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t randLock = PTHREAD_MUTEX_INITIALIZER; /* global RandomValue */
+
 static ParmKind ForcePKind = ANON; /* force to output a customized parm kind to make older versions
                                     happy for all the parm kind types supported here */
 
@@ -235,11 +247,21 @@ typedef struct {
    Vector eql;        /* Equal loundness curve */
    DMatrix cm;        /* Cosine matrix for IDFT */ 
    FBankInfo fbInfo;  /* FBank info used for filterbank analysis */
+   int nBatch;        /* num frames waiting in batch, -1 if not batching */
+   Vector bs[FBANKBATCH];     /* speech vectors waiting in batch */
+   Vector bfbank[FBANKBATCH]; /* and their filterbank vectors */
+   float bte[FBANKBATCH];     /* and their energies */
+   float *bdst[FBANKBATCH];   /* and where their parameters go */
+   Matrix mfccTab;    /* DCT table for MFCC of batched frames */
+   Vector hamWin;     /* Hamming window */
+   Vector cepWin;     /* cepstral liftering weights */
+   RandState dither;  /* dither random number generator */
    Vector mean;       /* Running mean shared by this config */
    /* Running stuff */
    Source src;        /* Source to read HParm file from */
    Boolean bSwap;     /* TRUE if source needs byte swapping */
    unsigned short crcc; /* Running CRCC */
+   unsigned short lastShort; /* Last short read by GetCRCCFrame */
    Vector A;          /* Parameters for decompressing */
    Vector B;          /*  HTK parameterised files */
    Vector varScale;   /* var scaling vector  */
@@ -906,41 +928,61 @@ static AdaptXForm *LoadAppendXForm(IOConfig cf, char *fname)
    return xf;
 }
 
-static void ApplyXForm2Vector(LinXForm *linXForm, Vector mean)
-{  
-   Vector vec, bias;
-   int size,b,bsize;
+/* The feature transforms are applied to XFORMBATCH rows at a time.
+   The rows are interleaved so that each matrix element multiplies a
+   fixed length run of values, which the compiler can vectorise, and
+   each product is still summed in the same order as one row at a time */
+#define XFORMBATCH 8
+
+/* ApplyXForm2Rows: apply linXForm in place to the first vecSize
+   components of the n rows of data, which are step floats apart */
+static void ApplyXForm2Rows(MemHeap *x, LinXForm *linXForm, float *data, int step, int n)
+{
+   float acc[XFORMBATCH], *in, *out, *xp, *fp, a;
+   int size,b,bsize,cnt;
+   int i,j,f,r,nr;
    Matrix A;
-   float tmp;
-   int i,j;
-   int cnt,cnti,cntj;
+   Vector bias;
 
-   /* Check dimensions */
    size = linXForm->vecSize;
-   if (size != VectorSize(mean))
-      HError(999,"Transform dimension (%d) does not match mean dimension (%d)",
-             size,VectorSize(mean));
-   vec = CreateVector(&gstack,size);
-   CopyVector(mean,vec); ZeroVector(mean);
-   /* Transform mean */
-   for (b=1,cnti=1,cnt=1;b<=IntVecSize(linXForm->blockSize);b++) {
-      bsize = linXForm->blockSize[b];
-      A = linXForm->xform[b];
-      for (i=1;i<=bsize;i++,cnti++) {
-         tmp = 0;
-         for (j=1,cntj=cnt;j<=bsize;j++,cntj++)
-            tmp += A[i][j] * vec[cntj];
-         mean[cnti] = tmp;
-      }
-      cnt += bsize;
-   }
-   /* Apply bias if required */
+   if (size > step)
+      HError(999,"Transform dimension (%d) exceeds vector size (%d)",size,step);
+   in = (float *)New(x,2*size*XFORMBATCH*sizeof(float));
+   out = in + size*XFORMBATCH;
    bias = linXForm->bias;
-   if (bias != NULL) {
-      for (i=1;i<=size;i++)
-         mean[i] += bias[i];
+   for (r=0; r<n; r+=XFORMBATCH) {
+      nr = (n-r < XFORMBATCH) ? n-r : XFORMBATCH;
+      /* interleave the rows, padding a short batch with zeros */
+      if (nr < XFORMBATCH)
+         for (i=0; i<size*XFORMBATCH; i++) in[i] = 0.0;
+      for (f=0,fp=data+r*step; f<nr; f++,fp+=step)
+         for (i=0; i<size; i++)
+            in[i*XFORMBATCH+f] = fp[i];
+      for (b=1,cnt=0; b<=IntVecSize(linXForm->blockSize); b++) {
+         bsize = linXForm->blockSize[b];
+         A = linXForm->xform[b];
+         for (i=1; i<=bsize; i++) {
+            for (f=0; f<XFORMBATCH; f++) acc[f] = 0.0;
+            for (j=1; j<=bsize; j++) {
+               a = A[i][j]; xp = in + (cnt+j-1)*XFORMBATCH;
+               for (f=0; f<XFORMBATCH; f++) acc[f] += a*xp[f];
+            }
+            xp = out + (cnt+i-1)*XFORMBATCH;
+            for (f=0; f<XFORMBATCH; f++) xp[f] = acc[f];
+         }
+         cnt += bsize;
+      }
+      if (bias != NULL) {
+         for (i=1; i<=size; i++) {
+            a = bias[i]; xp = out + (i-1)*XFORMBATCH;
+            for (f=0; f<XFORMBATCH; f++) xp[f] += a;
+         }
+      }
+      for (f=0,fp=data+r*step; f<nr; f++,fp+=step)
+         for (i=0; i<size; i++)
+            fp[i] = out[i*XFORMBATCH+f];
    }
-   FreeVector(&gstack,vec);
+   Dispose(x,in);
 }
 
 /* 
@@ -1102,6 +1144,7 @@ ReturnStatus InitParm(void)
 {
    Boolean b;
    int i;
+   double f;
    char buf[MAXSTRLEN];
 
    CreateHeap(&parmHeap, "HPARM C Heap",  MSTAK, 1, 1.0, 20000, 80000 );
@@ -1115,6 +1158,10 @@ ReturnStatus InitParm(void)
       if (GetConfBool(cParm,nParm,"NATURALWRITEORDER",&b)) natWriteOrder = b;
       if (GetConfBool(cParm,nParm,"HIGHDIFF",&b)) highDiff = b;
       if (GetConfBool(cParm,nParm,"USEOLDXFORMCVN",&b)) UseOldXFormCVN = b;
+      if (GetConfBool(cParm,nParm,"BATCHFBANK",&b)) batchFBank = b;
+      if (GetConfInt(cParm,nParm,"ONLINELOOKAHEAD",&i)) onlineLookAhead = i;
+      if (GetConfFlt(cParm,nParm,"CMNTCONST",&f)) cmnTConst = f;
+      if (GetConfBool(cParm,nParm,"CMNRESETONSTOP",&b)) cmnResetOnStop = b;
       if (GetConfStr(cParm,nParm,"FORCEPKIND",buf))
          ForcePKind = Str2ParmKind(buf);      
    }
@@ -1429,50 +1476,46 @@ Boolean SyncBuffers(ParmBuf pbuf,ParmBuf pbuf2)
 
 
 /* Apply the global feature transform */
-static void ApplyStaticMat(IOConfig cf, float *data, Matrix trans, int vSize, int n, int step, int offset)
+static void ApplyStaticMat(MemHeap *x, IOConfig cf, float *data, Matrix trans, int vSize, int n, int step, int offset)
 {
-   float *fp,*fp1;
-   int i,j,k,l,mrows,mcols,nframes,fsize,m;
-   Vector *odata,tmp;
+   float acc[XFORMBATCH], *in, *xp, *fp, a;
+   int i,j,k,l,f,r,nr,mrows,mcols,nframes,fsize,nin,nout;
 
    mrows = NumRows(trans); mcols = NumCols(trans);
    nframes = 1 + cf->preFrames + cf->postFrames;
    fsize = cf->nUsed;
-   odata = New(&gstack,nframes*sizeof(Vector));
-   odata--;
-   fp = data-1;
-   for (i=1;i<=nframes;i++)
-      odata[i] = CreateVector(&gstack,fsize);
-   for (i=2;i<=nframes;i++) {
-      for (j=1;j<=fsize;j++)
-         odata[i][j] = fp[j];
-      fp += vSize;
-   }
-   fp1 = data-1;
-
-   if ((fsize*nframes) != mcols)
+   nin = fsize*nframes; nout = n-nframes+1;
+
+   if (nin != mcols)
       HError(-1,"Incorrect number of elements (%d %d)",cf->nUsed ,mcols);
-   for (i=1;i<=n-nframes+1;i++){
-      tmp = odata[1];
-      for (j=1;j<=nframes-1;j++)
-         odata[j] = odata[j+1];
-      odata[nframes] = tmp;
-      for (j=1;j<=fsize;j++){
-         tmp[j]=fp[j];
-      }
-      for (j=1;j<=mrows;j++) {
-         fp++; fp1++; *fp1=0; m=0;
-         for(l=1;l<=nframes;l++) {
-            for (k=1;k<=fsize;k++) {
-               m++;
-               *fp1 += trans[j][m]*odata[l][k];
-            }
+   /* Each output row r is made from the spliced input rows r..r+nframes-1
+      and written over row r, so a batch of rows can be gathered before
+      any of them is overwritten */
+   in = (float *)New(x,(nin+mrows)*XFORMBATCH*sizeof(float));
+   for (r=0; r<nout; r+=XFORMBATCH) {
+      nr = (nout-r < XFORMBATCH) ? nout-r : XFORMBATCH;
+      if (nr < XFORMBATCH)
+         for (i=0; i<nin*XFORMBATCH; i++) in[i] = 0.0;
+      for (f=0; f<nr; f++)
+         for (l=0; l<nframes; l++) {
+            fp = data + (r+f+l)*vSize;
+            for (k=0; k<fsize; k++)
+               in[(l*fsize+k)*XFORMBATCH+f] = fp[k];
+         }
+      for (j=1; j<=mrows; j++) {
+         for (f=0; f<XFORMBATCH; f++) acc[f] = 0.0;
+         for (i=1; i<=nin; i++) {
+            a = trans[j][i]; xp = in + (i-1)*XFORMBATCH;
+            for (f=0; f<XFORMBATCH; f++) acc[f] += a*xp[f];
          }
+         xp = in + (nin+j-1)*XFORMBATCH;
+         for (f=0; f<XFORMBATCH; f++) xp[f] = acc[f];
       }
-      fp += vSize-mrows;
-      fp1 += vSize-mrows;
+      for (f=0,fp=data+r*vSize; f<nr; f++,fp+=vSize)
+         for (j=0; j<mrows; j++)
+            fp[j] = in[(nin+j)*XFORMBATCH+f];
    }
-   Dispose(&gstack,odata+1);
+   Dispose(x,in);
    cf->nUsed = mrows;
 }
 
@@ -1529,6 +1572,8 @@ static IOConfig MakeIOConfig(MemHeap *x,ChannelInfo *chan)
    
    p = (IOConfig)New(x,sizeof(IOConfigRec));
    *p = chan->cf;
+   p->hamWin = p->cepWin = NULL;
+   p->nBatch = -1;
    return p;
 }
 
@@ -1861,10 +1906,10 @@ static void AddQualifiers(ParmBuf pbuf,float *data, int nRows, IOConfig cf,
 {
    char buf[100],buff1[256],buff2[256];
    int si,ti,d=0,ds,de, i, j, step, size;
+   int nLev,lsi[MAXREGLEV],lti[MAXREGLEV],ld[MAXREGLEV],lwin[MAXREGLEV];
    short span[12];
    float *fp, mean, scale;
    ParmKind tgtBase;
-   Vector tmp;
    LinXForm *xf;
 
    if (highDiff && ((cf->curPK&HASDELTA) || (cf->curPK&HASACCS) || (cf->curPK&HASTHIRD)))
@@ -1886,7 +1931,7 @@ static void AddQualifiers(ParmBuf pbuf,float *data, int nRows, IOConfig cf,
    if ((cf->MatTranFN != NULL) && (cf->preQual)) {
       if ((HasZerom(cf->matPK) && !(HasZerom(cf->curPK))) || (HasZerom(cf->curPK) && !(HasZerom(cf->matPK))))
          HError(6371, "AddQualifiers: Incorrect qualifiers in parameter type (%s %s)",ParmKind2Str(cf->curPK,buff1),ParmKind2Str(cf->matPK,buff2));
-      ApplyStaticMat(cf,data,cf->MatTran,cf->nCols,nRows,0,0);
+      ApplyStaticMat(pbuf->mem,cf,data,cf->MatTran,cf->nCols,nRows,0,0);
       pbuf->main.nRows -= (cf->postFrames + cf->preFrames);
       nRows = pbuf->main.nRows;
       cf->nSamples = pbuf->main.nRows;
@@ -1901,6 +1946,33 @@ static void AddQualifiers(ParmBuf pbuf,float *data, int nRows, IOConfig cf,
    } else 
       FindSpans(span,cf->tgtPK,cf->tgtUsed);    
 
+   /* With no margins, as for a table, add all the difference
+      coefficients in one pass over the rows */
+   if ((cf->tgtPK&HASDELTA) && !(cf->curPK&HASDELTA) && 
+       hdValid==0 && tlValid==0 && !cf->v1Compat) {
+      lsi[0] = span[0]; lti[0] = span[4]; ld[0] = span[5]-span[4]+1;
+      lwin[0] = cf->delWin; nLev = 1;
+      if (cf->tgtPK&HASACCS) {
+         lsi[1] = span[4]; lti[1] = span[6]; ld[1] = span[7]-span[6]+1;
+         lwin[1] = cf->accWin; nLev = 2;
+         if (cf->tgtPK&HASTHIRD) {
+            lsi[2] = span[6]; lti[2] = span[8]; ld[2] = span[9]-span[8]+1;
+            lwin[2] = cf->thirdWin; nLev = 3;
+            if (highDiff == TRUE) {
+               lsi[3] = span[8]; lti[3] = span[10]; ld[3] = span[11]-span[10]+1;
+               lwin[3] = cf->fourthWin; nLev = 4;
+            }
+         }
+      }
+      if (trace&T_QUA)
+         printf("\nHParm:  adding %d levels of differences to %d rows",nLev,nRows);
+      AddRegressions(data,nRows,cf->nCols,nLev,lsi,lti,ld,lwin,cf->simpleDiffs);
+      for (i=0; i<nLev; i++) cf->nUsed += ld[i];
+      cf->curPK |= HASDELTA;
+      if (nLev>1) cf->curPK |= HASACCS;
+      if (nLev>2) cf->curPK |= HASTHIRD;
+   }
+
    /* Add any required difference coefficients */
    if ((cf->tgtPK&HASDELTA) && !(cf->curPK&HASDELTA)){   
       d = span[5]-span[4]+1; si = span[0]; ti = span[4];
@@ -1990,7 +2062,7 @@ static void AddQualifiers(ParmBuf pbuf,float *data, int nRows, IOConfig cf,
             HError(999,"Incorrect qualifiers in parameter type (%s %s)",
                    ParmKind2Str(cf->curPK,buff1),ParmKind2Str(cf->matPK,buff2));
          }
-         ApplyStaticMat(cf,data,cf->MatTran,cf->nCols,nRows,0,0);
+         ApplyStaticMat(pbuf->mem,cf,data,cf->MatTran,cf->nCols,nRows,0,0);
          pbuf->main.nRows -= (cf->postFrames + cf->preFrames);
          cf->nSamples = pbuf->main.nRows;
       }  
@@ -2043,15 +2115,7 @@ static void AddQualifiers(ParmBuf pbuf,float *data, int nRows, IOConfig cf,
             /*                HError(999,"Incompatible sizes %d and %d",xf->vecSize,d); */
             /*          } */
             d = xf->vecSize;
-            tmp = CreateVector(&gstack,d);
-            step = cf->nCols; fp = data;
-            for (j=0;j<nRows;j++) {
-               for (i=0;i<d;i++) tmp[i+1]=*(fp+i);
-               ApplyXForm2Vector(xf,tmp);
-               for (i=0;i<d;i++) *(fp+i)=tmp[i+1];
-               fp += step;
-            }
-            FreeVector(&gstack,tmp);
+            ApplyXForm2Rows(pbuf->mem,xf,data,cf->nCols,nRows);
          }
       }
    } else {
@@ -2086,7 +2150,7 @@ static void AddQualifiers(ParmBuf pbuf,float *data, int nRows, IOConfig cf,
             HError(999,"Incorrect qualifiers in parameter type (%s %s)",
                    ParmKind2Str(cf->curPK,buff1),ParmKind2Str(cf->matPK,buff2));
          }
-         ApplyStaticMat(cf,data,cf->MatTran,cf->nCols,nRows,0,0);
+         ApplyStaticMat(pbuf->mem,cf,data,cf->MatTran,cf->nCols,nRows,0,0);
          pbuf->main.nRows -= (cf->postFrames + cf->preFrames);
          cf->nSamples = pbuf->main.nRows;
       }      
@@ -2107,15 +2171,7 @@ static void AddQualifiers(ParmBuf pbuf,float *data, int nRows, IOConfig cf,
             }
          */
          d = xf->vecSize;
-         tmp = CreateVector(&gstack,d);
-         step = cf->nCols; fp = data;
-         for (j=0;j<nRows;j++) {
-            for (i=0;i<d;i++) tmp[i+1]=*(fp+i);
-            ApplyXForm2Vector(xf,tmp);
-            for (i=0;i<d;i++) *(fp+i)=tmp[i+1];
-            fp += step;
-         }
-         FreeVector(&gstack,tmp);
+         ApplyXForm2Rows(pbuf->mem,xf,data,cf->nCols,nRows);
       }
       /* cz277 - 141022 */
       /* Finallly append the append XForm */
@@ -2126,7 +2182,7 @@ static void AddQualifiers(ParmBuf pbuf,float *data, int nRows, IOConfig cf,
 
          xf = cf->appendXForm->xformSet->xforms[1];
          /* convert parametes to a vector and check */
-         appendVec = CreateVector(&gstack,cf->appendXFormSize);
+         appendVec = CreateVector(pbuf->mem,cf->appendXFormSize);
          d = xf->vecSize;
          for (b=1,cnti=1;b<=IntVecSize(xf->blockSize);b++) {
             bsize = xf->blockSize[b];
@@ -2150,7 +2206,7 @@ static void AddQualifiers(ParmBuf pbuf,float *data, int nRows, IOConfig cf,
             for (i=0;i<cf->appendXFormSize;i++) *(fp+i) = appendVec[i+1];
             fp += step;
          }
-         FreeVector(&gstack,appendVec);
+         FreeVector(pbuf->mem,appendVec);
       }
 
    }
@@ -2218,37 +2274,37 @@ static void DelQualifiers(float *data, IOConfig cf)
 }
 
 /* XformLPC2LPREFC: Convert Static Coefficients LPC -> LPREFC */
-static void XformLPC2LPREFC(float *data,int d)
+static void XformLPC2LPREFC(MemHeap *x,float *data,int d)
 {
    Vector a,k;
    int j;
    float *p;
    
-   a = CreateVector(&gstack,d);  k = CreateVector(&gstack,d);
+   a = CreateVector(x,d);  k = CreateVector(x,d);
    p = data-1;
    for (j=1; j<=d; j++) a[j] = p[j];
    LPC2RefC(a,k);
    for (j=1; j<=d; j++) p[j] = k[j];
-   FreeVector(&gstack,k); FreeVector(&gstack,a); 
+   FreeVector(x,k); FreeVector(x,a); 
 }
 
 /* XformLPREFC2LPC: Convert Static Coefficients LPREFC -> LPC */
-static void XformLPREFC2LPC(float *data,int d)
+static void XformLPREFC2LPC(MemHeap *x,float *data,int d)
 {
    Vector a,k;
    int j;
    float *p;
    
-   a = CreateVector(&gstack,d);  k = CreateVector(&gstack,d);
+   a = CreateVector(x,d);  k = CreateVector(x,d);
    p = data-1;
    for (j=1; j<=d; j++) k[j] = p[j];
    RefC2LPC(k,a);
    for (j=1; j<=d; j++) p[j] = a[j];
-   FreeVector(&gstack,k); FreeVector(&gstack,a); 
+   FreeVector(x,k); FreeVector(x,a); 
 }
 
 /* XformLPC2LPCEPSTRA: Convert Static Coefficients LPC -> LPCEPSTRA */
-static void XformLPC2LPCEPSTRA(float *data,int d,int dnew,int lifter)
+static void XformLPC2LPCEPSTRA(MemHeap *x,float *data,int d,int dnew,Vector win)
 {
    Vector a,c;
    int j;
@@ -2256,65 +2312,65 @@ static void XformLPC2LPCEPSTRA(float *data,int d,int dnew,int lifter)
    
    if (dnew>d)
       HError(6322,"XformLPC2LPCEPSTRA: lp cep size cannot exceed lpc vec");
-   a = CreateVector(&gstack,d);  c = CreateVector(&gstack,dnew);
+   a = CreateVector(x,d);  c = CreateVector(x,dnew);
    p = data-1;
    for (j=1; j<=d; j++) a[j] = p[j];
    LPC2Cepstrum(a,c);
-   if (lifter>0)
-      WeightCepstrum(c,1,dnew,lifter);
+   if (win!=NULL)
+      WeightCepstrumWin(c,1,dnew,win);
    for (j=1; j<=d; j++) p[j] = c[j];
-   FreeVector(&gstack,c); FreeVector(&gstack,a); 
+   FreeVector(x,c); FreeVector(x,a); 
 }
 
 /* XformLPCEPSTRA2LPC: Convert Static Coefficients LPCEPSTRA -> LPC */
-static void XformLPCEPSTRA2LPC(float *data,int d,int lifter)
+static void XformLPCEPSTRA2LPC(MemHeap *x,float *data,int d,Vector win)
 {
    Vector a,c;
    int j;
    float *p;
    
-   a = CreateVector(&gstack,d);  c = CreateVector(&gstack,d);
+   a = CreateVector(x,d);  c = CreateVector(x,d);
    p = data-1;
    for (j=1; j<=d; j++) c[j] = p[j];   
-   if (lifter>0)
-      UnWeightCepstrum(c,1,d,lifter);
+   if (win!=NULL)
+      UnWeightCepstrumWin(c,1,d,win);
    Cepstrum2LPC(c,a);
    for (j=1; j<=d; j++) p[j] = a[j];
-   FreeVector(&gstack,c); FreeVector(&gstack,a); 
+   FreeVector(x,c); FreeVector(x,a); 
 }
 
 /* XformMELSPEC2FBANK: Convert Static Coefficients MELSPEC -> FBANK */
-static void XformMELSPEC2FBANK(float *data,int d)
+static void XformMELSPEC2FBANK(MemHeap *x,float *data,int d)
 {
    Vector v;
    int j;
    float *p;
    
-   v = CreateVector(&gstack,d);
+   v = CreateVector(x,d);
    p = data-1;
    for (j=1; j<=d; j++) v[j] = p[j];
    MelSpec2FBank(v);
    for (j=1; j<=d; j++) p[j] = v[j];
-   FreeVector(&gstack,v); 
+   FreeVector(x,v); 
 }
 
 /* XformFBANK2MELSPEC: Convert Static Coefficients FBANK -> MELSPEC */
-static void XformFBANK2MELSPEC(float *data,int d)
+static void XformFBANK2MELSPEC(MemHeap *x,float *data,int d)
 {
    Vector v;
    int j;
    float *p;
    
-   v = CreateVector(&gstack,d);
+   v = CreateVector(x,d);
    p = data-1;
    for (j=1; j<=d; j++) v[j] = p[j];   
    FBank2MelSpec(v);
    for (j=1; j<=d; j++) p[j] = v[j];
-   FreeVector(&gstack,v); 
+   FreeVector(x,v); 
 }
 
 /* XformFBANK2MFCC: Convert Static Coefficients FBANK -> MFCC */
-static void XformFBANK2MFCC(float *data,int d,int dnew,int lifter)
+static void XformFBANK2MFCC(MemHeap *x,float *data,int d,int dnew,Vector win)
 {
    Vector fbank,c;
    int j;
@@ -2322,23 +2378,24 @@ static void XformFBANK2MFCC(float *data,int d,int dnew,int lifter)
    
    if (dnew>d)
       HError(6322,"XformFBANK2MFCC: mfcc size cannot exceed fbank size");
-   fbank = CreateVector(&gstack,d);  c = CreateVector(&gstack,dnew);
+   fbank = CreateVector(x,d);  c = CreateVector(x,dnew);
    p = data-1;
    for (j=1; j<=d; j++) fbank[j] = p[j];
    FBank2MFCC(fbank,c,dnew);
-   if (lifter>0)
-      WeightCepstrum(c,1,dnew,lifter);
+   if (win!=NULL)
+      WeightCepstrumWin(c,1,dnew,win);
    for (j=1; j<=d; j++) p[j] = c[j];
-   FreeVector(&gstack,c); FreeVector(&gstack,fbank); 
+   FreeVector(x,c); FreeVector(x,fbank); 
 }
 
 /* XformBase: convert statics to change basekind of cf->curPK to cf->tgtPK.
       Conversion is applied to a single row pointed to by data.  */ 
-static void XformBase(float *data, IOConfig cf)
+static void XformBase(MemHeap *x, float *data, IOConfig cf)
 {
    char b1[50],b2[50];
    ParmKind curBase,tgtBase,quals;
-   int d, dnew, lifter;
+   int d, dnew;
+   Vector win = NULL;
    short span[12];
    
    curBase = cf->curPK&BASEMASK;
@@ -2349,15 +2406,21 @@ static void XformBase(float *data, IOConfig cf)
       printf("HParm: Attempting to xform static parms from %s to %s\n",
              ParmKind2Str(curBase,b1),ParmKind2Str(tgtBase,b2));
    FindSpans(span, cf->curPK, cf->nUsed);
-   d = span[1]-span[0]+1; dnew = cf->numCepCoef; lifter = cf->cepLifter;
+   d = span[1]-span[0]+1; dnew = cf->numCepCoef;
+   if (cf->cepLifter>0) {
+      /* make the weights before any workspace so it can be freed */
+      if (cf->cepWin==NULL || VectorSize(cf->cepWin)<d || VectorSize(cf->cepWin)<dnew)
+         cf->cepWin = CreateCepWindow(x,cf->cepLifter,(d>dnew)?d:dnew);
+      win = cf->cepWin;
+   }
    switch (curBase) {
    case LPC:
       switch(tgtBase){
       case LPREFC:    
-         XformLPC2LPREFC(data,d); 
+         XformLPC2LPREFC(x,data,d); 
          break;
       case LPCEPSTRA: 
-         XformLPC2LPCEPSTRA(data,d,dnew,lifter);
+         XformLPC2LPCEPSTRA(x,data,d,dnew,win);
          if (dnew<d) {
             DeleteColumn(data,cf->nUsed,dnew,d-dnew);
             cf->nUsed -= d-dnew;
@@ -2370,11 +2433,11 @@ static void XformBase(float *data, IOConfig cf)
    case LPREFC:
       switch(tgtBase){
       case LPC:       
-         XformLPREFC2LPC(data,d);       
+         XformLPREFC2LPC(x,data,d);       
          break;
       case LPCEPSTRA: 
-         XformLPREFC2LPC(data,d);       
-         XformLPC2LPCEPSTRA(data,d,dnew,lifter);
+         XformLPREFC2LPC(x,data,d);       
+         XformLPC2LPCEPSTRA(x,data,d,dnew,win);
          if (dnew<d) {
             DeleteColumn(data,cf->nUsed,dnew,d-dnew);
             cf->nUsed -= d-dnew;
@@ -2387,11 +2450,11 @@ static void XformBase(float *data, IOConfig cf)
    case LPCEPSTRA:
       switch(tgtBase){
       case LPREFC:    
-         XformLPCEPSTRA2LPC(data,d,lifter);
-         XformLPC2LPREFC(data,d); 
+         XformLPCEPSTRA2LPC(x,data,d,win);
+         XformLPC2LPREFC(x,data,d); 
          break;
       case LPC:
-         XformLPCEPSTRA2LPC(data,d,lifter);
+         XformLPCEPSTRA2LPC(x,data,d,win);
          break;
       default:
          HError(6322,"XformBase: Bad target %s",ParmKind2Str(tgtBase,b1));
@@ -2400,11 +2463,11 @@ static void XformBase(float *data, IOConfig cf)
    case MELSPEC:
       switch(tgtBase){
       case FBANK:    
-         XformMELSPEC2FBANK(data,d); 
+         XformMELSPEC2FBANK(x,data,d); 
          break;
       case MFCC:     
-         XformMELSPEC2FBANK(data,d); 
-         XformFBANK2MFCC(data,d,dnew,lifter);
+         XformMELSPEC2FBANK(x,data,d); 
+         XformFBANK2MFCC(x,data,d,dnew,win);
          if (dnew<d) {
             DeleteColumn(data,cf->nUsed,dnew,d-dnew);
             cf->nUsed -= d-dnew;
@@ -2417,10 +2480,10 @@ static void XformBase(float *data, IOConfig cf)
    case FBANK:    
       switch(tgtBase){
       case MELSPEC:    
-         XformFBANK2MELSPEC(data,d); 
+         XformFBANK2MELSPEC(x,data,d); 
          break;
       case MFCC:     
-         XformFBANK2MFCC(data,d,dnew,lifter);
+         XformFBANK2MFCC(x,data,d,dnew,win);
          if (dnew<d) {
             DeleteColumn(data,cf->nUsed,dnew,d-dnew);
             cf->nUsed -= d-dnew;
@@ -2457,11 +2520,13 @@ static void SetUpForCoding(MemHeap *x, IOConfig cf, int frSize)
 {
    char buf[50];
    ParmKind btgt;
+   int i;
   
    cf->s = CreateVector(x,frSize);
    cf->r = CreateShortVec(x,frSize);
    cf->curPK = btgt = cf->tgtPK&BASEMASK;
    cf->a = cf->k = cf->c = cf->fbank = NULL;
+   cf->nBatch = -1;
    SetCodeStyle(cf);
    switch(cf->style){
    case LPCbased:
@@ -2495,11 +2560,24 @@ static void SetUpForCoding(MemHeap *x, IOConfig cf, int frSize)
          cf->cm = CreateDMatrix (x, cf->lpcOrder+1, cf->numChans+2);
          InitPLP (cf->fbInfo, cf->lpcOrder, cf->eql, cf->cm);
       }
+      if (batchFBank) {
+         for (i=0; i<FBANKBATCH; i++) {
+            cf->bs[i] = CreateVector(x,frSize);
+            cf->bfbank[i] = CreateVector(x,cf->numChans);
+         }
+         if (btgt == MFCC)
+            cf->mfccTab = CreateMFCCTable(x,cf->numChans,cf->numCepCoef);
+         cf->nBatch = 0;
+      }
       break;
    default:
       HError(6321,"SetUpForCoding: target %s is not a parameterised form",
              ParmKind2Str(cf->tgtPK,buf));
    }
+   if (cf->useHam)
+      cf->hamWin = CreateHamWindow(x,frSize);
+   if (cf->cepLifter > 0 && cf->c != NULL)
+      cf->cepWin = CreateCepWindow(x,cf->cepLifter,cf->numCepCoef);
    if (cf->tgtPK&HASENERGY) {
       cf->curPK |= HASENERGY; ++cf->nUsed;
    }
@@ -2528,36 +2606,102 @@ static void SetUpForCoding(MemHeap *x, IOConfig cf, int frSize)
    cf->nCvrt = cf->nUsed;
 }
 
-/* ConvertFrame: convert frame in cf->s and store in pbuf, return total
-   parameters stored in pbuf */
-static int ConvertFrame(IOConfig cf, float *pbuf)
+/* UseRawEnergy: return TRUE if energy is measured before windowing */
+static Boolean UseRawEnergy(IOConfig cf)
 {
-   ParmKind btgt = cf->tgtPK&BASEMASK;
-   float re,rawte=0.0,te,*p, cepScale = 1.0;
-   int i,bsize=0;
-   Vector v=NULL;
-   char buf[50];
-   Boolean rawE;
-   
-   p = pbuf;
-   rawE = cf->rawEnergy;
-   if (btgt<MFCC && cf->v1Compat)
-      rawE = FALSE;
+   if ((cf->tgtPK&BASEMASK)<MFCC && cf->v1Compat)
+      return FALSE;
+   return cf->rawEnergy;
+}
+
+/* InitDither: seed the dither generator of cf.  A +ve ADDDITHER
+   repeats the same sequence for every buffer, a -ve one carries on
+   the global generator, seeded from the clock by InitMath, so that
+   the noise differs between buffers and between runs */
+static void InitDither(IOConfig cf)
+{
+   int seed;
+
+   if (cf->addDither>0.0)
+      RandInitState(&cf->dither,12345);
+   else if (cf->addDither<0.0) {
+      pthread_mutex_lock(&randLock);
+      seed = (int)(RandomValue()*2147483647.0);
+      pthread_mutex_unlock(&randLock);
+      RandInitState(&cf->dither,seed);
+   }
+}
+
+/* PrepareFrame: dither, zero mean, pre-emphasise and window the frame
+   in cf->s, returning its raw energy if it will be needed */
+static float PrepareFrame(IOConfig cf)
+{
+   float rawte=0.0;
+   int i;
 
    if (cf->addDither!=0.0)
       for (i=1; i<=VectorSize(cf->s); i++)
-         cf->s[i] += (RandomValue()*2.0 - 1.0)*cf->addDither;
+         cf->s[i] += (RandomStateValue(&cf->dither)*2.0 - 1.0)*cf->addDither;
 
    if (cf->zMeanSrc && !cf->v1Compat)
       ZeroMeanFrame(cf->s);
-   if ((cf->tgtPK&HASENERGY) && rawE){
+   if ((cf->tgtPK&HASENERGY) && UseRawEnergy(cf)){
       rawte = 0.0;
       for (i=1; i<=VectorSize(cf->s); i++)
          rawte += cf->s[i] * cf->s[i];
    }
    if (cf->preEmph>0.0) 
       PreEmphasise(cf->s,cf->preEmph);
-   if (cf->useHam) Ham(cf->s);
+   if (cf->useHam) ApplyWindow(cf->s,cf->hamWin);
+   return rawte;
+}
+
+/* StoreFrame: store the bsize coefs in v of a frame with filterbank
+   fbank and energy te in pbuf, adding C0 and energy if needed, and
+   return total parameters stored in pbuf */
+static int StoreFrame(IOConfig cf, Vector v, int bsize, Vector fbank,
+                      float te, float *pbuf)
+{
+   ParmKind btgt = cf->tgtPK&BASEMASK;
+   float *p, cepScale = 1.0;
+   int i;
+
+   p = pbuf;
+   if (btgt == PLP || btgt == MFCC)
+      cepScale = (cf->v1Compat) ? 1.0 : cf->cepScale;
+   for (i=1; i<=bsize; i++) 
+      *p++ = v[i] * cepScale;
+
+   if (cf->tgtPK&HASZEROC){
+      if (btgt == MFCC) {
+         *p = FBank2C0(fbank) * cepScale;
+         if (cf->v1Compat) *p *= cf->eScale;
+         ++p;
+      }
+      else      /* For PLP include gain as C0 */
+         *p++ = v[bsize+1] * cepScale;   
+      cf->curPK|=HASZEROC ;
+   }
+   if (cf->tgtPK&HASENERGY) {
+      *p++ = (te<MINLARG) ? LZERO : log(te);  
+      cf->curPK|=HASENERGY;
+   }
+   return p - pbuf;
+}
+
+/* ConvertFrame: convert frame in cf->s and store in pbuf, return total
+   parameters stored in pbuf */
+static int ConvertFrame(IOConfig cf, float *pbuf)
+{
+   ParmKind btgt = cf->tgtPK&BASEMASK;
+   float re,rawte,te=0.0;
+   int bsize=0;
+   Vector v=NULL;
+   char buf[50];
+   Boolean rawE;
+   
+   rawE = UseRawEnergy(cf);
+   rawte = PrepareFrame(cf);
    switch(btgt){
    case LPC: 
       Wave2LPC(cf->s,cf->a,cf->k,&re,&te);
@@ -2571,7 +2715,7 @@ static int ConvertFrame(IOConfig cf, float *pbuf)
       Wave2LPC(cf->s,cf->a,cf->k,&re,&te);
       LPC2Cepstrum(cf->a,cf->c);
       if (cf->cepLifter > 0)
-         WeightCepstrum(cf->c, 1, cf->numCepCoef, cf->cepLifter);
+         WeightCepstrumWin(cf->c, 1, cf->numCepCoef, cf->cepWin);
       v = cf->c; bsize = cf->numCepCoef;
       break;
    case MELSPEC:
@@ -2583,7 +2727,7 @@ static int ConvertFrame(IOConfig cf, float *pbuf)
       Wave2FBank(cf->s, cf->fbank, rawE?NULL:&te, cf->fbInfo);
       FBank2MFCC(cf->fbank, cf->c, cf->numCepCoef);
       if (cf->cepLifter > 0)
-         WeightCepstrum(cf->c, 1, cf->numCepCoef, cf->cepLifter);
+         WeightCepstrumWin(cf->c, 1, cf->numCepCoef, cf->cepWin);
       v = cf->c; bsize = cf->numCepCoef;
       break;
    case PLP:
@@ -2591,7 +2735,7 @@ static int ConvertFrame(IOConfig cf, float *pbuf)
       FBank2ASpec(cf->fbank, cf->as, cf->eql, cf->compressFact, cf->fbInfo);
       ASpec2LPCep(cf->as, cf->ac, cf->lp, cf->c, cf->cm);
       if (cf->cepLifter > 0)
-         WeightCepstrum(cf->c, 1, cf->numCepCoef, cf->cepLifter);
+         WeightCepstrumWin(cf->c, 1, cf->numCepCoef, cf->cepWin);
       v = cf->c; 
       bsize = cf->numCepCoef;
       break;
@@ -2599,28 +2743,63 @@ static int ConvertFrame(IOConfig cf, float *pbuf)
       HError(6321,"ConvertFrame: target %s is not a parameterised form",
              ParmKind2Str(cf->tgtPK,buf));
    }
+   return StoreFrame(cf, v, bsize, cf->fbank, rawE?rawte:te, pbuf);
+}
 
-   if (btgt == PLP || btgt == MFCC)
-      cepScale = (cf->v1Compat) ? 1.0 : cf->cepScale;
-   for (i=1; i<=bsize; i++) 
-      *p++ = v[i] * cepScale;
+/* ConvertBatch: convert the frames waiting in the batch of cf and
+   store them where QueueFrame was told */
+static void ConvertBatch(IOConfig cf)
+{
+   ParmKind btgt = cf->tgtPK&BASEMASK;
+   Vector fbank,v=NULL;
+   int i,bsize=0;
+   Boolean rawE;
 
-   if (cf->tgtPK&HASZEROC){
-      if (btgt == MFCC) {
-         *p = FBank2C0(cf->fbank) * cepScale;
-         if (cf->v1Compat) *p *= cf->eScale;
-         ++p;
+   if (cf->nBatch<=0) return;
+   rawE = UseRawEnergy(cf);
+   Wave2FBankBatch(cf->bs, cf->bfbank, rawE?NULL:cf->bte, cf->nBatch,
+                   cf->fbInfo);
+   for (i=0; i<cf->nBatch; i++) {
+      fbank = cf->bfbank[i];
+      switch(btgt){
+      case MELSPEC:
+      case FBANK: 
+         v = fbank; bsize = cf->numChans;
+         break;
+      case MFCC: 
+         FBank2MFCCTable(fbank, cf->c, cf->mfccTab);
+         if (cf->cepLifter > 0)
+            WeightCepstrumWin(cf->c, 1, cf->numCepCoef, cf->cepWin);
+         v = cf->c; bsize = cf->numCepCoef;
+         break;
+      case PLP:
+         FBank2ASpec(fbank, cf->as, cf->eql, cf->compressFact, cf->fbInfo);
+         ASpec2LPCep(cf->as, cf->ac, cf->lp, cf->c, cf->cm);
+         if (cf->cepLifter > 0)
+            WeightCepstrumWin(cf->c, 1, cf->numCepCoef, cf->cepWin);
+         v = cf->c; bsize = cf->numCepCoef;
+         break;
       }
-      else      /* For PLP include gain as C0 */
-         *p++ = v[bsize+1] * cepScale;   
-      cf->curPK|=HASZEROC ;
-   }
-   if (cf->tgtPK&HASENERGY) {
-      if (rawE) te = rawte;
-      *p++ = (te<MINLARG) ? LZERO : log(te);  
-      cf->curPK|=HASENERGY;
+      cf->nUsed = cf->nCvrt; cf->curPK = cf->tgtPK&BASEMASK;
+      if (StoreFrame(cf, v, bsize, fbank, cf->bte[i], cf->bdst[i]) != cf->nCvrt)
+         HError(6391,"ConvertBatch: convert count != %d",cf->nCvrt);
+      cf->nCvrt = cf->nUsed; cf->unqPK = cf->curPK;
    }
-   return p - pbuf;
+   cf->nBatch = 0;
+}
+
+/* QueueFrame: prepare the frame in cf->s and add it to the batch, to
+   be converted and stored in pbuf when the batch is full or flushed
+   by ConvertBatch */
+static void QueueFrame(IOConfig cf, float *pbuf)
+{
+   int i = cf->nBatch;
+
+   cf->bte[i] = PrepareFrame(cf);
+   CopyVector(cf->s, cf->bs[i]);
+   cf->bdst[i] = pbuf;
+   if (++cf->nBatch == FBANKBATCH)
+      ConvertBatch(cf);
 }
 
 /* Get data from external source and convert to 16 bit linear */
@@ -3038,6 +3217,7 @@ static void SetSilDetParms(ParmBuf pbuf, TriState silMeasure)
 {
    /* Don't set now if using self calibration (will be set later) */
    if (pbuf->cf->selfCalSilDet!=0) return;
+   pthread_mutex_lock(&chanLock);
    if (((pbuf->cf->measureSil==TRUE && silMeasure!=FALSE) || 
         silMeasure==TRUE ||
         (!pbuf->chan->spDetParmsSet && pbuf->cf->silMean<=0.0))) {
@@ -3059,6 +3239,7 @@ static void SetSilDetParms(ParmBuf pbuf, TriState silMeasure)
       pbuf->chan->spDetThresh = pbuf->cf->silMean+pbuf->cf->spThresh;
       pbuf->chan->spDetParmsSet = TRUE;
    }
+   pthread_mutex_unlock(&chanLock);
 }
 
 
@@ -3487,12 +3668,59 @@ void  SetStreamWidths(ParmKind pk, int size, short *swidth, Boolean *eSep)
 
 /* ----- side based normalisation ------------ */
 
+/* Parsed side vectors are kept for the life of the process, keyed by
+   kind and resolved file name, so that utterances from interleaved
+   sides read each side's file only once.  The table is only touched
+   by OpenBuffer under chanLock. */
+#define NORMHASHSIZE 251
+
+typedef struct _NormVecEntry {
+   char kind;                    /* 'm' mean, 'v' var scale, 'a' aug fea */
+   char *fn;                     /* resolved file name */
+   Vector vec;                   /* parsed (and projected) vector */
+   struct _NormVecEntry *next;   /* next in hash chain */
+} NormVecEntry;
+
+static NormVecEntry *normVecTab[NORMHASHSIZE];
+
+/* NormVecHash: hash kind and file name into normVecTab */
+static unsigned int NormVecHash(char kind, char *fn)
+{
+   unsigned int h = (unsigned char)kind;
+
+   while (*fn != '\0')
+      h = h*31 + (unsigned char)*fn++;
+   return h%NORMHASHSIZE;
+}
+
+/* FindNormVec: return the cached vector of given kind for fn or NULL */
+static Vector FindNormVec(char kind, char *fn)
+{
+   NormVecEntry *e;
+
+   for (e=normVecTab[NormVecHash(kind,fn)]; e!=NULL; e=e->next)
+      if (e->kind==kind && strcmp(e->fn,fn)==0)
+         return e->vec;
+   return NULL;
+}
+
+/* CacheNormVec: add vec, allocated on gcheap, to the cache for fn */
+static void CacheNormVec(char kind, char *fn, Vector vec)
+{
+   NormVecEntry *e;
+   unsigned int h;
+
+   h = NormVecHash(kind,fn);
+   e = (NormVecEntry *)New(&gcheap,sizeof(NormVecEntry));
+   e->kind = kind; e->fn = CopyString(&gcheap,fn); e->vec = vec;
+   e->next = normVecTab[h]; normVecTab[h] = e;
+}
+
 /* load appropriate mean vector into ParmBuf */
 static void LoadCMeanVector( MemHeap* x , IOConfig cf , char* fname )
 {
-   static char mfname_prev[MAXFNAMELEN] = "";
-   static Vector meanVector = NULL;
-
+   Vector meanVector;
+   char mfname_prev[MAXFNAMELEN]; /* resolved name, the cache key */
    char mfname[MAXFNAMELEN]; /* actual mean filename */
    char pname[MAXFNAMELEN];  /* actual path name */
    char buf[MAXSTRLEN];    /* temporary working buffer */
@@ -3517,13 +3745,12 @@ static void LoadCMeanVector( MemHeap* x , IOConfig cf , char* fname )
       MakeFN(mfname, cf->cMeanDN, 0, buf);
    
    /* caching of vector */
-   if (strcmp(buf, mfname_prev) == 0){ /* names match , old vector must be the same */
+   if ((meanVector = FindNormVec('m', buf)) != NULL){ /* side seen before */
       cf->cMeanVector = CreateVector(x,VectorSize(meanVector));
       CopyVector(meanVector, cf->cMeanVector ); 
       return;
    }
-   else
-      strcpy(mfname_prev, buf);
+   strcpy(mfname_prev, buf);
    
    /* read file header and ParmKind */
    if (InitSource (buf, &src, NoFilter) < SUCCESS)
@@ -3551,11 +3778,10 @@ static void LoadCMeanVector( MemHeap* x , IOConfig cf , char* fname )
    ReadInt (&src, &dim, 1, FALSE);
    
    /* caching of vector */
-   if (meanVector)
-       Dispose (&gcheap, meanVector);
    meanVector = CreateVector (&gcheap, dim);
    if (!ReadVector (&src, meanVector , FALSE))
       HError(6376, "LoadCMeanVector: Couldn't read mean vector from file");
+   CacheNormVec('m', mfname_prev, meanVector);
 
    cf->cMeanVector = CreateVector (x, dim);
    CopyVector (meanVector, cf->cMeanVector);
@@ -3565,8 +3791,8 @@ static void LoadCMeanVector( MemHeap* x , IOConfig cf , char* fname )
 /* load appropriate vscale vector into ParmBuf */
 static void LoadVarScaleVector(MemHeap* x, IOConfig cf, char *fname)
 {
-   static char mfname_prev[MAXFNAMELEN] = "";
-   static Vector varVector = NULL;
+   Vector varVector;
+   char mfname_prev[MAXFNAMELEN]; /* resolved name, the cache key */
    char mfname[MAXFNAMELEN]; /* actual mean filename */
    char pname[MAXFNAMELEN];  /* actual path name */
    char buf[MAXSTRLEN];    /* temporary working buffer */
@@ -3591,15 +3817,13 @@ static void LoadVarScaleVector(MemHeap* x, IOConfig cf, char *fname)
    else
       MakeFN (mfname, cf->varScaleDN, 0, buf);
    
-   /* caching of vector: if the same side as the previous one, just use the cached one */
-   if (strcmp (buf, mfname_prev) == 0 ){ /* names match , old vector must be the same */
+   /* caching of vector: if this side has been seen before, just use the cached one */
+   if ((varVector = FindNormVec('v', buf)) != NULL){
       cf->varScaleVector = CreateVector (x, VectorSize (varVector));
       CopyVector(varVector, cf->varScaleVector);
       return;
    }
-   else {
-      strcpy(mfname_prev, buf);
-   }
+   strcpy(mfname_prev, buf);
 
    /* read file header and ParmKind */
    if (InitSource (buf, &src, NoFilter) < SUCCESS)
@@ -3626,9 +3850,7 @@ static void LoadVarScaleVector(MemHeap* x, IOConfig cf, char *fname)
       HError (6376, "LoadVarScaleVector: <VARIANCE> missing, read: %s", buf);
    ReadInt (&src, &dim, 1, FALSE);
 
-   /* refresh the cache if a new side */
-   if (varVector)
-      Dispose (&gcheap, varVector);
+   /* add the new side to the cache */
    varVector = CreateVector (&gcheap, dim);
    if (!ReadVector (&src, varVector, FALSE))
       HError(6376,"LoadVarScaleVector: Couldn't read var scale vector from file");
@@ -3649,8 +3871,7 @@ static void LoadVarScaleVector(MemHeap* x, IOConfig cf, char *fname)
       
       LinTranQuaProd(NewCepstrVarNorm,cf->MatTran,CepstrVarNorm);
 
-      if (varVector)
-         Dispose (&gcheap, varVector);
+      Dispose (&gcheap, varVector);
       varVector = CreateVector(&gcheap,NewFDim);
       ZeroVector(varVector);
       
@@ -3660,6 +3881,7 @@ static void LoadVarScaleVector(MemHeap* x, IOConfig cf, char *fname)
       
       dim = NewFDim;
    }
+   CacheNormVec('v', mfname_prev, varVector);
 
    cf->varScaleVector = CreateVector (x, dim);
    CopyVector (varVector, cf->varScaleVector);
@@ -3670,8 +3892,7 @@ static void LoadVarScaleVector(MemHeap* x, IOConfig cf, char *fname)
 /* cz277 - aug */
 /* load appropriate vectors for augmented features */
 static void LoadAugFeaVector(MemHeap *x, IOConfig config, char *fileName, char *augFeaDN, char *augFeaMask, char *augFeaPathMask, Vector *augFeaVecPtr) {
-    static char augFeaNamePrev[MAXFNAMELEN] = "";
-    static Vector augFeaVector = NULL;
+    Vector augFeaVector;
     char augFeaName[MAXFNAMELEN];
     char pathName[MAXFNAMELEN];
     char buf1[MAXFNAMELEN], buf2[MAXFNAMELEN];
@@ -3696,14 +3917,11 @@ static void LoadAugFeaVector(MemHeap *x, IOConfig config, char *fileName, char *
         MakeFN(augFeaName, augFeaDN, 0, buf1);
     }
     /* caching of vector */
-    if (strcmp(buf1, augFeaNamePrev) == 0) { /* names match, old vector must be the same */
+    if ((augFeaVector = FindNormVec('a', buf1)) != NULL) { /* file seen before */
         *augFeaVecPtr = CreateVector(x, VectorSize(augFeaVector));
         CopyVector(augFeaVector, *augFeaVecPtr);
         return;
     }
-    else {
-        strcpy(augFeaNamePrev, buf1);
-    }
     
     /* read file header and the augFea vector kind */
     if (InitSource(buf1, &source, NoFilter) < SUCCESS) {
@@ -3724,14 +3942,12 @@ static void LoadAugFeaVector(MemHeap *x, IOConfig config, char *fileName, char *
     }
     ReadInt(&source, &dim, 1, FALSE);
 
-    /* cachubg of vector */
-    if (augFeaVector) {
-        Dispose(&gcheap, augFeaVector);
-    }
+    /* caching of vector */
     augFeaVector = CreateVector(&gcheap, dim);
     if (!ReadVector(&source, augFeaVector, FALSE)) {
         HError(9999, "LoadAugFeaVector: Couldn't read augmented feature vector from file");
     }
+    CacheNormVec('a', buf1, augFeaVector);
 
     *augFeaVecPtr = CreateVector(x, dim);
     CopyVector(augFeaVector, *augFeaVecPtr);
@@ -3773,7 +3989,6 @@ static Boolean GetCRCCFrame(ParmBuf pbuf,void *data,int n,int s,Boolean bSwap)
 {
    IOConfig cf=pbuf->cf;
    Boolean lastReadValid=FALSE;
-   static unsigned short lastReadShort;
    unsigned int crcc=cf->crcc;
    unsigned short *sp,s1,s2;
    int j = 0;
@@ -3797,12 +4012,12 @@ static Boolean GetCRCCFrame(ParmBuf pbuf,void *data,int n,int s,Boolean bSwap)
    else {
       /* Try to read two shorts - if the first reads okay and the */
       /*  second doesn't then we have found a crcc. */
-      if (lastReadValid) s1=lastReadShort;
+      if (lastReadValid) s1=cf->lastShort;
       else
          if (!RawReadShort(&cf->src,(short*)&s1,1,hparmBin,cf->bSwap)) {
             if (n!=1 || s!=sizeof(short))
                HError(6350,"GetCRCCFrame: CRCC missing");
-            pbuf->crcc=lastReadShort;
+            pbuf->crcc=cf->lastShort;
             return(FALSE);
          }
       lastReadValid=FALSE;
@@ -3813,7 +4028,7 @@ static Boolean GetCRCCFrame(ParmBuf pbuf,void *data,int n,int s,Boolean bSwap)
       else if (n==1 && s==sizeof(short)) {
          /* We have read two shorts but only need one */
          /*  so we remember it and see if it is CRCC next time !! */
-         lastReadShort=s2;lastReadValid=TRUE;
+         cf->lastShort=s2;lastReadValid=TRUE;
          j=1; *sp++=s1; crcc=(crcc*65536+s1)%36897;
       }
       else
@@ -3903,7 +4118,7 @@ static int GetParm(ParmBuf pbuf,int nFrame,void *data)
             /* Delete any qualifiers which are not required by target */
             DelQualifiers(v+1, cf);
             /* Transform static parms if necessary */
-            XformBase(v+1, cf);
+            XformBase(pbuf->mem, v+1, cf);
          }
          /* Now copy transformed vector */
          for (j=1;j<=cf->nUsed;j++)
@@ -4295,6 +4510,12 @@ static int GetFrameFromChannel(ParmBuf pbuf,int chType,void *vp)
       if (pbuf->spVal!=NULL)
          pbuf->spVal[pbuf->main.nRows] = e;
 
+      /* Filterbank frames are converted in batches */
+      if (cf->nBatch>=0 && !pbuf->dShort) {
+         QueueFrame(cf, (float *) vp);
+         r=1;
+         break;
+      }
       /* Reset current nUsed/PK to indicate results of conversion */
       cf->nUsed = cf->nCvrt; cf->curPK = cf->tgtPK&BASEMASK;
       /* Then convert it to a frame */
@@ -4477,6 +4698,9 @@ static void FillBufFromChannel(ParmBuf pbuf,int minRows)
       }
       pbuf->inRow++;pbuf->main.nRows++;
    }
+   /* Convert any frames still waiting in a batch */
+   if (cf->nBatch>0)
+      ConvertBatch(cf);
 
    /* Make sure we mark the buffer if we have consumed all input */
    CheckBuffer(pbuf);
@@ -4508,7 +4732,7 @@ static void FillBufFromChannel(ParmBuf pbuf,int minRows)
 
       AddQualifiers(pbuf,fp1,pbuf->qen-pbuf->qst+1,cf,head,tail);
       /* Assume session adaptation now done */
-      pbuf->chan->oCnt+=pbuf->qen-pbuf->qst+1;
+      __atomic_add_fetch(&pbuf->chan->oCnt,pbuf->qen-pbuf->qst+1,__ATOMIC_RELAXED);
       /* Set qst for the next time */
       pbuf->qst=pbuf->qen+1;
    }
@@ -4521,8 +4745,11 @@ static void FillBufFromChannel(ParmBuf pbuf,int minRows)
    /*  Until silence is detected and */
    /*   spDetEn should be set to last+1 row of speech (spDetFin+1) */
    if (!pbuf->chan->spDetParmsSet && pbuf->cf->useSilDet && 
-       pbuf->cf->selfCalSilDet!=0)
+       pbuf->cf->selfCalSilDet!=0) {
+      pthread_mutex_lock(&chanLock);
       SetSelfCalSpDetParms(pbuf);
+      pthread_mutex_unlock(&chanLock);
+   }
    if (cf->useSilDet)
       RunSilDet(pbuf,cleared);
    else {
@@ -4766,9 +4993,10 @@ ParmBuf OpenBuffer(MemHeap *x, char *fn, int maxObs, FileFormat ff,
    pbuf->chan = curChan; pbuf->ext=NULL; pbuf->chClear=FALSE;
    pbuf->cf = MakeIOConfig(pbuf->mem, pbuf->chan);
    if (enSpeechDet!=TRI_UNDEF) pbuf->cf->useSilDet=(Boolean)enSpeechDet;
-   if (pbuf->cf->addDither>0.0) RandInit(12345);
+   InitDither(pbuf->cf);
 
    /* side based normalisation -- #### should maybe be in OpenAsChannel? */
+   pthread_mutex_lock(&chanLock);
    /* Load mean vector into pbuf->cf */
    if (HasZerom (pbuf->cf->tgtPK) && !HasZerom (pbuf->cf->srcPK) && 
        (pbuf->cf->cMeanDN || pbuf->cf->cMeanMask))
@@ -4786,9 +5014,6 @@ ParmBuf OpenBuffer(MemHeap *x, char *fn, int maxObs, FileFormat ff,
       pbuf->cf->sideGMM = curChan->cf.sideGMM;
       pbuf->cf->siGMM = curChan->cf.siGMM;
    }
-   if (pbuf->cf->sideXFormMask != NULL) {
-      pbuf->cf->sideXForm = LoadSideXForm(pbuf->cf,fn);
-   }
 
    /* Load xform associated with this side if necessary */
    if (pbuf->cf->sideXFormMask != NULL) {
@@ -4832,6 +5057,7 @@ ParmBuf OpenBuffer(MemHeap *x, char *fn, int maxObs, FileFormat ff,
    else {
        pbuf->cf->augFea5Vector = NULL;
    }
+   pthread_mutex_unlock(&chanLock);
    if(OpenAsChannel(pbuf,maxObs,fn,ff,silMeasure)<SUCCESS){
       Dispose(x, pbuf);
       HRError(6316,"OpenBuffer: OpenAsChannel failed");   
@@ -4879,7 +5105,7 @@ ParmBuf OpenExtBuffer(MemHeap *x, char *fn, int maxObs,
    pbuf->chan = curChan; pbuf->ext=ext; pbuf->chClear=FALSE;
    pbuf->cf = MakeIOConfig(pbuf->mem, pbuf->chan);
    if (enSpeechDet!=TRI_UNDEF) pbuf->cf->useSilDet=(Boolean)enSpeechDet;
-   if (pbuf->cf->addDither>0.0) RandInit(12345);
+   InitDither(pbuf->cf);
 
    if(OpenAsChannel(pbuf,maxObs,fn,ff,silMeasure)<SUCCESS){
       Dispose(x, pbuf);
@@ -4936,8 +5162,8 @@ void StartBuffer(ParmBuf pbuf)
       if (pbuf->cf->useSilDet) ChangeState(pbuf,PB_WAITING); 
       else ChangeState(pbuf,PB_FILLING); 
    }
-   pbuf->chan->fCnt++;
-   pbuf->chan->sCnt++;
+   __atomic_add_fetch(&pbuf->chan->fCnt,1,__ATOMIC_RELAXED);
+   __atomic_add_fetch(&pbuf->chan->sCnt,1,__ATOMIC_RELAXED);
 }
 
 /* EXPORT->StopBuffer: stop audio and let the buffer empty */
@@ -5092,18 +5318,9 @@ void ReadAsTable(ParmBuf pbuf, int index, Observation *o)
 
 /* ------------------ Other buffer operations ------------------- */
 
-/* EXPORT->GetBufferInfo: Get info associated with pbuf */
-void GetBufferInfo(ParmBuf pbuf, BufferInfo *info)
+/* GetConfigInfo: get info associated with cf on chan */
+static void GetConfigInfo(ChannelInfo *chan, IOConfig cf, BufferInfo *info)
 {
-   ChannelInfo *chan;
-   IOConfig cf;
-
-   if (pbuf!=NULL) {
-      chan=pbuf->chan,cf=pbuf->cf;
-      CheckAndFillBuffer(pbuf);
-   }
-   else chan=curChan, cf=&curChan->cf;
-   
    info->srcPK       = cf->srcPK;
    info->srcFF       = cf->srcFF;
    info->srcSampRate = cf->srcSampRate;
@@ -5135,6 +5352,21 @@ void GetBufferInfo(ParmBuf pbuf, BufferInfo *info)
    info->spDetThresh=chan->spDetThresh;
    
    info->curVol=cf->curVol;
+}
+
+/* EXPORT->GetBufferInfo: Get info associated with pbuf */
+void GetBufferInfo(ParmBuf pbuf, BufferInfo *info)
+{
+   ChannelInfo *chan;
+   IOConfig cf;
+
+   if (pbuf!=NULL) {
+      chan=pbuf->chan,cf=pbuf->cf;
+      CheckAndFillBuffer(pbuf);
+   }
+   else chan=curChan, cf=&curChan->cf;
+   
+   GetConfigInfo(chan,cf,info);
 
    info->a=NULL;info->w=NULL;info->i=NULL;
    if (pbuf!=NULL) {
@@ -5153,6 +5385,307 @@ void GetBufferInfo(ParmBuf pbuf, BufferInfo *info)
    }
 }
 
+/* ------------------ Online Feature Extraction ------------------ */
+
+/*
+   An OnlineFE codes waveform samples frame by frame as they are
+   pushed, for live input.  The statics of a frame are coded as soon
+   as its samples are complete and the difference coefficients as
+   soon as the frames their windows span are coded, so the only delay
+   is the look-ahead of the regression windows.  ONLINELOOKAHEAD
+   limits this: a window reaching further than the look-ahead of its
+   level is computed as though the utterance ended there.  With full
+   windows the frames are those OpenBuffer codes from the same file,
+   except that _Z uses a running mean and ENORMALISE the running
+   maximum of the log energy.  The running mean averages all frames
+   so far until that weights the newest frame less than 1-CMNTCONST,
+   and then decays with time constant CMNTCONST.
+*/
+
+#define MAXONLINELEV 3        /* deltas, accelerations and thirds */
+
+typedef struct _OnlineFERec {
+   MemHeap *mem;              /* memory for this front end */
+   IOConfig cf;               /* coding configuration and workspace */
+   short *samp;               /* samples not yet coded, in gcheap */
+   long sampSize;             /* allocated size of samp */
+   long nSamp;                /* samples in samp */
+   long sampSt;               /* start in samp of next frame */
+   long nPushed;              /* samples pushed in this utterance */
+   Boolean ended;             /* no more samples will be pushed */
+   int nLev;                  /* number of regression levels */
+   int win[MAXONLINELEV+1];   /* regression window halfsize of level */
+   int la[MAXONLINELEV+1];    /* look-ahead of level */
+   int si[MAXONLINELEV+1];    /* source column of level */
+   int ti[MAXONLINELEV+1];    /* target column of level */
+   int d[MAXONLINELEV+1];     /* number of columns of level */
+   int done[MAXONLINELEV+1];  /* frames complete at each level, 0=statics */
+   int nOut;                  /* frames popped */
+   int ringSize;              /* number of rows in ring */
+   float *ring;               /* last ringSize frames of nCols */
+   float *row;                /* frame being popped */
+   int cmnDim;                /* columns normalised by running mean */
+   Vector cmnMean;            /* running mean */
+   long cmnCount;             /* frames in running mean */
+   int eCol;                  /* column with energy to normalise or -1 */
+   float eMax;                /* running max log energy */
+} OnlineFERec;
+
+/* OnlineRow: return row for frame t in the ring of fe */
+static float *OnlineRow(OnlineFE fe, int t)
+{
+   return fe->ring + (t%fe->ringSize)*fe->cf->nCols;
+}
+
+/* EXPORT->CreateOnlineFE: create a front end for the current channel */
+OnlineFE CreateOnlineFE(MemHeap *x, HTime srcSampRate)
+{
+   OnlineFE fe;
+   IOConfig cf;
+   char buf[MAXSTRLEN];
+   short span[12];
+   int l,maxLA;
+
+   fe = (OnlineFE) New(x,sizeof(OnlineFERec));
+   fe->mem = x;
+   fe->cf = cf = MakeIOConfig(x,curChan);
+   if (srcSampRate > 0.0) cf->srcSampRate = srcSampRate;
+   cf->srcPK = WAVEFORM;
+   if (cf->MatTranFN != NULL || cf->sideXFormMask != NULL ||
+       cf->sideGMMMask != NULL || cf->sideGMMList != NULL ||
+       cf->sideGMMMMF != NULL || cf->varScaleFN != NULL ||
+       cf->appendXFormMask != NULL || cf->cMeanDN != NULL || 
+       cf->cMeanMask != NULL || cf->v1Compat || highDiff)
+      HError(6380,"CreateOnlineFE: transforms, side based normalisation and V1COMPAT are not supported online");
+   if ((cf->tgtPK&BASEMASK)==DISCRETE || (cf->tgtPK&HASVQ))
+      HError(6380,"CreateOnlineFE: cannot code %s online",ParmKind2Str(cf->tgtPK,buf));
+   ValidCodeParms(cf);
+   cf->frSize = (int) (cf->winDur/cf->srcSampRate);
+   cf->frRate = (int) (cf->tgtSampRate/cf->srcSampRate);
+   SetUpForCoding(x,cf,cf->frSize);
+   cf->nBatch = -1;                   /* frames are coded one at a time */
+   cf->unqPK = cf->curPK;
+
+   /* regression levels in the order AddQualifiers adds them */
+   FindSpans(span,cf->tgtPK,cf->tgtUsed);
+   fe->nLev = 0; maxLA = 0;
+   if (cf->tgtPK&HASDELTA) {
+      l = ++fe->nLev; fe->win[l] = cf->delWin;
+      fe->si[l] = span[0]; fe->ti[l] = span[4]; fe->d[l] = span[5]-span[4]+1;
+   }
+   if (cf->tgtPK&HASACCS) {
+      l = ++fe->nLev; fe->win[l] = cf->accWin;
+      fe->si[l] = span[4]; fe->ti[l] = span[6]; fe->d[l] = span[7]-span[6]+1;
+   }
+   if (cf->tgtPK&HASTHIRD) {
+      l = ++fe->nLev; fe->win[l] = cf->thirdWin;
+      fe->si[l] = span[6]; fe->ti[l] = span[8]; fe->d[l] = span[9]-span[8]+1;
+   }
+   fe->ringSize = 2;
+   for (l=1; l<=fe->nLev; l++) {
+      if (fe->win[l] < 1)
+         HError(6380,"CreateOnlineFE: regression windows must be at least 1");
+      fe->la[l] = fe->win[l];
+      if (onlineLookAhead >= 0 && fe->la[l] > onlineLookAhead - maxLA)
+         fe->la[l] = (onlineLookAhead > maxLA) ? onlineLookAhead - maxLA : 0;
+      maxLA += fe->la[l];
+      fe->ringSize += fe->win[l] + fe->la[l];
+   }
+   fe->ring = (float *) New(x,fe->ringSize*cf->nCols*sizeof(float));
+   fe->row = (float *) New(x,cf->nCols*sizeof(float));
+
+   /* running normalisation of the statics as AddQualifiers does it */
+   fe->cmnDim = 0; fe->cmnMean = NULL; fe->cmnCount = 0;
+   if (cf->tgtPK&HASZEROM) {
+      fe->cmnDim = span[1]-span[0]+1;
+      if (cf->tgtPK&HASZEROC) ++fe->cmnDim;
+      fe->cmnMean = CreateVector(x,fe->cmnDim);
+      ZeroVector(fe->cmnMean);
+   }
+   fe->eCol = ((cf->tgtPK&HASENERGY) && cf->eNormalise) ? cf->nCvrt-1 : -1;
+
+   fe->sampSize = 0; fe->samp = NULL;
+   ResetOnlineFE(fe);
+   return fe;
+}
+
+/* EXPORT->ResetOnlineFE: discard all input and start a new utterance */
+void ResetOnlineFE(OnlineFE fe)
+{
+   int l;
+
+   fe->nSamp = fe->sampSt = fe->nPushed = 0; fe->ended = FALSE;
+   for (l=0; l<=fe->nLev; l++) fe->done[l] = 0;
+   fe->nOut = 0;
+   if (fe->cmnMean != NULL && cmnResetOnStop) {
+      ZeroVector(fe->cmnMean); fe->cmnCount = 0;
+   }
+   fe->eMax = LZERO;
+   InitDither(fe->cf);
+}
+
+/* EXPORT->CloseOnlineFE: release the sample buffer of fe */
+void CloseOnlineFE(OnlineFE fe)
+{
+   if (fe->samp != NULL) Dispose(&gcheap,fe->samp);
+   fe->samp = NULL; fe->sampSize = 0;
+}
+
+/* EXPORT->PushOnlineFE: append n samples to the input of fe */
+void PushOnlineFE(OnlineFE fe, short *data, int n)
+{
+   short *ns;
+   long size;
+
+   if (fe->ended)
+      HError(6381,"PushOnlineFE: input has been ended");
+   if (fe->nSamp+n > fe->sampSize) {
+      /* drop coded samples and grow if still short of space */
+      fe->nSamp -= fe->sampSt;
+      if (fe->nSamp > 0)
+         memmove(fe->samp,fe->samp+fe->sampSt,fe->nSamp*sizeof(short));
+      fe->sampSt = 0;
+      if (fe->nSamp+n > fe->sampSize) {
+         size = 2*fe->sampSize;
+         if (size < fe->nSamp+n) size = fe->nSamp+n;
+         ns = (short *) New(&gcheap,size*sizeof(short));
+         if (fe->samp != NULL) {
+            memcpy(ns,fe->samp,fe->nSamp*sizeof(short));
+            Dispose(&gcheap,fe->samp);
+         }
+         fe->samp = ns; fe->sampSize = size;
+      }
+   }
+   memcpy(fe->samp+fe->nSamp,data,n*sizeof(short));
+   fe->nSamp += n; fe->nPushed += n;
+}
+
+/* EXPORT->EndOnlineFE: mark the end of the input of fe */
+void EndOnlineFE(OnlineFE fe)
+{
+   fe->ended = TRUE;
+}
+
+/* CodeOnlineFrame: code the statics of the next frame if its samples
+   are complete and return TRUE if it was coded */
+static Boolean CodeOnlineFrame(OnlineFE fe)
+{
+   IOConfig cf = fe->cf;
+   float *row,*p,min,a;
+   int i,t = fe->done[0];
+
+   if (fe->sampSt+cf->frSize > fe->nSamp) return FALSE;
+   for (i=1; i<=cf->frSize; i++)
+      cf->s[i] = fe->samp[fe->sampSt+i-1];
+   fe->sampSt += cf->frRate;
+   row = OnlineRow(fe,t);
+   cf->nUsed = cf->nCvrt; cf->curPK = cf->tgtPK&BASEMASK;
+   if (ConvertFrame(cf,row) != cf->nCvrt)
+      HError(6391,"CodeOnlineFrame: convert count != %d",cf->nCvrt);
+   cf->nCvrt = cf->nUsed; cf->unqPK = cf->curPK;
+   if (fe->eCol >= 0) {
+      /* as NormaliseLogEnergy with the max so far */
+      p = row+fe->eCol;
+      if (*p > fe->eMax) fe->eMax = *p;
+      min = fe->eMax - (cf->silFloor*log(10.0))/10.0;
+      if (*p < min) *p = min;
+      *p = 1.0 - (fe->eMax - *p) * cf->eScale;
+   }
+   if (fe->cmnMean != NULL) {
+      a = (float) fe->cmnCount / (fe->cmnCount+1);
+      if (a > cmnTConst) a = cmnTConst;
+      for (i=1; i<=fe->cmnDim; i++)
+         fe->cmnMean[i] = a*fe->cmnMean[i] + (1.0-a)*row[i-1];
+      ++fe->cmnCount;
+   }
+   fe->done[0] = t+1;
+   return TRUE;
+}
+
+/* RegressOnline: compute level l of frame t from level l-1 of frames
+   up to last, replicating the edge frames as Regress does */
+static void RegressOnline(OnlineFE fe, int l, int t, int last)
+{
+   IOConfig cf = fe->cf;
+   float *row,*back,*forw,sum,sigmaT2=0.0;
+   int i,k,w = fe->win[l];
+
+   row = OnlineRow(fe,t);
+   for (k=1; k<=w; k++) sigmaT2 += k*k;
+   sigmaT2 *= 2.0;
+   for (i=0; i<fe->d[l]; i++) {
+      if (cf->simpleDiffs) {
+         back = OnlineRow(fe,(t-w<0)?0:t-w);
+         forw = OnlineRow(fe,(t+w>last)?last:t+w);
+         row[fe->ti[l]+i] = (forw[fe->si[l]+i] - back[fe->si[l]+i]) / (2*w);
+      }
+      else {
+         for (k=1,sum=0.0; k<=w; k++) {
+            back = OnlineRow(fe,(t-k<0)?0:t-k);
+            forw = OnlineRow(fe,(t+k>last)?last:t+k);
+            sum += k * (forw[fe->si[l]+i] - back[fe->si[l]+i]);
+         }
+         row[fe->ti[l]+i] = sum / sigmaT2;
+      }
+   }
+}
+
+/* RegressOnlineFE: compute every regression frame whose window is
+   available and return TRUE if any were */
+static Boolean RegressOnlineFE(OnlineFE fe, Boolean fin)
+{
+   Boolean any = FALSE;
+   int l,t,last;
+
+   for (l=1; l<=fe->nLev; l++) {
+      /* level l-1 is final once all statics are coded and it has them all */
+      if (l>1) fin = fin && fe->done[l-1]==fe->done[0];
+      while ((t=fe->done[l]) < fe->done[l-1] && 
+             (fin || t+fe->la[l] < fe->done[l-1])) {
+         last = t+fe->la[l];
+         if (last > fe->done[l-1]-1) last = fe->done[l-1]-1;
+         RegressOnline(fe,l,t,last);
+         fe->done[l] = t+1; any = TRUE;
+      }
+   }
+   return any;
+}
+
+/* EXPORT->PopOnlineFE: get the next complete frame of fe into o */
+Boolean PopOnlineFE(OnlineFE fe, Observation *o)
+{
+   float *row;
+   int i;
+
+   while (fe->nOut >= fe->done[fe->nLev]) {
+      if (RegressOnlineFE(fe,FALSE)) continue;
+      if (CodeOnlineFrame(fe)) continue;
+      /* no more frames until more samples unless at the end */
+      if (!fe->ended || !RegressOnlineFE(fe,TRUE)) return FALSE;
+   }
+   row = OnlineRow(fe,fe->nOut++);
+   for (i=0; i<fe->cf->nCols; i++) fe->row[i] = row[i];
+   for (i=0; i<fe->cmnDim; i++) fe->row[i] -= fe->cmnMean[i+1];
+   ExtractObservation(fe->row,o);
+   return TRUE;
+}
+
+/* EXPORT->OnlineFEDelay: return frames coded but not yet complete */
+int OnlineFEDelay(OnlineFE fe)
+{
+   return fe->done[0] - fe->nOut;
+}
+
+/* EXPORT->GetOnlineFEInfo: get info associated with fe */
+void GetOnlineFEInfo(OnlineFE fe, BufferInfo *info)
+{
+   GetConfigInfo(curChan,fe->cf,info);
+   info->i = NULL;
+   info->nSamples = fe->nPushed;
+   info->nObs = fe->nOut;
+   info->spDetSt = 0; info->spDetEn = fe->nOut;
+}
+
 /* ---------------- Writing buffer functions ------------------ */
 
 /* EXPORT->EmptyBuffer: Open and return an empty ParmBuf object */
@@ -5383,8 +5916,8 @@ static void CalcCompress(ParmBuf pbuf, PBlock *pbInit,int nCols, Boolean irefc)
    if (irefc)
       for(i=1;i<=cf->srcUsed;i++) cf->A[i]=32767.0,cf->B[i]=0.0;
    else {
-      min = CreateVector(&gstack,nCols); ZeroVector(min); 
-      max = CreateVector(&gstack,nCols); ZeroVector(max); 
+      min = CreateVector(pbuf->mem,nCols); ZeroVector(min); 
+      max = CreateVector(pbuf->mem,nCols); ZeroVector(max); 
       /* Find max and min of each vector component */
       /* Initial value from first block */
       if (pbInit->nRows>0) {
@@ -5409,7 +5942,7 @@ static void CalcCompress(ParmBuf pbuf, PBlock *pbInit,int nCols, Boolean irefc)
             cf->B[nx] = (max[nx]+min[nx]) * 32767.0 / (max[nx]-min[nx]);
          }
       }
-      FreeVector(&gstack,max); FreeVector(&gstack,min);
+      FreeVector(pbuf->mem,max); FreeVector(pbuf->mem,min);
    }
 }
 
@@ -5535,12 +6068,12 @@ ReturnStatus SaveBuffer(ParmBuf pbuf, char *fname, FileFormat ff)
                              sizeof(short),bSwap,cf->crcc);
       }
       else if (cf->saveCompressed) {
-         sp=(short *) New(&gstack,sizeof(short)*pb->nRows*cf->nCols);
+         sp=(short *) New(pbuf->mem,sizeof(short)*pb->nRows*cf->nCols);
          CompressPBlock(pbuf,pb,sp,cf->nCols);
          WriteShort(f,sp,pb->nRows*cf->nCols,hparmBin);
          cf->crcc=UpdateCRCC(sp,pb->nRows*cf->nCols,
                              sizeof(short),bSwap,cf->crcc);
-         Dispose(&gstack,sp);
+         Dispose(pbuf->mem,sp);
       }
       else {
          WriteFloat(f, (float *) pb->data, pb->nRows*cf->nCols, hparmBin);
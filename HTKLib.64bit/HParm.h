@@ -310,6 +310,60 @@ ParmBuf OpenExtBuffer(MemHeap *x, char *fn, int maxObs,
   Open and return input buffer using an external source
 */
 
+/* ---------------- Online Feature Extraction ------------------- */
+
+typedef struct _OnlineFERec *OnlineFE;
+
+OnlineFE CreateOnlineFE(MemHeap *x, HTime srcSampRate);
+/*
+   Create and return a front end which codes 16 bit waveform samples
+   at srcSampRate (0.0 for SOURCERATE) to the target kind of the
+   current channel, frame by frame as they are pushed.  Frames are
+   delayed only by the look-ahead of the regression windows, which
+   HPARM: ONLINELOOKAHEAD can limit.  _Z uses a running mean with
+   time constant CMNTCONST and ENORMALISE the maximum energy so far.
+   Side based normalisation and transforms are not supported.
+*/
+
+void PushOnlineFE(OnlineFE fe, short *data, int n);
+/*
+   Append n samples in data to the input of fe
+*/
+
+void EndOnlineFE(OnlineFE fe);
+/*
+   Mark the end of the input so that the final frames can complete
+*/
+
+Boolean PopOnlineFE(OnlineFE fe, Observation *o);
+/*
+   Get the next complete frame into o and return TRUE, or return
+   FALSE if more samples are needed or the input has ended.  Never
+   blocks.
+*/
+
+int OnlineFEDelay(OnlineFE fe);
+/*
+   Return the number of frames which are coded but waiting for
+   look-ahead, ie the current latency in frames
+*/
+
+void ResetOnlineFE(OnlineFE fe);
+/*
+   Discard the input of fe and start a new utterance.  The running
+   mean is kept unless CMNRESETONSTOP is set (the default).
+*/
+
+void CloseOnlineFE(OnlineFE fe);
+/*
+   Release the sample buffer of fe; the rest is on its heap
+*/
+
+void GetOnlineFEInfo(OnlineFE fe, BufferInfo *info);
+/*
+   Get info associated with fe as GetBufferInfo does for a buffer
+*/
+
 /* ----------------- New Buffer Creation Routines -------------- */
 
 ParmBuf EmptyBuffer(MemHeap *x, int size, Observation o, BufferInfo info);
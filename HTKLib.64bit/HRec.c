@@ -37,9 +37,13 @@ char *hrec_vc_id = "$Id: HRec.c,v 1.1.1.1 2006/10/11 09:54:58 jal58 Exp $";
 #include "HUtil.h"
 #include "HAdapt.h"
 
+#include <pthread.h>
+#include <time.h>
+
 /* Trace levels */
 
 #define T_NGEN 1
+#define T_PRUNE 2       /* Time spent in max model pruning */
 
 /* Checks */
 
@@ -47,6 +51,22 @@ char *hrec_vc_id = "$Id: HRec.c,v 1.1.1.1 2006/10/11 09:54:58 jal58 Exp $";
 
 static int trace=0;
 static Boolean forceOutput=FALSE;
+static Boolean gmmBatch=TRUE;   /* Evaluate Gaussians in packed blocks */
+static char *gsFile=NULL;       /* Gaussian selection file (from HGSel) */
+static LogFloat gsFloor=-10.0;  /* Unselected Gaussians, rel to best selected */
+static int gsNBest=1;           /* Codewords whose shortlists are selected */
+static int numThreads=1;        /* Threads for the internal token pass */
+static Boolean histPrune=TRUE;  /* Select max model cutoff by histogram */
+static int maxWordEnd=0;        /* Max word ends propagated per frame */
+
+/* Number of bins of the pruning score histogram */
+#define HIST_BINS 256
+
+/* Number of Gaussians evaluated together by the batched engine */
+#define GMM_BLOCK 8
+
+/* Max number of nearest codewords used for Gaussian selection */
+#define GS_MAXNBEST 16
 
 const Token null_token={LZERO,0.0,NULL,NULL};
 
@@ -146,6 +166,13 @@ struct _NetInst
 #endif
 };
 
+/* The frame ids of the precomps are read and written with acquire and */
+/*  release ordering, so that the threads of the parallel internal pass */
+/*  can share them.  Two threads may evaluate the same entry, but both  */
+/*  store the same value.                                               */
+#define GetPreId(id) __atomic_load_n(&(id),__ATOMIC_ACQUIRE)
+#define SetPreId(id,v) __atomic_store_n(&(id),(v),__ATOMIC_RELEASE)
+
 /* HMMSet information is some precomputed limits plus the precomps */
 typedef struct precomp
 {
@@ -154,6 +181,52 @@ typedef struct precomp
 }
 PreComp;
 
+/* The INVDIAGC Gaussians of one stream packed in blocks of GMM_BLOCK  */
+/*  components.  Within a block the means and precisions are stored    */
+/*  dimension by dimension, so that the loop over the components of a  */
+/*  block is unit stride.  A whole block is evaluated when any of its  */
+/*  components is first needed in a frame (the outputs are kept by    */
+/*  each recogniser).  With Gaussian selection only the shortlisted    */
+/*  components of a state are needed, and they are spread over the    */
+/*  blocks, so then each block holds a single component.               */
+typedef struct gmmpool
+{
+   int vSize;               /* Stream width */
+   int bSize;               /* Components per block, GMM_BLOCK or 1 */
+   int nBlk;                /* Number of blocks */
+   float *mean;             /* Array[nBlk][vSize][bSize] of means */
+   float *prec;             /* Array[nBlk][vSize][bSize] of inv vars */
+   float *gConst;           /* Array[nBlk][bSize] of gConsts */
+}
+GMMPool;
+
+/* The components of one state stream in the GMMPool */
+typedef struct gmmstream
+{
+   int nMix;                /* Number of usable components */
+   int *slot;               /* Array[0..nMix-1] of positions in pool */
+   int *mIdx;               /* Array[0..nMix-1] of MixPDF indexes */
+   float *wt;               /* Array[0..nMix-1] of log weights */
+   float *lwt;              /* Array[0..nMix-1] of weights, with gSel only */
+   double wSum;             /* Sum of the (linear) weights */
+}
+GMMStream;
+
+/* The Gaussian selection codebook of one stream.  Each codeword has */
+/*  a shortlist of the MixPDF indexes of the Gaussians near to it.   */
+/*  The codewords are packed as a pool of zero gConst Gaussians with  */
+/*  the inverse variance as precision, so that the nearest codeword   */
+/*  is the one with the highest output.                               */
+typedef struct gselstream
+{
+   int vSize;               /* Stream width */
+   int nCode;               /* Number of codewords */
+   GMMPool code;            /* Codeword c-1 in slot c-1 */
+   int *nList;              /* Array[1..nCode] of shortlist sizes */
+   int **list;              /* Array[1..nCode] of Array[0..nList-1] */
+}
+GSelStream;
+
 struct psetinfo
 {
    MemHeap heap;            /* Memory for this set of pre-comps */
@@ -161,19 +234,38 @@ struct psetinfo
 
    int max;                 /* Max states in HMM set */
    Boolean mixShared;
-   int nsp;
-   PreComp *sPre;           /* Array[1..nsp] State PreComps */
-   int nmp;
-   PreComp *mPre;           /* Array[1..nmp] Shared mixture PreComps */
+   int nsp;                 /* Number of state PreComps */
+   int nmp;                 /* Number of shared mixture PreComps */
    int ntr;
    short ***seIndexes;      /* Array[1..ntr] of seIndexes */
    Token *tBuf;             /* Buffer Array[2..N-1] of tok for StepHMM1 */
-   TokenSet *sBuf;          /* Buffer Array[2..N-1] of tokset for StepHMM1_N */
 
    short stHeapNum;         /* Number of separate state heaps */
    short *stHeapIdx;        /* Array[1..max] of state to heap index */
+
+   GMMPool *gPool;          /* Array[1..S] of packed Gaussians or NULL */
+   GMMStream **gStr;        /* Array[1..nsp] of Array[1..S] state streams */
+   int gMaxMix;             /* Max usable components in a state stream */
+
+   GSelStream *gSel;        /* Array[1..S] of selection codebooks or NULL */
 };
 
+/* One share of the internal token pass.  Each task has its own state */
+/*  buffer and beam maxima, which are reduced in task order so that    */
+/*  the result is the same as stepping the instances one by one.  The  */
+/*  serial pass uses task 0 for all the instances.                     */
+typedef struct steptask
+{
+   NetInst **inst;          /* First of the instances of this task */
+   int n;                   /* Number of instances */
+   TokenSet *sBuf;          /* Buffer Array[1..max] of tokset for StepHMM1 */
+   Token genMaxTok;         /* Most likely token */
+   NetNode *genMaxNode;     /* Most likely node */
+   Token wordMaxTok;        /* Most likely word end token */
+   NetNode *wordMaxNode;    /* Most likely word end node */
+}
+StepTask;
+
 /* Private recognition information PRecInfo. (Not visible outside HRec) */
 /* Contains all status/network/allocation/pruning information for a     */
 /*  single network.                                                     */
@@ -193,6 +285,7 @@ struct precinfo {
    float pscale;            /* Pronunciation probs scale factor */
    /* Private global info */
 
+   AdaptXForm *xform;       /* Input transform of the current frame */
 
    int frame;               /* Current frame number */
    int id;                  /* Unique observation identifier */
@@ -210,6 +303,7 @@ struct precinfo {
 
    LogFloat *qsa;           /* Array form performing qsort */
    int qsn;                 /* Sizeof qsa */
+   clock_t pruneClock;      /* Time spent in max model pruning */
 
    MemHeap instHeap;        /* Inst heap */
    MemHeap *stHeap;         /* Array[0..stHeapNum-1] of heaps for states */
@@ -237,6 +331,22 @@ struct precinfo {
    NetInst head;            /* Head (oldest) of Inst linked list */
    NetInst tail;            /* Tail (newest) of Inst linked list */
    NetInst *nxtInst;        /* Inst used to select next in step sequence */
+
+   NetInst **nInst;         /* Array[0..nInstN-1] of node instances */
+   int nInstN;              /* Size of nInst */
+
+   PreComp *sPre;           /* Array[1..nsp] State PreComps */
+   PreComp *mPre;           /* Array[1..nmp] Shared mixture PreComps */
+   float **gOutp;           /* Array[1..S] of Array[nBlk][bSize] outps */
+   int **gBlkId;            /* Array[1..S] of Array[nBlk] frame ids */
+   int *gsId;               /* Array[1..numMix] frame id of selection */
+
+   int nTask;               /* Number of tasks of the internal pass */
+   StepTask *task;          /* Array[0..nTask-1] of tasks */
+   NetInst **instArr;       /* Active instances for the parallel pass */
+   int instArrN;            /* Size of instArr */
+   Boolean inPar;           /* Parallel internal pass in progress */
+   pthread_mutex_t alignLock; /* Serialises NewNRefAlign in that pass */
 #ifdef SANITY
    NetInst *start_inst;     /* Inst that started a move */
    int ipos;                /* Current inst position */
@@ -250,9 +360,18 @@ struct precinfo {
 
 };
 
-/* Global variable (so we want to get rid of them) */
-static PRecInfo *pri;
-static AdaptXForm *inXForm;
+/* The recogniser being driven by this thread.  It is set from the  */
+/*  VRecInfo on entry to each exported routine, so it carries no     */
+/*  state of its own and any number of threads can each drive their */
+/*  own recogniser.                                                  */
+static __thread PRecInfo *pri;
+
+/* The instance of a network node is kept by the recogniser, indexed */
+/*  by the node number, so that the network is never written.        */
+#define NodeInst(node) (pri->nInst[(node)->aux])
+static double gmmMinLogExp;     /* Smallest term kept by GMMLogSumExp */
+static __thread float *gmmBuf=NULL;  /* Log-sum-exp buffer of this thread */
+static __thread int gmmBufN=0;       /* Size of gmmBuf */
 
 /* Module Initialisation */
 static ConfParam *cParm[MAXGLOBS];      /* config parameters */
@@ -263,14 +382,25 @@ static int nParm = 0;
 void InitRec(void)
 {
    int i;
+   double d;
    Boolean b;
+   char buf[MAXSTRLEN];
 
    Register(hrec_version,hrec_vc_id);
    nParm = GetConfig("HREC", TRUE, cParm, MAXGLOBS);
    if (nParm>0){
       if (GetConfInt(cParm,nParm,"TRACE",&i)) trace = i;
       if (GetConfBool(cParm,nParm,"FORCEOUT",&b)) forceOutput = b;
+      if (GetConfBool(cParm,nParm,"GMMBATCH",&b)) gmmBatch = b;
+      if (GetConfStr(cParm,nParm,"GSELFILE",buf)) gsFile = CopyString(&gcheap,buf);
+      if (GetConfFlt(cParm,nParm,"GSFLOOR",&d)) gsFloor = d;
+      if (GetConfInt(cParm,nParm,"GSNBEST",&i))
+         gsNBest = (i<1)?1:(i>GS_MAXNBEST)?GS_MAXNBEST:i;
+      if (GetConfInt(cParm,nParm,"NUMTHREADS",&i)) numThreads = (i>0)?i:1;
+      if (GetConfBool(cParm,nParm,"HISTPRUNE",&b)) histPrune = b;
+      if (GetConfInt(cParm,nParm,"MAXWORDEND",&i)) maxWordEnd = i;
    }
+   gmmMinLogExp = -log(-LZERO);
 }
 
 
@@ -284,7 +414,7 @@ static void TokSetMerge(TokenSet *res,Token *cmp,TokenSet *src)
    LogFloat diff,like,limit;
    RelToken *cur,*mch,rtoks[MAX_TOKS];
    NetNode *node, *nodes[MAX_TOKS];
-   int i,nw,k,null,aux;
+   int i,nw,k,null,aux,auxs[MAX_TOKS];
 
 #ifdef SANITY
    if (res->n==0) 
@@ -357,9 +487,10 @@ static void TokSetMerge(TokenSet *res,Token *cmp,TokenSet *src)
          null=i+1;
       else {
          /* allow for NULL nodes in path */
-         node=path->node;
-         node->aux = i+1; 
-         nodes[nw++] = node;
+         /* (kept here rather than in node->aux so that the */
+         /*  internal pass can run on several threads)     */
+         nodes[nw] = path->node;
+         auxs[nw++] = i+1;
       }
    }
    
@@ -375,7 +506,10 @@ static void TokSetMerge(TokenSet *res,Token *cmp,TokenSet *src)
          aux=null, node=NULL;
       else {
          node=path->node;
-         aux=node->aux;
+         for (k=nw-1,aux=0;k>=0;k--)
+            if (nodes[k]==node) {
+               aux=auxs[k]; break;
+            }
       }
       like=cur->like-diff;
       mch=NULL;
@@ -429,10 +563,6 @@ static void TokSetMerge(TokenSet *res,Token *cmp,TokenSet *src)
          mch->like=like;
       }
    }
-
-   /* Void lookup information */
-   for (i=0;i<nw;i++)
-      nodes[i]->aux=0;
 }
 
 /* Caching version of SOutP used when mixPDFs shared */
@@ -440,7 +570,9 @@ static LogFloat cSOutP(HMMSet *hset, int s, Observation *x, StreamElem *se,
                        int id)
 {
    PreComp *pre;
-   LogFloat bx,px,wt,det;
+   LogFloat bx,px,wt,det,best;
+   Boolean gsel;
+   double uwt;
    int m,vSize;
    double sum;
    MixtureElem *me;
@@ -455,41 +587,54 @@ static LogFloat cSOutP(HMMSet *hset, int s, Observation *x, StreamElem *se,
       me=se->spdf.cpdf+1;
       if (se->nMix==1){     /* Single Mixture Case */
          if (me->mpdf->mIdx>0 && me->mpdf->mIdx<=pri->psi->nmp)
-            pre=pri->psi->mPre+me->mpdf->mIdx;
+            pre=pri->mPre+me->mpdf->mIdx;
          else pre=NULL;
          if (pre==NULL) {
-            bx= MOutP(ApplyCompFXForm(me->mpdf,v,inXForm,&det,id),me->mpdf);
+            bx= MOutP(ApplyCompFXForm(me->mpdf,v,pri->xform,&det,id),me->mpdf);
             bx += det;
-         } else if (pre->id!=id) {
-            bx= MOutP(ApplyCompFXForm(me->mpdf,v,inXForm,&det,id),me->mpdf);
+         } else if (GetPreId(pre->id)!=id) {
+            bx= MOutP(ApplyCompFXForm(me->mpdf,v,pri->xform,&det,id),me->mpdf);
             bx += det;
-            pre->id=id;
             pre->outp=bx;
+            SetPreId(pre->id,id);
          }
          else
             bx=pre->outp;
       } else {
-         bx=LZERO;                   /* Multi Mixture Case */
-         for (m=1; m<=se->nMix; m++,me++) {
-            wt = MixLogWeight(hset, me->weight);
-            if (wt>LMINMIX) {   
+         gsel=(pri->gsId!=NULL);     /* Multi Mixture Case */
+         for (;;) {
+            bx=best=LZERO; uwt=0.0; me=se->spdf.cpdf+1;
+            for (m=1; m<=se->nMix; m++,me++) {
+               wt = MixLogWeight(hset, me->weight);
+               if (wt<=LMINMIX) continue;
                if (me->mpdf->mIdx>0 && me->mpdf->mIdx<=pri->psi->nmp)
-                  pre=pri->psi->mPre+me->mpdf->mIdx;
+                  pre=pri->mPre+me->mpdf->mIdx;
                else pre=NULL;
+               if (gsel && me->mpdf->mIdx>0 &&
+                   pri->gsId[me->mpdf->mIdx]!=id) {
+                  uwt+=exp(wt);       /* Not in the shortlist */
+                  continue;
+               }
                if (pre==NULL) {
-                  px= MOutP(ApplyCompFXForm(me->mpdf,v,inXForm,&det,id),me->mpdf);
+                  px= MOutP(ApplyCompFXForm(me->mpdf,v,pri->xform,&det,id),me->mpdf);
                   px += det;
-               } else if (pre->id!=id) {
-                  px= MOutP(ApplyCompFXForm(me->mpdf,v,inXForm,&det,id),me->mpdf);
+               } else if (GetPreId(pre->id)!=id) {
+                  px= MOutP(ApplyCompFXForm(me->mpdf,v,pri->xform,&det,id),me->mpdf);
                   px += det;
-                  pre->id=id;
                   pre->outp=px;
+                  SetPreId(pre->id,id);
                }
                else
                   px=pre->outp;
+               if (px>best) best=px;
                bx=LAdd(bx,wt+px);
             }
+            if (uwt==0.0 || best>LSMALL) break;
+            gsel=FALSE;      /* Nothing shortlisted: score the state in full */
          }
+         /* Back off the unselected Gaussians from the best selected one */
+         if (uwt>0.0)
+            bx=LAdd(bx,log(uwt)+best+gsFloor);
       }
       return bx;
    case TIEDHS:
@@ -515,17 +660,134 @@ static LogFloat cSOutP(HMMSet *hset, int s, Observation *x, StreamElem *se,
 }
 
 
+/* Evaluate block b of pool gp for vector v into outp[0..GMM_BLOCK-1], */
+/*  exactly as IDOutP would */
+static void EvalGMMBlock(GMMPool *gp, int b, Vector v, float *outp)
+{
+   float acc[GMM_BLOCK];
+   float *mean,*prec,*gc;
+   float x,xmm;
+   int d,l;
+
+   mean=gp->mean+(size_t)b*gp->vSize*GMM_BLOCK;
+   prec=gp->prec+(size_t)b*gp->vSize*GMM_BLOCK;
+   gc=gp->gConst+(size_t)b*GMM_BLOCK;
+   for (l=0;l<GMM_BLOCK;l++)
+      acc[l]=gc[l];
+   for (d=1;d<=gp->vSize;d++,mean+=GMM_BLOCK,prec+=GMM_BLOCK) {
+      x=v[d];
+      for (l=0;l<GMM_BLOCK;l++) {
+         xmm=x-mean[l];
+         acc[l]+=xmm*xmm*prec[l];
+      }
+   }
+   for (l=0;l<GMM_BLOCK;l++)
+      outp[l]=-0.5*acc[l];
+}
+
+/* Return the output of component c of pool gp, in blocks of one, for */
+/*  vector v, exactly as IDOutP would */
+static float EvalGMMComp(GMMPool *gp, int c, Vector v)
+{
+   float *mean,*prec;
+   float acc,xmm;
+   int d;
+
+   mean=gp->mean+(size_t)c*gp->vSize-1;
+   prec=gp->prec+(size_t)c*gp->vSize-1;
+   acc=gp->gConst[c];
+   for (d=1;d<=gp->vSize;d++) {
+      xmm=v[d]-mean[d];
+      acc+=xmm*xmm*prec[d];
+   }
+   return -0.5*acc;
+}
+
+/* Return log of sum of exp(t[0..n-1]), dropping terms LAdd would drop */
+static LogFloat GMMLogSumExp(float *t, int n)
+{
+   float max;
+   double sum,diff;
+   int m;
+
+   if (n==0) return LZERO;
+   max=t[0];
+   for (m=1;m<n;m++)
+      if (t[m]>max) max=t[m];
+   if (max<LSMALL) return LZERO;
+   sum=0.0;
+   for (m=0;m<n;m++) {
+      diff=t[m]-max;
+      sum+=(diff<gmmMinLogExp)?0.0:exp(diff);
+   }
+   return max+log(sum);
+}
+
+/* Batched version of cSOutP for a state stream packed in pool s */
+static LogFloat gSOutP(PSetInfo *psi, int s, GMMStream *gs, 
+                       Vector v, int id)
+{
+   GMMPool *gp;
+   float *t,*outp,best;
+   double sWt;
+   int m,n,b,slot,*blkId;
+   Boolean gsel;
+
+   if (gmmBufN<psi->gMaxMix) {
+      if (gmmBuf!=NULL) free(gmmBuf);
+      gmmBufN=psi->gMaxMix;
+      if ((gmmBuf=(float*) malloc(gmmBufN*sizeof(float)))==NULL)
+         HError(8505,"gSOutP: Cannot allocate log-sum-exp buffer");
+   }
+   gp=psi->gPool+s;
+   outp=pri->gOutp[s]; blkId=pri->gBlkId[s];
+   t=gmmBuf; gsel=(pri->gsId!=NULL);
+   for (;;) {
+      best=LZERO; sWt=0.0;
+      for (m=n=0;m<gs->nMix;m++) {
+         if (gsel && pri->gsId[gs->mIdx[m]]!=id)
+            continue;                 /* Not in the shortlist */
+         slot=gs->slot[m];
+         if (gp->bSize==1) {
+            if (GetPreId(blkId[slot])!=id) {
+               outp[slot]=EvalGMMComp(gp,slot,v);
+               SetPreId(blkId[slot],id);
+            }
+         }
+         else {
+            b=slot/GMM_BLOCK;
+            if (GetPreId(blkId[b])!=id) {
+               EvalGMMBlock(gp,b,v,outp+(size_t)b*GMM_BLOCK);
+               SetPreId(blkId[b],id);
+            }
+         }
+         if (outp[slot]>best) best=outp[slot];
+         if (gsel) sWt+=gs->lwt[m];
+         t[n++]=gs->wt[m]+outp[slot];
+      }
+      if (n>0 || !gsel) break;
+      gsel=FALSE;      /* Nothing shortlisted: score the state in full */
+   }
+   /* Back off the unselected Gaussians from the best selected one, */
+   /*  taking their total weight from the selected ones */
+   if (gsel && n<gs->nMix && (sWt=gs->wSum-sWt)>0.0)
+      t[n++]=log(sWt)+best+gsFloor;
+   if (n==1) return t[0];
+   return GMMLogSumExp(t,n);
+}
+
 /* Version of POutP that caches outp values with frame id */
 static LogFloat cPOutP(PSetInfo *psi,Observation *obs,StateInfo *si,int id)
 {
    PreComp *pre;
    LogFloat outp;
    StreamElem *se;
+   GMMStream *gs;
    Vector w;
    int s,S;
 
    if (si->sIdx>0 && si->sIdx<=pri->psi->nsp)
-      pre=pri->psi->sPre+si->sIdx;
+      pre=pri->sPre+si->sIdx;
    else pre=NULL;
 
 #ifdef SANITY
@@ -533,13 +795,24 @@ static LogFloat cPOutP(PSetInfo *psi,Observation *obs,StateInfo *si,int id)
       HError(8520,"cPOutP: State has no PreComp attached");
 #endif
    
-   if (pre->id!=id) { /* bodged at the moment - fix !! */
+   if (GetPreId(pre->id)!=id) { /* bodged at the moment - fix !! */
       if ((FALSE && psi->mixShared==FALSE) || (psi->hset->hsKind == DISCRETEHS)) {
          outp=POutP(psi->hset,obs,si);
       }
       else {
          S=obs->swidth[0];
-         if (S==1 && si->weights==NULL){
+         if (psi->gPool!=NULL && pri->xform==NULL) {
+            gs=psi->gStr[si->sIdx];
+            if (S==1 && si->weights==NULL)
+               outp=gSOutP(psi,1,gs+1,obs->fv[1],id);
+            else {
+               outp=0.0;
+               w=si->weights;
+               for (s=1;s<=S;s++)
+                  outp+=w[s]*gSOutP(psi,s,gs+s,obs->fv[s],id);
+            }
+         }
+         else if (S==1 && si->weights==NULL){
             outp=cSOutP(psi->hset,1,obs,si->pdf+1,id);
          }
          else {
@@ -552,7 +825,7 @@ static LogFloat cPOutP(PSetInfo *psi,Observation *obs,StateInfo *si,int id)
          }
       }
       pre->outp=outp;
-      pre->id=id;
+      SetPreId(pre->id,id);
    }
    return(pre->outp);
 }
@@ -607,6 +880,7 @@ static Align *NewNRefAlign(NetNode *node,int state,double like,
 {
    Align *align;
 
+   if (pri->inPar) pthread_mutex_lock(&pri->alignLock);
    align=(Align*) New(&pri->alignHeap,0);
    align->link=pri->aNoRef.link;
    align->knil=&pri->aNoRef;
@@ -626,6 +900,7 @@ static Align *NewNRefAlign(NetNode *node,int state,double like,
 #ifdef SANITY
    pri->anlen++;
 #endif
+   if (pri->inPar) pthread_mutex_unlock(&pri->alignLock);
 
    return(align);
 }
@@ -646,7 +921,9 @@ static void UnlinkAlign(Align *align)
    pri->nalign--;
 }
 
-static void StepHMM1(NetNode *node) /* Model internal propagation NBEST */
+/* Model internal propagation NBEST, with the state buffer and beam */
+/*  maxima of task st */
+static void StepHMM1(NetNode *node,StepTask *st)
 {
    NetInst *inst;
    HMMDef *hmm;
@@ -661,7 +938,7 @@ static void StepHMM1(NetNode *node) /* Model internal propagation NBEST */
    int n;
 #endif
    
-   inst=node->inst;
+   inst=NodeInst(node);
    max=null_token;
    
    hmm=node->info.hmm; 
@@ -669,7 +946,7 @@ static void StepHMM1(NetNode *node) /* Model internal propagation NBEST */
    trP=hmm->transP;
    seIndex=pri->psi->seIndexes[hmm->tIdx];
    
-   for (j=2,res=pri->psi->sBuf+2;j<N;j++,res++) {  /* Emitting states first */
+   for (j=2,res=st->sBuf+2;j<N;j++,res++) {  /* Emitting states first */
       i=seIndex[j][0]; 
       endi=seIndex[j][1];
       cur=inst->state+i-1;
@@ -729,16 +1006,16 @@ static void StepHMM1(NetNode *node) /* Model internal propagation NBEST */
    
    /* Null entry state ready for external propagation */
    /*  And copy tokens from buffer to instance */
-   for (i=1,res=pri->psi->sBuf+1,cur=inst->state;
+   for (i=1,res=st->sBuf+1,cur=inst->state;
         i<N;i++,res++,cur++) {
       cur->n=res->n; cur->tok=res->tok; 
       for (k=0;k<res->n;k++) cur->set[k]=res->set[k];
    }
 
    /* Set up pruning limits */
-   if (max.like>pri->genMaxTok.like) {
-      pri->genMaxTok=max;
-      pri->genMaxNode=node;
+   if (max.like>st->genMaxTok.like) {
+      st->genMaxTok=max;
+      st->genMaxNode=node;
    }
    inst->max=max.like;
 
@@ -767,9 +1044,9 @@ static void StepHMM1(NetNode *node) /* Model internal propagation NBEST */
    }
    if (res->tok.like>LSMALL){
       tok.like=res->tok.like+inst->wdlk;
-      if (tok.like > pri->wordMaxTok.like) {
-         pri->wordMaxTok=tok;
-         pri->wordMaxNode=node;
+      if (tok.like > st->wordMaxTok.like) {
+         st->wordMaxTok=tok;
+         st->wordMaxNode=node;
       }
       if (!node_tr0(node) && pri->models) {
          align=NewNRefAlign(node,-1,
@@ -805,7 +1082,7 @@ static void StepHMM2(NetNode *node)
    int n;
 #endif
 
-   inst=node->inst;
+   inst=NodeInst(node);
 
    hmm=node->info.hmm; 
    N=hmm->numStates;
@@ -1043,11 +1320,11 @@ static void CollectPaths(void)
 
 static void StepWord1(NetNode *node) /* Just invalidate the tokens */
 {
-   node->inst->state->tok=null_token;
-   node->inst->state->n=((pri->nToks>1)?1:0);
-   node->inst->exit->tok=null_token;
-   node->inst->exit->n=((pri->nToks>1)?1:0);
-   node->inst->max=LZERO;
+   NodeInst(node)->state->tok=null_token;
+   NodeInst(node)->state->n=((pri->nToks>1)?1:0);
+   NodeInst(node)->exit->tok=null_token;
+   NodeInst(node)->exit->n=((pri->nToks>1)?1:0);
+   NodeInst(node)->max=LZERO;
 }
 
 static void StepWord2(NetNode *node) /* Update the path - may be repeated */
@@ -1058,7 +1335,7 @@ static void StepWord2(NetNode *node) /* Update the path - may be repeated */
    NxtPath *rth;
    int i,k;
 
-   inst=node->inst;
+   inst=NodeInst(node);
 
    if (node->info.pron==NULL && node->tag==NULL) {
       inst->exit->tok=inst->state->tok;
@@ -1161,16 +1438,16 @@ static void ReOrderList(NetNode *node)
    NetLink *dest;
    int i;
 
-   if (node->inst!=NULL?!node->inst->ooo:TRUE) return;
-   node->inst->ooo=FALSE;
+   if (NodeInst(node)!=NULL?!NodeInst(node)->ooo:TRUE) return;
+   NodeInst(node)->ooo=FALSE;
    for (i=0,dest=node->links;i<node->nlinks;i++,dest++) {
       if (!node_tr0(dest->node)) break;
-      if (dest->node->inst!=NULL) 
-         MoveToRecent(dest->node->inst);
+      if (NodeInst(dest->node)!=NULL) 
+         MoveToRecent(NodeInst(dest->node));
    }
    for (i=0,dest=node->links;i<node->nlinks;i++,dest++) {
       if (!node_tr0(dest->node)) break;
-      if (dest->node->inst!=NULL)
+      if (NodeInst(dest->node)!=NULL)
          ReOrderList(dest->node);
    }
 }
@@ -1253,7 +1530,7 @@ static void AttachInst(NetNode *node)
    inst->link->knil=inst;
    inst->knil->link=inst;
 
-   node->inst=inst;
+   NodeInst(node)=inst;
 
    if (node_wd0(node))
       inst->wdlk=LikeToWord(inst->node);
@@ -1278,7 +1555,7 @@ static void DetachInst(NetNode *node)
    NetInst *inst;
    int i,n;
 
-   inst=node->inst;
+   inst=NodeInst(node);
    pri->nact--;
 #ifdef SANITY
    if (inst->node!=node)
@@ -1304,7 +1581,7 @@ static void DetachInst(NetNode *node)
 #endif
    Dispose(&pri->instHeap,inst);
 
-   node->inst=0;
+   NodeInst(node)=0;
 }
 
 static void SetEntryState(NetNode *node,TokenSet *src)
@@ -1317,10 +1594,10 @@ static void SetEntryState(NetNode *node,TokenSet *src)
 #endif
 #endif
 
-   if (node->inst==NULL)
+   if (NodeInst(node)==NULL)
       AttachInst(node);
 
-   inst=node->inst;
+   inst=NodeInst(node);
    res=inst->state;
 #ifdef SANITY
    if ((res->n==0 && src->n!=0) || (res->n!=0 && src->n==0))
@@ -1349,19 +1626,151 @@ static void SetEntryState(NetNode *node,TokenSet *src)
    if (res->tok.like>inst->max)
       inst->max=res->tok.like;
    if (node->type==n_word && (pri->wordMaxNode==NULL || 
-                              pri->wordMaxNode->inst==NULL || 
-                              res->tok.like > pri->wordMaxNode->inst->max))
+                              NodeInst(pri->wordMaxNode)==NULL || 
+                              res->tok.like > NodeInst(pri->wordMaxNode)->max))
       pri->wordMaxNode=node;
 }
 
-static void StepInst1(NetNode *node) /* First pass of token propagation (Internal) */
+/* First pass of token propagation (Internal) */
+static void StepInst1(NetNode *node,StepTask *st)
 {
    if (node_hmm(node))
-      StepHMM1(node);   /* Advance tokens within HMM instance t => t-1 */
+      StepHMM1(node,st);   /* Advance tokens within HMM instance t => t-1 */
                         /* Entry tokens valid for t-1, do states 2..N */
    else
       StepWord1(node);
-   node->inst->pxd=FALSE;
+   NodeInst(node)->pxd=FALSE;
+}
+
+/* ------------------ Parallel Internal Propagation ------------------- */
+
+/* Pass 1 only touches the instance it steps, the precomps (whose ids  */
+/*  are atomic) and the align records (locked), so its instances can   */
+/*  be shared out to numThreads-1 pool threads and the caller.  The    */
+/*  pool is started the first time it is needed; a pass that finds it  */
+/*  in use by another recogniser runs its tasks serially.              */
+
+#define MIN_TASK_INST 32   /* Fewest instances worth a task */
+
+static pthread_t *stepThreads=NULL;  /* Array[0..stepPoolSize-1] */
+static pthread_mutex_t stepMutex=PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t stepStartCond=PTHREAD_COND_INITIALIZER;
+static pthread_cond_t stepDoneCond=PTHREAD_COND_INITIALIZER;
+static int stepPoolSize=0;           /* Number of pool threads */
+static Boolean stepBusy=FALSE;       /* Pool in use */
+static unsigned long stepGen=0;      /* Generation of the current pass */
+static int stepPending=0;            /* Threads still in the current pass */
+static PRecInfo *stepPri=NULL;       /* Recogniser of the current pass */
+
+/* Step the instances of task t of recogniser p */
+static void RunStepTask(PRecInfo *p,int t)
+{
+   StepTask *st;
+   int i;
+
+   pri=p;   /* This may be a pool thread */
+   st=p->task+t;
+   for (i=0;i<st->n;i++)
+      StepInst1(st->inst[i]->node,st);
+}
+
+/* Run the tasks of the current pass that belong to pool thread w */
+static void RunStepShare(int w)
+{
+   int t;
+
+   for (t=w;t<stepPri->nTask;t+=stepPoolSize+1)
+      RunStepTask(stepPri,t);
+}
+
+static void *StepWorker(void *arg)
+{
+   int w=(int)(long)arg;
+   unsigned long gen=0;
+
+   while (TRUE) {
+      pthread_mutex_lock(&stepMutex);
+      while (stepGen==gen)
+         pthread_cond_wait(&stepStartCond,&stepMutex);
+      gen=stepGen;
+      pthread_mutex_unlock(&stepMutex);
+
+      RunStepShare(w);
+
+      pthread_mutex_lock(&stepMutex);
+      if (--stepPending==0)
+         pthread_cond_signal(&stepDoneCond);
+      pthread_mutex_unlock(&stepMutex);
+   }
+   return NULL;
+}
+
+/* Run all the tasks of p, on the pool if it is free */
+static void RunStepTasks(PRecInfo *p)
+{
+   Boolean usePool=FALSE;
+   int t;
+
+   pthread_mutex_lock(&stepMutex);
+   if (stepThreads==NULL) {
+      stepPoolSize=numThreads-1;
+      stepThreads=(pthread_t*) New(&gcheap,stepPoolSize*sizeof(pthread_t));
+      for (t=0;t<stepPoolSize;t++)
+         if (pthread_create(stepThreads+t,NULL,StepWorker,(void*)(long)(t+1))!=0)
+            HError(8505,"RunStepTasks: Cannot create thread %d",t+1);
+   }
+   if (!stepBusy) {
+      stepBusy=usePool=TRUE;
+      stepPri=p;
+      stepPending=stepPoolSize;
+      stepGen++;
+      pthread_cond_broadcast(&stepStartCond);
+   }
+   pthread_mutex_unlock(&stepMutex);
+
+   if (!usePool) {
+      for (t=0;t<p->nTask;t++)
+         RunStepTask(p,t);
+      return;
+   }
+   RunStepShare(0);   /* The caller is thread 0 */
+   pthread_mutex_lock(&stepMutex);
+   while (stepPending>0)
+      pthread_cond_wait(&stepDoneCond,&stepMutex);
+   stepBusy=FALSE;
+   pthread_mutex_unlock(&stepMutex);
+}
+
+/* Share the active instances out to the tasks of p and step them. */
+/*  Returns FALSE (having done nothing) when there are too few.     */
+static Boolean StepInstPar(PRecInfo *p)
+{
+   NetInst *inst;
+   StepTask *st;
+   int n,t,lo,hi;
+
+   for (inst=p->head.link,n=0;inst!=NULL;inst=inst->link)
+      if (inst->node) n++;
+   if (n<p->nTask*MIN_TASK_INST)
+      return(FALSE);
+   if (n>p->instArrN) {
+      if (p->instArr!=NULL)
+         Dispose(&gcheap,p->instArr);
+      p->instArrN=(n*3)/2;
+      p->instArr=(NetInst**) New(&gcheap,p->instArrN*sizeof(NetInst*));
+   }
+   for (inst=p->head.link,n=0;inst!=NULL;inst=inst->link)
+      if (inst->node) p->instArr[n++]=inst;
+   for (t=0,st=p->task;t<p->nTask;t++,st++) {
+      lo=(int)(((long)n*t)/p->nTask);
+      hi=(int)(((long)n*(t+1))/p->nTask);
+      st->inst=p->instArr+lo;
+      st->n=hi-lo;
+   }
+   p->inPar=TRUE;
+   RunStepTasks(p);
+   p->inPar=FALSE;
+   return(TRUE);
 }
 
 static void StepInst2(NetNode *node) /* Second pass of token propagation (External) */
@@ -1379,12 +1788,12 @@ static void StepInst2(NetNode *node) /* Second pass of token propagation (Extern
    else if (node_tr0(node) /* && node_hmm(node) */)
       StepHMM2(node);   /* Advance tokens within HMM instance t => t-1 */
                         /* Entry token valid for t, only do state N */
-   tok=node->inst->exit->tok;
+   tok=NodeInst(node)->exit->tok;
    xtok.tok=tok;
-   xtok.n=node->inst->exit->n;
+   xtok.n=NodeInst(node)->exit->n;
    xtok.set=rtoks;
    for (k=0;k<xtok.n;k++)
-      xtok.set[k]=node->inst->exit->set[k];
+      xtok.set[k]=NodeInst(node)->exit->set[k];
 
    if (node_word(node))
       if (tok.like<pri->wordThresh)
@@ -1396,7 +1805,7 @@ static void StepInst2(NetNode *node) /* Second pass of token propagation (Extern
          xtok.tok.like=tok.like+lm*pri->scale;
          xtok.tok.lm=tok.lm+lm;
          for (k=0;k<xtok.n;k++)
-            xtok.set[k].lm=node->inst->exit->set[k].lm+lm;
+            xtok.set[k].lm=NodeInst(node)->exit->set[k].lm+lm;
          if (xtok.tok.like>pri->genThresh) {
             SetEntryState(dest->node,&xtok);
             /* Transfer set of tokens to node, activating when necessary */
@@ -1404,7 +1813,7 @@ static void StepInst2(NetNode *node) /* Second pass of token propagation (Extern
          }
       }
    }
-   node->inst->pxd=TRUE;
+   NodeInst(node)->pxd=TRUE;
 }
 
 static void CreateSEIndex(PSetInfo *psi,HLink hmm)
@@ -1438,16 +1847,286 @@ static void CreateSEIndex(PSetInfo *psi,HLink hmm)
    }
 }
 
+/* Pack the Gaussians of a PLAINHS/SHAREDHS set into per stream pools */
+/*  for the batched engine.  Leaves psi->gPool NULL when the set has    */
+/*  components the engine cannot evaluate.                             */
+static void InitGMMPools(PSetInfo *psi)
+{
+   HMMSet *hset;
+   HMMScanState hss;
+   StreamElem *se;
+   MixtureElem *me;
+   GMMStream *gs;
+   GMMPool *gp;
+   MixPDF **mpOf,*mp;
+   int *slotOf,*streamOf,*nSlot;
+   float *mean,*prec;
+   LogFloat wt;
+   Boolean ok;
+   int i,j,m,n,d,b,l,s,S,maxMix;
+
+   hset=psi->hset;
+   psi->gPool=NULL; psi->gStr=NULL; psi->gMaxMix=0;
+   if (!gmmBatch || (hset->hsKind!=PLAINHS && hset->hsKind!=SHAREDHS))
+      return;
+   S=hset->swidth[0];
+
+   /* Check every usable component is INVDIAGC with a valid index */
+   ok=TRUE;
+   NewHMMScan(hset,&hss);
+   while(ok && GoNextState(&hss,FALSE)) {
+      for (s=1,se=hss.si->pdf+1;s<=S && ok;s++,se++)
+         for (m=1,me=se->spdf.cpdf+1;m<=se->nMix;m++,me++) {
+            if (se->nMix>1 && MixLogWeight(hset,me->weight)<=LMINMIX) 
+               continue;
+            if (me->mpdf->ckind!=INVDIAGC || me->mpdf->mIdx<=0 || 
+                me->mpdf->mIdx>hset->numMix) {
+               ok=FALSE; break;
+            }
+         }
+   }
+   EndHMMScan(&hss);
+   if (!ok) {
+      if (trace&T_NGEN)
+         printf("HRec: Gaussians not all INVDIAGC, batched engine not used\n");
+      return;
+   }
+
+   /* Give each component a slot in the pool of its stream */
+   mpOf=(MixPDF**) New(&gstack,(hset->numMix+1)*sizeof(MixPDF*));
+   slotOf=(int*) New(&gstack,(hset->numMix+1)*sizeof(int));
+   streamOf=(int*) New(&gstack,(hset->numMix+1)*sizeof(int));
+   nSlot=(int*) New(&gstack,(S+1)*sizeof(int));
+   for (i=1;i<=hset->numMix;i++) slotOf[i]=-1;
+   for (s=1;s<=S;s++) nSlot[s]=0;
+   psi->gStr=(GMMStream**) New(&psi->heap,psi->nsp*sizeof(GMMStream*));
+   psi->gStr--;
+   for (j=1;j<=psi->nsp;j++) psi->gStr[j]=NULL;
+   maxMix=1;
+   NewHMMScan(hset,&hss);
+   while(GoNextState(&hss,FALSE)) {
+      gs=(GMMStream*) New(&psi->heap,S*sizeof(GMMStream));
+      psi->gStr[hss.si->sIdx]=--gs;
+      for (s=1,se=hss.si->pdf+1;s<=S;s++,se++) {
+         gs[s].slot=(int*) New(&psi->heap,se->nMix*sizeof(int));
+         gs[s].wt=(float*) New(&psi->heap,se->nMix*sizeof(float));
+         gs[s].mIdx=(int*) New(&psi->heap,se->nMix*sizeof(int));
+         gs[s].lwt=NULL;
+         for (m=1,n=0,me=se->spdf.cpdf+1;m<=se->nMix;m++,me++) {
+            /* Single mixtures ignore the weight, as in cSOutP */
+            wt=(se->nMix==1)?0.0:MixLogWeight(hset,me->weight);
+            if (se->nMix>1 && wt<=LMINMIX) continue;
+            mp=me->mpdf;
+            if (slotOf[mp->mIdx]<0) {
+               slotOf[mp->mIdx]=nSlot[s]++;
+               mpOf[mp->mIdx]=mp;
+               streamOf[mp->mIdx]=s;
+            }
+            gs[s].slot[n]=slotOf[mp->mIdx];
+            gs[s].mIdx[n]=mp->mIdx;
+            gs[s].wt[n++]=wt;
+         }
+         gs[s].nMix=n;
+         if (psi->gSel!=NULL)
+            gs[s].lwt=(float*) New(&psi->heap,n*sizeof(float));
+         for (m=0,gs[s].wSum=0.0;m<n;m++) {
+            if (gs[s].lwt!=NULL) gs[s].lwt[m]=exp(gs[s].wt[m]);
+            gs[s].wSum+=exp(gs[s].wt[m]);
+         }
+         if (n>maxMix) maxMix=n;
+      }
+   }
+   EndHMMScan(&hss);
+
+   /* Pack means, precisions and gConsts, padding the last block */
+   psi->gPool=(GMMPool*) New(&psi->heap,S*sizeof(GMMPool));
+   psi->gPool--;
+   for (s=1;s<=S;s++) {
+      gp=psi->gPool+s;
+      gp->vSize=hset->swidth[s];
+      gp->bSize=(psi->gSel!=NULL)?1:GMM_BLOCK;
+      gp->nBlk=(nSlot[s]+gp->bSize-1)/gp->bSize;
+      n=gp->nBlk*gp->bSize;
+      gp->mean=(float*) New(&psi->heap,(size_t)n*gp->vSize*sizeof(float));
+      gp->prec=(float*) New(&psi->heap,(size_t)n*gp->vSize*sizeof(float));
+      gp->gConst=(float*) New(&psi->heap,n*sizeof(float));
+      memset(gp->mean,0,(size_t)n*gp->vSize*sizeof(float));
+      memset(gp->prec,0,(size_t)n*gp->vSize*sizeof(float));
+      for (i=0;i<n;i++) gp->gConst[i]=0.0;
+   }
+   for (i=1;i<=hset->numMix;i++) {
+      if (slotOf[i]<0) continue;
+      mp=mpOf[i];
+      gp=psi->gPool+streamOf[i];
+      b=slotOf[i]/gp->bSize; l=slotOf[i]%gp->bSize;
+      mean=gp->mean+(size_t)b*gp->vSize*gp->bSize+l;
+      prec=gp->prec+(size_t)b*gp->vSize*gp->bSize+l;
+      for (d=1;d<=gp->vSize;d++,mean+=gp->bSize,prec+=gp->bSize) {
+         *mean=mp->mean[d];
+         *prec=mp->cov.var[d];
+      }
+      gp->gConst[slotOf[i]]=mp->gConst;
+   }
+   Dispose(&gstack,mpOf);
+   if (trace&T_NGEN)
+      for (s=1;s<=S;s++)
+         printf("HRec: stream %d, %d Gaussians packed in %d blocks of %d\n",
+                s,nSlot[s],psi->gPool[s].nBlk,psi->gPool[s].bSize);
+   psi->gMaxMix=maxMix;
+}
+
+
+/* Read keyword key followed by an int from a Gaussian selection file */
+static int ReadGSelInt(Source *src, char *key)
+{
+   char buf[MAXSTRLEN];
+   int i;
+
+   if (!ReadString(src,buf) || strcmp(buf,key)!=0)
+      HError(8530,"ReadGSelInt: %s expected in %s",key,src->name);
+   if (!ReadInt(src,&i,1,FALSE))
+      HError(8530,"ReadGSelInt: Integer after %s expected in %s",
+             key,src->name);
+   return i;
+}
+
+/* Load the Gaussian selection file fn written by HGSel for hset */
+static void LoadGSel(PSetInfo *psi, char *fn)
+{
+   Source src;
+   HMMSet *hset;
+   GSelStream *gss;
+   GMMPool *gp;
+   Vector ivar,code;
+   int i,c,d,s,S,n;
+
+   hset=psi->hset;
+   if (hset->hsKind!=PLAINHS && hset->hsKind!=SHAREDHS)
+      HError(8530,"LoadGSel: Gaussian selection needs PLAINHS or SHAREDHS");
+   if (InitSource(fn,&src,NoFilter)<SUCCESS)
+      HError(8530,"LoadGSel: Can't open Gaussian selection file %s",fn);
+   if (ReadGSelInt(&src,"<NUMMIXES>")!=hset->numMix)
+      HError(8530,"LoadGSel: %s was not built for this HMM set",fn);
+   S=ReadGSelInt(&src,"<NUMSTREAMS>");
+   if (S!=hset->swidth[0])
+      HError(8530,"LoadGSel: %s has %d streams not %d",fn,S,hset->swidth[0]);
+   psi->gSel=(GSelStream*) New(&psi->heap,S*sizeof(GSelStream));
+   psi->gSel--;
+   for (s=1;s<=S;s++) {
+      gss=psi->gSel+s;
+      if (ReadGSelInt(&src,"<STREAM>")!=s)
+         HError(8530,"LoadGSel: Stream %d expected in %s",s,fn);
+      gss->vSize=ReadGSelInt(&src,"<VECSIZE>");
+      if (gss->vSize!=hset->swidth[s])
+         HError(8530,"LoadGSel: Stream %d width %d not %d in %s",
+                s,gss->vSize,hset->swidth[s],fn);
+      gss->nCode=ReadGSelInt(&src,"<NUMCODES>");
+      ivar=CreateVector(&gstack,gss->vSize);
+      code=CreateVector(&gstack,gss->vSize);
+      if (ReadGSelInt(&src,"<VARIANCE>")!=gss->vSize ||
+          !ReadFloat(&src,ivar+1,gss->vSize,FALSE))
+         HError(8530,"LoadGSel: Bad variance for stream %d in %s",s,fn);
+      for (i=1;i<=gss->vSize;i++) ivar[i]=1.0/ivar[i];
+      gp=&gss->code;
+      gp->vSize=gss->vSize; gp->bSize=GMM_BLOCK;
+      gp->nBlk=(gss->nCode+GMM_BLOCK-1)/GMM_BLOCK;
+      n=gp->nBlk*GMM_BLOCK;
+      gp->mean=(float*) New(&psi->heap,(size_t)n*gp->vSize*sizeof(float));
+      gp->prec=(float*) New(&psi->heap,(size_t)n*gp->vSize*sizeof(float));
+      gp->gConst=(float*) New(&psi->heap,n*sizeof(float));
+      memset(gp->mean,0,(size_t)n*gp->vSize*sizeof(float));
+      memset(gp->prec,0,(size_t)n*gp->vSize*sizeof(float));
+      for (i=0;i<n;i++) gp->gConst[i]=0.0;
+      gss->nList=(int*) New(&psi->heap,gss->nCode*sizeof(int));
+      gss->list=(int**) New(&psi->heap,gss->nCode*sizeof(int*));
+      gss->nList--; gss->list--;
+      for (c=1;c<=gss->nCode;c++) {
+         if (ReadGSelInt(&src,"<CODE>")!=c)
+            HError(8530,"LoadGSel: Codeword %d expected in %s",c,fn);
+         if (ReadGSelInt(&src,"<MEAN>")!=gss->vSize ||
+             !ReadFloat(&src,code+1,gss->vSize,FALSE))
+            HError(8530,"LoadGSel: Bad codeword %d in %s",c,fn);
+         i=(c-1)/GMM_BLOCK*gp->vSize*GMM_BLOCK+(c-1)%GMM_BLOCK;
+         for (d=1;d<=gp->vSize;d++,i+=GMM_BLOCK) {
+            gp->mean[i]=code[d];
+            gp->prec[i]=ivar[d];
+         }
+         n=gss->nList[c]=ReadGSelInt(&src,"<LIST>");
+         gss->list[c]=(int*) New(&psi->heap,(n>0?n:1)*sizeof(int));
+         if (n>0 && !ReadInt(&src,gss->list[c],n,FALSE))
+            HError(8530,"LoadGSel: Bad shortlist %d in %s",c,fn);
+         for (i=0;i<n;i++)
+            if (gss->list[c][i]<1 || gss->list[c][i]>hset->numMix)
+               HError(8530,"LoadGSel: Bad Gaussian %d in shortlist %d of %s",
+                      gss->list[c][i],c,fn);
+      }
+      FreeVector(&gstack,ivar);
+   }
+   CloseSource(&src);
+   if (trace&T_NGEN)
+      for (s=1;s<=S;s++)
+         printf("HRec: stream %d, %d Gaussian selection codewords\n",
+                s,psi->gSel[s].nCode);
+}
+
+/* Mark the shortlists of the gsNBest codewords nearest to obs as */
+/*  selected for id in the gsId of the current recogniser */
+static void SelectGaussians(PSetInfo *psi, Observation *obs, int id)
+{
+   GSelStream *gss;
+   float outp[GMM_BLOCK],max[GS_MAXNBEST];
+   int i,j,b,c,k,n,s,best[GS_MAXNBEST],*list;
+
+   for (s=1;s<=obs->swidth[0];s++) {
+      gss=psi->gSel+s;
+      n=0; k=(gsNBest<gss->nCode)?gsNBest:gss->nCode;
+      for (b=0,c=1;b<gss->code.nBlk;b++) {
+         EvalGMMBlock(&gss->code,b,obs->fv[s],outp);
+         for (i=0;i<GMM_BLOCK && c<=gss->nCode;i++,c++) {
+            if (n==k && outp[i]<=max[n-1]) continue;
+            if (n<k) n++;
+            for (j=n-1;j>0 && outp[i]>max[j-1];j--) {
+               max[j]=max[j-1]; best[j]=best[j-1];
+            }
+            max[j]=outp[i]; best[j]=c;
+         }
+      }
+      for (j=0;j<n;j++) {
+         list=gss->list[best[j]];
+         for (i=0;i<gss->nList[best[j]];i++)
+            pri->gsId[list[i]]=id;
+      }
+   }
+}
+
+/* Invalidate all the cached outps and the Gaussian selection of p, */
+/*  since frame ids restart with each utterance */
+static void ResetPreComps(PRecInfo *p)
+{
+   PSetInfo *psi;
+   PreComp *pre;
+   int i,s,b;
+
+   psi=p->psi;
+   for(i=1,pre=p->sPre+1;i<=psi->nsp;i++,pre++) pre->id=-1;
+   for(i=1,pre=p->mPre+1;i<=psi->nmp;i++,pre++) pre->id=-1;
+   if (psi->gPool!=NULL)
+      for (s=1;s<=psi->hset->swidth[0];s++)
+         for (b=0;b<psi->gPool[s].nBlk;b++)
+            p->gBlkId[s][b]=-1;
+   if (p->gsId!=NULL)
+      for (i=1;i<=psi->hset->numMix;i++)
+         p->gsId[i]=-1;
+}
+
 /* Prepare HMMSet for recognition.  Allocates seIndex and preComp from */
 /*  hmmset heap.*/
 PSetInfo *InitPSetInfo(HMMSet *hset)
 {
    PSetInfo *psi;
-   RelToken *rtoks;
    int n,h,i;
    HLink hmm;
    MLink q;
-   PreComp *pre;
    char name[80];
    static int psid=0;
 
@@ -1461,16 +2140,6 @@ PSetInfo *InitPSetInfo(HMMSet *hset)
    psi->tBuf=(Token*) New(&psi->heap,(psi->max-1)*sizeof(Token));
    psi->tBuf-=2;
 
-   psi->sBuf=(TokenSet*) New(&psi->heap,psi->max*sizeof(TokenSet));
-   rtoks=(RelToken*) New(&psi->heap,psi->max*sizeof(RelToken)*MAX_TOKS);
-   psi->sBuf-=1;
-   for (i=0; i<psi->max; i++) {
-      psi->sBuf[i+1].set=rtoks;rtoks+=MAX_TOKS;
-      psi->sBuf[i+1].tok=null_token;
-      psi->sBuf[i+1].n=0;
-      psi->sBuf[i+1].set[0]=rmax;
-   }
-
    psi->stHeapIdx=(short*) New(&psi->heap,(psi->max+1)*sizeof(short));
    for (i=0; i<=psi->max; i++) psi->stHeapIdx[i]=-1;
    psi->stHeapIdx[1]=0; /* For one state word end models */
@@ -1489,18 +2158,16 @@ PSetInfo *InitPSetInfo(HMMSet *hset)
          }
       }
    psi->nsp=hset->numStates;
-   psi->sPre=(PreComp*) New(&psi->heap, sizeof(PreComp)*psi->nsp);
-   psi->sPre--;
-   for(i=1,pre=psi->sPre+1;i<=psi->nsp;i++,pre++) pre->id=-1;
    if (hset->numSharedMix>0) {
       psi->mixShared=TRUE;
       psi->nmp=hset->numSharedMix;
-      psi->mPre=(PreComp*) New(&psi->heap, sizeof(PreComp)*psi->nmp);
-      psi->mPre--;
-      for(i=1,pre=psi->mPre+1;i<=psi->nmp;i++,pre++) pre->id=-1;
    }
    else
-      psi->mixShared=FALSE,psi->nmp=0,psi->mPre=NULL;
+      psi->mixShared=FALSE,psi->nmp=0;
+   psi->gSel=NULL;
+   if (gsFile!=NULL)
+      LoadGSel(psi,gsFile);
+   InitGMMPools(psi);
 
    for (n=1,i=0;n<=psi->max;n++)
       if (psi->stHeapIdx[n]>=0)
@@ -1516,6 +2183,16 @@ void FreePSetInfo(PSetInfo *psi)
    Dispose(&gcheap,psi);
 }
 
+/* EXPORT->SharedPSetInfo: TRUE if recognisers on several threads may */
+/*  use psi at once */
+Boolean SharedPSetInfo(PSetInfo *psi)
+{
+   /* Only the batched Gaussians and discrete sets compute their */
+   /*  output probabilities without writing to the HMMSet or to  */
+   /*  shared scratch space */
+   return(psi->gPool!=NULL || psi->hset->hsKind==DISCRETEHS);
+}
+
 static void LatFromPaths(Path *path,int *ln,Lattice *lat)
 {
    LNode *ne,*ns;
@@ -1769,12 +2446,58 @@ static void qcksrtM(float *array,int l,int r,int M)
    else qcksrtM(array,l,j,M);
 }
 
+/* Return the M'th largest (from 0) of array[0..n-1], which must be  */
+/*  more than M long.  The scores are counted into HIST_BINS bins     */
+/*  spanning [max-range,max] (lower scores share the bottom bin) and  */
+/*  only the bin holding the M'th is sorted, so this is linear in n   */
+/*  but returns the same value as qcksrtM.  array is overwritten.      */
+static float HistSelect(float *array,int n,int M,float range)
+{
+   int bin[HIST_BINS];
+   int i,b,m,above;
+   float hi,lo,scale;
+
+   hi=lo=array[0];
+   for (i=1;i<n;i++)
+      if (array[i]>hi) hi=array[i];
+      else if (array[i]<lo) lo=array[i];
+   if (lo<hi-range) lo=hi-range;
+   if (hi<=lo) {
+      qcksrtM(array,0,n-1,M);
+      return(array[M]);
+   }
+   scale=(HIST_BINS-1)/(hi-lo);
+   for (b=0;b<HIST_BINS;b++) bin[b]=0;
+   for (i=0;i<n;i++) {
+      b=(array[i]<=lo)?0:(int)((array[i]-lo)*scale);
+      bin[b]++;
+   }
+   for (b=HIST_BINS-1,above=0;above+bin[b]<=M;b--)
+      above+=bin[b];
+   /* Bring the scores of bin b to the front and select among them */
+   for (i=0,m=0;i<n;i++)
+      if (((array[i]<=lo)?0:(int)((array[i]-lo)*scale))==b)
+         array[m++]=array[i];
+   qcksrtM(array,0,m-1,M-above);
+   return(array[M-above]);
+}
+
+/* Return the cutoff that keeps the M most likely of array[0..n-1] */
+static float PruneCutoff(float *array,int n,int M,LogFloat range)
+{
+   if (histPrune)
+      return(HistSelect(array,n,M,range));
+   qcksrtM(array,0,n-1,M);
+   return(array[M]);
+}
+
 /* EXPORT->InitVRecInfo: initialise ready for recognition */
 VRecInfo *InitVRecInfo(PSetInfo *psi,int nToks,Boolean models,Boolean states)
 {
    VRecInfo *vri;
-   PreComp *pre;
-   int i,n;
+   StepTask *st;
+   RelToken *rtoks;
+   int i,n,s,S;
    char name[80];
    static int prid=0;
 
@@ -1819,9 +2542,35 @@ VRecInfo *InitVRecInfo(PSetInfo *psi,int nToks,Boolean models,Boolean states)
 
    /* Model set dependent */
    pri->psi=psi;
-   /* pri->psi->sBuf[1].n=((pri->nToks>1)?1:0);  Needed every observation */
-   for(i=1,pre=psi->sPre+1;i<=psi->nsp;i++,pre++) pre->id=-1;
-   for(i=1,pre=psi->mPre+1;i<=psi->nmp;i++,pre++) pre->id=-1;
+   pri->xform=NULL;
+   pri->nInst=NULL; pri->nInstN=0;
+
+   /* Output probability caches of this recogniser */
+   pri->sPre=(PreComp*) New(&vri->heap,sizeof(PreComp)*psi->nsp);
+   pri->sPre--;
+   if (psi->nmp>0) {
+      pri->mPre=(PreComp*) New(&vri->heap,sizeof(PreComp)*psi->nmp);
+      pri->mPre--;
+   }
+   else pri->mPre=NULL;
+   pri->gOutp=NULL; pri->gBlkId=NULL;
+   if (psi->gPool!=NULL) {
+      S=psi->hset->swidth[0];
+      pri->gOutp=(float**) New(&vri->heap,S*sizeof(float*));
+      pri->gBlkId=(int**) New(&vri->heap,S*sizeof(int*));
+      pri->gOutp--; pri->gBlkId--;
+      for (s=1;s<=S;s++) {
+         n=psi->gPool[s].nBlk;
+         pri->gOutp[s]=(float*) New(&vri->heap,n*psi->gPool[s].bSize*sizeof(float));
+         pri->gBlkId[s]=(int*) New(&vri->heap,(n+1)*sizeof(int));
+      }
+   }
+   pri->gsId=NULL;
+   if (psi->gSel!=NULL) {
+      pri->gsId=(int*) New(&vri->heap,psi->hset->numMix*sizeof(int));
+      pri->gsId--;
+   }
+   ResetPreComps(pri);
 
    pri->stHeap=(MemHeap *) New(&vri->heap,pri->psi->stHeapNum*sizeof(MemHeap));
    for (n=1;n<=pri->psi->max;n++) {
@@ -1846,6 +2595,30 @@ VRecInfo *InitVRecInfo(PSetInfo *psi,int nToks,Boolean models,Boolean states)
    CreateHeap(&pri->alignHeap,"Align Heap",
               MHEAP,sizeof(Align),1.0,200,3200);
 
+   /* Tasks of the internal pass, which can only run on several */
+   /*  threads when the output probabilities are thread safe    */
+   pri->nTask=1;
+   if (numThreads>1 && (psi->gPool!=NULL || psi->hset->hsKind==TIEDHS ||
+                        psi->hset->hsKind==DISCRETEHS ||
+                        psi->hset->hsKind==HYBRIDHS))
+      pri->nTask=numThreads;
+   pri->task=(StepTask*) New(&vri->heap,pri->nTask*sizeof(StepTask));
+   for (n=0,st=pri->task;n<pri->nTask;n++,st++) {
+      st->inst=NULL; st->n=0;
+      st->sBuf=(TokenSet*) New(&vri->heap,psi->max*sizeof(TokenSet));
+      rtoks=(RelToken*) New(&vri->heap,psi->max*sizeof(RelToken)*MAX_TOKS);
+      st->sBuf-=1;
+      for (i=0; i<psi->max; i++) {
+         st->sBuf[i+1].set=rtoks;rtoks+=MAX_TOKS;
+         st->sBuf[i+1].tok=null_token;
+         st->sBuf[i+1].n=0;
+         st->sBuf[i+1].set[0]=rmax;
+      }
+   }
+   pri->instArr=NULL; pri->instArrN=0;
+   pri->inPar=FALSE;
+   pthread_mutex_init(&pri->alignLock,NULL);
+
 
    /* Now set up instances */
 
@@ -1888,6 +2661,11 @@ void DeleteVRecInfo(VRecInfo *vri)
    DeleteHeap(&pri->rPthHeap);
    DeleteHeap(&pri->pathHeap);
    DeleteHeap(&pri->alignHeap);
+   if (pri->instArr!=NULL)
+      Dispose(&gcheap,pri->instArr);
+   if (pri->nInst!=NULL)
+      Dispose(&gcheap,pri->nInst);
+   pthread_mutex_destroy(&pri->alignLock);
    DeleteHeap(&vri->heap);
    Dispose(&gcheap,vri);
 }
@@ -1896,15 +2674,12 @@ void DeleteVRecInfo(VRecInfo *vri)
 void StartRecognition(VRecInfo *vri,Network *net,
                       float scale,LogFloat wordpen,float pscale)
 {
-   NetNode *node;
    NetInst *inst,*next;
-   PreComp *pre;
    int i;
 
    pri=vri->pri;
    if (pri==NULL)
       HError(8570,"StartRecognition: Visible recognition info not initialised");
-   /* pri->psi->sBuf[1].n=((pri->nToks>1)?1:0);  Only needed for Step1 */
 
    vri->noTokenSurvived=TRUE;
    pri->net=net;
@@ -1913,15 +2688,20 @@ void StartRecognition(VRecInfo *vri,Network *net,
    pri->pscale=pscale;
    /* Initialise the network and instances ready for first frame */
                        
-   for (node=pri->net->chain;node!=NULL;node=node->chain) node->inst=NULL;
-   pri->net->final.inst=pri->net->initial.inst=NULL;
-   for(i=1,pre=pri->psi->sPre+1;i<=pri->psi->nsp;i++,pre++) pre->id=-1;
-   for(i=1,pre=pri->psi->mPre+1;i<=pri->psi->nmp;i++,pre++) pre->id=-1;
+   if (net->numNode>pri->nInstN) {
+      if (pri->nInst!=NULL)
+         Dispose(&gcheap,pri->nInst);
+      pri->nInstN=net->numNode;
+      pri->nInst=(NetInst**) New(&gcheap,pri->nInstN*sizeof(NetInst*));
+   }
+   for (i=0;i<net->numNode;i++) pri->nInst[i]=NULL;
+   ResetPreComps(pri);
 
    pri->tact=pri->nact=pri->frame=0;
+   pri->pruneClock=0;
 
    AttachInst(&pri->net->initial);
-   inst=pri->net->initial.inst;
+   inst=NodeInst(&pri->net->initial);
    inst->state->tok.like=inst->max=0.0;
    inst->state->tok.lm=0.0;
    inst->state->tok.path=NULL;
@@ -1947,17 +2727,18 @@ void StartRecognition(VRecInfo *vri,Network *net,
 void ProcessObservation(VRecInfo *vri,Observation *obs,int id, AdaptXForm *xform)
 {
    NetInst *inst,*next;
+   StepTask *st;
    int j;
    float thresh;
+   clock_t start=0;
 
    pri=vri->pri;
-   inXForm = xform; /* sepcifies the transform to use for this observation */
+   pri->xform = xform; /* sepcifies the transform to use for this observation */
    if (pri==NULL)
       HError(8570,"ProcessObservation: Visible recognition info not initialised");
    if (pri->net==NULL)
       HError(8570,"ProcessObservation: Recognition not started");
 
-   pri->psi->sBuf[1].n=((pri->nToks>1)?1:0); /* Needed every observation */
    pri->frame++;
    pri->obs=obs;
    if (id<0) pri->id=(pri->prid<<20)+pri->frame;
@@ -1973,20 +2754,25 @@ void ProcessObservation(VRecInfo *vri,Observation *obs,int id, AdaptXForm *xform
                    j,VectorSize(obs->fv[j]),pri->psi->hset->swidth[j]);
 
 
+   if (pri->psi->gSel!=NULL)
+      SelectGaussians(pri->psi,obs,pri->id);
+
    /* Max model pruning is done initially in a separate pass */
 
+   if (pri->nact>pri->qsn && ((vri->maxBeam>0 && pri->nact>vri->maxBeam) ||
+                              (maxWordEnd>0 && pri->nact>maxWordEnd))) {
+      if (pri->qsn>0)
+         Dispose(&vri->heap,pri->qsa);
+      pri->qsn=(pri->nact*3)/2;
+      pri->qsa=(LogFloat*) New(&vri->heap,pri->qsn*sizeof(LogFloat));
+   }
    if (vri->maxBeam>0 && pri->nact>vri->maxBeam) {
-      if (pri->nact>pri->qsn) {
-         if (pri->qsn>0)
-            Dispose(&vri->heap,pri->qsa);
-         pri->qsn=(pri->nact*3)/2;
-         pri->qsa=(LogFloat*) New(&vri->heap,pri->qsn*sizeof(LogFloat));
-      }
       for (inst=pri->head.link,j=0;inst!=NULL;inst=inst->link,j++)
          pri->qsa[j]=inst->max;
-      if (j>=vri->maxBeam) {
-         qcksrtM(pri->qsa,0,j-1,vri->maxBeam);
-         thresh=pri->qsa[vri->maxBeam];
+      if (j>vri->maxBeam) {
+         if (trace&T_PRUNE) start=clock();
+         thresh=PruneCutoff(pri->qsa,j,vri->maxBeam,vri->genBeam);
+         if (trace&T_PRUNE) pri->pruneClock+=clock()-start;
          if (thresh>LSMALL) 
             for (inst=pri->head.link;inst->link!=NULL;inst=next) {
                next=inst->link;
@@ -1998,16 +2784,46 @@ void ProcessObservation(VRecInfo *vri,Observation *obs,int id, AdaptXForm *xform
    if (pri->psi->hset->hsKind==TIEDHS)
       PrecomputeTMix(pri->psi->hset,obs,vri->tmBeam,0);
    /* Pass 1 must calculate top of all beams - inc word end !! */
+   for (j=0,st=pri->task;j<pri->nTask;j++,st++) {
+      st->sBuf[1].n=((pri->nToks>1)?1:0); /* Needed every observation */
+      st->genMaxTok=st->wordMaxTok=null_token;
+      st->genMaxNode=st->wordMaxNode=NULL;
+   }
+   if (pri->nTask==1 || pri->xform!=NULL || !StepInstPar(pri))
+      for (inst=pri->head.link;inst!=NULL;inst=inst->link)
+         if (inst->node)
+            StepInst1(inst->node,pri->task);
+   /* Reduce the task maxima in instance order */
    pri->genMaxTok=pri->wordMaxTok=null_token;
    pri->genMaxNode=pri->wordMaxNode=NULL;
-   for (inst=pri->head.link,j=0;inst!=NULL;inst=inst->link,j++)
-      if (inst->node)
-         StepInst1(inst->node);
+   for (j=0,st=pri->task;j<pri->nTask;j++,st++) {
+      if (st->genMaxTok.like>pri->genMaxTok.like) {
+         pri->genMaxTok=st->genMaxTok;
+         pri->genMaxNode=st->genMaxNode;
+      }
+      if (st->wordMaxTok.like>pri->wordMaxTok.like) {
+         pri->wordMaxTok=st->wordMaxTok;
+         pri->wordMaxNode=st->wordMaxNode;
+      }
+   }
    
    /* Not changing beam width for max model pruning */
    
    pri->wordThresh=pri->wordMaxTok.like-vri->wordBeam;
    if (pri->wordThresh<LSMALL) pri->wordThresh=LSMALL;
+   if (maxWordEnd>0 && pri->nact>maxWordEnd) {
+      /* Word end histogram pruning on the scores pass 1 found */
+      for (inst=pri->head.link,j=0;inst!=NULL;inst=inst->link)
+         if (inst->node && node_hmm(inst->node) && 
+             inst->exit->tok.like>LSMALL && inst->wdlk>LSMALL)
+            pri->qsa[j++]=inst->exit->tok.like+inst->wdlk;
+      if (j>maxWordEnd) {
+         if (trace&T_PRUNE) start=clock();
+         thresh=PruneCutoff(pri->qsa,j,maxWordEnd,vri->wordBeam);
+         if (trace&T_PRUNE) pri->pruneClock+=clock()-start;
+         if (thresh>pri->wordThresh) pri->wordThresh=thresh;
+      }
+   }
    pri->genThresh=pri->genMaxTok.like-vri->genBeam;
    if (pri->genThresh<LSMALL) pri->genThresh=LSMALL;
    if (pri->nToks>1) {
@@ -2080,13 +2896,20 @@ Lattice *CompleteRecognition(VRecInfo *vri,HTime frameDur,MemHeap *heap)
       HError(-8570,"CompleteRecognition: No observations processed");
 
    vri->frameDur=frameDur;
+   if ((trace&T_PRUNE) && pri->frame>0) {
+      printf(" Max model pruning (%s): %.3fs, RTF %.5f\n",
+             histPrune?"histogram":"sort",
+             pri->pruneClock/(double)CLOCKS_PER_SEC,
+             pri->pruneClock/(double)CLOCKS_PER_SEC/(pri->frame*frameDur));
+      fflush(stdout);
+   }
    
    /* Should delay this until we have freed everything that we can */
    if (heap!=NULL) {
       lat=NULL;vri->noTokenSurvived=TRUE;
-      if (pri->net->final.inst!=NULL)
-         if (pri->net->final.inst->exit->tok.path!=NULL)
-            lat=CreateLattice(heap,pri->net->final.inst->exit,vri->frameDur),
+      if (NodeInst(&pri->net->final)!=NULL)
+         if (NodeInst(&pri->net->final)->exit->tok.path!=NULL)
+            lat=CreateLattice(heap,NodeInst(&pri->net->final)->exit,vri->frameDur),
                vri->noTokenSurvived=FALSE;
      
       if (lat==NULL && forceOutput) {
@@ -2103,7 +2926,7 @@ Lattice *CompleteRecognition(VRecInfo *vri,HTime frameDur,MemHeap *heap)
    /* Now dispose of everything apart from the answer */
    for (inst=pri->head.link;inst!=NULL;inst=inst->link)
       if (inst->node)
-         inst->node->inst=NULL;
+         NodeInst(inst->node)=NULL;
 
    /* Remove everything from active lists */
 
@@ -136,7 +136,20 @@ void InitRec(void);
 PSetInfo *InitPSetInfo(HMMSet *hset);
 /*
    Attach precomps to HMMSet and return PSetInfo
-   describing HMMSet
+   describing HMMSet.  Unless HREC: GMMBATCH is false, the INVDIAGC
+   Gaussians of a PLAINHS/SHAREDHS set are also copied into packed
+   blocks which are evaluated a block at a time.  These copies are
+   not updated if the models change, so InitPSetInfo must be called
+   again after the means or variances are altered.  Frames with an
+   input transform are evaluated component by component as before.
+   If HREC: GSELFILE names a Gaussian selection file built by HGSel
+   for hset, each frame only the Gaussians in the shortlists of the
+   HREC: GSNBEST (default 1) nearest codewords are evaluated, one
+   at a time rather than in blocks.  The others of a mixture are
+   backed off to the log likelihood of the best evaluated Gaussian
+   of that state stream plus HREC: GSFLOOR (default -10.0; LZERO
+   drops them), and a state stream with no Gaussian in the
+   shortlist is evaluated in full.
 */
 
 void FreePSetInfo(PSetInfo *psi);
@@ -144,6 +157,16 @@ void FreePSetInfo(PSetInfo *psi);
    Free storage allocated by InitPSetInfo
 */
 
+Boolean SharedPSetInfo(PSetInfo *psi);
+/*
+   Return TRUE if recognisers driven by different threads may use psi
+   at the same time.  psi, its HMMSet and the networks are then only
+   read; all the state of a recognition (instances, tokens, traceback
+   and output probability caches) is kept in its VRecInfo.  This
+   needs batched Gaussians (see above) or a discrete set, and no
+   input transform.
+*/
+
 
 /*
    Functions specific to each recogniser started
@@ -155,7 +178,11 @@ VRecInfo *InitVRecInfo(PSetInfo *psi,int nToks,Boolean models,Boolean states);
 /* 
    Initialise a recognition engine attached to a particular HMMSet
    that will use nToks tokens per state and also perform alignment
-   at states or models level
+   at states or models level.  If HREC: NUMTHREADS is greater than 1
+   and the output probabilities of psi can be computed by several
+   threads (batched Gaussians, or a tied, discrete or hybrid set),
+   the propagation within the models is shared out to that many
+   threads.  The results are the same as with one thread.
 */
 
 void DeleteVRecInfo(VRecInfo *vri);
@@ -194,7 +221,12 @@ void SetPruningLevels(VRecInfo *vri,int maxBeam,LogFloat genBeam,
 		      LogFloat wordBeam,LogFloat nBeam,LogFloat tmBeam);
 /*
    At any time after initialisation pruning levels can be set
-   using SetPruningLevels or by directly altering the vri values
+   using SetPruningLevels or by directly altering the vri values.
+   The maxBeam most likely models are found from a histogram of
+   their scores, unless HREC: HISTPRUNE is false when they are
+   sorted; both give the same cutoff.  If HREC: MAXWORDEND is set,
+   the word end beam is also narrowed so that at most that many
+   word ends are propagated in each frame.
 */
 
 Transcription *TranscriptionFromLattice(MemHeap *heap,Lattice *lat,int N);
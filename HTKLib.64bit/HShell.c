@@ -36,6 +36,7 @@ char *hshell_version = "!HVER!HShell:   3.4.1 [CUED 12/03/09]";
 char *hshell_vc_id = "$Id: HShell.c,v 1.1.1.1 2006/10/11 09:54:58 jal58 Exp $";
 
 #include "HShell.h"
+#include <pthread.h>
 
 #ifdef WIN32
 #include <windows.h>
@@ -76,18 +77,38 @@ typedef struct {                        /* extended file name */
    long enindex;                        /* end sample to extract */
 }ExtFile;
 
-static ExtFile extFiles[MAXEFS];        /* circ buf of ext file names */
-static int extFileNext = 0;             /* next slot to save into */
-static int extFileUsed = 0;             /* total ext files in buffer */
+/* Extended names registered by the thread that called InitShell go
+   in extTab, which other threads may also search under extLock.  The
+   names registered by any other thread go in a table of its own, so
+   that a loader thread can register a name and open it without the
+   entry being recycled by another thread in between */
+typedef struct {
+   ExtFile files[MAXEFS];               /* circ buf of ext file names */
+   int next;                            /* next slot to save into */
+   int used;                            /* total ext files in buffer */
+}ExtFileTab;
+
+static ExtFileTab extTab;               /* of the main thread */
+static __thread ExtFileTab thExtTab;    /* of any other thread */
+static pthread_t mainThread;            /* the thread that called InitShell */
+static pthread_mutex_t extLock = PTHREAD_MUTEX_INITIALIZER; /* guards extTab */
 
 /* ------------- Extended File Name Handling ---------------- */
 
+/* IsMainThread: true if the caller is the thread that called InitShell */
+static Boolean IsMainThread(void)
+{
+   return pthread_equal(pthread_self(),mainThread) ? TRUE : FALSE;
+}
+
 /* EXPORT->RegisterExtFileName: record details of fn exts if any in circ buffer */
 char * RegisterExtFileName(char *s)
 {
    char *eq,*rb,*lb,*co;
    char buf[1024];
    ExtFile *p;
+   ExtFileTab *t;
+   Boolean isMain;
 
    if (!extendedFileNames)
       return s;
@@ -101,12 +122,15 @@ char * RegisterExtFileName(char *s)
    if (trace&T_EXF)
       printf("Ext File Name: %s\n",buf);
 
-   p = extFiles+extFileNext;
-   ++extFileNext; 
-   if (extFileNext==MAXEFS) 
-      extFileNext=0;
-   if (extFileUsed < MAXEFS) 
-      ++extFileUsed;
+   isMain = IsMainThread();
+   t = isMain ? &extTab : &thExtTab;
+   if (isMain) pthread_mutex_lock(&extLock);
+   p = t->files+t->next;
+   ++t->next; 
+   if (t->next==MAXEFS) 
+      t->next=0;
+   if (t->used < MAXEFS) 
+      ++t->used;
    p->stindex = p->enindex = -1;
 
    if (lb!=NULL) {
@@ -126,6 +150,7 @@ char * RegisterExtFileName(char *s)
       strcpy(p->logfile,buf);
       strcpy(p->actfile,buf);
    }
+   if (isMain) pthread_mutex_unlock(&extLock);
 
    if (trace&T_EXF) {
       printf("%s=%s", p->logfile, p->actfile);
@@ -137,16 +162,8 @@ char * RegisterExtFileName(char *s)
    return p->logfile;
 }
 
-/* GetFileNameExt: return true if given file has extensions and return
-   the extend info.  The problem with this routine is that the logical
-   name can be repeated in the buffer.  This is normally handled by 
-   comparing the pointer rather than the string itself.  However, if
-   the application copies the logical file name, this would break.
-   Hence, if the pointer is not there, the name is searched for
-   going back in time.  If the name is found and it occurs more
-   than once, a warning is printed.
-*/
-Boolean GetFileNameExt(char *logfn, char *actfn, long *st, long *en)
+/* FindExtFile: search table t for logfn as GetFileNameExt does */
+static Boolean FindExtFile(ExtFileTab *t, char *logfn, char *actfn, long *st, long *en)
 {
    int i, noccs;
    ExtFile *p;
@@ -155,7 +172,7 @@ Boolean GetFileNameExt(char *logfn, char *actfn, long *st, long *en)
 
    /* First count number of times logfn occurs in buffer */
    noccs = 0;
-   for (i=0,p=extFiles; i<extFileUsed; i++,p++){
+   for (i=0,p=t->files; i<t->used; i++,p++){
       if (strcmp(logfn,p->logfile) == 0 ) 
          ++noccs;
    }
@@ -163,7 +180,7 @@ Boolean GetFileNameExt(char *logfn, char *actfn, long *st, long *en)
       return FALSE;
 
    /* Try to find the logfn, by pointer first */
-   for (i=0,p=extFiles; i<extFileUsed && !found; i++){
+   for (i=0,p=t->files; i<t->used && !found; i++){
       if (logfn == p->logfile) 
          found = TRUE; 
       else 
@@ -173,9 +190,9 @@ Boolean GetFileNameExt(char *logfn, char *actfn, long *st, long *en)
    if (!found) {   /* look for actual name */
       if (noccs>1) 
          ambiguous = TRUE;
-      p = extFiles + extFileNext;
-      for (i=0; i<extFileUsed && !found; i++){
-         if (p==extFiles) 
+      p = t->files + t->next;
+      for (i=0; i<t->used && !found; i++){
+         if (p==t->files) 
             p += MAXEFS;
          else
             p--;
@@ -201,6 +218,28 @@ Boolean GetFileNameExt(char *logfn, char *actfn, long *st, long *en)
    return TRUE;
 }
 
+/* GetFileNameExt: return true if given file has extensions and return
+   the extend info.  The problem with this routine is that the logical
+   name can be repeated in the buffer.  This is normally handled by 
+   comparing the pointer rather than the string itself.  However, if
+   the application copies the logical file name, this would break.
+   Hence, if the pointer is not there, the name is searched for
+   going back in time.  If the name is found and it occurs more
+   than once, a warning is printed.  A thread other than the main
+   one searches its own names first and then those of the main thread.
+*/
+Boolean GetFileNameExt(char *logfn, char *actfn, long *st, long *en)
+{
+   Boolean found;
+
+   if (!IsMainThread() && FindExtFile(&thExtTab,logfn,actfn,st,en))
+      return TRUE;
+   pthread_mutex_lock(&extLock);
+   found = FindExtFile(&extTab,logfn,actfn,st,en);
+   pthread_mutex_unlock(&extLock);
+   return found;
+}
+
 
 /* --------------------- Version Display -------------------- */
 
@@ -742,11 +781,10 @@ static char * ScriptWord(void)
 }
 
 /* cz277 - ANN */
-/* ScriptWord(void) for cache script */
-char *GetNextScpWord(FILE *script, char *scriptBuf)
+/* EXPORT->GetNextRawScpWord: the next word of a cache script, without registering extended file names */
+char *GetNextRawScpWord(FILE *script, char *scriptBuf)
 {
     int ch, qch, i;
-    char *extBuf;
 
     i = 0;
     ch = ' ';
@@ -774,6 +812,18 @@ char *GetNextScpWord(FILE *script, char *scriptBuf)
         } while (!isspace(ch) && ch != EOF);
     }
     scriptBuf[i] = '\0';
+    return scriptBuf;
+}
+
+/* cz277 - ANN */
+/* ScriptWord(void) for cache script */
+char *GetNextScpWord(FILE *script, char *scriptBuf)
+{
+    char *extBuf;
+
+    if (GetNextRawScpWord(script, scriptBuf) == NULL) {
+        return NULL;
+    }
     if (extendedFileNames) {
         extBuf = RegisterExtFileName(scriptBuf);
         strcpy(scriptBuf, extBuf);
@@ -2026,6 +2076,7 @@ ReturnStatus InitShell(int argc, char *argv[], char *ver, char *sccs)
     int i,j;
     Boolean b;
 
+    mainThread = pthread_self();
     argcount = 1; 
     arglist = (char **) malloc(argc * sizeof(char *));
     arglist[0] = argv[0];
@@ -228,7 +228,11 @@ void Register(char *ver, char *sccs);
 */
 
 char * RegisterExtFileName(char *s);
-/* Record details of fn extended attributed if any in circular buffer */
+/* 
+   Record details of fn extended attributed if any in circular buffer.
+   Names registered by the thread that called InitShell are visible to
+   all threads; those registered by any other thread only to itself.
+*/
 
 
 Boolean InfoPrinted(void);
@@ -338,7 +342,8 @@ Boolean GetFileNameExt(char *logfn, char *actfn, long *st, long *en);
    or        logfile=actfile
    or        logfile=actfile[1,999]
      
-   File extensions can be disabled by seting EXTENDFILENAMES to F
+   File extensions can be disabled by seting EXTENDFILENAMES to F.
+   A thread other than the main one searches its own names first.
 */       
 
 /* ---------------------- Input Handling ----------------------------- */
@@ -559,6 +564,11 @@ char *RetrieveCommandLine(void);
 
 /* cz277 - ANN */
 char *GetNextScpWord(FILE *script, char *scriptBuf);
+char *GetNextRawScpWord(FILE *script, char *scriptBuf);
+/*
+   As GetNextScpWord, but an extended file name is returned as it
+   is in the script and is not registered yet
+*/
 FILE *GetTrainScript(int *scriptCnt);
 Boolean GetConfAny(ConfParam **list, int size, char *name, ConfParam **item);
 char *CatDirs(char *baseDir, char *extDir, char *newDir);
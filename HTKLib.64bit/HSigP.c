@@ -104,20 +104,46 @@ void ZeroMean(short *data, long nSamples)
 static int hamWinSize = 0;          /* Size of current Hamming window */
 static Vector hamWin = NULL;        /* Current Hamming window */
 
-/* GenHamWindow: generate precomputed Hamming window function */
-static void GenHamWindow (int frameSize)
+/* FillHamWindow: fill win with a Hamming window of frameSize */
+static void FillHamWindow (Vector win, int frameSize)
 {
    int i;
    float a;
    
-   if (hamWin==NULL || VectorSize(hamWin) < frameSize)
-      hamWin = CreateVector(&sigpHeap,frameSize);
    a = TPI / (frameSize - 1);
    for (i=1;i<=frameSize;i++)
-      hamWin[i] = 0.54 - 0.46 * cos(a*(i-1));
+      win[i] = 0.54 - 0.46 * cos(a*(i-1));
+}
+
+/* GenHamWindow: generate precomputed Hamming window function */
+static void GenHamWindow (int frameSize)
+{
+   if (hamWin==NULL || VectorSize(hamWin) < frameSize)
+      hamWin = CreateVector(&sigpHeap,frameSize);
+   FillHamWindow(hamWin,frameSize);
    hamWinSize = frameSize;
 }
 
+/* EXPORT->CreateHamWindow: return a Hamming window of frameSize */
+Vector CreateHamWindow(MemHeap *x, int frameSize)
+{
+   Vector win;
+
+   win = CreateVector(x,frameSize);
+   FillHamWindow(win,frameSize);
+   return win;
+}
+
+/* EXPORT->ApplyWindow: Apply window win to speech frame s */
+void ApplyWindow(Vector s, Vector win)
+{
+   int i,frameSize;
+   
+   frameSize=VectorSize(s);
+   for (i=1;i<=frameSize;i++)
+      s[i] *= win[i];
+}
+
 /* EXPORT->Ham: Apply Hamming Window to Speech frame s */
 void Ham (Vector s)
 {
@@ -467,6 +493,62 @@ float WarpFreq (float fcl, float fcu, float freq, float minFreq, float maxFreq ,
    }
 }
 
+/* InitFBankBatch: build the tables used by Wave2FBankBatch, ie the
+   bit reversal swaps and twiddles of FFT and Realft and, for each
+   channel, the weights of the fft indices it spans */
+static void InitFBankBatch(MemHeap *x, FBankInfo *fb)
+{
+   int i,ii,j,k,m,n,nn,nt,chan;
+
+   /* Swaps of complex values, found as in FFT */
+   n = fb->fftN; nn = n/2;
+   fb->swap = CreateIntVec(x,nn); k = 0;
+   for (ii=1,j=1; ii<=nn; ii++) {
+      i = 2 * ii - 1;
+      if (j>i) {
+         fb->swap[++k] = (i-1)/2; fb->swap[++k] = (j-1)/2;
+      }
+      m = n / 2;
+      while (m >= 2  && j > m) {
+         j -= m; m /= 2;
+      }
+      j += m;
+   }
+   fb->nSwap = k/2;
+   /* Twiddles exp(i*TPI*t/nn) of FFT and exp(i*PI*t/nn) of Realft */
+   nt = (nn>=2) ? nn/2 : 1;
+   fb->fftCos = (float *) New(x,nt*sizeof(float));
+   fb->fftSin = (float *) New(x,nt*sizeof(float));
+   fb->rftCos = (float *) New(x,nt*sizeof(float));
+   fb->rftSin = (float *) New(x,nt*sizeof(float));
+   for (i=0; i<nt; i++) {
+      fb->fftCos[i] = cos(TPI*i/nn); fb->fftSin[i] = sin(TPI*i/nn);
+      fb->rftCos[i] = cos(PI*i/nn);  fb->rftSin[i] = sin(PI*i/nn);
+   }
+   /* Channel chan gets loWt[k] of fft index k if loChan[k] is chan and
+      1-loWt[k] if it is chan-1.  loChan is nondecreasing so these
+      indices are contiguous. */
+   fb->chanLo = CreateIntVec(x,fb->numChans);
+   fb->chanN = CreateIntVec(x,fb->numChans);
+   fb->chanOff = CreateIntVec(x,fb->numChans);
+   fb->chanWt = (float *) New(x,2*nn*sizeof(float));
+   for (chan=1,nt=0; chan<=fb->numChans; chan++) {
+      fb->chanLo[chan] = fb->klo; fb->chanN[chan] = 0;
+      fb->chanOff[chan] = nt;
+      for (k=fb->klo; k<=fb->khi; k++) {
+         if (fb->loChan[k]==chan)
+            fb->chanWt[nt++] = fb->loWt[k];
+         else if (fb->loChan[k]==chan-1)
+            fb->chanWt[nt++] = 1.0 - fb->loWt[k];
+         else
+            continue;
+         if (fb->chanN[chan]++ == 0) fb->chanLo[chan] = k;
+      }
+   }
+   /* Workspace holding FBANKBATCH frames */
+   fb->bx = (float *) New(x,fb->fftN*FBANKBATCH*sizeof(float));
+}
+
 /* EXPORT->InitFBank: Initialise an FBankInfo record */
 FBankInfo InitFBank(MemHeap *x, int frameSize, long sampPeriod, int numChans,
                     float lopass, float hipass, Boolean usePower, Boolean takeLogs,
@@ -551,6 +633,7 @@ FBankInfo InitFBank(MemHeap *x, int frameSize, long sampPeriod, int numChans,
    }
    /* Create workspace for fft */
    fb.x = CreateVector(x,fb.fftN);
+   InitFBankBatch(x,&fb);
    return fb;
 }
 
@@ -620,6 +703,158 @@ void FBank2MFCC(Vector fbank, Vector c, int n)
    }        
 }
 
+/* EXPORT->Wave2FBankBatch: Perform filterbank analysis on n frames */
+void Wave2FBankBatch(Vector *s, Vector *fbank, float *te, int n,
+                     FBankInfo info)
+{
+   const float melfloor = 1.0;
+   const int nb = FBANKBATCH;
+   int f,i,k,m,nn,half,step,chan;
+   float *x = info.bx, *xi, *yi, *xj, *yj, *wt;
+   float wr,wi,t1,t2,xr1,xi1,xr2,xi2;
+   float acc[FBANKBATCH];
+
+   if (n<1 || n>FBANKBATCH)
+      HError(5321,"Wave2FBankBatch: %d frames in batch",n);
+   for (f=0; f<n; f++) {
+      /* Check that info record is compatible */
+      if (info.frameSize != VectorSize(s[f]))
+         HError(5321,"Wave2FBankBatch: frame size mismatch");
+      if (info.numChans != VectorSize(fbank[f]))
+         HError(5321,"Wave2FBankBatch: num channels mismatch");
+      /* Compute frame energy if needed */
+      if (te != NULL){
+         te[f] = 0.0;
+         for (k=1; k<=info.frameSize; k++)
+            te[f] += (s[f][k]*s[f][k]);
+      }
+   }
+   /* Interleave the frames, so that x[k*nb+f] is sample k of frame f
+      and complex value c of frame f is x[2*c*nb+f], x[(2*c+1)*nb+f].
+      The fft and unused frames are padded with zeroes. */
+   memset(x,0,info.fftN*nb*sizeof(float));
+   for (f=0; f<n; f++)
+      for (k=0; k<info.frameSize; k++)
+         x[k*nb+f] = s[f][k+1];
+
+   /* Apply FFT, first the bit reversal then the butterflies.  The
+      lanes xi..yj of the loops over frames never overlap, which the
+      ivdep pragmas tell the compiler so that it vectorises them. */
+   nn = info.fftN / 2;
+   for (i=1; i<=2*info.nSwap; i+=2) {
+      xi = x + 2*nb*info.swap[i]; xj = x + 2*nb*info.swap[i+1];
+#pragma GCC ivdep
+      for (f=0; f<2*nb; f++) {
+         t1 = xi[f]; xi[f] = xj[f]; xj[f] = t1;
+      }
+   }
+   for (half=1; half<nn; half*=2) {
+      step = nn / (2*half);
+      for (m=0; m<half; m++) {
+         wr = info.fftCos[m*step]; wi = info.fftSin[m*step];
+         for (i=m; i<nn; i+=2*half) {
+            xi = x + 2*nb*i; yi = xi + nb;
+            xj = xi + 2*nb*half; yj = xj + nb;
+#pragma GCC ivdep
+            for (f=0; f<nb; f++) {
+               t1 = wr * xj[f] - wi * yj[f];
+               t2 = wr * yj[f] + wi * xj[f];
+               xj[f] = xi[f] - t1; yj[f] = yi[f] - t2;
+               xi[f] = xi[f] + t1; yi[f] = yi[f] + t2;
+            }
+         }
+      }
+   }
+   /* Separate the spectrum of the real frames as in Realft */
+   for (i=1; i<nn/2; i++) {
+      wr = info.rftCos[i]; wi = info.rftSin[i];
+      xi = x + 2*nb*i; yi = xi + nb;
+      xj = x + 2*nb*(nn-i); yj = xj + nb;
+#pragma GCC ivdep
+      for (f=0; f<nb; f++) {
+         xr1 = 0.5 * (xi[f] + xj[f]); xi1 = 0.5 * (yi[f] - yj[f]);
+         xr2 = 0.5 * (yi[f] + yj[f]); xi2 = 0.5 * (xj[f] - xi[f]);
+         xi[f] = xr1 + wr * xr2 - wi * xi2;
+         yi[f] = xi1 + wr * xi2 + wi * xr2;
+         xj[f] = xr1 - wr * xr2 + wi * xi2;
+         yj[f] = -xi1 + wr * xi2 + wi * xr2;
+      }
+   }
+   for (f=0; f<nb; f++) {
+      x[f] = x[f] + x[nb+f]; x[nb+f] = 0.0;
+   }
+
+   /* Store the energy of fft channel k in the real part of x[k-1] */
+   for (k=info.klo; k<=info.khi; k++) {
+      xi = x + 2*nb*(k-1); yi = xi + nb;
+      for (f=0; f<nb; f++) {
+         t1 = xi[f]; t2 = yi[f];
+         xi[f] = t1*t1 + t2*t2;
+      }
+      if (!info.usePower)
+         for (f=0; f<nb; f++)
+            xi[f] = sqrt(xi[f]);
+   }
+
+   /* Fill filterbank channels and take logs */
+   for (chan=1; chan<=info.numChans; chan++) {
+      for (f=0; f<nb; f++)
+         acc[f] = 0.0;
+      wt = info.chanWt + info.chanOff[chan];
+      xi = x + 2*nb*(info.chanLo[chan]-1);
+      for (k=0; k<info.chanN[chan]; k++, xi+=2*nb)
+         for (f=0; f<nb; f++)
+            acc[f] += wt[k] * xi[f];
+      for (f=0; f<n; f++) {
+         t1 = acc[f];
+         if (info.takeLogs) {
+            if (t1<melfloor) t1 = melfloor;
+            t1 = log(t1);
+         }
+         fbank[f][chan] = t1;
+      }
+   }
+}
+
+/* EXPORT->CreateMFCCTable: return the cosines of FBank2MFCC */
+Matrix CreateMFCCTable(MemHeap *x, int numChans, int n)
+{
+   Matrix tab;
+   int j,k;
+   float pi_factor,y;
+
+   tab = CreateMatrix(x,numChans,n);
+   pi_factor = PI/(float)numChans;
+   for (j=1; j<=n; j++) {
+      y = (float)j * pi_factor;
+      for (k=1; k<=numChans; k++)
+         tab[k][j] = cos(y*(k-0.5));
+   }
+   return tab;
+}
+
+/* EXPORT->FBank2MFCCTable: compute first n cepstral coeff using tab */
+void FBank2MFCCTable(Vector fbank, Vector c, Matrix tab)
+{
+   int j,k,n,numChan;
+   float mfnorm,fk;
+   Vector t;
+
+   numChan = NumRows(tab); n = NumCols(tab);
+   if (numChan != VectorSize(fbank))
+      HError(5321,"FBank2MFCCTable: num channels mismatch");
+   mfnorm = sqrt(2.0/(float)numChan);
+   for (j=1; j<=n; j++)
+      c[j] = 0.0;
+   for (k=1; k<=numChan; k++) {
+      fk = fbank[k]; t = tab[k];
+      for (j=1; j<=n; j++)
+         c[j] += fk * t[j];
+   }
+   for (j=1; j<=n; j++)
+      c[j] *= mfnorm;
+}
+
 /* EXPORT->FBank2MelSpec: convert log fbank to linear */
 void FBank2MelSpec(Vector fbank)
 {
@@ -753,22 +988,38 @@ static int cepWinSize=0;            /* Size of current cepstral weight window */
 static int cepWinL=0;               /* Current liftering coeff */
 static Vector cepWin = NULL;        /* Current cepstral weight window */
 
-/* GenCepWin: generate a new cep liftering vector */
-static void GenCepWin (int cepLiftering, int count)
+/* FillCepWin: fill win with count cep liftering weights */
+static void FillCepWin (Vector win, int cepLiftering, int count)
 {
    int i;
    float a, Lby2;
    
-   if (cepWin==NULL || VectorSize(cepWin) < count)
-      cepWin = CreateVector(&sigpHeap,count);
    a = PI/cepLiftering;
    Lby2 = cepLiftering/2.0;
    for (i=1;i<=count;i++)
-      cepWin[i] = 1.0 + Lby2*sin(i * a);
+      win[i] = 1.0 + Lby2*sin(i * a);
+}
+
+/* GenCepWin: generate a new cep liftering vector */
+static void GenCepWin (int cepLiftering, int count)
+{
+   if (cepWin==NULL || VectorSize(cepWin) < count)
+      cepWin = CreateVector(&sigpHeap,count);
+   FillCepWin(cepWin,cepLiftering,count);
    cepWinL = cepLiftering;
    cepWinSize = count;
 }  
 
+/* EXPORT->CreateCepWindow: return count cep liftering weights */
+Vector CreateCepWindow(MemHeap *x, int cepLiftering, int count)
+{
+   Vector win;
+
+   win = CreateVector(x,count);
+   FillCepWin(win,cepLiftering,count);
+   return win;
+}
+
 /* EXPORT->WeightCepstrum: Apply cepstral weighting to c */
 void WeightCepstrum (Vector c, int start, int count, int cepLiftering)
 {
@@ -793,6 +1044,26 @@ void UnWeightCepstrum(Vector c, int start, int count, int cepLiftering)
       c[j++] /= cepWin[i];
 }
 
+/* EXPORT->WeightCepstrumWin: Apply cepstral weights win to c */
+void WeightCepstrumWin(Vector c, int start, int count, Vector win)
+{
+   int i,j;
+   
+   j = start;
+   for (i=1;i<=count;i++)
+      c[j++] *= win[i];
+}
+
+/* EXPORT->UnWeightCepstrumWin: Undo cepstral weights win of c */
+void UnWeightCepstrumWin(Vector c, int start, int count, Vector win)
+{
+   int i,j;
+   
+   j = start;
+   for (i=1;i<=count;i++)
+      c[j++] /= win[i];
+}
+
 /* The following operations apply to a sequence of n vectors step apart.
    They are used to operate on the 'columns' of data files 
    containing a sequence of feature vectors packed together to form a
@@ -823,33 +1094,57 @@ void FZeroMean(float *data, int vSize, int n, int step)
 }
 
 /* Regression: add regression vector at +offset from source vector.  If head
-   or tail is less than delwin then duplicate first/last vector to compensate */
+   or tail is less than delwin then duplicate first/last vector to compensate.
+   The components are taken REGVEC at a time, summing over the window for
+   all of them at once; the fixed length inner loops vectorise and the
+   sums stay in registers.  Each component still sums its terms in the
+   order t=1..delwin, so the results are unchanged. */
+#define REGVEC 4
 static void Regress(float *data, int vSize, int n, int step, int offset,
                     int delwin, int head, int tail, Boolean simpleDiffs)
 {
-   float *fp,*fp1,*fp2, *back, *forw;
-   float sum, sigmaT2;
-   int i,t,j;
+   float *fp,*fp2, *back, *forw;
+   float sum[REGVEC], sigmaT2, wt, d2;
+   int i,t,j,k,nBack,nForw;
    
    sigmaT2 = 0.0;
    for (t=1;t<=delwin;t++)
       sigmaT2 += t*t;
    sigmaT2 *= 2.0;
+   d2 = 2*delwin;
    fp = data;
    for (i=1;i<=n;i++){
-      fp1 = fp; fp2 = fp+offset;
-      for (j=1;j<=vSize;j++){
-         back = forw = fp1; sum = 0.0;
-         for (t=1;t<=delwin;t++) {
-            if (head+i-t > 0)     back -= step;
-            if (tail+n-i+1-t > 0) forw += step;
-            if (!simpleDiffs) sum += t * (*forw - *back);
+      fp2 = fp+offset;
+      /* valid vectors back and forward, the end ones are replicated */
+      nBack = head+i-1; nForw = tail+n-i;
+      if (simpleDiffs) {
+         back = fp - step*(delwin<nBack?delwin:nBack);
+         forw = fp + step*(delwin<nForw?delwin:nForw);
+         for (j=0;j<vSize;j++)
+            fp2[j] = (forw[j] - back[j]) / d2;
+      }
+      else {
+         for (j=0;j+REGVEC<=vSize;j+=REGVEC) {
+            for (k=0;k<REGVEC;k++) sum[k] = 0.0;
+            for (t=1;t<=delwin;t++) {
+               back = fp - step*(t<nBack?t:nBack) + j;
+               forw = fp + step*(t<nForw?t:nForw) + j;
+               wt = t;
+               for (k=0;k<REGVEC;k++)
+                  sum[k] += wt * (forw[k] - back[k]);
+            }
+            for (k=0;k<REGVEC;k++)
+               fp2[j+k] = sum[k] / sigmaT2;
+         }
+         for (;j<vSize;j++) {
+            sum[0] = 0.0;
+            for (t=1;t<=delwin;t++) {
+               back = fp - step*(t<nBack?t:nBack);
+               forw = fp + step*(t<nForw?t:nForw);
+               sum[0] += t * (forw[j] - back[j]);
+            }
+            fp2[j] = sum[0] / sigmaT2;
          }
-         if (simpleDiffs)
-            *fp2 = (*forw - *back) / (2*delwin);
-         else
-            *fp2 = sum / sigmaT2;
-         ++fp1; ++fp2;
       }
       fp += step;
    }
@@ -863,6 +1158,34 @@ void AddRegression(float *data, int vSize, int n, int step, int offset,
    Regress(data,vSize,n,step,offset,delwin,head,tail,simpleDiffs);
 }
 
+/* EXPORT->AddRegressions: add nLev levels of regression vectors, each
+   regressing the one before, a block of vectors at a time */
+void AddRegressions(float *data, int n, int step, int nLev, int *si, int *ti,
+                    int *vSize, int *delwin, Boolean simpleDiffs)
+{
+   int l,lim,done[MAXREGLEV];
+
+   if (nLev<1 || nLev>MAXREGLEV)
+      HError(5322,"AddRegressions: %d levels of regression",nLev);
+   for (l=0; l<nLev; l++) done[l] = 0;
+   while (done[nLev-1] < n) {
+      for (l=0; l<nLev; l++) {
+         /* the vectors whose windows lie in the source done so far */
+         if (l==0)
+            lim = (done[0]+REGBLOCK<n) ? done[0]+REGBLOCK : n;
+         else if (done[l-1]==n)
+            lim = n;
+         else
+            lim = done[l-1]-delwin[l];
+         if (lim > done[l]) {
+            Regress(data+done[l]*step+si[l],vSize[l],lim-done[l],step,
+                    ti[l]-si[l],delwin[l],done[l],n-lim,simpleDiffs);
+            done[l] = lim;
+         }
+      }
+   }
+}
+
 /* EXPORT->AddHeadRegress: add regression at start of data */
 void AddHeadRegress(float *data, int vSize, int n, int step, int offset,
                     int delwin, Boolean simpleDiffs)
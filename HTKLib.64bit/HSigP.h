@@ -59,6 +59,14 @@ void Ham (Vector s);
    Apply Hamming Window to Speech frame s
 */
 
+Vector CreateHamWindow(MemHeap *x, int frameSize);
+void ApplyWindow(Vector s, Vector win);
+/*
+   Create a Hamming window for frames of frameSize samples and
+   apply a window to frame s.  Unlike Ham, which keeps one window
+   in this module, these can be used by several threads at once.
+*/
+
 void PreEmphasise (Vector s, float k);
 /*
    Apply first order preemphasis filter y[n] = x[n] - K*x[n-1] to s
@@ -136,6 +144,18 @@ typedef struct{
    ShortVec loChan;     /* array[1..fftN/2] of loChan index */
    Vector loWt;         /* array[1..fftN/2] of loChan weighting */
    Vector x;            /* array[1..fftN] of fftchans */
+   /* Tables for Wave2FBankBatch, built by InitFBank */
+   int nSwap;           /* number of bit reversal swaps */
+   IntVec swap;         /* array[1..2*nSwap] of complex indices to swap */
+   float *fftCos;       /* array[0..fftN/4-1] of complex fft twiddles */
+   float *fftSin;
+   float *rftCos;       /* array[0..fftN/4-1] of real fft twiddles */
+   float *rftSin;
+   IntVec chanLo;       /* array[1..numChans] of first fft index of chan */
+   IntVec chanN;        /* array[1..numChans] of num fft indices of chan */
+   IntVec chanOff;      /* array[1..numChans] of offset of chan in chanWt */
+   float *chanWt;       /* fft index weights of all channels */
+   float *bx;           /* array[0..fftN*FBANKBATCH-1] of batch workspace */
 }FBankInfo;
 
 float Mel(int k, float fres);
@@ -168,6 +188,31 @@ void FBank2MFCC(Vector fbank, Vector c, int n);
    Note that the resulting coef are normalised by sqrt(2/numChans)
 */ 
 
+/* The batched forms below give the same results as Wave2FBank and
+   FBank2MFCC to within rounding.  Wave2FBankBatch analyses up to
+   FBANKBATCH frames together, interleaving them so that the inner
+   loops of the FFT and filterbank run across the frames and can be
+   vectorised by the compiler.
+*/
+
+#define FBANKBATCH 8
+
+void Wave2FBankBatch(Vector *s, Vector *fbank, float *te, int n,
+                     FBankInfo info);
+/*
+   Convert the n speech frames s[0..n-1] into filterbank coefficients
+   fbank[0..n-1], storing their energies in te[0..n-1] unless te is
+   NULL.  n must be in the range 1..FBANKBATCH.
+*/
+
+Matrix CreateMFCCTable(MemHeap *x, int numChans, int n);
+void FBank2MFCCTable(Vector fbank, Vector c, Matrix tab);
+/*
+   CreateMFCCTable returns the DCT of FBank2MFCC as a numChans x n
+   table of cosines and FBank2MFCCTable applies it to fbank,
+   storing the first n cepstral coeff in c.
+*/
+
 void FBank2MelSpec(Vector fbank);
 /*
    Convert the given log filterbank coef, in place, to linear
@@ -212,6 +257,14 @@ void UnWeightCepstrum(Vector c, int start, int count, int cepLiftering);
    where w[i] = 1.0 + (L/2.0)*sin(i*pi/L),  L=cepLiftering
 */
 
+Vector CreateCepWindow(MemHeap *x, int cepLiftering, int count);
+void WeightCepstrumWin(Vector c, int start, int count, Vector win);
+void UnWeightCepstrumWin(Vector c, int start, int count, Vector win);
+/*
+   As above with weights w[1]..w[count] created by CreateCepWindow,
+   for use by several threads at once
+*/
+
 /* The following apply to a sequence of 'n' vectors 'step' floats apart  */
 
 void FZeroMean(float *data, int vSize, int n, int step);
@@ -231,6 +284,22 @@ void AddRegression(float *data, int vSize, int n, int step, int offset,
    calculated from (v[delwin] - v[-delwin])/(2*delwin).  
 */
 
+#define MAXREGLEV 4     /* max levels of AddRegressions */
+#define REGBLOCK 64     /* vectors regressed at a time by AddRegressions */
+
+void AddRegressions(float *data, int n, int step, int nLev, int *si, int *ti,
+                    int *vSize, int *delwin, Boolean simpleDiffs);
+/*
+   Add nLev levels of regression vectors to the n vectors of data, level
+   l regressing the vSize[l] components at si[l] into those at ti[l]
+   over delwin[l].  Each level after the first must regress the one
+   before it, ie si[l]==ti[l-1].  The result is that of AddRegression
+   with head = tail = 0 applied to each level in turn, but the levels
+   follow each other through the data REGBLOCK vectors at a time, so
+   a block is still in cache when the next level reads it.  nLev must
+   be at most MAXREGLEV.
+*/
+
 void AddHeadRegress(float *data, int vSize, int n, int step, int offset, 
                     int delwin, Boolean simpleDiffs);
 /* 
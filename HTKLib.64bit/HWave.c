@@ -538,8 +538,10 @@ static long GetOGIHeaderInfo(FILE *f, Wave w, InputAction *ia)
 
 /* ---------------------- NIST Format Interface Routines --------------------- */
 
-static int cNIST;    /* current input char */
-static int cCount;   /* num bytes read */
+typedef struct {     /* state of a NIST header scan */
+   int c;            /* current input char */
+   int count;        /* num bytes read */
+} NISTScan;
 
 enum _CompressType{
    SHORTPACK,   /* MIT shortpack-v0 */
@@ -549,52 +551,52 @@ enum _CompressType{
 typedef enum _CompressType CompressType;
 
 /* GetNISTToken: get next token delimited by white space from f */
-static char * GetNISTToken(FILE *f,char *buf)
+static char * GetNISTToken(FILE *f,NISTScan *ns,char *buf)
 {
    int i=0;
    
-   while (isspace(cNIST)) {
-      cNIST=fgetc(f); ++cCount;
+   while (isspace(ns->c)) {
+      ns->c=fgetc(f); ++ns->count;
    }
    do {
-      if (cNIST == EOF)
+      if (ns->c == EOF)
          HError(6250,"GetNISTToken: Unexpected end of file");
-      buf[i++] = cNIST; cNIST=fgetc(f); ++cCount;
-   } while(!isspace(cNIST) && i<99);
+      buf[i++] = ns->c; ns->c=fgetc(f); ++ns->count;
+   } while(!isspace(ns->c) && i<99);
    buf[i] = '\0';
    return buf;
 }
 
 /* NISTSkipLine: skip to next input line of f */
-static void NISTSkipLine(FILE *f)
+static void NISTSkipLine(FILE *f,NISTScan *ns)
 {
-   while (cNIST != '\012'){   /* new line is line feed on NIST ROM */
-      cNIST=fgetc(f); ++cCount;
-      if (cNIST == EOF)
+   while (ns->c != '\012'){   /* new line is line feed on NIST ROM */
+      ns->c=fgetc(f); ++ns->count;
+      if (ns->c == EOF)
          HError(6250,"NISTSkipLine: Unexpected end of file");
    }  
-   cNIST=fgetc(f); ++cCount;
+   ns->c=fgetc(f); ++ns->count;
 }
 
 /* GetNISTIVal: get int val from f (indicated by -i) */
-static int GetNISTIVal(FILE *f)
+static int GetNISTIVal(FILE *f,NISTScan *ns)
 {
    char buf[100];
    
-   if (strcmp(GetNISTToken(f,buf),"-i") != 0)
+   if (strcmp(GetNISTToken(f,ns,buf),"-i") != 0)
       HError(6251,"GetNISTIVal: NIST type indicator -i expected");
-   return atoi(GetNISTToken(f,buf));
+   return atoi(GetNISTToken(f,ns,buf));
 }
 
 /* GetNISTSVal: get string of lenth n into s (indicated by -sn) */
-static void GetNISTSVal(FILE *f, char *s)
+static void GetNISTSVal(FILE *f, NISTScan *ns, char *s)
 {
    char buf[100];
 
-   GetNISTToken(f,buf);
+   GetNISTToken(f,ns,buf);
    if (buf[0] != '-' || buf[1] != 's')
       HError(6251,"GetNISTSVal: NIST type indicator -s expected");
-   GetNISTToken(f,s);
+   GetNISTToken(f,ns,s);
    if (atoi(buf+2) != strlen(s))
       HError(6251,"GetNISTSVal: bad string length");
 }
@@ -606,43 +608,44 @@ static long GetNISTHeaderInfo(FILE *f, Wave w, InputAction *ia)
    Boolean interleaved = FALSE;
    long nS,sR,sS, cC;
    long dataBytes;
+   NISTScan scan, *ns = &scan;
    
-   cNIST = ' '; cCount = 0;
+   ns->c = ' '; ns->count = 0;
    nS=sR=sS=-1; 
    byteFormat[0]='\0'; sampCoding[0]='\0';
-   lab = GetNISTToken(f,token);           /* Check NIST label */
+   lab = GetNISTToken(f,ns,token);        /* Check NIST label */
    if (strlen(lab)>4) *(lab+4) = '\0';
    if (strcmp(lab,"NIST") !=0){
       HRError(6251,"GetNISTHeaderInfo: NIST header label missing");
       return -1;
    }
-   NISTSkipLine(f);
-   w->hdrSize = atoi(GetNISTToken(f,token)); /* header #bytes */
-   NISTSkipLine(f);
-   while (strcmp(GetNISTToken(f,token),"end_head")!=0){
+   NISTSkipLine(f,ns);
+   w->hdrSize = atoi(GetNISTToken(f,ns,token)); /* header #bytes */
+   NISTSkipLine(f,ns);
+   while (strcmp(GetNISTToken(f,ns,token),"end_head")!=0){
       if (strcmp(token,"sample_count") == 0)    /* objects */
-         nS = GetNISTIVal(f);
+         nS = GetNISTIVal(f,ns);
       else if (strcmp(token,"sample_rate") == 0)
-         sR = GetNISTIVal(f);
+         sR = GetNISTIVal(f,ns);
       else if (strcmp(token,"sample_n_bytes") == 0)
-         sS = GetNISTIVal(f);
+         sS = GetNISTIVal(f,ns);
       else if (strcmp(token,"sample_byte_format") == 0)
-         GetNISTSVal(f,byteFormat);
+         GetNISTSVal(f,ns,byteFormat);
       else if (strcmp(token,"sample_coding") == 0)
-         GetNISTSVal(f,sampCoding);
+         GetNISTSVal(f,ns,sampCoding);
       else if (strcmp(token,"channels_interleaved") == 0){
-         GetNISTSVal(f,buf);
+         GetNISTSVal(f,ns,buf);
          if (strcmp(buf,"TRUE") == 0)
             interleaved = TRUE;
       }
       else if (strcmp (token, "channel_count") == 0) {
-         cC = GetNISTIVal(f);
+         cC = GetNISTIVal(f,ns);
          if (cC==2)
             interleaved = TRUE;
          else if (cC!=1)
             HError(6251,"GetNISTHeaderInfo: channel count = %d in NIST header",cC);
       }
-      NISTSkipLine(f);
+      NISTSkipLine(f,ns);
    }
    if (sS < 1 || sS > 2){
       HRError(6251,"GetNISTHeaderInfo: Sample size = %d in NIST header",sS);
@@ -704,7 +707,7 @@ static long GetNISTHeaderInfo(FILE *f, Wave w, InputAction *ia)
       HRError(6251,"GetNISTHeaderInfo: unknown byte format in NIST header");
       return -1;
    }
-   ConsumeHeader(f,cCount,w->hdrSize);
+   ConsumeHeader(f,ns->count,w->hdrSize);
    return dataBytes;
 }
 
@@ -1 +0,0 @@
-../HTKTools/HCopy.c
\ No newline at end of file
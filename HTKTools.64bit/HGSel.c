@@ -0,0 +1,342 @@
+/* ----------------------------------------------------------- */
+/*                                                             */
+/*                          ___                                */
+/*                       |_| | |_/   SPEECH                    */
+/*                       | | | | \   RECOGNITION               */
+/*                       =========   SOFTWARE                  */
+/*                                                             */
+/*                                                             */
+/* ----------------------------------------------------------- */
+/*         Copyright: Microsoft Corporation                    */
+/*          1995-2000 Redmond, Washington USA                  */
+/*                    http://www.microsoft.com                 */
+/*                                                             */
+/*   Use of this software is governed by a License Agreement   */
+/*    ** See the file License for the Conditions of Use  **    */
+/*    **     This banner notice must not be removed      **    */
+/*                                                             */
+/* ----------------------------------------------------------- */
+/*       File: HGSel.c: Gaussian selection table generation    */
+/* ----------------------------------------------------------- */
+
+char *hgsel_version = "!HVER!HGSel:   3.4.1 [CUED 17/10/16]";
+char *hgsel_vc_id = "$Id: HGSel.c,v 1.1.1.1 2016/10/17 09:55:01 cz277 Exp $";
+
+/*
+   This program builds the Gaussian selection file used by HRec.
+   The means of the Gaussians in each stream of an HMM set are
+   clustered into a codebook, using the average Gaussian variance
+   as a diagonal Mahalanobis metric.  Each codeword gets a shortlist
+   of the Gaussians whose normalised distance
+
+         1/V sum_d (c[d]-mean[d])^2/var[d]
+
+   to the codeword is at most the threshold, plus the nearest
+   Gaussian of every state stream so that no state is left without
+   a component.  With HREC: GSELFILE set to the file, HVite only
+   evaluates the shortlists of the HREC: GSNBEST codewords nearest
+   to each frame and backs the other Gaussians off to the best evaluated one in
+   the state plus HREC: GSFLOOR.  The file is
+   tied to the Gaussian indexes of the HMM set, so it must be used
+   with the same HMM list and definitions it was built from.
+*/
+
+#include "HShell.h"
+#include "HMem.h"
+#include "HMath.h"
+#include "HSigP.h"
+#include "HAudio.h"
+#include "HWave.h"
+#include "HVQ.h"
+#include "HParm.h"
+#include "HLabel.h"
+#include "HANNet.h"
+#include "HModel.h"
+#include "HTrain.h"
+#include "HUtil.h"
+
+/* ------------------- Trace Flags & Vars ------------------------ */
+
+#define T_TOP     0001              /* basic progress reporting */
+#define T_CLUST   0002              /* dump clusters */
+#define T_LIST    0004              /* shortlist sizes */
+
+static int trace = 0;               /* trace level */
+static ConfParam *cParm[MAXGLOBS];   /* configuration parameters */
+static int nParm = 0;               /* total num params */
+
+/* ---------------------- Global Variables ----------------------- */
+
+#define DEF_NCLUST 256              /* default codebook size */
+#define DEF_THRESH 1.5              /* default shortlist threshold */
+
+static char *hmmListFn = NULL;      /* HMM list file */
+static char *hmmDir = NULL;         /* directory to look for hmm def files */
+static char *hmmExt = NULL;         /* hmm def file extension */
+static int cbSizes[SMAX];           /* codebook sizes, per stream */
+static float thresh = DEF_THRESH;   /* shortlist distance threshold */
+
+static HMMSet hset;                 /* the HMM set */
+static MemHeap hmmStack;            /* HMM definitions */
+static MemHeap cStack;              /* clusters and work space */
+
+/* ------------- Process Command Line and Check Data ------------ */
+
+/* SetConfParms: set conf parms relevant to HGSel  */
+void SetConfParms(void)
+{
+   int i;
+
+   nParm = GetConfig("HGSEL", TRUE, cParm, MAXGLOBS);
+   if (nParm>0) {
+      if (GetConfInt(cParm,nParm,"TRACE",&i)) trace = i;
+   }
+}
+
+void ReportUsage(void)
+{
+   printf("\nUSAGE: HGSel [options] hmmList gselFile\n\n" );
+   printf(" Option                                       Default\n\n");
+   printf(" -d s    Dir to find hmm definitions          current\n");
+   printf(" -n S N  Set codebook size for stream S to N  N=%d\n",DEF_NCLUST);
+   printf(" -t f    Set shortlist threshold to f         %.1f\n",DEF_THRESH);
+   printf(" -x s    Extension for hmm files              none\n");
+   PrintStdOpts("H");
+   printf("\n\n");
+}
+
+int main(int argc, char *argv[])
+{
+   char *gselfn, *s;
+   int i, stream;
+   void Initialise(void);
+   void BuildGSel(char *fn);
+
+   if(InitShell(argc,argv,hgsel_version,hgsel_vc_id)<SUCCESS)
+      HError(2500,"HGSel: InitShell failed");
+
+   InitMem();   InitLabel();
+   InitMath();  InitSigP();
+   InitWave();  InitAudio();
+   InitVQ();    InitModel();
+   InitANNet();
+   if(InitParm()<SUCCESS)
+      HError(2500,"HGSel: InitParm failed");
+   InitTrain(); InitUtil();
+
+   if (!InfoPrinted() && NumArgs() == 0)
+      ReportUsage();
+   if (NumArgs() == 0) Exit(0);
+   SetConfParms();
+   for (i=0; i<SMAX; i++) cbSizes[i] = DEF_NCLUST;
+
+   CreateHeap(&hmmStack,"HmmStore", MSTAK, 1, 1.0, 50000, 500000);
+   CreateHMMSet(&hset,&hmmStack,TRUE);
+   while (NextArg() == SWITCHARG) {
+      s = GetSwtArg();
+      if (strlen(s)!=1)
+         HError(2519,"HGSel: Bad switch %s; must be single letter",s);
+      switch(s[0]){
+      case 'd':
+         if (NextArg()!=STRINGARG)
+            HError(2519,"HGSel: HMM definition directory expected");
+         hmmDir = GetStrArg(); break;
+      case 'n':
+         if (NextArg() != INTARG)
+            HError(2519,"HGSel: Stream number expected");
+         stream = GetChkedInt(1,SMAX-1,s);
+         if (NextArg() != INTARG)
+            HError(2519,"HGSel: Codebook size expected");
+         cbSizes[stream]= GetChkedInt(1,32768,s);
+         break;
+      case 't':
+         thresh = GetChkedFlt(0.0,1.0E10,s); break;
+      case 'x':
+         if (NextArg()!=STRINGARG)
+            HError(2519,"HGSel: HMM file extension expected");
+         hmmExt = GetStrArg(); break;
+      case 'H':
+         if (NextArg() != STRINGARG)
+            HError(2519,"HGSel: MMF File name expected");
+         AddMMF(&hset,GetStrArg());
+         break;
+      case 'T':
+         trace = GetChkedInt(0,0100000,s);
+         break;
+      default:
+         HError(2519,"HGSel: Unknown switch %s",s);
+      }
+   }
+   if (NextArg()!=STRINGARG)
+      HError(2519,"HGSel: HMM list file name expected");
+   hmmListFn = GetStrArg();
+   if (NextArg()!=STRINGARG)
+      HError(2519,"HGSel: Gaussian selection file name expected");
+   gselfn = GetStrArg();
+   Initialise();
+   BuildGSel(gselfn);
+   Exit(0);
+   return (0);          /* never reached -- make compiler happy */
+}
+
+/* Initialise: load the HMM set */
+void Initialise(void)
+{
+   CreateHeap(&cStack,"Cluster Stack",MSTAK,1,0.5,100000,1000000);
+   if(MakeHMMSet(&hset,hmmListFn)<SUCCESS)
+      HError(2528,"Initialise: MakeHMMSet failed");
+   if(LoadHMMSet(&hset,hmmDir,hmmExt)<SUCCESS)
+      HError(2528,"Initialise: LoadHMMSet failed");
+   if (hset.hsKind!=PLAINHS && hset.hsKind!=SHAREDHS)
+      HError(2530,"Initialise: Only PLAINHS and SHAREDHS sets supported");
+   if (trace&T_TOP)
+      printf("Read %d physical / %d logical HMMs, %d Gaussians\n",
+             hset.numPhyHMM,hset.numLogHMM,hset.numMix);
+}
+
+/* ---------------- Building the Shortlists ---------------------- */
+
+/* Variance: return the variance of dimension i of Gaussian mp */
+static float Variance(MixPDF *mp, int i)
+{
+   switch (mp->ckind) {
+   case DIAGC:    return mp->cov.var[i];
+   case INVDIAGC: return 1.0/mp->cov.var[i];
+   default:
+      HError(2530,"Variance: Only DIAGC and INVDIAGC Gaussians supported");
+   }
+   return 0.0;
+}
+
+/* GaussDists: dist[mIdx] = normalised distance of Gaussians in stream s to c */
+static void GaussDists(MixPDF **gauss, int n, Vector c, float *dist)
+{
+   MixPDF *mp;
+   float x,sum;
+   int g,i,vSize;
+
+   vSize = VectorSize(c);
+   for (g=1; g<=n; g++) {
+      mp = gauss[g];
+      for (i=1,sum=0.0; i<=vSize; i++) {
+         x = c[i]-mp->mean[i];
+         sum += x*x/Variance(mp,i);
+      }
+      dist[mp->mIdx] = sum/vSize;
+   }
+}
+
+/* WriteVec: write vector v as text to f */
+static void WriteVec(FILE *f, Vector v)
+{
+   int i;
+
+   for (i=1; i<=VectorSize(v); i++)
+      fprintf(f," %e",v[i]);
+   fprintf(f,"\n");
+}
+
+/* BuildGSel: cluster the Gaussians of each stream and write shortlists to fn */
+void BuildGSel(char *fn)
+{
+   HMMScanState hss;
+   ClusterSet *cs;
+   Sequence seq;
+   Covariance dcov;
+   MixPDF **gauss,*mp;
+   Boolean *sel,isPipe;
+   float *dist,min;
+   int s,S,c,nc,g,n,i,m,best,nSel,nList;
+   long totList;
+   FILE *f;
+
+   S = hset.swidth[0];
+   if ((f = FOpen(fn,NoOFilter,&isPipe)) == NULL)
+      HError(2511,"BuildGSel: Cannot create Gaussian selection file %s",fn);
+   fprintf(f,"<NUMMIXES> %d <NUMSTREAMS> %d\n",hset.numMix,S);
+   gauss = (MixPDF **) New(&gstack,hset.numMix*sizeof(MixPDF *)); --gauss;
+   dist = (float *) New(&gstack,hset.numMix*sizeof(float)); --dist;
+   sel = (Boolean *) New(&gstack,hset.numMix*sizeof(Boolean)); --sel;
+   for (s=1; s<=S; s++) {
+      /* Collect the distinct usable Gaussians of stream s */
+      n = 0;
+      NewHMMScan(&hset,&hss);
+      while (GoNextMix(&hss,FALSE))
+         if (hss.s==s && hss.mp->mIdx>0 && hss.mp->mIdx<=hset.numMix)
+            gauss[++n] = hss.mp;
+      EndHMMScan(&hss);
+      if (n==0)
+         HError(2530,"BuildGSel: No Gaussians in stream %d",s);
+
+      /* Cluster their means with the average variance as metric */
+      seq = CreateSequence(&cStack,4096);
+      dcov.var = CreateVector(&cStack,hset.swidth[s]);
+      ZeroVector(dcov.var);
+      for (g=1; g<=n; g++) {
+         StoreItem(seq,(Ptr)gauss[g]->mean);
+         for (i=1; i<=hset.swidth[s]; i++)
+            dcov.var[i] += Variance(gauss[g],i)/n;
+      }
+      nc = (cbSizes[s]<n) ? cbSizes[s] : n;
+      cs = FlatCluster(&cStack,seq,nc,DIAGC,NULLC,dcov);
+      if (trace&T_CLUST) ShowClusterSet(cs);
+      fprintf(f,"<STREAM> %d <VECSIZE> %d <NUMCODES> %d\n",
+              s,hset.swidth[s],cs->numClust);
+      fprintf(f,"<VARIANCE> %d\n",hset.swidth[s]);
+      WriteVec(f,dcov.var);
+
+      /* Shortlist each codeword */
+      totList = 0;
+      for (c=1; c<=cs->numClust; c++) {
+         GaussDists(gauss,n,cs->cl[c].vCtr,dist);
+         for (i=1; i<=hset.numMix; i++) sel[i] = FALSE;
+         for (g=1; g<=n; g++)
+            if (dist[gauss[g]->mIdx] <= thresh)
+               sel[gauss[g]->mIdx] = TRUE;
+         /* Make sure every state keeps at least one component */
+         NewHMMScan(&hset,&hss);
+         while (GoNextState(&hss,FALSE)) {
+            StreamElem *ste = hss.si->pdf+s;
+            MixtureElem *me = ste->spdf.cpdf+1;
+            best = 0; min = 0.0; nSel = 0;
+            for (m=1; m<=ste->nMix; m++,me++) {
+               mp = me->mpdf;
+               if (mp->mIdx<=0 || mp->mIdx>hset.numMix) continue;
+               if (ste->nMix>1 && MixWeight(&hset,me->weight)<=MINMIX) continue;
+               if (sel[mp->mIdx]) nSel++;
+               if (best==0 || dist[mp->mIdx]<min) {
+                  best = mp->mIdx; min = dist[best];
+               }
+            }
+            if (nSel==0 && best>0) sel[best] = TRUE;
+         }
+         EndHMMScan(&hss);
+         for (i=1,nList=0; i<=hset.numMix; i++)
+            if (sel[i]) nList++;
+         fprintf(f,"<CODE> %d <MEAN> %d\n",c,hset.swidth[s]);
+         WriteVec(f,cs->cl[c].vCtr);
+         fprintf(f,"<LIST> %d\n",nList);
+         for (i=1,m=0; i<=hset.numMix; i++)
+            if (sel[i])
+               fprintf(f,"%d%c",i,(++m%20==0 || m==nList)?'\n':' ');
+         if (trace&T_LIST)
+            printf(" Stream %d codeword %d: %d Gaussians (%.1f%%)\n",
+                   s,c,nList,100.0*nList/n);
+         totList += nList;
+      }
+      if (trace&T_TOP)
+         printf("Stream %d: %d Gaussians, %d codewords, "
+                "average shortlist %.1f (%.1f%%)\n",s,n,cs->numClust,
+                (float)totList/cs->numClust,
+                100.0*totList/((float)n*cs->numClust));
+      ResetHeap(&cStack);
+   }
+   FClose(f,isPipe);
+   Dispose(&gstack,sel+1);
+   Dispose(&gstack,dist+1);
+   Dispose(&gstack,gauss+1);
+}
+
+/* ----------------------------------------------------------- */
+/*                      END:  HGSel.c                          */
+/* ----------------------------------------------------------- */
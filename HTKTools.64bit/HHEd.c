@@ -6355,6 +6355,8 @@ static FeaMix *CloneOneFeaMix(FeaMix *srcMix) {
         dstElem->feaMat = CreateNMatrix(hset->hmem, GetNBatchSamples(), dstElem->extDim);;
         if (dstElem->hisMat != NULL) {
             dstElem->hisMat = CreateNMatrix(hset->hmem, GetNBatchSamples(), dstElem->hisLen * dstElem->feaDim);
+            dstElem->hisHead = CreateIntVec(hset->hmem, GetNBatchSamples());
+            ZeroIntVec(dstElem->hisHead);
         }
     }
     dstMix->mixMat = CreateNMatrix(hset->hmem, GetNBatchSamples(), dstMix->mixDim); 
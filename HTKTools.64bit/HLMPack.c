@@ -0,0 +1,133 @@
+/* ----------------------------------------------------------- */
+/*                                                             */
+/*                          ___                                */
+/*                       |_| | |_/   SPEECH                    */
+/*                       | | | | \   RECOGNITION               */
+/*                       =========   SOFTWARE                  */
+/*                                                             */
+/*                                                             */
+/* ----------------------------------------------------------- */
+/*         Copyright: Microsoft Corporation                    */
+/*          1995-2000 Redmond, Washington USA                  */
+/*                    http://www.microsoft.com                 */
+/*                                                             */
+/*   Use of this software is governed by a License Agreement   */
+/*    ** See the file License for the Conditions of Use  **    */
+/*    **     This banner notice must not be removed      **    */
+/*                                                             */
+/* ----------------------------------------------------------- */
+/*     File: HLMPack.c:  Compile an N-gram LM to binary form  */
+/* ----------------------------------------------------------- */
+
+char *hlmpack_version = "!HVER!HLMPack:   3.4.1 [CUED 17/10/16]";
+char *hlmpack_vc_id = "$Id: HLMPack.c,v 1.1.1.1 2016/10/17 09:55:01 cz277 Exp $";
+
+/* The HLMPack program reads a back-off N-gram language model in ARPA
+   format and writes it in the binary form of HLM.  ReadLModel maps a
+   binary model straight into memory, so tools such as HLRescore and
+   HBuild load it in a fraction of the time needed to parse the text.
+   The probabilities can optionally be quantised to 8 or 16 bits.
+*/
+
+/* Trace Flags */
+#define T_TOP        0001    /* Top Level tracing */
+
+#include "HShell.h" /* HMM ToolKit Modules */
+#include "HMem.h"
+#include "HMath.h"
+#include "HWave.h"
+#include "HLabel.h"
+#include "HLM.h"
+
+static int trace     = 0;           /* Trace flags */
+static int qBits     = 0;           /* Bits per quantised probability */
+
+MemHeap lmHeap;
+
+/* ---------------- Configuration Parameters --------------------- */
+
+static ConfParam *cParm[MAXGLOBS];
+static int nParm = 0;            /* total num params */
+
+/* ---------------- Process Command Line ------------------------- */
+
+/* SetConfParms: set conf parms relevant to this tool */
+void SetConfParms(void)
+{
+   int i;
+
+   nParm = GetConfig("HLMPACK", TRUE, cParm, MAXGLOBS);
+   if (nParm>0){
+      if (GetConfInt(cParm,nParm,"TRACE",&i)) trace = i;
+   }
+}
+
+void ReportUsage(void)
+{
+   printf("\nUSAGE: HLMPack [options] inLM outLM\n\n");
+   printf(" Option                                       Default\n\n");
+   printf(" -q n    quantise probabilities to n bits     off\n");
+   PrintStdOpts("");
+   printf("\n\n");
+}
+
+int main(int argc, char *argv[])
+{
+   char *inFn,*outFn;
+   LModel *lm;
+   char  *s;
+
+   if(InitShell(argc,argv,hlmpack_version,hlmpack_vc_id)<SUCCESS)
+      HError(2700,"HLMPack: InitShell failed");
+   InitMem();   InitLabel();
+   InitMath();  InitWave();
+   InitLM();
+
+   CreateHeap(&lmHeap, "HLMPack Heap", MSTAK, 1, 0.0, 100000, LONG_MAX );
+
+   if (!InfoPrinted() && NumArgs() == 0)
+      ReportUsage();
+   if (NumArgs() == 0) Exit(0);
+   SetConfParms();
+
+   while (NextArg() == SWITCHARG) {
+      s = GetSwtArg();
+      if (strlen(s)!=1)
+         HError(2719,"HLMPack: Bad switch %s; must be single letter",s);
+      switch(s[0]){
+      case 'q':
+         qBits = GetChkedInt(0,16,s);
+         if (qBits!=0 && qBits!=8 && qBits!=16)
+            HError(2719,"HLMPack: Probabilities can only be quantised to 8 or 16 bits");
+         break;
+      case 'T':
+         trace = GetChkedInt(0,077,s); break;
+      default:
+         HError(2719,"HLMPack: Unknown switch %s",s);
+      }
+   }
+   if (NextArg()!=STRINGARG)
+      HError(2719,"HLMPack: Input LM file name expected");
+   inFn = GetStrArg();
+   if (NextArg()!=STRINGARG)
+      HError(2719,"HLMPack: Output LM file name expected");
+   outFn = GetStrArg();
+   if (NextArg()!=NOARG)
+      HError(2719,"HLMPack: Unexpected argument");
+
+   if (trace&T_TOP)
+      printf("Reading LM from %s\n",inFn),fflush(stdout);
+   lm = ReadLModel(&lmHeap,inFn);
+   if (lm->type!=boNGram)
+      HError(2730,"HLMPack: %s is not a back-off N-gram",inFn);
+   if (trace&T_TOP)
+      printf("Writing %s LM to %s\n",(qBits>0)?"quantised binary":"binary",outFn);
+   WriteBinLModel(lm,outFn,qBits);
+
+   Exit(0);
+   return (0);          /* never reached -- make compiler happy */
+}
+
+/* ----------------------------------------------------------- */
+/*                      END:  HLMPack.c                        */
+/* ----------------------------------------------------------- */
@@ -1 +0,0 @@
-../HTKTools/HLRescore.c
\ No newline at end of file
@@ -0,0 +1,197 @@
+/* ----------------------------------------------------------- */
+/*                                                             */
+/*                          ___                                */
+/*                       |_| | |_/   SPEECH                    */
+/*                       | | | | \   RECOGNITION               */
+/*                       =========   SOFTWARE                  */
+/*                                                             */
+/*                                                             */
+/* ----------------------------------------------------------- */
+/*         Copyright: Microsoft Corporation                    */
+/*          1995-2000 Redmond, Washington USA                  */
+/*                    http://www.microsoft.com                 */
+/*                                                             */
+/*   Use of this software is governed by a License Agreement   */
+/*    ** See the file License for the Conditions of Use  **    */
+/*    **     This banner notice must not be removed      **    */
+/*                                                             */
+/* ----------------------------------------------------------- */
+/*     File: HLatPack.c:  Convert lattices to binary form      */
+/* ----------------------------------------------------------- */
+
+char *hlatpack_version = "!HVER!HLatPack:   3.4.1 [CUED 17/10/16]";
+char *hlatpack_vc_id = "$Id: HLatPack.c,v 1.1.1.1 2016/10/17 09:55:01 cz277 Exp $";
+
+/* The HLatPack program reads SLF lattices and packs them into a
+   lattice archive, keyed by their file names as given, or with -l
+   writes each one as a binary lattice file in a directory.  Both
+   forms are loaded by HNet without any parsing, the archive when
+   HNET: LATARCHIVE names it and the files by ReadLattice.  The
+   archive keys must match the names the loading tools build from
+   their lattice directories and extension.
+*/
+
+/* Trace Flags */
+#define T_TOP        0001    /* Top Level tracing */
+
+#include "HShell.h" /* HMM ToolKit Modules */
+#include "HMem.h"
+#include "HMath.h"
+#include "HWave.h"
+#include "HLabel.h"
+#include "HAudio.h"
+#include "HParm.h"
+#include "HANNet.h"
+#include "HModel.h"
+#include "HUtil.h"
+#include "HDict.h"
+#include "HNet.h"
+
+static int trace     = 0;           /* Trace flags */
+static char *dictFn  = NULL;        /* Words must be in this dictionary */
+static char *outDir  = NULL;        /* Write binary files here, not an archive */
+
+static Vocab vocab;
+static MemHeap latHeap;
+
+/* ---------------- Configuration Parameters --------------------- */
+
+static ConfParam *cParm[MAXGLOBS];
+static int nParm = 0;            /* total num params */
+
+/* ---------------- Process Command Line ------------------------- */
+
+/* SetConfParms: set conf parms relevant to this tool */
+void SetConfParms(void)
+{
+   int i;
+
+   nParm = GetConfig("HLATPACK", TRUE, cParm, MAXGLOBS);
+   if (nParm>0){
+      if (GetConfInt(cParm,nParm,"TRACE",&i)) trace = i;
+   }
+}
+
+void ReportUsage(void)
+{
+   printf("\nUSAGE: HLatPack [options] archiveFile latFiles...\n");
+   printf("       HLatPack [options] -l dir latFiles...\n\n");
+   printf(" Option                                       Default\n\n");
+   printf(" -d s    check words against dictionary s     off\n");
+   printf(" -l s    write binary lattice files to dir s  off\n");
+   PrintStdOpts("S");
+   printf("\n\n");
+}
+
+/* ReadLat: read lattice file fn on latHeap */
+Lattice *ReadLat(char *fn)
+{
+   FILE *f;
+   Boolean isPipe;
+   Lattice *lat;
+
+   if ((f=FOpen(fn,NetFilter,&isPipe))==NULL)
+      HError(2810,"HLatPack: Cannot open lattice file %s",fn);
+   if ((lat=ReadLattice(f,&latHeap,&vocab,FALSE,dictFn==NULL))==NULL)
+      HError(2813,"HLatPack: Cannot read lattice %s",fn);
+   FClose(f,isPipe);
+   return(lat);
+}
+
+/* WriteBinLat: write lat as a binary lattice file to outDir */
+void WriteBinLat(Lattice *lat,char *fn)
+{
+   FILE *f;
+   Boolean isPipe;
+   char name[MAXFNAMELEN],outFn[MAXFNAMELEN];
+
+   MakeFN(NameOf(fn,name),outDir,NULL,outFn);
+   if ((f=FOpen(outFn,NetOFilter,&isPipe))==NULL)
+      HError(2811,"HLatPack: Cannot create lattice file %s",outFn);
+   if (WriteLattice(lat,f,HLAT_BLAT)<SUCCESS)
+      HError(2814,"HLatPack: Cannot write lattice %s",outFn);
+   FClose(f,isPipe);
+}
+
+int main(int argc, char *argv[])
+{
+   char *arcFn=NULL,*latFn;
+   LatArchive *arc=NULL;
+   Lattice *lat;
+   char  *s;
+   int nLat=0;
+
+   if(InitShell(argc,argv,hlatpack_version,hlatpack_vc_id)<SUCCESS)
+      HError(2800,"HLatPack: InitShell failed");
+   InitMem();   InitMath();
+   InitWave();  InitLabel();
+   InitAudio();
+   if(InitParm()<SUCCESS)
+      HError(2800,"HLatPack: InitParm failed");
+   InitModel(); InitUtil();
+   InitDict();  InitNet();
+
+   CreateHeap(&latHeap, "HLatPack Heap", MSTAK, 1, 1.0, 100000, LONG_MAX );
+
+   if (!InfoPrinted() && NumArgs() == 0)
+      ReportUsage();
+   if (NumArgs() == 0) Exit(0);
+   SetConfParms();
+
+   while (NextArg() == SWITCHARG) {
+      s = GetSwtArg();
+      if (strlen(s)!=1)
+         HError(2819,"HLatPack: Bad switch %s; must be single letter",s);
+      switch(s[0]){
+      case 'd':
+         if (NextArg()!=STRINGARG)
+            HError(2819,"HLatPack: Dictionary file name expected");
+         dictFn = GetStrArg(); break;
+      case 'l':
+         if (NextArg()!=STRINGARG)
+            HError(2819,"HLatPack: Output lattice directory expected");
+         outDir = GetStrArg(); break;
+      case 'T':
+         trace = GetChkedInt(0,077,s); break;
+      default:
+         HError(2819,"HLatPack: Unknown switch %s",s);
+      }
+   }
+   InitVocab(&vocab);
+   if (dictFn!=NULL && ReadDict(dictFn,&vocab)<SUCCESS)
+      HError(2810,"HLatPack: ReadDict failed");
+   if (outDir==NULL) {
+      if (NextArg()!=STRINGARG)
+         HError(2819,"HLatPack: Archive file name expected");
+      arcFn = GetStrArg();
+      arc = CreateLatArchive(arcFn);
+   }
+
+   while (NumArgs()>0) {
+      if (NextArg()!=STRINGARG)
+         HError(2819,"HLatPack: Lattice file name expected");
+      latFn = GetStrArg();
+      if (trace&T_TOP)
+         printf("Packing %s\n",latFn),fflush(stdout);
+      lat = ReadLat(latFn);
+      if (arc!=NULL) {
+         if (AddLatArchive(arc,latFn,lat)<SUCCESS)
+            HError(2814,"HLatPack: Cannot add lattice %s to %s",latFn,arcFn);
+      }
+      else
+         WriteBinLat(lat,latFn);
+      ResetHeap(&latHeap);
+      nLat++;
+   }
+   if (arc!=NULL)
+      CloseLatArchive(arc);
+   if (trace&T_TOP)
+      printf("Packed %d lattices\n",nLat);
+
+   Exit(0);
+   return (0);          /* never reached -- make compiler happy */
+}
+
+/* ----------------------------------------------------------- */
+/*                      END:  HLatPack.c                       */
+/* ----------------------------------------------------------- */
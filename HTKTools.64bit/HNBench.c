@@ -0,0 +1,595 @@
+/* ----------------------------------------------------------- */
+/*                                                             */
+/*                          ___                                */
+/*                       |_| | |_/   SPEECH                    */
+/*                       | | | | \   RECOGNITION               */
+/*                       =========   SOFTWARE                  */
+/*                                                             */
+/*                                                             */
+/* ----------------------------------------------------------- */
+/* developed at:                                               */
+/*                                                             */
+/*      Machine Intelligence Laboratory                        */
+/*      Cambridge University Engineering Department            */
+/*      http://mil.eng.cam.ac.uk/                              */
+/*                                                             */
+/* ----------------------------------------------------------- */
+/*         Copyright: Microsoft Corporation                    */
+/*          1995-2000 Redmond, Washington USA                  */
+/*                    http://www.microsoft.com                 */
+/*                                                             */
+/*              2002  Cambridge University                     */
+/*                    Engineering Department                   */
+/*                                                             */
+/*   Use of this software is governed by a License Agreement   */
+/*    ** See the file License for the Conditions of Use  **    */
+/*    **     This banner notice must not be removed      **    */
+/*                                                             */
+/* ----------------------------------------------------------- */
+/*    File: HNBench.c: ANN math kernel benchmarking program    */
+/* ----------------------------------------------------------- */
+
+char *hnbench_version = "!HVER!HNBench:   3.4.1 [CUED 17/10/16]";
+char *hnbench_vc_id = "$Id: HNBench.c,v 1.1.1.1 2016/10/17 09:55:01 cz277 Exp $";
+
+/*
+    This program checks the host kernel sets of the NMatrix routines
+    (see NKernSet in HMath) against the plain reference kernels, or
+    against libm in double for the activations, and reports their
+    speed.  The LAYER group compares the fused bias + GEMM + activation
+    kernel of each set with the separate passes of the same set.
+*/
+
+#include "cfgs.h"
+#include "HShell.h"
+#include "HMem.h"
+#include "HMath.h"
+#include "HCPU.h"
+
+#include <math.h>
+#include <stddef.h>
+#include <sys/time.h>
+
+/* -------------------------- Trace Flags & Vars ------------------------ */
+
+/* Trace Flags */
+#define T_TOP   0001    /* Top level tracing */
+static int trace = 0;
+
+/* -------------------------- Global Variables etc ---------------------- */
+
+#define MAX(a, b) ((a)>(b)?(a):(b))
+
+static ConfParam *cParm[MAXGLOBS];      /* configuration parameters */
+static int nParm = 0;                   /* total num params */
+
+static int gemmM = 2048;                /* rows of C, e.g. the number of nodes */
+static int gemmN = 256;                 /* columns of C, e.g. the batch size */
+static int gemmK = 2048;                /* inner dimension, e.g. the input dimension */
+static int actRow = 256;                /* rows of the activation input, e.g. the batch size */
+static int actCol = 2048;               /* columns of the activation input, e.g. the number of nodes */
+static char *benchGroup = NULL;         /* the only group of kernels to benchmark */
+static int nRepeat = 3;                 /* times each kernel is timed */
+static Boolean optRefKern = TRUE;       /* also time the reference kernels */
+static char *benchSet = NULL;           /* the only kernel set to benchmark */
+
+/* the kernel sets benchmarked against REF, when available */
+static char *benchSets[] = {"CPU", "SSE", "AVX2", "AVX512", "MKL", NULL};
+
+static MemHeap benchHeap;               /* the heap for the test matrices */
+
+/* ------------------------------ Initialisation ------------------------ */
+
+void SetConfParms(void)
+{
+    int intVal;
+
+    nParm = GetConfig("HNBENCH", TRUE, cParm, MAXGLOBS);
+    if (nParm > 0) {
+        if (GetConfInt(cParm, nParm, "TRACE", &intVal)) {
+            trace = intVal;
+        }
+    }
+}
+
+void ReportUsage(void)
+{
+    printf("\nUSAGE: HNBench [options]\n\n");
+    printf(" Option                                       Default\n\n");
+    printf(" -a i j    Activation input rows and columns  256 2048\n");
+    printf(" -b s      Only benchmark group s             all\n");
+    printf("           (GEMM, ACT or LAYER)\n");
+    printf(" -g i j k  GEMM sizes m, n and k              2048 256 2048\n");
+    printf(" -n        Skip the reference kernels         off\n");
+    printf(" -r i      Repeat each kernel i times         3\n");
+    printf(" -s s      Only benchmark kernel set s        all\n");
+    PrintStdOpts("");
+    printf("\n\n");
+}
+
+/* ---------------------------- Utilities ------------------------------- */
+
+/* the wall clock time in seconds; the kernels may be multi-threaded */
+static double WallTime(void)
+{
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec * 1.0e-6;
+}
+
+static void FillRandom(NFloat *seg, size_t len)
+{
+    size_t i;
+
+    for (i = 0; i < len; ++i) {
+        seg[i] = RandomValue() - 0.5;
+    }
+}
+
+/* the largest absolute and relative differences between two segments */
+static void CompareSegs(NFloat *ref, NFloat *hyp, size_t len, double *maxAbs, double *maxRel)
+{
+    size_t i;
+    double diff, refMax = 0.0;
+
+    *maxAbs = 0.0;
+    for (i = 0; i < len; ++i) {
+        diff = fabs((double) ref[i] - (double) hyp[i]);
+        if (diff > *maxAbs) {
+            *maxAbs = diff;
+        }
+        if (fabs((double) ref[i]) > refMax) {
+            refMax = fabs((double) ref[i]);
+        }
+    }
+    /* relative to the largest reference value, as near zero entries have no meaningful relative error */
+    *maxRel = *maxAbs / MAX(refMax, 1.0e-30);
+}
+
+/* ------------------------------ GEMM ---------------------------------- */
+
+/* time one GEMM kernel; returns the best time of nRepeat runs */
+static double TimeGemm(NGemmFunc func, int m, int n, int k, NFloat *A, NFloat *B, NFloat *C0, NFloat *C)
+{
+    int i;
+    double st, cost, best = -1.0;
+
+    for (i = 0; i < nRepeat; ++i) {
+        memcpy(C, C0, sizeof(NFloat) * m * n);
+        st = WallTime();
+        func(m, n, k, 1.0, A, B, 0.5, C);
+        cost = WallTime() - st;
+        if (best < 0.0 || cost < best) {
+            best = cost;
+        }
+    }
+    return best;
+}
+
+/* time one transposition variant of the GEMM in REF and then in each kernel set */
+static void BenchGemmKind(char *kind, size_t off, int m, int n, int k, NFloat *A, NFloat *B, NFloat *C0, NFloat *Cref, NFloat *Cset)
+{
+    int i;
+    double flops, refTime = 0.0, setTime, maxAbs = 0.0, maxRel = 0.0;
+    NKernSet kset;
+    NGemmFunc func;
+
+    flops = 2.0 * m * n * k;
+    printf(" %s:\n", kind);
+    if (optRefKern) {
+        LoadNKernSet("REF", &kset);
+        memcpy(&func, (char *) &kset + off, sizeof(NGemmFunc));
+        refTime = TimeGemm(func, m, n, k, A, B, C0, Cref);
+        printf("  %-6s %8.4fs %7.2f GFLOPS\n", "REF", refTime, flops / refTime * 1.0e-9);
+    }
+    for (i = 0; benchSets[i] != NULL; ++i) {
+        if (benchSet != NULL && strcmp(benchSet, benchSets[i]) != 0) {
+            continue;
+        }
+        if (!LoadNKernSet(benchSets[i], &kset)) {
+            printf("  %-6s not available\n", benchSets[i]);
+            continue;
+        }
+        memcpy(&func, (char *) &kset + off, sizeof(NGemmFunc));
+        setTime = TimeGemm(func, m, n, k, A, B, C0, Cset);
+        printf("  %-6s %8.4fs %7.2f GFLOPS", kset.name, setTime, flops / setTime * 1.0e-9);
+        if (optRefKern) {
+            CompareSegs(Cref, Cset, (size_t) m * n, &maxAbs, &maxRel);
+            printf(", speedup %.1fx, max abs err %.3e, max rel err %.3e", refTime / setTime, maxAbs, maxRel);
+        }
+        printf("\n");
+        fflush(stdout);
+    }
+}
+
+/* check and time the three transposition variants of the GEMM */
+static void BenchGemm(void)
+{
+    int m = gemmM, n = gemmN, k = gemmK;
+    NFloat *A, *B, *Bt, *At, *C0, *Cref, *Cset;
+
+    A = (NFloat *) New(&benchHeap, sizeof(NFloat) * m * k);
+    At = (NFloat *) New(&benchHeap, sizeof(NFloat) * k * m);
+    B = (NFloat *) New(&benchHeap, sizeof(NFloat) * k * n);
+    Bt = (NFloat *) New(&benchHeap, sizeof(NFloat) * n * k);
+    C0 = (NFloat *) New(&benchHeap, sizeof(NFloat) * m * n);
+    Cref = (NFloat *) New(&benchHeap, sizeof(NFloat) * m * n);
+    Cset = (NFloat *) New(&benchHeap, sizeof(NFloat) * m * n);
+    FillRandom(A, (size_t) m * k);
+    FillRandom(At, (size_t) k * m);
+    FillRandom(B, (size_t) k * n);
+    FillRandom(Bt, (size_t) n * k);
+    FillRandom(C0, (size_t) m * n);
+
+    printf("GEMM m = %d, n = %d, k = %d, SIMD = %s, threads = %d\n", m, n, k, CPUSIMDKind2Str(GetCPUSIMDKind()), GetCPUThreadNum());
+    BenchGemmKind("NN", offsetof(NKernSet, nnGemm), m, n, k, A, B, C0, Cref, Cset);
+    BenchGemmKind("NT", offsetof(NKernSet, ntGemm), m, n, k, A, Bt, C0, Cref, Cset);
+    BenchGemmKind("TN", offsetof(NKernSet, tnGemm), m, n, k, At, B, C0, Cref, Cset);
+
+    ResetHeap(&benchHeap);
+}
+
+/* --------------------------- Activations ------------------------------ */
+
+typedef enum _ActBenchKind {
+    SIGMOIDBK, DSIGMOIDBK, DSIGMOIDMULBK, TANHBK, DTANHBK, DTANHMULBK,
+    SOFTRELBK, DSOFTRELBK, DSOFTRELMULBK, SOFTMAXBK
+} ActBenchKind;
+
+typedef struct _ActBench {
+    char *name;                         /* the kernel name, as in NKERNOVERRIDE */
+    ActBenchKind kind;
+    size_t off;                         /* the entry in NKernSet */
+    double lo, hi;                      /* the range of the inputs */
+} ActBench;
+
+static ActBench actBenches[] = {
+    {"SIGMOIDACT", SIGMOIDBK, offsetof(NKernSet, sigmoidAct), -20.0, 20.0},
+    {"DSIGMOIDACT", DSIGMOIDBK, offsetof(NKernSet, dSigmoidAct), 0.0, 1.0},
+    {"DSIGMOIDACTMUL", DSIGMOIDMULBK, offsetof(NKernSet, dSigmoidActMul), 0.0, 1.0},
+    {"TANHACT", TANHBK, offsetof(NKernSet, tanHAct), -10.0, 10.0},
+    {"DTANHACT", DTANHBK, offsetof(NKernSet, dTanHAct), -1.0, 1.0},
+    {"DTANHACTMUL", DTANHMULBK, offsetof(NKernSet, dTanHActMul), -1.0, 1.0},
+    {"SOFTRELACT", SOFTRELBK, offsetof(NKernSet, softReLAct), -20.0, 20.0},
+    {"DSOFTRELACT", DSOFTRELBK, offsetof(NKernSet, dSoftReLAct), 0.0, 20.0},
+    {"DSOFTRELACTMUL", DSOFTRELMULBK, offsetof(NKernSet, dSoftReLActMul), 0.0, 20.0},
+    {"SOFTMAXACT", SOFTMAXBK, offsetof(NKernSet, softmaxAct), -20.0, 20.0},
+    {NULL, SIGMOIDBK, 0, 0.0, 0.0}
+};
+
+/* the exact result of an activation kernel, evaluated with libm in double;
+   dy is the gradient multiplied by the fused back-propagation kernels */
+static void ActBenchRef(ActBenchKind kind, NFloat *x, NFloat *dy, int row, int col, double *ref)
+{
+    int i, j;
+    size_t k, len = (size_t) row * col;
+    double maxVal, sum;
+
+    for (k = 0; k < len; ++k) {
+        switch (kind) {
+            case SIGMOIDBK:
+                ref[k] = 1.0 / (1.0 + exp(-x[k]));
+                break;
+            case DSIGMOIDBK:
+                ref[k] = x[k] * (1.0 - x[k]);
+                break;
+            case DSIGMOIDMULBK:
+                ref[k] = dy[k] * x[k] * (1.0 - x[k]);
+                break;
+            case TANHBK:
+                ref[k] = tanh(x[k]);
+                break;
+            case DTANHBK:
+                ref[k] = 1.0 - (double) x[k] * x[k];
+                break;
+            case DTANHMULBK:
+                ref[k] = dy[k] * (1.0 - (double) x[k] * x[k]);
+                break;
+            case SOFTRELBK:
+                ref[k] = log1p(exp(x[k]));
+                break;
+            case DSOFTRELBK:
+                ref[k] = -expm1(-x[k]);
+                break;
+            case DSOFTRELMULBK:
+                ref[k] = -dy[k] * expm1(-x[k]);
+                break;
+            case SOFTMAXBK:
+                break;
+        }
+    }
+    if (kind == SOFTMAXBK) {
+        for (i = 0; i < row; ++i) {
+            maxVal = x[i * col];
+            for (j = 1; j < col; ++j) {
+                maxVal = MAX(maxVal, x[i * col + j]);
+            }
+            sum = 0.0;
+            for (j = 0; j < col; ++j) {
+                ref[i * col + j] = exp(x[i * col + j] - maxVal);
+                sum += ref[i * col + j];
+            }
+            for (j = 0; j < col; ++j) {
+                ref[i * col + j] /= sum;
+            }
+        }
+    }
+}
+
+/* the largest absolute and element-wise relative errors against the exact result */
+static void CompareActSegs(double *ref, NFloat *hyp, size_t len, double *maxAbs, double *maxRel)
+{
+    size_t i;
+    double diff;
+
+    *maxAbs = *maxRel = 0.0;
+    for (i = 0; i < len; ++i) {
+        diff = fabs(ref[i] - (double) hyp[i]);
+        *maxAbs = MAX(*maxAbs, diff);
+        if (fabs(ref[i]) > 1.0e-30) {
+            *maxRel = MAX(*maxRel, diff / fabs(ref[i]));
+        }
+    }
+}
+
+/* run one activation kernel; the fused kernels update dst in place, so it
+   is restored from dy each time; returns the best time of nRepeat runs */
+static double TimeAct(NKernSet *kset, ActBench *ab, int row, int col, NFloat *x, NFloat *dy, NFloat *dst)
+{
+    int i;
+    size_t len = (size_t) row * col;
+    double st, cost, best = -1.0;
+    NSegFunc segFunc;
+
+    memcpy(&segFunc, (char *) kset + ab->off, sizeof(NSegFunc));
+    for (i = 0; i < nRepeat; ++i) {
+        memcpy(dst, dy, sizeof(NFloat) * len);
+        st = WallTime();
+        if (ab->kind == SOFTMAXBK) {
+            kset->softmaxAct(x, row, col, dst);
+        }
+        else {
+            segFunc(x, (int) len, dst);
+        }
+        cost = WallTime() - st;
+        if (best < 0.0 || cost < best) {
+            best = cost;
+        }
+    }
+    return best;
+}
+
+/* check and time the activation kernels of each kernel set against libm */
+static void BenchAct(void)
+{
+    int i, row = actRow, col = actCol;
+    size_t k, len = (size_t) row * col;
+    double *ref, setTime, refTime = 0.0, maxAbs, maxRel;
+    NFloat *x, *dy, *dst;
+    NKernSet kset;
+    ActBench *ab;
+
+    x = (NFloat *) New(&benchHeap, sizeof(NFloat) * len);
+    dy = (NFloat *) New(&benchHeap, sizeof(NFloat) * len);
+    dst = (NFloat *) New(&benchHeap, sizeof(NFloat) * len);
+    ref = (double *) New(&benchHeap, sizeof(double) * len);
+    FillRandom(dy, len);
+
+    printf("Activations %d x %d, SIMD = %s\n", row, col, CPUSIMDKind2Str(GetCPUSIMDKind()));
+    for (ab = actBenches; ab->name != NULL; ++ab) {
+        for (k = 0; k < len; ++k) {
+            x[k] = ab->lo + (ab->hi - ab->lo) * RandomValue();
+        }
+        ActBenchRef(ab->kind, x, dy, row, col, ref);
+        printf(" %s:\n", ab->name);
+        for (i = -1; i < 0 || benchSets[i] != NULL; ++i) {
+            /* i = -1 is the REF set */
+            if (i >= 0 && benchSet != NULL && strcmp(benchSet, benchSets[i]) != 0) {
+                continue;
+            }
+            if (i < 0 && !optRefKern) {
+                continue;
+            }
+            if (!LoadNKernSet(i < 0? "REF": benchSets[i], &kset)) {
+                printf("  %-6s not available\n", benchSets[i]);
+                continue;
+            }
+            setTime = TimeAct(&kset, ab, row, col, x, dy, dst);
+            CompareActSegs(ref, dst, len, &maxAbs, &maxRel);
+            printf("  %-6s %8.4fs %7.2f Gelem/s", kset.name, setTime, len / setTime * 1.0e-9);
+            if (i < 0) {
+                refTime = setTime;
+            }
+            else if (optRefKern) {
+                printf(", speedup %.1fx", refTime / setTime);
+            }
+            printf(", max abs err %.3e, max rel err %.3e\n", maxAbs, maxRel);
+            fflush(stdout);
+        }
+    }
+
+    ResetHeap(&benchHeap);
+}
+
+/* ----------------------------- Layers --------------------------------- */
+
+typedef struct _LayerBench {
+    char *name;
+    size_t off;                         /* the activation in NKernSet, or 0 for none */
+    Boolean rowWise;                    /* an NRowFunc over each column of C */
+} LayerBench;
+
+static LayerBench layerBenches[] = {
+    {"LINEAR", 0, FALSE},
+    {"RELU", offsetof(NKernSet, reLAct), FALSE},
+    {"SIGMOID", offsetof(NKernSet, sigmoidAct), FALSE},
+    {"SOFTMAX", offsetof(NKernSet, softmaxAct), TRUE},
+    {"SOFTRELU", offsetof(NKernSet, softReLAct), FALSE},
+    {"SOFTSIGN", offsetof(NKernSet, softSignAct), FALSE},
+    {"TANH", offsetof(NKernSet, tanHAct), FALSE},
+    {NULL, 0, FALSE}
+};
+
+/* time the forward pass of one layer, C = act(A^T * B + bias), either
+   fused or as the three passes ForwardPropBatch used to make; returns
+   the best time of nRepeat runs */
+static double TimeLayer(NKernSet *kset, LayerBench *lb, Boolean fused, int m, int n, int k, NFloat *A, NFloat *B, NFloat *bias, NFloat *C)
+{
+    int i;
+    double st, cost, best = -1.0;
+    NSegFunc act = NULL;
+    NRowFunc rowAct = NULL;
+
+    if (lb->rowWise) {
+        rowAct = kset->softmaxAct;
+    }
+    else if (lb->off > 0) {
+        memcpy(&act, (char *) kset + lb->off, sizeof(NSegFunc));
+    }
+    for (i = 0; i < nRepeat; ++i) {
+        st = WallTime();
+        if (fused) {
+            kset->tnGemmBiasAct(m, n, k, A, B, bias, act, rowAct, C);
+        }
+        else {
+            kset->dupSeg(bias, m, C, n);
+            kset->tnGemm(m, n, k, 1.0, A, B, 1.0, C);
+            if (act != NULL) {
+                act(C, m * n, C);
+            }
+            if (rowAct != NULL) {
+                rowAct(C, n, m, C);
+            }
+        }
+        cost = WallTime() - st;
+        if (best < 0.0 || cost < best) {
+            best = cost;
+        }
+    }
+    return best;
+}
+
+/* compare the fused layer kernel of each set with its unfused passes */
+static void BenchLayer(void)
+{
+    int i, m = gemmM, n = gemmN, k = gemmK;
+    double sepTime, fusedTime, maxAbs, maxRel;
+    NFloat *A, *B, *bias, *Csep, *Cfused;
+    NKernSet kset;
+    LayerBench *lb;
+
+    A = (NFloat *) New(&benchHeap, sizeof(NFloat) * k * m);
+    B = (NFloat *) New(&benchHeap, sizeof(NFloat) * k * n);
+    bias = (NFloat *) New(&benchHeap, sizeof(NFloat) * m);
+    Csep = (NFloat *) New(&benchHeap, sizeof(NFloat) * m * n);
+    Cfused = (NFloat *) New(&benchHeap, sizeof(NFloat) * m * n);
+    FillRandom(A, (size_t) k * m);
+    FillRandom(B, (size_t) k * n);
+    FillRandom(bias, (size_t) m);
+
+    printf("Layer nodes = %d, batch = %d, inputs = %d, SIMD = %s, threads = %d\n", m, n, k, CPUSIMDKind2Str(GetCPUSIMDKind()), GetCPUThreadNum());
+    for (lb = layerBenches; lb->name != NULL; ++lb) {
+        printf(" %s:\n", lb->name);
+        for (i = 0; benchSets[i] != NULL; ++i) {
+            if (benchSet != NULL && strcmp(benchSet, benchSets[i]) != 0) {
+                continue;
+            }
+            if (!LoadNKernSet(benchSets[i], &kset)) {
+                printf("  %-6s not available\n", benchSets[i]);
+                continue;
+            }
+            sepTime = TimeLayer(&kset, lb, FALSE, m, n, k, A, B, bias, Csep);
+            fusedTime = TimeLayer(&kset, lb, TRUE, m, n, k, A, B, bias, Cfused);
+            CompareSegs(Csep, Cfused, (size_t) m * n, &maxAbs, &maxRel);
+            printf("  %-6s unfused %8.4fs, fused %8.4fs, speedup %.2fx, max abs diff %.3e\n", kset.name, sepTime, fusedTime, sepTime / fusedTime, maxAbs);
+            fflush(stdout);
+        }
+    }
+
+    ResetHeap(&benchHeap);
+}
+
+/* ------------------------------ Main ---------------------------------- */
+
+int main(int argc, char *argv[])
+{
+    char *str;
+
+    if (InitShell(argc, argv, hnbench_version, hnbench_vc_id) < SUCCESS) {
+        HError(9999, "HNBench: InitShell failed");
+    }
+    InitMem();
+    InitMath();
+    InitCPU();
+
+    if (!InfoPrinted() && NumArgs() == 0) {
+        ReportUsage();
+    }
+    SetConfParms();
+
+    while (NextArg() == SWITCHARG) {
+        str = GetSwtArg();
+        switch (str[0]) {
+            case 'a':
+                actRow = GetChkedInt(1, INT_MAX, str);
+                actCol = GetChkedInt(1, INT_MAX, str);
+                break;
+            case 'b':
+                if (NextArg() != STRINGARG) {
+                    HError(9999, "HNBench: Benchmark group name expected");
+                }
+                benchGroup = GetStrArg();
+                break;
+            case 'g':
+                gemmM = GetChkedInt(1, INT_MAX, str);
+                gemmN = GetChkedInt(1, INT_MAX, str);
+                gemmK = GetChkedInt(1, INT_MAX, str);
+                break;
+            case 'n':
+                optRefKern = FALSE;
+                break;
+            case 'r':
+                nRepeat = GetChkedInt(1, INT_MAX, str);
+                break;
+            case 's':
+                if (NextArg() != STRINGARG) {
+                    HError(9999, "HNBench: Kernel set name expected");
+                }
+                benchSet = GetStrArg();
+                break;
+            case 'T':
+                trace = GetChkedInt(0, 0100000, str);
+                break;
+            default:
+                HError(9999, "HNBench: Unknown switch %s", str);
+        }
+    }
+    if (NextArg() != NOARG) {
+        HError(9999, "HNBench: Unexpected extra argument");
+    }
+
+    CreateHeap(&benchHeap, "bench heap", MSTAK, 1, 0.0, 100000000, ULONG_MAX);
+    StartCPU();
+    RandInit(12345);
+
+    if (benchGroup == NULL || strcmp(benchGroup, "GEMM") == 0) {
+        BenchGemm();
+    }
+    if (benchGroup == NULL || strcmp(benchGroup, "ACT") == 0) {
+        BenchAct();
+    }
+    if (benchGroup == NULL || strcmp(benchGroup, "LAYER") == 0) {
+        BenchLayer();
+    }
+
+    DeleteHeap(&benchHeap);
+    StopCPU();
+
+    Exit(0);
+    return 0;
+}
+
+/* ----------------------------------------------------------- */
+/*                      END:  HNBench.c                        */
+/* ----------------------------------------------------------- */
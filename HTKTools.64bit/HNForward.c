@@ -46,6 +46,7 @@ char *hnforward_vc_id = "$Id: HNForward.c,v 1.1.1.1 2006/10/11 09:55:01 cz277 Ex
 #include "HShell.h"
 #include "HMem.h"
 #include "HMath.h"
+#include "HCPU.h"
 #include "HSigP.h"
 #include "HWave.h"
 #include "HLabel.h"
@@ -176,6 +177,29 @@ static ParmBuf parmBuf;
 /*static ParmBuf dstPBuf;*/
 static BufferInfo bufInfo;			/* buffer info */
 
+/* forwarding on several threads, each with a replica of the ANNSet */
+enum _FwdJobState {FWDFREE, FWDQUEUED, FWDDONE};
+typedef enum _FwdJobState FwdJobState;
+
+typedef struct _FwdJob {
+    ANNSet *annSet;             /* the replica forwarding this batch */
+    pthread_t thread;           /* the thread running on this replica */
+    FwdJobState state;          /* protected by fwdLock */
+    int nLoaded;                /* the number of samples in the batch */
+    Boolean uttStart;           /* the batch starts an utterance */
+    Boolean uttEnd;             /* the batch ends an utterance */
+    char uttName[MAXSTRLEN];    /* the utterance of the batch */
+    int uttLen;                 /* the length of that utterance */
+    IntVec labVec[SMAX];        /* the targets of the batch, if optHasLabMat */
+    NMatrix *labMat[SMAX];      /* the target matrices of the batch, if any */
+} FwdJob;
+
+static int nFwdThreads = 1;                     /* the number of forwarding threads; 1 to forward on the main thread */
+static FwdJob *fwdJobs = NULL;                  /* one job slot per thread, used in turn */
+static pthread_mutex_t fwdLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t fwdCond = PTHREAD_COND_INITIALIZER;
+static Boolean fwdStop = FALSE;                 /* the threads should exit */
+
 /* ------------------------- Global Options ----------------------------- */
 
 static Boolean optHasLabMat = FALSE;            /* whether do supervised learning or not (associated with NULLLK) */
@@ -304,6 +328,12 @@ void SetConfParms(void)
         if (GetConfBool(cParm, nParm, "INCNUMLATINDENLAT", &boolVal)) {
             optIncNumInDen = boolVal;
         }
+        if (GetConfInt(cParm, nParm, "FWDTHREADS", &intVal)) {
+            if (intVal < 1) {
+                HError(9999, "SetConfParms: FWDTHREADS should be positive");
+            }
+            nFwdThreads = intVal;
+        }
     }
 
 }
@@ -387,22 +417,20 @@ float CalApproxAvgBatchLikelhood(DataCache *cache, int batLen) {
     return llh;
 }
 
-/*  */
-void AccCriteria(DataCache *cache, int batLen, CriteriaInfo *criteria) {
+/* accumulate the criteria of a batch of stream streamIdx forwarded by annSet, with targets labVec and labMat */
+void AccCriteria(ANNSet *annSet, int streamIdx, IntVec labVec, NMatrix *labMat, int batLen, CriteriaInfo *criteria) {
     LELink layerElem;
     int i, j, labTgt, recTgt, recTgtMapMax, recTgtMapSum, recLLHTgt, recTgtLLHMapSum;
     IntVec mapVec;
     float yn, tn;
-    ANNSet *annSet;
 
-    annSet = ((HMMSet *) cache->hmmSet)->annSet;
     /* do accumulateion */
-    layerElem = annSet->outLayers[cache->streamIdx];
+    layerElem = annSet->outLayers[streamIdx];
     /* for tSamp */
     criteria->tSampAcc += batLen;
     /* for accuracy */
     for (i = 1; i <= batLen; ++i) {
-        labTgt = cache->labVec[i];
+        labTgt = labVec[i];
         recTgt = recVec[i];
         if (labTgt == recTgt) {
             ++criteria->cSampAcc;
@@ -411,15 +439,15 @@ void AccCriteria(DataCache *cache, int batLen, CriteriaInfo *criteria) {
         if (showObjFunKind & MLOF) {
             recLLHTgt = recVecLLH[i];
             if (labTgt == recLLHTgt) {
-                criteria->LLHVal += cache->hmmSet->annSet->llhMat[cache->streamIdx]->matElems[(i - 1) * layerElem->nodeNum + recLLHTgt];
+                criteria->LLHVal += annSet->llhMat[streamIdx]->matElems[(i - 1) * layerElem->nodeNum + recLLHTgt];
             } 
         }
     }
     /* for mapped accuracy by max and sum*/
     if (optMapTarget) {
-        mapVec = hset.annSet->mapStruct->mapVectors[cache->streamIdx];
+        mapVec = hset.annSet->mapStruct->mapVectors[streamIdx];
         for (i = 1; i <= batLen; ++i) {
-            labTgt = mapVec[cache->labVec[i] + 1];
+            labTgt = mapVec[labVec[i] + 1];
             recTgtMapSum = recVecMapSum[i];
             if (labTgt == recTgtMapSum) {
                 ++criteria->cSampAccMapSum;
@@ -429,37 +457,37 @@ void AccCriteria(DataCache *cache, int batLen, CriteriaInfo *criteria) {
             if (showObjFunKind & MLOF) {
                 recTgtLLHMapSum = recVecLLHMapSum[i];
                 if (labTgt == recTgtLLHMapSum) {
-                    criteria->LLHValMapSum += cache->hmmSet->annSet->mapStruct->llhMatMapSum[cache->streamIdx]->matElems[(i - 1) * hset.annSet->mapStruct->mappedTargetNum + recTgtMapSum];
+                    criteria->LLHValMapSum += annSet->mapStruct->llhMatMapSum[streamIdx]->matElems[(i - 1) * hset.annSet->mapStruct->mappedTargetNum + recTgtMapSum];
                 }
             }
         } 
     }
     /* for MMSE */
     if (showObjFunKind & MMSEOF) {
-        criteria->MMSEAcc += CalMMSECriterion(cache->labMat, layerElem->yFeaMat, batLen);
+        criteria->MMSEAcc += CalMMSECriterion(labMat, layerElem->yFeaMat, batLen);
         if (optMapTarget) {
-            criteria->MMSEAccMapSum += CalMMSECriterion(annSet->mapStruct->labMatMapSum[cache->streamIdx], annSet->mapStruct->outMatMapSum[cache->streamIdx], batLen);
+            criteria->MMSEAccMapSum += CalMMSECriterion(annSet->mapStruct->labMatMapSum[streamIdx], annSet->mapStruct->outMatMapSum[streamIdx], batLen);
         }
     }
     /* for XENT */
     if (showObjFunKind & XENTOF) {
-        criteria->XENTAcc += CalXENTCriterion(cache->labMat, layerElem->yFeaMat, batLen);
+        criteria->XENTAcc += CalXENTCriterion(labMat, layerElem->yFeaMat, batLen);
         if (optMapTarget) {
-            criteria->XENTAccMapSum += CalXENTCriterion(annSet->mapStruct->labMatMapSum[cache->streamIdx], annSet->mapStruct->outMatMapSum[cache->streamIdx], batLen);
+            criteria->XENTAccMapSum += CalXENTCriterion(annSet->mapStruct->labMatMapSum[streamIdx], annSet->mapStruct->outMatMapSum[streamIdx], batLen);
         }
     }
     /* for ML? */
-    if (FALSE && (showObjFunKind & MLOF) && (cache->streamIdx == 1)) {
+    if (FALSE && (showObjFunKind & MLOF) && (streamIdx == 1)) {
         criteria->LLHVal += fbInfo.pr;
     }
 
     /* for MPE */
-    if ((showObjFunKind & MPEOF) && (cache->streamIdx == 1)) {
+    if ((showObjFunKind & MPEOF) && (streamIdx == 1)) {
         criteria->MPEAcc += fbInfo.AvgCorr;
         criteria->tNWordAcc += fbInfo.MPEFileLength;
     }
     /* for MMI */
-    if ((showObjFunKind & MMIOF) && (cache->streamIdx == 1)) {
+    if ((showObjFunKind & MMIOF) && (streamIdx == 1)) {
         criteria->NumLLHAcc += fbInfo.latPr[corrIdx];
         criteria->DenLLHAcc += fbInfo.latPr[recogIdx1];
     }
@@ -652,7 +680,6 @@ void Initialise(void) {
         SetStreamWidths(tgtPK, tgtSize, tgtSwidth, &eSep);
         obsOut = MakeObservation(&gcheap, tgtSwidth, tgtPK, FALSE, eSep);
     }
-
 }
 
 void ShowCriteriaInfo(CriteriaInfo *criteria) {
@@ -667,12 +694,12 @@ void ShowCriteriaInfo(CriteriaInfo *criteria) {
     }
 }
 
-void LoadFeaMatToParmBuf(int nFrame) {
+void LoadFeaMatToParmBuf(ANNSet *annSet, int nFrame) {
     int s, streamDim, i, j;
     LELink layerElem;
 
     for (s = 1; s <= hset.swidth[0]; ++s) {
-        layerElem = hset.annSet->outLayers[s];
+        layerElem = annSet->outLayers[s];
         for (i = 0; i < nFrame; ++i) {
             /*for (j = 0; j < layerElem->nodeNum; ++j) {
                 obsOut.fv[s][j + 1] = (float) layerElem->yFeaMat->matElems[i * layerElem->nodeNum + j];
@@ -683,15 +710,271 @@ void LoadFeaMatToParmBuf(int nFrame) {
     }
 }
 
+/* start the outputs of an utterance of uttLen frames */
+void BeginUttOutput(int uttLen) {
+    char *str, fnbuf[1024];
+
+    if (optHasLabMat && optShowUttStats) {
+        memset(&criteriaUtt, 0, sizeof(CriteriaInfo) * SMAX);
+    }
+    /* write the data, if needed */
+    if (optGenANNFeas) {
+        str = GetStrArg();
+        strcpy(fnbuf, str);
+        parmBuf = OpenBuffer(&feaHeap, fnbuf, 50, UNDEFF, TRI_UNDEF, TRI_UNDEF);    
+        GetBufferInfo(parmBuf, &bufInfo); 
+        bufInfo.tgtPK = tgtPK;
+        CloseBuffer(parmBuf);
+        parmBuf = EmptyBuffer(&feaHeap, uttLen, obsOut, bufInfo);
+        /*CopyParmBufInfo(srcPBuf, dstPBuf);*/
+    }
+}
+
+/* finish the outputs of the utterance uttName */
+void EndUttOutput(char *uttName) {
+    char buf[256];
+
+    if (optHasLabMat && optShowUttStats) {
+        printf("\t\tShow criterion values for %s:\n", uttName);
+        ShowCriteriaInfo(criteriaUtt);
+    }
+    /* write the data, if needed */
+    if (optGenANNFeas) {
+        GetNextScpWord(scriptOut, buf);
+        if (SaveBuffer(parmBuf, buf, tgtFF) < SUCCESS) {
+            HError(9999, "HNForward: Could not save parm file %s", buf);
+        }
+        /*CloseBuffer(parmBuf);*/
+        /*printf("%s --> %s\n", uttName, buf);*/
+        ResetHeap(&feaHeap);
+    }
+}
+
+/* find the hypotheses of a batch forwarded by annSet and accumulate its criteria */
+void AccBatchCriteria(ANNSet *annSet, IntVec *labVecs, NMatrix **labMats, int nLoaded, char *uttName, Boolean sentFail) {
+    int i;
+    LELink layerElem;
+    SpeakerInfo *speakerInfo = NULL;
+
+    if (xfInfo.inSpkrPat != NULL) {
+        speakerInfo = GetSpeakerInfo(uttName);
+    }
+    for (i = 1; i <= hset.swidth[0]; ++i) {
+        layerElem = annSet->outLayers[i];
+        FindMaxElement(layerElem->yFeaMat, nLoaded, layerElem->nodeNum, recVec);
+        if (showObjFunKind & MLOF) {
+            FindMaxElement(annSet->llhMat[i], nLoaded, layerElem->nodeNum, recVecLLH);
+        }
+        if (optMapTarget) {
+            FindMaxElement(annSet->mapStruct->outMatMapSum[i], nLoaded, annSet->mapStruct->mappedTargetNum, recVecMapSum);
+            if (showObjFunKind & MLOF) {
+                FindMaxElement(annSet->mapStruct->llhMatMapSum[i], nLoaded, annSet->mapStruct->mappedTargetNum, recVecLLHMapSum);
+            }
+            UpdateLabMatMapSum(annSet, nLoaded, i);
+#ifdef CUDA
+            SyncNMatrixDev2Host(annSet->mapStruct->labMatMapSum[i]);
+#endif
+        }
+        if (!sentFail) {
+            AccCriteria(annSet, i, labVecs[i], labMats[i], nLoaded, &criteriaAll[i]);
+            if (optShowUttStats) {
+                AccCriteria(annSet, i, labVecs[i], labMats[i], nLoaded, &criteriaUtt[i]);
+            }
+            if (xfInfo.inSpkrPat != NULL) {
+                AccCriteria(annSet, i, labVecs[i], labMats[i], nLoaded, &speakerInfo->criteria[i]);
+            }
+        }
+    }
+}
+
+/* ------------------------ Forwarding Threads -------------------------- */
+
+/* each thread forwards batches on its own replica of the ANNSet, which
+   shares the weights of hset; the main thread fills the batches and takes
+   the results of the job slots in turn, so the outputs stay in input order */
+static void *FwdWorker(void *arg) {
+    int s;
+    FwdJob *job = (FwdJob *) arg;
+    LELink layerElem;
+
+    while (TRUE) {
+        pthread_mutex_lock(&fwdLock);
+        while (!fwdStop && job->state != FWDQUEUED) {
+            pthread_cond_wait(&fwdCond, &fwdLock);
+        }
+        if (job->state != FWDQUEUED) {
+            pthread_mutex_unlock(&fwdLock);
+            break;
+        }
+        pthread_mutex_unlock(&fwdLock);
+        /* forward propagation */
+        ForwardPropBatch(job->annSet, job->nLoaded, NULL);
+        /* convert posteriors to llh */
+        if (showObjFunKind & MLOF) {
+            for (s = 1; s <= hset.swidth[0]; ++s) {
+                layerElem = job->annSet->outLayers[s];
+                ApplyLogTrans(layerElem->yFeaMat, job->nLoaded, layerElem->nodeNum, job->annSet->llhMat[s]);
+                AddNVectorTargetPen(job->annSet->llhMat[s], job->annSet->penVec[s], job->nLoaded, job->annSet->llhMat[s]);
+            }
+        }
+        pthread_mutex_lock(&fwdLock);
+        job->state = FWDDONE;
+        pthread_cond_broadcast(&fwdCond);
+        pthread_mutex_unlock(&fwdLock);
+    }
+    return NULL;
+}
+
+/* create the replicas and their threads, if FWDTHREADS > 1 */
+void StartFwdThreads(void) {
+    int i, s;
+    ANNSet *replica;
+    FwdJob *job;
+
+    if (nFwdThreads <= 1) {
+        return;
+    }
+#ifdef CUDA
+    HError(-1, "StartFwdThreads: FWDTHREADS is not used with CUDA, forwarding on one thread");
+    nFwdThreads = 1;
+    return;
+#endif
+    if (optShowSeqObjVal || optMapTarget) {
+        HError(-1, "StartFwdThreads: Sequence criteria and target mapping need FWDTHREADS = 1, forwarding on one thread");
+        nFwdThreads = 1;
+        return;
+    }
+    fwdJobs = (FwdJob *) New(&gcheap, nFwdThreads * sizeof(FwdJob));
+    memset(fwdJobs, 0, nFwdThreads * sizeof(FwdJob));
+    for (i = 0; i < nFwdThreads; ++i) {
+        if ((replica = CreateANNSetReplica(&modelHeap, hset.annSet)) == NULL) {
+            HError(-1, "StartFwdThreads: The ANN carries state between batches, forwarding on one thread");
+            nFwdThreads = 1;
+            return;
+        }
+        job = &fwdJobs[i];
+        job->annSet = replica;
+        job->state = FWDFREE;
+        for (s = 1; s <= hset.swidth[0] && optHasLabMat; ++s) {
+            job->labVec[s] = CreateIntVec(&gcheap, GetNBatchSamples());
+            if (cacheIn[s]->labMat != NULL) {
+                job->labMat[s] = CreateNMatrix(&gcheap, cacheIn[s]->labMat->rowNum, cacheIn[s]->labMat->colNum);
+            }
+        }
+    }
+    for (i = 0; i < nFwdThreads; ++i) {
+        if (pthread_create(&fwdJobs[i].thread, NULL, FwdWorker, (void *) &fwdJobs[i]) != 0) {
+            HError(9999, "StartFwdThreads: Failed to create forwarding thread %d", i);
+        }
+    }
+    if (trace & T_TOP) {
+        printf("Forwarding on %d threads\n", nFwdThreads);
+    }
+}
+
+/* stop the forwarding threads */
+void StopFwdThreads(void) {
+    int i;
+
+    if (nFwdThreads <= 1) {
+        return;
+    }
+    pthread_mutex_lock(&fwdLock);
+    fwdStop = TRUE;
+    pthread_cond_broadcast(&fwdCond);
+    pthread_mutex_unlock(&fwdLock);
+    for (i = 0; i < nFwdThreads; ++i) {
+        pthread_join(fwdJobs[i].thread, NULL);
+    }
+}
+
+/* wait for the batch of a job slot and take its results */
+static void RetireFwdJob(FwdJob *job) {
+    pthread_mutex_lock(&fwdLock);
+    while (job->state == FWDQUEUED) {
+        pthread_cond_wait(&fwdCond, &fwdLock);
+    }
+    pthread_mutex_unlock(&fwdLock);
+    if (job->state == FWDFREE) {
+        return;
+    }
+    if (job->uttStart) {
+        BeginUttOutput(job->uttLen);
+    }
+    if (optHasLabMat) {
+        AccBatchCriteria(job->annSet, job->labVec, job->labMat, job->nLoaded, job->uttName, FALSE);
+    }
+    if (optGenANNFeas) {
+        LoadFeaMatToParmBuf(job->annSet, job->nLoaded);
+    }
+    if (job->uttEnd) {
+        EndUttOutput(job->uttName);
+    }
+    job->state = FWDFREE;
+}
+
+/* forward all the data on the forwarding threads */
+void ForwardParallel(void) {
+    int i, S, slot = 0, nLoaded, uttCnt, uttLen;
+    char uttName[MAXSTRLEN];
+    Boolean finish = FALSE, uttStart;
+    FwdJob *job;
+
+    S = hset.swidth[0];
+    while (!finish) {
+        uttCnt = 1;
+        uttStart = TRUE;
+        strcpy(uttName, GetCurUttName(cacheIn[1]));
+        uttLen = GetCurUttLen(cacheIn[1]);
+        while ((!finish) && uttCnt > 0) {
+            /* the slots are reused in turn, so the batches are retired in input order */
+            job = &fwdJobs[slot];
+            slot = (slot + 1) % nFwdThreads;
+            RetireFwdJob(job);
+            /* load data */
+            for (i = 1; i <= S; ++i) {
+                finish |= FillAllInpBatch(cacheIn[i], &nLoaded, &uttCnt);
+                LoadCacheData(cacheIn[i]);
+            }
+            CopyReplicaInputs(job->annSet, 0, nLoaded);
+            for (i = 1; i <= S && optHasLabMat; ++i) {
+                memcpy(&job->labVec[i][1], &cacheIn[i]->labVec[1], nLoaded * sizeof(int));
+                if (job->labMat[i] != NULL) {
+                    CopyNSegment(cacheIn[i]->labMat, 0, nLoaded * cacheIn[i]->labMat->colNum, job->labMat[i], 0);
+                }
+            }
+            job->nLoaded = nLoaded;
+            job->uttStart = uttStart;
+            job->uttEnd = finish || uttCnt <= 0;
+            strcpy(job->uttName, uttName);
+            job->uttLen = uttLen;
+            uttStart = FALSE;
+            pthread_mutex_lock(&fwdLock);
+            job->state = FWDQUEUED;
+            pthread_cond_broadcast(&fwdCond);
+            pthread_mutex_unlock(&fwdLock);
+        }
+        /* cz277 - mtload */
+        for (i = 1; i <= S; ++i) {
+            UnloadCacheData(cacheIn[i]);
+        }
+    }
+    /* the last batches, oldest first */
+    for (i = 0; i < nFwdThreads; ++i) {
+        RetireFwdJob(&fwdJobs[(slot + i) % nFwdThreads]);
+    }
+}
+
 int main(int argc, char *argv[]) {
     char *str;
-    char buf[256], uttName[MAXSTRLEN], fnbuf[1024];
+    char buf[256], uttName[MAXSTRLEN];
     clock_t stClock, edClock;
     int i, S, nLoaded, sampCnt, batchCnt, tSampCnt, tUttCnt, uttCnt, uttLen;
     Boolean finish = FALSE, skipOneUtt, sentFail;
     LELink layerElem;
-    SpeakerInfo *speakerInfo;
     UttElem *uttElem;
+    IntVec labVecs[SMAX];
+    NMatrix *labMats[SMAX];
     Lattice *MPECorrLat = NULL;
 
     if (InitShell(argc, argv, hnforward_version, hnforward_vc_id) < SUCCESS) {
@@ -699,6 +982,7 @@ int main(int argc, char *argv[]) {
     }
     InitMem();
     InitMath();
+    InitCPU();
     InitSigP();
     InitWave();
     InitLabel();
@@ -935,7 +1219,8 @@ int main(int argc, char *argv[]) {
     printf("\n");
 #endif
     /* initialise */
-    Initialise(); 
+    Initialise();
+    StartFwdThreads();
 #ifdef CUDA
     ShowGPUMemUsage();
 #endif
@@ -957,6 +1242,10 @@ int main(int argc, char *argv[]) {
     printf("\n");
     printf("Evaluating ************************\n");
     printf("\tProcessing the evaluation set...\n");
+    if (nFwdThreads > 1) {
+        ForwardParallel();
+        finish = TRUE;
+    }
     while (!finish) {
         sampCnt = 0;
         uttCnt = 1;
@@ -976,20 +1265,7 @@ int main(int argc, char *argv[]) {
             LoadXFormsFromUttElem(uttElem, &fbInfo);
             fbInfo.uFlags = cacheIn[1]->labelInfo->uFlags;
         }
-        if (optHasLabMat && optShowUttStats) {
-            memset(&criteriaUtt, 0, sizeof(CriteriaInfo) * SMAX);
-        }
-        /* write the data, if needed */
-        if (optGenANNFeas) {
-            str = GetStrArg();
-            strcpy(fnbuf, str);
-            parmBuf = OpenBuffer(&feaHeap, fnbuf, 50, UNDEFF, TRI_UNDEF, TRI_UNDEF);    
-            GetBufferInfo(parmBuf, &bufInfo); 
-            bufInfo.tgtPK = tgtPK;
-            CloseBuffer(parmBuf);
-            parmBuf = EmptyBuffer(&feaHeap, uttLen, obsOut, bufInfo);
-            /*CopyParmBufInfo(srcPBuf, dstPBuf);*/
-        }
+        BeginUttOutput(uttLen);
         while ((!finish) && uttCnt > 0) {
             /* load data */
             for (i = 1; i <= S; ++i) {
@@ -1067,39 +1343,15 @@ int main(int argc, char *argv[]) {
             }
             /* compute the criteria */
             if (optHasLabMat) {
-                if (xfInfo.inSpkrPat != NULL) {
-                    speakerInfo = GetSpeakerInfo(uttName);
-                }
                 for (i = 1; i <= S; ++i) {
-                    layerElem = hset.annSet->outLayers[i];
-                    FindMaxElement(layerElem->yFeaMat, nLoaded, layerElem->nodeNum, recVec);
-                    if (showObjFunKind & MLOF) {
-                        FindMaxElement(hset.annSet->llhMat[i], nLoaded, layerElem->nodeNum, recVecLLH);
-                    }
-                    if (optMapTarget) {
-                        FindMaxElement(hset.annSet->mapStruct->outMatMapSum[i], nLoaded, hset.annSet->mapStruct->mappedTargetNum, recVecMapSum);
-                        if (showObjFunKind & MLOF) {
-                            FindMaxElement(hset.annSet->mapStruct->llhMatMapSum[i], nLoaded, hset.annSet->mapStruct->mappedTargetNum, recVecLLHMapSum);
-                        }
-                        UpdateLabMatMapSum(hset.annSet, nLoaded, i);
-#ifdef CUDA
-                        SyncNMatrixDev2Host(hset.annSet->mapStruct->labMatMapSum[i]);
-#endif
-                    }
-                    if (!sentFail) {
-                        AccCriteria(cacheIn[i], nLoaded, &criteriaAll[i]);
-                        if (optShowUttStats) {
-                            AccCriteria(cacheIn[i], nLoaded, &criteriaUtt[i]);
-                        }
-                        if (xfInfo.inSpkrPat != NULL) {
-                            AccCriteria(cacheIn[i], nLoaded, &speakerInfo->criteria[i]);
-                        }
-                    }
+                    labVecs[i] = cacheIn[i]->labVec;
+                    labMats[i] = cacheIn[i]->labMat;
                 }
+                AccBatchCriteria(hset.annSet, labVecs, labMats, nLoaded, uttName, sentFail);
             }
             /* write the data, if needed */
             if (optGenANNFeas) {
-                LoadFeaMatToParmBuf(nLoaded);
+                LoadFeaMatToParmBuf(hset.annSet, nLoaded);
             }
             /* update the statistics */
             batchCnt += 1;
@@ -1107,20 +1359,7 @@ int main(int argc, char *argv[]) {
             sampCnt += nLoaded;
             tSampCnt += nLoaded;
         }
-        if (optHasLabMat && optShowUttStats) {
-            printf("\t\tShow criterion values for %s:\n", uttName);
-            ShowCriteriaInfo(criteriaUtt);
-        }
-        /* write the data, if needed */
-        if (optGenANNFeas) {
-            GetNextScpWord(scriptOut, buf);
-            if (SaveBuffer(parmBuf, buf, tgtFF) < SUCCESS) {
-                HError(9999, "HNForward: Could not save parm file %s", buf);
-            }
-            /*CloseBuffer(parmBuf);*/
-            /*printf("%s --> %s\n", uttName, buf);*/
-            ResetHeap(&feaHeap);
-        }
+        EndUttOutput(uttName);
         /* cz277 - mtload */
         for (i = 1; i <= S; ++i) {
             /*UpdateCacheStatus(cacheIn[i]);*/
@@ -1149,6 +1388,7 @@ int main(int argc, char *argv[]) {
     printf("\t\tCost time = %.2fs\n", (edClock - stClock) / (double) CLOCKS_PER_SEC);
 
     /* free ANNSet */
+    StopFwdThreads();
     FreeANNSet(&hset);
     for (i = 1; i <= S; ++i) {
         FreeCache(cacheIn[i]);
@@ -1157,6 +1397,7 @@ int main(int argc, char *argv[]) {
 #ifdef CUDA
     StopCUDA();
 #endif
+    StopCPU();
 
     return 0;
 }
@@ -0,0 +1,238 @@
+/* ----------------------------------------------------------- */
+/*                                                             */
+/*                          ___                                */
+/*                       |_| | |_/   SPEECH                    */
+/*                       | | | | \   RECOGNITION               */
+/*                       =========   SOFTWARE                  */
+/*                                                             */
+/*                                                             */
+/* ----------------------------------------------------------- */
+/* developed at:                                               */
+/*                                                             */
+/*      Machine Intelligence Laboratory                        */
+/*      Cambridge University Engineering Department            */
+/*      http://mil.eng.cam.ac.uk/                              */
+/*                                                             */
+/* ----------------------------------------------------------- */
+/*         Copyright: Microsoft Corporation                    */
+/*          1995-2000 Redmond, Washington USA                  */
+/*                    http://www.microsoft.com                 */
+/*                                                             */
+/*              2002  Cambridge University                     */
+/*                    Engineering Department                   */
+/*                                                             */
+/*   Use of this software is governed by a License Agreement   */
+/*    ** See the file License for the Conditions of Use  **    */
+/*    **     This banner notice must not be removed      **    */
+/*                                                             */
+/* ----------------------------------------------------------- */
+/*     File: HNPack.c: pack features into a feature archive    */
+/* ----------------------------------------------------------- */
+
+char *hnpack_version = "!HVER!HNPack:   3.4.1 [CUED 17/10/16]";
+char *hnpack_vc_id = "$Id: HNPack.c,v 1.1.1.1 2016/10/17 09:55:01 cz277 Exp $";
+
+/*
+    This program reads the observations of each file in a script,
+    converted by HParm exactly as HNCache would convert them, and packs
+    them into one feature archive.  With HNCACHE: FEAARCHIVE set to the
+    archive, HNTrainSGD and HNForward take the frames of each utterance
+    from the memory mapped archive by its logical name, and no longer
+    open the parameter files.
+*/
+
+#include "cfgs.h"
+#include "HShell.h"
+#include "HMem.h"
+#include "HMath.h"
+#include "HSigP.h"
+#include "HWave.h"
+#include "HLabel.h"
+#include "HAudio.h"
+#include "HParm.h"
+#include "HDict.h"
+#include "HANNet.h"
+#include "HModel.h"
+#include "HTrain.h"
+#include "HUtil.h"
+#include "HAdapt.h"
+#include "HFB.h"
+#include "HNet.h"       /* for Lattice */
+#include "HLM.h"
+#include "HLat.h"       /* for Lattice */
+#include "HArc.h"
+#include "HFBLat.h"
+#include "HNCache.h"
+
+#include <math.h>
+
+/* -------------------------- Trace Flags & Vars ------------------------ */
+
+/* Trace Flags */
+#define T_TOP   0001    /* Top level tracing */
+static int trace = 0;
+
+/* -------------------------- Global Variables etc ---------------------- */
+
+#define MAX(a, b) ((a)>(b)?(a):(b))
+
+static ConfParam *cParm[MAXGLOBS];      /* configuration parameters */
+static int nParm = 0;                   /* total num params */
+
+static int numS = 1;                    /* the number of streams */
+
+static FeaArchiveWriter *arcw = NULL;   /* the archive being written */
+static short swidth[SMAX];              /* the stream widths of the archive */
+static ParmKind arcPK;                  /* the parameter kind of the archive */
+static int arcVecSize;                  /* the vector size of the archive */
+static Boolean arcESep;                 /* whether energy is split into its own stream */
+static long tFrmNum = 0;                /* the total number of frames packed */
+
+static MemHeap feaHeap;                 /* the heap for each utterance */
+
+/* ------------------------------ Initialisation ------------------------ */
+
+void SetConfParms(void)
+{
+    int intVal;
+
+    nParm = GetConfig("HNPACK", TRUE, cParm, MAXGLOBS);
+    if (nParm > 0) {
+        if (GetConfInt(cParm, nParm, "TRACE", &intVal)) {
+            trace = intVal;
+        }
+    }
+}
+
+void ReportUsage(void)
+{
+    printf("\nUSAGE: HNPack [options] archiveFile files...\n\n");
+    printf(" Option                                       Default\n\n");
+    printf(" -n i      Set number of streams to i         1\n");
+    PrintStdOpts("S");
+    printf("\n\n");
+}
+
+/* ---------------------------- Packing --------------------------------- */
+
+/* append the observations of the file fn to the archive arcFn */
+static void PackFile(char *arcFn, char *fn)
+{
+    int i, s, k, nFrames;
+    float *frmMat, *dstPtr;
+    ParmBuf parmBuf;
+    BufferInfo info;
+    Observation obs;
+
+    ResetHeap(&feaHeap);
+    if ((parmBuf = OpenBuffer(&feaHeap, fn, 0, UNDEFF, TRI_UNDEF, TRI_UNDEF)) == NULL) {
+        HError(9999, "PackFile: Cannot open %s", fn);
+    }
+    GetBufferInfo(parmBuf, &info);
+    if (arcw == NULL) {
+        /* the first file sets the format of the archive */
+        ZeroStreamWidths(numS, swidth);
+        SetStreamWidths(info.tgtPK, info.tgtVecSize, swidth, &arcESep);
+        arcPK = info.tgtPK;
+        arcVecSize = info.tgtVecSize;
+        arcw = CreateFeaArchive(arcFn, swidth, info.tgtPK, info.tgtSampRate);
+    }
+    else if (info.tgtPK != arcPK || info.tgtVecSize != arcVecSize) {
+        HError(9999, "PackFile: %s does not have the parameter kind and size of the previous files", fn);
+    }
+    obs = MakeObservation(&feaHeap, swidth, info.tgtPK, FALSE, arcESep);
+    nFrames = ObsInBuffer(parmBuf);
+    frmMat = (float *) New(&feaHeap, MAX(nFrames, 1) * arcVecSize * sizeof(float));
+    dstPtr = frmMat;
+    for (i = 0; i < nFrames; ++i) {
+        ReadAsTable(parmBuf, i, &obs);
+        for (s = 1; s <= swidth[0]; ++s) {
+            for (k = 1; k <= swidth[s]; ++k, ++dstPtr) {
+                if (isnan(obs.fv[s][k])) {
+                    HError(9999, "PackFile: %s, frame no. %d, dim %d has nan value", fn, i, k);
+                }
+                if (isinf(obs.fv[s][k])) {
+                    HError(9999, "PackFile: %s, frame no. %d, dim %d has inf value", fn, i, k);
+                }
+                *dstPtr = obs.fv[s][k];
+            }
+        }
+    }
+    CloseBuffer(parmBuf);
+    AddFeaArchiveUtt(arcw, fn, nFrames, frmMat);
+    tFrmNum += nFrames;
+    if (trace & T_TOP) {
+        printf(" %s: %d frames\n", fn, nFrames);
+        fflush(stdout);
+    }
+}
+
+/* ---------------------------- Main Program ---------------------------- */
+
+int main(int argc, char *argv[])
+{
+    char *str, *arcFn;
+    int nFiles = 0;
+
+    if (InitShell(argc, argv, hnpack_version, hnpack_vc_id) < SUCCESS) {
+        HError(9999, "HNPack: InitShell failed");
+    }
+    InitMem();
+    InitMath();
+    InitSigP();
+    InitWave();
+    InitAudio();
+    InitLabel();
+    if (InitParm() < SUCCESS) {
+        HError(9999, "HNPack: InitParm failed");
+    }
+
+    if (!InfoPrinted() && NumArgs() == 0) {
+        ReportUsage();
+    }
+    if (NumArgs() == 0) {
+        Exit(0);
+    }
+    SetConfParms();
+
+    while (NextArg() == SWITCHARG) {
+        str = GetSwtArg();
+        switch (str[0]) {
+            case 'n':
+                numS = GetChkedInt(1, SMAX - 1, str);
+                break;
+            case 'T':
+                trace = GetChkedInt(0, 0100000, str);
+                break;
+            default:
+                HError(9999, "HNPack: Unknown switch %s", str);
+        }
+    }
+    if (NextArg() != STRINGARG) {
+        HError(9999, "HNPack: Feature archive file name expected");
+    }
+    arcFn = GetStrArg();
+
+    CreateHeap(&feaHeap, "feature heap", MSTAK, 1, 0.5, 100000, 5000000);
+    while (NextArg() == STRINGARG) {
+        PackFile(arcFn, GetStrArg());
+        ++nFiles;
+    }
+    if (NextArg() != NOARG) {
+        HError(9999, "HNPack: Unexpected argument");
+    }
+    if (arcw == NULL) {
+        HError(9999, "HNPack: No files to pack");
+    }
+    CloseFeaArchive(arcw);
+    if (trace & T_TOP) {
+        printf("HNPack: %d files, %ld frames packed into %s\n", nFiles, tFrmNum, arcFn);
+    }
+
+    Exit(0);
+    return (0);
+}
+
+/* ----------------------------------------------------------- */
+/*                      END:  HNPack.c                         */
+/* ----------------------------------------------------------- */
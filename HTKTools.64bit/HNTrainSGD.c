@@ -47,6 +47,7 @@ char *hntrainsgd_vc_id = "$Id: HNTrainSGD.c,v 1.1.1.1 2006/10/11 09:55:01 cz277
 #include "HShell.h"
 #include "HMem.h"
 #include "HMath.h"
+#include "HCPU.h"
 #include "HSigP.h"
 #include "HWave.h"
 #include "HLabel.h"
@@ -65,6 +66,7 @@ char *hntrainsgd_vc_id = "$Id: HNTrainSGD.c,v 1.1.1.1 2006/10/11 09:55:01 cz277
 #include "HArc.h"
 #include "HFBLat.h"
 #include "HNCache.h"
+#include "HNDist.h"
 
 #include <time.h>
 #include <math.h>
@@ -251,6 +253,39 @@ static int bgWaitNBatchPL = 0;			/* the number of batches be held */
 static int edAccBatchLenPL = 0;			/* the length of batch start to be held */
 static VisitKind visitKindHV = NONEVK;		/* default visit kind for held-out validation */
 
+/* data-parallel training on several threads, each with a replica of the ANNSet */
+enum _TrainTask {TRNNONE, TRNBATCH, TRNREDUCE, TRNEXIT};
+typedef enum _TrainTask TrainTask;
+
+typedef struct _TrainJob {
+    ANNSet *annSet;             /* the replica of this thread */
+    pthread_t thread;           /* the thread */
+    TrainTask next;             /* the task to give the thread at the next RunTrainTasks */
+    TrainTask task;             /* the task being run, protected by trnLock */
+    int batOff;                 /* the first sample of the part of the batch for this thread */
+    int batLen;                 /* the number of samples in that part */
+    ANNSet *redSet;             /* the replica whose gradients are added to annSet by TRNREDUCE */
+    IntVec hypVec;              /* the hypothesis labels of the part */
+    IntVec hypVecLLH;
+    CriteriaInfo criteria[SMAX];/* the criteria of the part */
+} TrainJob;
+
+static int nTrainThreads = 1;                   /* the number of training threads; 1 to train on the main thread */
+static Boolean optHogwild = FALSE;              /* each thread updates the shared parameters without reduction or locks */
+static TrainJob *trnJobs = NULL;                /* one job per thread */
+static Boolean trnStarted = FALSE;              /* the threads are running */
+static int trnPending = 0;                      /* the number of tasks not finished, protected by trnLock */
+static pthread_mutex_t trnLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t trnCond = PTHREAD_COND_INITIALIZER;
+static float trnNegLR = 0.0;                    /* the learning rate for the HOGWILD updates of a batch */
+static float trnMomentum = 0.0;                 /* the momentum for the HOGWILD updates of a batch */
+
+/* distributed training over several processes, connected by HNDist */
+static int distAvgPeriod = 0;                   /* average the models every so many updates; 0 to sum the gradients of each update */
+static NFloat *distBuf = NULL;                  /* the parameters or gradients of the updated layers, packed for HNDist */
+static size_t distParmLen = 0;                  /* the number of parameters in distBuf, which has two more slots for the counts */
+static int distActive = 0;                      /* the number of workers with data left at the last reduction */
+
 /* cz277 - gradlim */
 static float wghtUpdtPosLim = 0.32;		/* suggested values: 1.6, 0.08, 0.02, 0.002 -> 800, 40, 10, 1 */
 static float wghtUpdtNegLim = 0.32;
@@ -296,6 +331,10 @@ static int nParm = 0;                           /* total num params */
 
 /* -------------------------- Prototypes -------------------------------- */
 
+void InitTrainReplicas(void);
+void InitDistTrain(void);
+float UpdateLRSchdPerU(int curEpochNum, int updtSamp);
+
 
 //cw564 - mb -- begin
 
@@ -861,6 +900,21 @@ void SetConfParms(void)
         if (GetConfFlt(cParm, nParm, "LOGPRIOROBSV", &doubleVal)) {
             logObsvPrior = (float) doubleVal;
         } 
+        if (GetConfInt(cParm, nParm, "TRAINTHREADS", &intVal)) {
+            if (intVal < 1) {
+                HError(9999, "SetConfParms: TRAINTHREADS should be positive");
+            }
+            nTrainThreads = intVal;
+        }
+        if (GetConfBool(cParm, nParm, "HOGWILD", &boolVal)) {
+            optHogwild = boolVal;
+        }
+        if (GetConfInt(cParm, nParm, "DISTAVGPERIOD", &intVal)) {
+            if (intVal < 0) {
+                HError(9999, "SetConfParms: DISTAVGPERIOD should be non-negative");
+            }
+            distAvgPeriod = intVal;
+        }
         /* cz277 - semi */
         if (GetConfInt(cParm, nParm, "BGNPLBATCHWAIT", &intVal)) {
             if (intVal < 0) {
@@ -1029,39 +1083,39 @@ float CalApproxAvgBatchLikelhood(DataCache *cache, int batLen) {
     return llh;
 }
 
-void AccCriteriaPerB(DataCache *cache, int batLen, CriteriaInfo *criteria) {
+/* accumulate the criteria of a batch of stream streamIdx forwarded by annSet, with
+   targets labVec and labMat and hypotheses hypVec (and hypVecLLH, for MLOF) */
+void AccBatchCriteria(ANNSet *annSet, int streamIdx, IntVec labVec, NMatrix *labMat, IntVec hypVec, IntVec hypVecLLH, int batLen, CriteriaInfo *criteria) {
     LELink layerElem;
     int i, j, labTgt, recTgt, recTgtMapMax, recTgtMapSum, recLLHTgt, recTgtLLHMapSum;
     IntVec mapVec;
     float yn, tn;
-    ANNSet *annSet;
 
-    annSet = cache->hmmSet->annSet;
     /* do accumulateion */
-    layerElem = annSet->outLayers[cache->streamIdx];
+    layerElem = annSet->outLayers[streamIdx];
     /* for tSamp */
     criteria->tSampAcc += batLen;
     /* for accuracy */
     for (i = 1; i <= batLen; ++i) {
-        labTgt = cache->labVec[i];
-        recTgt = recVec[i];
+        labTgt = labVec[i];
+        recTgt = hypVec[i];
         if (labTgt == recTgt) {
             ++criteria->cSampAcc;
         }
         /* for LLH values */
         if (showObjFunKind & MLOF) {
-            recLLHTgt = recVecLLH[i];
+            recLLHTgt = hypVecLLH[i];
             if (labTgt == recLLHTgt) {
-                criteria->LLHVal += cache->hmmSet->annSet->llhMat[cache->streamIdx]->matElems[(i - 1) * layerElem->nodeNum + recLLHTgt];
+                criteria->LLHVal += annSet->llhMat[streamIdx]->matElems[(i - 1) * layerElem->nodeNum + recLLHTgt];
             }
         }
     }
 
     /* for mapped accuracy by max and sum*/
     if (optMapTarget) {
-        mapVec = hset.annSet->mapStruct->mapVectors[cache->streamIdx];
+        mapVec = hset.annSet->mapStruct->mapVectors[streamIdx];
         for (i = 1; i <= batLen; ++i) {
-            labTgt = mapVec[cache->labVec[i] + 1];
+            labTgt = mapVec[labVec[i] + 1];
             recTgtMapSum = recVecMapSum[i];
             if (labTgt == recTgtMapSum) {
                 ++criteria->cSampAccMapSum;
@@ -1071,7 +1125,7 @@ void AccCriteriaPerB(DataCache *cache, int batLen, CriteriaInfo *criteria) {
             if (showObjFunKind & MLOF) {
                 recTgtLLHMapSum = recVecLLHMapSum[i];
                 if (labTgt == recTgtLLHMapSum) {
-                    criteria->LLHValMapSum += cache->hmmSet->annSet->mapStruct->llhMatMapSum[cache->streamIdx]->matElems[(i - 1) * hset.annSet->mapStruct->mappedTargetNum + recTgtMapSum];
+                    criteria->LLHValMapSum += annSet->mapStruct->llhMatMapSum[streamIdx]->matElems[(i - 1) * hset.annSet->mapStruct->mappedTargetNum + recTgtMapSum];
                 }
             }
         }
@@ -1079,21 +1133,47 @@ void AccCriteriaPerB(DataCache *cache, int batLen, CriteriaInfo *criteria) {
 
     /* MMSE */
     if (showObjFunKind & MMSEOF) {
-        criteria->MMSEAcc += CalMMSECriterion(cache->labMat, layerElem->yFeaMat, batLen);
+        criteria->MMSEAcc += CalMMSECriterion(labMat, layerElem->yFeaMat, batLen);
         if (optMapTarget) {
-            criteria->MMSEAccMapSum += CalMMSECriterion(annSet->mapStruct->labMatMapSum[cache->streamIdx], annSet->mapStruct->outMatMapSum[cache->streamIdx], batLen);
+            criteria->MMSEAccMapSum += CalMMSECriterion(annSet->mapStruct->labMatMapSum[streamIdx], annSet->mapStruct->outMatMapSum[streamIdx], batLen);
         }
     }
 
     /* XENT */
     if (showObjFunKind & XENTOF) {
-        criteria->XENTAcc += CalXENTCriterion(cache->labMat, layerElem->yFeaMat, batLen);
+        criteria->XENTAcc += CalXENTCriterion(labMat, layerElem->yFeaMat, batLen);
         if (optMapTarget) {
-            criteria->XENTAccMapSum += CalXENTCriterion(annSet->mapStruct->labMatMapSum[cache->streamIdx], annSet->mapStruct->outMatMapSum[cache->streamIdx], batLen);
+            criteria->XENTAccMapSum += CalXENTCriterion(annSet->mapStruct->labMatMapSum[streamIdx], annSet->mapStruct->outMatMapSum[streamIdx], batLen);
         }
     }
 }
 
+void AccCriteriaPerB(DataCache *cache, int batLen, CriteriaInfo *criteria) {
+    AccBatchCriteria(cache->hmmSet->annSet, cache->streamIdx, cache->labVec, cache->labMat, recVec, recVecLLH, batLen, criteria);
+}
+
+/* add the criteria src to dst */
+void AddCriteriaInfo(CriteriaInfo *src, CriteriaInfo *dst) {
+    dst->cSampAcc += src->cSampAcc;
+    dst->MMSEAcc += src->MMSEAcc;
+    dst->XENTAcc += src->XENTAcc;
+    dst->MPEAcc += src->MPEAcc;
+    dst->tUttAcc += src->tUttAcc;
+    dst->tNWordAcc += src->tNWordAcc;
+    dst->tSampAcc += src->tSampAcc;
+    dst->LLHAcc += src->LLHAcc;
+    dst->LLHVal += src->LLHVal;
+    dst->NumLLHAcc += src->NumLLHAcc;
+    dst->DenLLHAcc += src->DenLLHAcc;
+    dst->MMIFRAcc += src->MMIFRAcc;
+    dst->cSampAccMapMax += src->cSampAccMapMax;
+    dst->cSampAccMapSum += src->cSampAccMapSum;
+    dst->MMSEAccMapSum += src->MMSEAccMapSum;
+    dst->XENTAccMapSum += src->XENTAccMapSum;
+    dst->LLHAccMapSum += src->LLHAccMapSum;
+    dst->LLHValMapSum += src->LLHValMapSum;
+}
+
 void AccCriteriaPerU(DataCache *cache, int batLen, CriteriaInfo *criteria) {
     LELink layerElem;
     ANNSet *annSet;
@@ -1444,6 +1524,7 @@ void Initialise(void) {
     Boolean eSep;
     /*int s, tSampCntTr, tSampCntHV;*/
     int s;
+    double doubleVal;
     VisitKind visitKindTr;
 
     /* initialise epcBaseDir */
@@ -1542,6 +1623,8 @@ void Initialise(void) {
     /* initialise the cache structures */
     obs = MakeObservation(&gcheap, hset.swidth, hset.pkind, FALSE, eSep);
     scriptTr = GetTrainScript(&scriptCntTr);
+    /* each worker of a distributed job trains on its own share of the script */
+    scriptTr = ShardScript(scriptTr, &scriptCntTr);
     tSampCntTr = GetScpSampCnt(scriptTr);
     if (trace & T_TOP) {
         printf("%d utterances (%d samples) in the training set\n", scriptCntTr, tSampCntTr);
@@ -1551,7 +1634,14 @@ void Initialise(void) {
         visitKindTr = GetDefaultVisitKind();
         cacheTr[s] = CreateCache(&cacheHeap, scriptTr, scriptCntTr, &hset, &obs, s, GetDefaultNCacheSamples(), visitKindTr, &xfInfo, labelInfo, TRUE);
     }
+    if (IsDistributed()) {
+        /* the learning rate schedulers count the samples of all the workers */
+        doubleVal = tSampCntTr;
+        DistAllReduceDouble(&doubleVal, 1);
+        tSampCntTr = (int) doubleVal;
+    }
     if (scriptHV != NULL) {
+        scriptHV = ShardScript(scriptHV, &scriptCntHV);
         tSampCntHV = GetScpSampCnt(scriptHV);
         if (trace & T_TOP) {
             printf("%d utterances (%d samples) in the held-out set\n", scriptCntHV, tSampCntHV);
@@ -1617,6 +1707,10 @@ void Initialise(void) {
     SetHMMSetCriterion();
     /* set update flags */
     SetUpdateFlags(hset.annSet);
+    /* the replicas for the training threads */
+    InitTrainReplicas();
+    /* the other processes of a distributed job */
+    InitDistTrain();
 }
 
 /* cz277 - semi */
@@ -1756,7 +1850,8 @@ float GetCurClipScalingFactor(int layerIdx) {
     return (float) pow(2.0, layerIdx);
 }
 
-void UpdateANNParamSGD(ANNSet *annSet, float learnRate, float momentum, float weightDecay) {
+/* apply the gradients of annSet to its parameters (shared with the source, for a replica) */
+void ApplyANNParamSGD(ANNSet *annSet, float learnRate, float momentum, float weightDecay) {
     int i, j;
     AILink curAI;
     ADLink annDef;
@@ -1840,10 +1935,488 @@ void UpdateANNParamSGD(ANNSet *annSet, float learnRate, float momentum, float we
         /* fetch next ANNDef */
         curAI = curAI->prev;
     }
+}
 
+void UpdateANNParamSGD(ANNSet *annSet, float learnRate, float momentum, float weightDecay) {
+    ApplyANNParamSGD(annSet, learnRate, momentum, weightDecay);
     SetUpdateIndex(GetUpdateIndex() + 1);
 }
 
+/* ------------------------- Training Threads --------------------------- */
+
+/* forward and back-propagate the part of the batch of a job on its replica */
+static void TrainReplicaBatch(TrainJob *job) {
+    int i, S;
+    ANNSet *annSet;
+    LELink layerElem;
+    NMatrix *labMat;
+
+    S = hset.swidth[0];
+    annSet = job->annSet;
+    CopyReplicaInputs(annSet, job->batOff, job->batLen);
+    for (i = 1; i <= S; ++i) {
+        labMat = annSet->outLayers[i]->trainInfo->labMat;
+        if (labMat != NULL) {
+            CopyNSegment(cacheTr[i]->labMat, job->batOff * labMat->colNum, job->batLen * labMat->colNum, labMat, 0);
+        }
+    }
+    /* do forwarding */
+    ForwardPropBatch(annSet, job->batLen, NULL);
+    /* accumulate for the criteria, before the output layers hold the error signals */
+    for (i = 1; i <= S; ++i) {
+        layerElem = annSet->outLayers[i];
+        FindMaxElement(layerElem->yFeaMat, job->batLen, layerElem->nodeNum, job->hypVec);
+        if (showObjFunKind & MLOF) {
+            ApplyLogTrans(layerElem->yFeaMat, job->batLen, layerElem->nodeNum, annSet->llhMat[i]);
+            AddNVectorTargetPen(annSet->llhMat[i], annSet->penVec[i], job->batLen, annSet->llhMat[i]);
+            FindMaxElement(annSet->llhMat[i], job->batLen, layerElem->nodeNum, job->hypVecLLH);
+        }
+        AccBatchCriteria(annSet, i, cacheTr[i]->labVec + job->batOff, layerElem->trainInfo->labMat, job->hypVec, job->hypVecLLH, job->batLen, &job->criteria[i]);
+    }
+    /* do back-propagation, into the gradients of the replica */
+    BackwardPropBatch(annSet, job->batLen, FALSE);
+    if (optHogwild) {
+        ApplyANNParamSGD(annSet, trnNegLR, trnMomentum, weightDecay);
+    }
+}
+
+static void *TrainWorker(void *arg) {
+    TrainJob *job = (TrainJob *) arg;
+    TrainTask task;
+
+    while (TRUE) {
+        pthread_mutex_lock(&trnLock);
+        while (job->task == TRNNONE) {
+            pthread_cond_wait(&trnCond, &trnLock);
+        }
+        task = job->task;
+        pthread_mutex_unlock(&trnLock);
+        if (task == TRNEXIT) {
+            break;
+        }
+        if (task == TRNBATCH) {
+            TrainReplicaBatch(job);
+        }
+        else {
+            AccReplicaGradInfo(job->redSet, job->annSet, TRUE);
+        }
+        pthread_mutex_lock(&trnLock);
+        job->task = TRNNONE;
+        --trnPending;
+        pthread_cond_broadcast(&trnCond);
+        pthread_mutex_unlock(&trnLock);
+    }
+    return NULL;
+}
+
+/* give the threads the next tasks of their jobs and wait for all of them */
+static void RunTrainTasks(void) {
+    int k;
+
+    pthread_mutex_lock(&trnLock);
+    for (k = 0; k < nTrainThreads; ++k) {
+        if (trnJobs[k].next != TRNNONE) {
+            trnJobs[k].task = trnJobs[k].next;
+            trnJobs[k].next = TRNNONE;
+            if (trnJobs[k].task != TRNEXIT) {
+                ++trnPending;
+            }
+        }
+    }
+    pthread_cond_broadcast(&trnCond);
+    while (trnPending > 0) {
+        pthread_cond_wait(&trnCond, &trnLock);
+    }
+    pthread_mutex_unlock(&trnLock);
+}
+
+/* create the replicas of the ANNSet for the training threads, after each model (re)load */
+void InitTrainReplicas(void) {
+    int k;
+    ANNSet *replica;
+    VisitKind visitKind;
+
+    if (nTrainThreads <= 1) {
+        return;
+    }
+    if (trnJobs == NULL) {
+#ifdef CUDA
+        HError(-1, "InitTrainReplicas: TRAINTHREADS is not used with CUDA, training on one thread");
+        nTrainThreads = 1;
+        return;
+#endif
+        visitKind = GetDefaultVisitKind();
+        if (optTrainMode == SEQTM || updtKind != BATLEVEL || optMapTarget || optHasSSG || visitKind == PLNONEVK || visitKind == PLUTTVK || visitKind == PLUTTFRMVK) {
+            HError(-1, "InitTrainReplicas: TRAINTHREADS needs frame level training with batch level updates, no target mapping, AdaGrad or parallel utterances, training on one thread");
+            nTrainThreads = 1;
+            return;
+        }
+        if (optHogwild && numPerUpdt != 1) {
+            HError(9999, "InitTrainReplicas: HOGWILD needs NUMPERUPDATE = 1");
+        }
+        trnJobs = (TrainJob *) New(&gcheap, nTrainThreads * sizeof(TrainJob));
+        memset(trnJobs, 0, nTrainThreads * sizeof(TrainJob));
+        for (k = 0; k < nTrainThreads; ++k) {
+            trnJobs[k].next = TRNNONE;
+            trnJobs[k].task = TRNNONE;
+            trnJobs[k].hypVec = CreateIntVec(&gcheap, GetNBatchSamples());
+            trnJobs[k].hypVecLLH = CreateIntVec(&gcheap, GetNBatchSamples());
+        }
+    }
+    /* the replicas live on the model heap, and are made again when the models are reloaded */
+    for (k = 0; k < nTrainThreads; ++k) {
+        if ((replica = CreateANNSetReplica(&modelHeap, hset.annSet)) == NULL) {
+            HError(-1, "InitTrainReplicas: The ANN carries state between batches, training on one thread");
+            nTrainThreads = 1;
+            return;
+        }
+        InitReplicaTrainInfo(&modelHeap, replica);
+        trnJobs[k].annSet = replica;
+    }
+    if (!trnStarted) {
+        for (k = 0; k < nTrainThreads; ++k) {
+            if (pthread_create(&trnJobs[k].thread, NULL, TrainWorker, (void *) &trnJobs[k]) != 0) {
+                HError(9999, "InitTrainReplicas: Failed to create training thread %d", k);
+            }
+        }
+        trnStarted = TRUE;
+        if (trace & T_TOP) {
+            printf("Training on %d threads%s\n", nTrainThreads, optHogwild? " with HOGWILD updates": "");
+        }
+    }
+}
+
+/* stop the training threads */
+void StopTrainThreads(void) {
+    int k;
+
+    if (!trnStarted) {
+        return;
+    }
+    for (k = 0; k < nTrainThreads; ++k) {
+        trnJobs[k].next = TRNEXIT;
+    }
+    RunTrainTasks();
+    for (k = 0; k < nTrainThreads; ++k) {
+        pthread_join(trnJobs[k].thread, NULL);
+    }
+    trnStarted = FALSE;
+}
+
+/* train a batch of nLoaded samples split over the threads: each thread
+   forwards and back-propagates its part into the gradients of its replica,
+   then the gradients are summed pairwise in a tree and added (accGrad) or
+   copied to those of hset, as BackwardPropBatch would have left them.  With
+   HOGWILD the threads update the shared parameters themselves instead */
+void TrainBatchOnThreads(int nLoaded, Boolean accGrad, CriteriaInfo *criteria) {
+    int i, k, m, stride;
+
+    /* every thread used gets at least one sample */
+    m = MIN(nTrainThreads, nLoaded);
+    for (k = 0; k < m; ++k) {
+        trnJobs[k].batOff = k * nLoaded / m;
+        trnJobs[k].batLen = (k + 1) * nLoaded / m - trnJobs[k].batOff;
+        memset(trnJobs[k].criteria, 0, sizeof(CriteriaInfo) * SMAX);
+        trnJobs[k].next = TRNBATCH;
+    }
+    RunTrainTasks();
+    for (k = 0; k < m; ++k) {
+        for (i = 1; i <= hset.swidth[0]; ++i) {
+            AddCriteriaInfo(&trnJobs[k].criteria[i], &criteria[i]);
+        }
+    }
+    if (optHogwild) {
+        return;
+    }
+    /* tree reduction of the gradients into the first replica */
+    for (stride = 1; stride < m; stride *= 2) {
+        for (k = 0; k + stride < m; k += 2 * stride) {
+            trnJobs[k].redSet = trnJobs[k + stride].annSet;
+            trnJobs[k].next = TRNREDUCE;
+        }
+        RunTrainTasks();
+    }
+    AccReplicaGradInfo(trnJobs[0].annSet, hset.annSet, accGrad);
+}
+
+/* ------------------------ Distributed Training ------------------------ */
+
+/* copy the weights and biases of the updated layers (or their gradients,
+   with gradFlag) to distBuf, or back from it with fromBuf; only counts
+   the parameters if distBuf is NULL */
+static size_t CopyDistParams(ANNSet *annSet, Boolean gradFlag, Boolean fromBuf) {
+    int i, len;
+    size_t off = 0;
+    AILink curAI;
+    ADLink annDef;
+    LELink layerElem;
+    NMatrix *wghtMat;
+    NVector *biasVec;
+
+    for (curAI = annSet->defsHead; curAI != NULL; curAI = curAI->next) {
+        annDef = curAI->annDef;
+        for (i = 0; i < annDef->layerNum; ++i) {
+            layerElem = annDef->layerList[i];
+            if (layerElem->trainInfo->updtFlag & WEIGHTUK) {
+                wghtMat = gradFlag? layerElem->trainInfo->gradInfo->wghtMat: layerElem->wghtMat;
+                len = layerElem->nodeNum * layerElem->inputDim;
+                if (distBuf != NULL && fromBuf) {
+                    memcpy(wghtMat->matElems, &distBuf[off], len * sizeof(NFloat));
+#ifdef CUDA
+                    SyncNMatrixHost2Dev(wghtMat);
+#endif
+                }
+                else if (distBuf != NULL) {
+#ifdef CUDA
+                    SyncNMatrixDev2Host(wghtMat);
+#endif
+                    memcpy(&distBuf[off], wghtMat->matElems, len * sizeof(NFloat));
+                }
+                off += len;
+            }
+            if (layerElem->trainInfo->updtFlag & BIASUK) {
+                biasVec = gradFlag? layerElem->trainInfo->gradInfo->biasVec: layerElem->biasVec;
+                len = layerElem->nodeNum;
+                if (distBuf != NULL && fromBuf) {
+                    memcpy(biasVec->vecElems, &distBuf[off], len * sizeof(NFloat));
+#ifdef CUDA
+                    SyncNVectorHost2Dev(biasVec);
+#endif
+                }
+                else if (distBuf != NULL) {
+#ifdef CUDA
+                    SyncNVectorDev2Host(biasVec);
+#endif
+                    memcpy(&distBuf[off], biasVec->vecElems, len * sizeof(NFloat));
+                }
+                off += len;
+            }
+        }
+    }
+    return off;
+}
+
+/* give every worker the parameters of worker 0 */
+void BroadcastDistModels(void) {
+    if (!IsDistributed()) {
+        return;
+    }
+    CopyDistParams(hset.annSet, FALSE, FALSE);
+    DistBroadcast(distBuf, distParmLen * sizeof(NFloat));
+    if (GetDistRank() > 0) {
+        CopyDistParams(hset.annSet, FALSE, TRUE);
+    }
+}
+
+/* set up a distributed job: check the configuration, allocate the
+   buffer for the reductions and start from the model of worker 0 */
+void InitDistTrain(void) {
+    if (!IsDistributed()) {
+        return;
+    }
+    if (distBuf == NULL) {
+        if (updtKind != BATLEVEL || optTrainMode == SEQTM) {
+            HError(9999, "InitDistTrain: Distributed training needs frame level training with batch level updates");
+        }
+        if (bgWaitNBatchPL > 0 || edAccBatchLenPL > 0) {
+            HError(9999, "InitDistTrain: BGNPLBATCHWAIT and EDPLBATCHLENACC are not used in distributed training");
+        }
+        if ((uFlags & UPTRANS) != 0) {
+            HError(9999, "InitDistTrain: Transition probabilities are not updated in distributed training");
+        }
+        if (optHogwild && nTrainThreads > 1 && distAvgPeriod == 0) {
+            HError(9999, "InitDistTrain: HOGWILD needs DISTAVGPERIOD > 0 in distributed training");
+        }
+        distParmLen = CopyDistParams(hset.annSet, FALSE, FALSE);
+        distBuf = (NFloat *) New(&gcheap, (distParmLen + 2) * sizeof(NFloat));
+        if (trace & T_TOP) {
+            if (distAvgPeriod > 0) {
+                printf("Worker %d of %d, averaging %d parameters every %d updates\n", GetDistRank(), GetDistSize(), (int) distParmLen, distAvgPeriod);
+            }
+            else {
+                printf("Worker %d of %d, summing the gradients of %d parameters\n", GetDistRank(), GetDistSize(), (int) distParmLen);
+            }
+        }
+    }
+    else if (CopyDistParams(hset.annSet, FALSE, FALSE) != distParmLen) {
+        HError(9999, "InitDistTrain: The reloaded model has a different number of parameters");
+    }
+    BroadcastDistModels();
+}
+
+/* sum the gradients and the sample count of an update over the workers;
+   a worker without data (hasGrad FALSE) adds nothing.  more tells if this
+   worker has data left, and distActive is set to the number that have */
+static void ReduceDistGradInfo(ANNSet *annSet, Boolean hasGrad, int *sampCnt, Boolean more) {
+    if (hasGrad) {
+        CopyDistParams(annSet, TRUE, FALSE);
+    }
+    else {
+        memset(distBuf, 0, distParmLen * sizeof(NFloat));
+    }
+    distBuf[distParmLen] = hasGrad? *sampCnt: 0;
+    distBuf[distParmLen + 1] = more? 1: 0;
+    DistAllReduceNFloat(distBuf, distParmLen + 2);
+    CopyDistParams(annSet, TRUE, TRUE);
+    *sampCnt = (int) distBuf[distParmLen];
+    distActive = (int) distBuf[distParmLen + 1];
+}
+
+/* average the parameters of the workers that have updated them since the
+   last average (updated); more and distActive are as for ReduceDistGradInfo */
+static void AverageDistModels(ANNSet *annSet, Boolean updated, Boolean more) {
+    size_t i;
+    NFloat nModel;
+
+    if (updated) {
+        CopyDistParams(annSet, FALSE, FALSE);
+    }
+    else {
+        memset(distBuf, 0, distParmLen * sizeof(NFloat));
+    }
+    distBuf[distParmLen] = updated? 1: 0;
+    distBuf[distParmLen + 1] = more? 1: 0;
+    DistAllReduceNFloat(distBuf, distParmLen + 2);
+    nModel = distBuf[distParmLen];
+    distActive = (int) distBuf[distParmLen + 1];
+    if (nModel > 0) {
+        for (i = 0; i < distParmLen; ++i) {
+            distBuf[i] /= nModel;
+        }
+        CopyDistParams(annSet, FALSE, TRUE);
+    }
+}
+
+/* keep taking part in the reductions of the other workers once this one
+   has run out of data, so that all make the same updates */
+static void DrainDistUpdates(int curEpochNum, float momentum, int *updtCnt) {
+    int sampCnt;
+    float retNegLR;
+
+    while (distActive > 0) {
+        if (distAvgPeriod > 0) {
+            AverageDistModels(hset.annSet, FALSE, FALSE);
+            continue;
+        }
+        sampCnt = 0;
+        ReduceDistGradInfo(hset.annSet, FALSE, &sampCnt, FALSE);
+        if (sampCnt > 0) {
+            retNegLR = UpdateLRSchdPerU(curEpochNum, sampCnt);
+            UpdateANNParamSGD(hset.annSet, retNegLR, momentum, weightDecay);
+            ++(*updtCnt);
+        }
+    }
+}
+
+/* sum the criteria of a set over the workers */
+static void ReduceDistCriteria(CriteriaInfo *criteria) {
+    double crtBuf[18];
+
+    if (!IsDistributed()) {
+        return;
+    }
+    crtBuf[0] = criteria->cSampAcc;
+    crtBuf[1] = criteria->MMSEAcc;
+    crtBuf[2] = criteria->XENTAcc;
+    crtBuf[3] = criteria->MPEAcc;
+    crtBuf[4] = criteria->tUttAcc;
+    crtBuf[5] = criteria->tNWordAcc;
+    crtBuf[6] = criteria->tSampAcc;
+    crtBuf[7] = criteria->LLHAcc;
+    crtBuf[8] = criteria->LLHVal;
+    crtBuf[9] = criteria->NumLLHAcc;
+    crtBuf[10] = criteria->DenLLHAcc;
+    crtBuf[11] = criteria->MMIFRAcc;
+    crtBuf[12] = criteria->cSampAccMapMax;
+    crtBuf[13] = criteria->cSampAccMapSum;
+    crtBuf[14] = criteria->MMSEAccMapSum;
+    crtBuf[15] = criteria->XENTAccMapSum;
+    crtBuf[16] = criteria->LLHAccMapSum;
+    crtBuf[17] = criteria->LLHValMapSum;
+    DistAllReduceDouble(crtBuf, 18);
+    criteria->cSampAcc = crtBuf[0];
+    criteria->MMSEAcc = crtBuf[1];
+    criteria->XENTAcc = crtBuf[2];
+    criteria->MPEAcc = crtBuf[3];
+    criteria->tUttAcc = crtBuf[4];
+    criteria->tNWordAcc = crtBuf[5];
+    criteria->tSampAcc = crtBuf[6];
+    criteria->LLHAcc = crtBuf[7];
+    criteria->LLHVal = crtBuf[8];
+    criteria->NumLLHAcc = crtBuf[9];
+    criteria->DenLLHAcc = crtBuf[10];
+    criteria->MMIFRAcc = (int) crtBuf[11];
+    criteria->cSampAccMapMax = crtBuf[12];
+    criteria->cSampAccMapSum = crtBuf[13];
+    criteria->MMSEAccMapSum = crtBuf[14];
+    criteria->XENTAccMapSum = crtBuf[15];
+    criteria->LLHAccMapSum = crtBuf[16];
+    criteria->LLHValMapSum = crtBuf[17];
+}
+
+/* sum the state occupancies of stream streamIdx over the workers, before
+   the target penalties are set from them; a state shared by several HMMs
+   is gathered more than once, but gets the same sum each time */
+static void ReduceDistStateOccs(int streamIdx) {
+    int h, s, n;
+    MLink m;
+    HLink hmm;
+    double *occBuf;
+
+    if (!IsDistributed()) {
+        return;
+    }
+    n = 0;
+    for (h = 0; h < MACHASHSIZE; ++h) {
+        for (m = hset.mtab[h]; m != NULL; m = m->next) {
+            if (m->type == 'h') {
+                n += ((HLink) m->structure)->numStates - 2;
+            }
+        }
+    }
+    occBuf = (double *) New(&gstack, MAX(n, 1) * sizeof(double));
+    n = 0;
+    for (h = 0; h < MACHASHSIZE; ++h) {
+        for (m = hset.mtab[h]; m != NULL; m = m->next) {
+            if (m->type == 'h') {
+                hmm = (HLink) m->structure;
+                for (s = 2; s < hmm->numStates; ++s) {
+                    occBuf[n++] = hmm->svec[s].info->pdf[streamIdx].occAcc;
+                }
+            }
+        }
+    }
+    DistAllReduceDouble(occBuf, n);
+    n = 0;
+    for (h = 0; h < MACHASHSIZE; ++h) {
+        for (m = hset.mtab[h]; m != NULL; m = m->next) {
+            if (m->type == 'h') {
+                hmm = (HLink) m->structure;
+                for (s = 2; s < hmm->numStates; ++s) {
+                    hmm->svec[s].info->pdf[streamIdx].occAcc = occBuf[n++];
+                }
+            }
+        }
+    }
+    Dispose(&gstack, occBuf);
+}
+
+/* worker 0 decides the learning rate of the epoch and whether to go on */
+static Boolean SyncDistLRSchd(Boolean goOn) {
+    double schdBuf[3];
+
+    if (!IsDistributed()) {
+        return goOn;
+    }
+    schdBuf[0] = goOn? 1.0: 0.0;
+    schdBuf[1] = curNegLR;
+    schdBuf[2] = NewBob_Status;
+    DistBroadcast(schdBuf, 3 * sizeof(double));
+    curNegLR = schdBuf[1];
+    NewBob_Status = (int) schdBuf[2];
+    return schdBuf[0] > 0.0;
+}
+
 ReturnStatus ReloadHMMSet(MSILink MSIPtr) {
     int i, mappedTargetNum;
 
@@ -1893,6 +2466,7 @@ ReturnStatus ReloadHMMSet(MSILink MSIPtr) {
     /*InitTmpNMat(&hset);*/
     SetHMMSetCriterion();
     SetUpdateFlags(hset.annSet);
+    InitTrainReplicas();
     /* cz277 - 1015 */
     SetFeaMixBatchIdxes(hset.annSet, GetBatchIndex());
     /* update cache associated configs */
@@ -2510,65 +3084,78 @@ void BatchLevelTrProcess(int curEpochNum) {
             accGrad = FALSE;
         }
 
-        /* do forwarding */
-        stClock = clock();
-        ForwardPropBatch(hset.annSet, nLoaded, cacheTr[1]->CMDVecPL);
-        edClock = clock();
-        fbPropClock += edClock - stClock;
-        /* synchronise the data */
-        for (i = 1; i <= S; ++i) {
-            layerElem = hset.annSet->outLayers[i];
-            /* convert posteriors to llr */
-            if ((showObjFunKind & MLOF) || (optTrainMode == SEQTM)) {
-                ApplyLogTrans(layerElem->yFeaMat, nLoaded, layerElem->nodeNum, hset.annSet->llhMat[i]);
-                AddNVectorTargetPen(hset.annSet->llhMat[i], hset.annSet->penVec[i], nLoaded, hset.annSet->llhMat[i]);
-#ifdef CUDA
-                SyncNMatrixDev2Host(hset.annSet->llhMat[i]);
-#endif
+        if (nTrainThreads > 1) {
+            /* the batch is split over the training threads */
+            stClock = clock();
+            if (optHogwild) {
+                trnNegLR = UpdateLRSchdPerU(curEpochNum, nLoaded);
+                trnMomentum = momentum;
             }
-            /* for mapped targets */
-            if (optMapTarget) {
-                UpdateOutMatMapSum(hset.annSet, nLoaded, i);
+            TrainBatchOnThreads(nLoaded, accGrad, criteria);
+            edClock = clock();
+            fbPropClock += edClock - stClock;
+        }
+        else {
+            /* do forwarding */
+            stClock = clock();
+            ForwardPropBatch(hset.annSet, nLoaded, cacheTr[1]->CMDVecPL);
+            edClock = clock();
+            fbPropClock += edClock - stClock;
+            /* synchronise the data */
+            for (i = 1; i <= S; ++i) {
+                layerElem = hset.annSet->outLayers[i];
                 /* convert posteriors to llr */
-                if (showObjFunKind & MLOF) {
-                    ApplyLogTrans(hset.annSet->mapStruct->outMatMapSum[i], nLoaded, hset.annSet->mapStruct->mappedTargetNum, hset.annSet->mapStruct->llhMatMapSum[i]);
-                    AddNVectorTargetPen(hset.annSet->mapStruct->llhMatMapSum[i], hset.annSet->mapStruct->penVecMapSum[i], nLoaded, hset.annSet->mapStruct->llhMatMapSum[i]);
+                if ((showObjFunKind & MLOF) || (optTrainMode == SEQTM)) {
+                    ApplyLogTrans(layerElem->yFeaMat, nLoaded, layerElem->nodeNum, hset.annSet->llhMat[i]);
+                    AddNVectorTargetPen(hset.annSet->llhMat[i], hset.annSet->penVec[i], nLoaded, hset.annSet->llhMat[i]);
 #ifdef CUDA
-                    SyncNMatrixDev2Host(hset.annSet->mapStruct->llhMatMapSum[i]);
+                    SyncNMatrixDev2Host(hset.annSet->llhMat[i]);
 #endif
                 }
+                /* for mapped targets */
+                if (optMapTarget) {
+                    UpdateOutMatMapSum(hset.annSet, nLoaded, i);
+                    /* convert posteriors to llr */
+                    if (showObjFunKind & MLOF) {
+                        ApplyLogTrans(hset.annSet->mapStruct->outMatMapSum[i], nLoaded, hset.annSet->mapStruct->mappedTargetNum, hset.annSet->mapStruct->llhMatMapSum[i]);
+                        AddNVectorTargetPen(hset.annSet->mapStruct->llhMatMapSum[i], hset.annSet->mapStruct->penVecMapSum[i], nLoaded, hset.annSet->mapStruct->llhMatMapSum[i]);
 #ifdef CUDA
-                SyncNMatrixDev2Host(hset.annSet->mapStruct->outMatMapSum[i]);
+                        SyncNMatrixDev2Host(hset.annSet->mapStruct->llhMatMapSum[i]);
 #endif
-            }
+                    }
 #ifdef CUDA
-            SyncNMatrixDev2Host(layerElem->yFeaMat);
+                    SyncNMatrixDev2Host(hset.annSet->mapStruct->outMatMapSum[i]);
+#endif
+                }
+#ifdef CUDA
+                SyncNMatrixDev2Host(layerElem->yFeaMat);
 #endif
-        }
-        /* accumulate for the criteria */
-        for (i = 1; i <= S; ++i) {
-            layerElem = hset.annSet->outLayers[i];
-            FindMaxElement(layerElem->yFeaMat, nLoaded, layerElem->nodeNum, recVec);
-            if (showObjFunKind & MLOF) {
-                FindMaxElement(hset.annSet->llhMat[i], nLoaded, layerElem->nodeNum, recVecLLH);
             }
-            if (optMapTarget) {
-                FindMaxElement(hset.annSet->mapStruct->outMatMapSum[i], nLoaded, hset.annSet->mapStruct->mappedTargetNum, recVecMapSum);
+            /* accumulate for the criteria */
+            for (i = 1; i <= S; ++i) {
+                layerElem = hset.annSet->outLayers[i];
+                FindMaxElement(layerElem->yFeaMat, nLoaded, layerElem->nodeNum, recVec);
                 if (showObjFunKind & MLOF) {
-                    FindMaxElement(hset.annSet->mapStruct->llhMatMapSum[i], nLoaded, hset.annSet->mapStruct->mappedTargetNum, recVecLLHMapSum);
+                    FindMaxElement(hset.annSet->llhMat[i], nLoaded, layerElem->nodeNum, recVecLLH);
                 }
-                UpdateLabMatMapSum(hset.annSet, nLoaded, i);
+                if (optMapTarget) {
+                    FindMaxElement(hset.annSet->mapStruct->outMatMapSum[i], nLoaded, hset.annSet->mapStruct->mappedTargetNum, recVecMapSum);
+                    if (showObjFunKind & MLOF) {
+                        FindMaxElement(hset.annSet->mapStruct->llhMatMapSum[i], nLoaded, hset.annSet->mapStruct->mappedTargetNum, recVecLLHMapSum);
+                    }
+                    UpdateLabMatMapSum(hset.annSet, nLoaded, i);
 #ifdef CUDA
-                SyncNMatrixDev2Host(hset.annSet->mapStruct->labMatMapSum[i]);
+                    SyncNMatrixDev2Host(hset.annSet->mapStruct->labMatMapSum[i]);
 #endif
+                }
+                AccCriteriaPerB(cacheTr[i], nLoaded, &criteria[i]); 
             }
-            AccCriteriaPerB(cacheTr[i], nLoaded, &criteria[i]); 
+            /* do back-propagation */ 
+            stClock = clock();
+            BackwardPropBatch(hset.annSet, nLoaded, accGrad); 
+            edClock = clock();
+            fbPropClock += edClock - stClock;
         }
-        /* do back-propagation */ 
-        stClock = clock();
-        BackwardPropBatch(hset.annSet, nLoaded, accGrad); 
-        edClock = clock();
-        fbPropClock += edClock - stClock;
         /* accumulate the statistics */
         batchCnt += 1;
 
@@ -2585,7 +3172,17 @@ void BatchLevelTrProcess(int curEpochNum) {
                 ScaleGradInfo(hset.annSet, GetNBatchSamples() / edAccNSampPL);
             }
             /* update the parameters and learning rates */
-            if (batchCnt % numPerUpdt == 0) {
+            if (batchCnt % numPerUpdt == 0 && nTrainThreads > 1 && optHogwild) {
+                /* the threads have updated the parameters */
+                SetUpdateIndex(GetUpdateIndex() + 1);
+                ++updtCnt;
+                sampCnt = 0;
+            }
+            else if (batchCnt % numPerUpdt == 0 || (finish && IsDistributed() && distAvgPeriod == 0)) {
+                /* sum the gradients of all the workers */
+                if (IsDistributed() && distAvgPeriod == 0) {
+                    ReduceDistGradInfo(hset.annSet, TRUE, &sampCnt, !finish);
+                }
                 /* update learning rates */
                 retNegLR = UpdateLRSchdPerU(curEpochNum, sampCnt);
 		/* cz277 - semi */
@@ -2605,6 +3202,10 @@ void BatchLevelTrProcess(int curEpochNum) {
                 ++updtCnt;
                 sampCnt = 0;
             }
+            /* average the models of all the workers */
+            if (IsDistributed() && distAvgPeriod > 0 && (finish || (batchCnt % numPerUpdt == 0 && updtCnt % distAvgPeriod == 0))) {
+                AverageDistModels(hset.annSet, TRUE, !finish);
+            }
         }
         /* cz277 - mtload */
         /*for (i = 1; i <= S; ++i) {
@@ -2612,6 +3213,10 @@ void BatchLevelTrProcess(int curEpochNum) {
         }*/
 
     }
+    /* take part in the updates of the workers still having data */
+    if (IsDistributed()) {
+        DrainDistUpdates(curEpochNum, momentum, &updtCnt);
+    }
     /* cz277 - trans */
     /* update the transition probabilities */
     if ((uFlags & UPTRANS) != 0) {
@@ -2621,11 +3226,13 @@ void BatchLevelTrProcess(int curEpochNum) {
     /* update the target penalties */
     if ((curEpochNum == 0) && ((uFlags & UPTARGETPEN) != 0) && (hset.hsKind == HYBRIDHS)) {
         for (i = 1; i <= S; ++i) {
+            ReduceDistStateOccs(i);
             UpdateTargetLogPrior(cacheTr[i], logObsvPrior);
         }
     }
     /* show criteria */
     for (i = 1; i <= S; ++i) {
+        ReduceDistCriteria(&criteria[i]);
         if (S > 1) {
             printf("\t\tStream %d: ", i);
         }
@@ -3160,6 +3767,7 @@ void UtterLevelHVProcess(void) {
     }
     /* show criteria */
     for (i = 1; i <= S; ++i) {
+        ReduceDistCriteria(&criteria[i]);
         if (S > 1) {
             printf("\t\tStream %d: ", i);
         }
@@ -3224,6 +3832,7 @@ int main(int argc, char *argv[]) {
     }
     InitMem();
     InitMath();
+    InitCPU();
     InitSigP();
     InitWave();
     InitLabel();
@@ -3246,6 +3855,7 @@ int main(int argc, char *argv[]) {
     InitNet();
     InitAdapt(&xfInfo);
     InitNCache();
+    InitDist();
     if (!InfoPrinted() && NumArgs() == 0) {
         ReportUsage();
     }
@@ -3522,6 +4132,8 @@ int main(int argc, char *argv[]) {
     StartCUDA();
     printf("\n");
 #endif
+    /* connect the workers of a distributed job */
+    StartDist();
     /* initialise */
     Initialise();
 #ifdef CUDA
@@ -3543,13 +4155,16 @@ int main(int argc, char *argv[]) {
         printf("\n\n");
     }
     /* process training */
-    while (TermLRSchdOrNot(curEpochNum)) {
+    while (SyncDistLRSchd(TermLRSchdOrNot(curEpochNum))) {
         /* compute current epoch index */
         curEpochIdx = epochOff + curEpochNum;
         SetEpochIndex(curEpochIdx);
         printf("Epoch %d ******************************\n", curEpochIdx);
         /* update the learning rate by epoch (4 list and newbob) */
         UpdateLRSchdPerE(curEpochNum);
+        /* worker 0 sets the learning rate and the model for all the workers */
+        SyncDistLRSchd(TRUE);
+        BroadcastDistModels();
         /* process the train set */
         printf("\tProcessing training set...\n");
         stClock = clock();
@@ -3589,9 +4204,13 @@ int main(int argc, char *argv[]) {
             strcat(curEpcDir, buf);
             /* setup the absolute epc directory */
             CatDirs(epcBaseDir, curEpcDir, absEpcDir);
-            SetupDir(absEpcDir);
-            /* saves current models */
-            SaveModelSet(absEpcDir);
+            /* saves current models, which only worker 0 writes */
+            if (GetDistRank() == 0) {
+                SetupDir(absEpcDir);
+                SaveModelSet(absEpcDir);
+            }
+            /* the models must be there before any worker reloads them */
+            DistBarrier();
             /* attach current MSI */
             MSIPtr = (MSILink) New(&gcheap, sizeof(ModelSetInfo));
             SetModelSetInfo(absEpcDir, hmmExt, NULL, MSIPtr, curEpochIdx);
@@ -3612,8 +4231,12 @@ int main(int argc, char *argv[]) {
     }
 
     /* write the output model */
-    SaveModelSet(newDir);
+    if (GetDistRank() == 0) {
+        SaveModelSet(newDir);
+    }
+    StopDist();
     /* free ANNSet */
+    StopTrainThreads();
     FreeANNSet(&hset);
     for (i = 1; i <= hset.swidth[0]; ++i) {
         FreeCache(cacheTr[i]);
@@ -3627,6 +4250,7 @@ int main(int argc, char *argv[]) {
 #ifdef CUDA
     StopCUDA();
 #endif
+    StopCPU();
 
     return 0;
 }
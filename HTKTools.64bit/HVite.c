@@ -1 +0,0 @@
-../HTKTools/HVite.c
\ No newline at end of file